@@ -881,6 +881,7 @@ struct vidcodec {
 	viddec_decode_h *dech;
 	sdp_fmtp_enc_h *fmtp_ench;
 	sdp_fmtp_cmp_h *fmtp_cmph;
+	uint32_t encfmts;  /**< Native input formats, bitmask of vidfmt */
 };
 
 void vidcodec_register(struct list *vidcodecl, struct vidcodec *vc);
@@ -951,6 +952,7 @@ int  audio_set_source(struct audio *au, const char *mod, const char *device);
 int  audio_set_player(struct audio *au, const char *mod, const char *device);
 void audio_encoder_cycle(struct audio *audio);
 int  audio_debug(struct re_printf *pf, const struct audio *a);
+struct stream *audio_strm(const struct audio *a);
 
 
 /*
@@ -968,6 +970,17 @@ int   video_set_source(struct video *v, const char *name, const char *dev);
 void  video_set_devicename(struct video *v, const char *src, const char *disp);
 void  video_encoder_cycle(struct video *video);
 int   video_debug(struct re_printf *pf, const struct video *v);
+struct stream *video_strm(const struct video *v);
+
+
+/*
+ * Media stream
+ */
+
+struct stream;
+
+int  stream_set_relay(struct stream *s, struct stream *peer);
+bool stream_is_relayed(const struct stream *s);
 
 
 /*
@@ -37,7 +37,6 @@
 #   USE_OMX_BELLAGIO  libomxil-bellagio xvideosink driver
 #   USE_OPUS          Opus audio codec
 #   USE_OSS           OSS audio driver
-#   USE_PLC           Packet Loss Concealment
 #   USE_PORTAUDIO     Portaudio audio driver
 #   USE_PULSE         Pulseaudio audio driver
 #   USE_SDL           libSDL video output
@@ -135,9 +134,6 @@ USE_OPUS := $(shell [ -f $(SYSROOT)/include/opus/opus.h ] || \
 USE_OSS := $(shell [ -f $(SYSROOT)/include/soundcard.h ] || \
 	[ -f $(SYSROOT)/include/linux/soundcard.h ] || \
 	[ -f $(SYSROOT)/include/sys/soundcard.h ] && echo "yes")
-USE_PLC := $(shell [ -f $(SYSROOT)/include/spandsp/plc.h ] || \
-	[ -f $(SYSROOT_ALT)/include/spandsp/plc.h ] || \
-	[ -f $(SYSROOT)/local/include/spandsp/plc.h ] && echo "yes")
 USE_PORTAUDIO := $(shell [ -f $(SYSROOT)/local/include/portaudio.h ] || \
 		[ -f $(SYSROOT)/include/portaudio.h ] || \
 		[ -f $(SYSROOT_ALT)/include/portaudio.h ] && echo "yes")
@@ -271,6 +267,7 @@ MODULES   += menu contact vumeter mwi account natpmp httpd
 MODULES   += srtp
 MODULES   += uuid
 MODULES   += debug_cmd
+MODULES   += aec plc
 
 ifneq ($(HAVE_PTHREAD),)
 MODULES   += aubridge aufile
@@ -387,9 +384,6 @@ endif
 ifneq ($(USE_OSS),)
 MODULES   += oss
 endif
-ifneq ($(USE_PLC),)
-MODULES   += plc
-endif
 ifneq ($(USE_PORTAUDIO),)
 MODULES   += portaudio
 endif
@@ -0,0 +1,352 @@
+/**
+ * @file aec/aec.c  Acoustic Echo Cancellation
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+/**
+ * @defgroup aec aec
+ *
+ * Acoustic Echo Cancellation (AEC) with the echo canceller from librem
+ *
+ * The decoded audio is the far-end reference, and the echo of it is
+ * removed from the encoded audio. The echo path delay and the drift
+ * between the playback and capture clocks are tracked, so the filter
+ * only has to cover the echo tail itself. The encoded audio is delayed
+ * by one block of 8-16 ms.
+ *
+ * Sample config:
+ *
+ \verbatim
+  aec_tail                128     # Echo tail length in [ms]
+ \endverbatim
+ *
+ * The state of all echo cancellers is shown by the "aec" command.
+ */
+
+
+enum {
+	TAIL_DEFAULT = 128,
+};
+
+
+struct aec_st {
+	struct le le;
+	struct aec **aecv;    /* One echo canceller per channel */
+	uint8_t ch;
+};
+
+struct enc_st {
+	struct aufilt_enc_st af;  /* base class */
+	struct aec_st *st;
+	int16_t *buf;
+	size_t bufsz;
+};
+
+struct dec_st {
+	struct aufilt_dec_st af;  /* base class */
+	struct aec_st *st;
+	int16_t *buf;
+	size_t bufsz;
+};
+
+
+static struct list aecl;
+static uint32_t tail_ms = TAIL_DEFAULT;
+
+
+static void enc_destructor(void *arg)
+{
+	struct enc_st *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->buf);
+	mem_deref(st->st);
+}
+
+
+static void dec_destructor(void *arg)
+{
+	struct dec_st *st = arg;
+
+	list_unlink(&st->af.le);
+	mem_deref(st->buf);
+	mem_deref(st->st);
+}
+
+
+static void aec_st_destructor(void *arg)
+{
+	struct aec_st *st = arg;
+	uint8_t i;
+
+	list_unlink(&st->le);
+
+	for (i=0; i<st->ch; i++)
+		mem_deref(st->aecv[i]);
+
+	mem_deref(st->aecv);
+}
+
+
+static int aec_st_alloc(struct aec_st **stp, void **ctx,
+			const struct aufilt_prm *prm)
+{
+	struct aec_st *st;
+	uint8_t i;
+	int err = 0;
+
+	if (!stp || !ctx || !prm)
+		return EINVAL;
+
+	if (*ctx) {
+		*stp = mem_ref(*ctx);
+		return 0;
+	}
+
+	if (!prm->ch)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), aec_st_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->aecv = mem_zalloc(prm->ch * sizeof(*st->aecv), NULL);
+	if (!st->aecv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<prm->ch; i++) {
+
+		err = aec_alloc(&st->aecv[i], prm->srate, tail_ms);
+		if (err)
+			goto out;
+
+		++st->ch;
+	}
+
+	list_append(&aecl, &st->le, st);
+
+	info("aec: echo canceller loaded: srate=%uHz ch=%u tail=%ums"
+	     " latency=%u samples\n", prm->srate, prm->ch, tail_ms,
+	     aec_latency(st->aecv[0]));
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*ctx = *stp = st;
+
+	return err;
+}
+
+
+static int encode_update(struct aufilt_enc_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct enc_st *st;
+	int err;
+
+	if (!stp || !ctx || !af || !prm)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), enc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = aec_st_alloc(&st->st, ctx, prm);
+
+	if (err)
+		mem_deref(st);
+	else
+		*stp = (struct aufilt_enc_st *)st;
+
+	return err;
+}
+
+
+static int decode_update(struct aufilt_dec_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct dec_st *st;
+	int err;
+
+	if (!stp || !ctx || !af || !prm)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), dec_destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = aec_st_alloc(&st->st, ctx, prm);
+
+	if (err)
+		mem_deref(st);
+	else
+		*stp = (struct aufilt_dec_st *)st;
+
+	return err;
+}
+
+
+/* Channel buffer for deinterleaving, grown to the largest frame */
+static int16_t *chan_buf(int16_t **bufp, size_t *szp, size_t n)
+{
+	int16_t *buf;
+
+	if (n <= *szp)
+		return *bufp;
+
+	buf = mem_realloc(*bufp, n * sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	*bufp = buf;
+	*szp  = n;
+
+	return buf;
+}
+
+
+static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct enc_st *est = (struct enc_st *)st;
+	const struct aec_st *ast = est->st;
+	const size_t n = *sampc / ast->ch;
+	int16_t *buf;
+	size_t i;
+	uint8_t c;
+
+	if (!*sampc)
+		return 0;
+
+	if (ast->ch == 1) {
+		aec_capture(ast->aecv[0], sampv, *sampc);
+		return 0;
+	}
+
+	buf = chan_buf(&est->buf, &est->bufsz, n);
+	if (!buf)
+		return ENOMEM;
+
+	for (c=0; c<ast->ch; c++) {
+
+		for (i=0; i<n; i++)
+			buf[i] = sampv[i * ast->ch + c];
+
+		aec_capture(ast->aecv[c], buf, n);
+
+		for (i=0; i<n; i++)
+			sampv[i * ast->ch + c] = buf[i];
+	}
+
+	return 0;
+}
+
+
+static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct dec_st *dst = (struct dec_st *)st;
+	const struct aec_st *ast = dst->st;
+	const size_t n = *sampc / ast->ch;
+	int16_t *buf;
+	size_t i;
+	uint8_t c;
+
+	if (!*sampc)
+		return 0;
+
+	if (ast->ch == 1) {
+		aec_playback(ast->aecv[0], sampv, *sampc);
+		return 0;
+	}
+
+	buf = chan_buf(&dst->buf, &dst->bufsz, n);
+	if (!buf)
+		return ENOMEM;
+
+	for (c=0; c<ast->ch; c++) {
+
+		for (i=0; i<n; i++)
+			buf[i] = sampv[i * ast->ch + c];
+
+		aec_playback(ast->aecv[c], buf, n);
+	}
+
+	return 0;
+}
+
+
+static int aec_status(struct re_printf *pf, void *arg)
+{
+	struct le *le;
+	int err = 0;
+	(void)arg;
+
+	err |= re_hprintf(pf, "\n--- Echo cancellers: (%u) ---\n",
+			  list_count(&aecl));
+
+	for (le = aecl.head; le; le = le->next) {
+
+		const struct aec_st *st = le->data;
+		uint8_t c;
+
+		for (c=0; c<st->ch; c++)
+			err |= aec_debug(pf, st->aecv[c]);
+	}
+
+	return err;
+}
+
+
+static struct aufilt aec_filt = {
+	LE_INIT, "aec", encode_update, encode, decode_update, decode
+};
+
+
+static const struct cmd cmdv[] = {
+	{"aec", 0, 0, "Echo canceller status", aec_status},
+};
+
+
+static int module_init(void)
+{
+	(void)conf_get_u32(conf_cur(), "aec_tail", &tail_ms);
+
+	if (!tail_ms) {
+		warning("aec: invalid tail length\n");
+		return EINVAL;
+	}
+
+	aufilt_register(baresip_aufiltl(), &aec_filt);
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+}
+
+
+static int module_close(void)
+{
+	cmd_unregister(baresip_commands(), cmdv);
+	aufilt_unregister(&aec_filt);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(aec) = {
+	"aec",
+	"filter",
+	module_init,
+	module_close
+};
@@ -0,0 +1,10 @@
+#
+# module.mk
+#
+# Copyright (C) 2010 Creytiv.com
+#
+
+MOD		:= aec
+$(MOD)_SRCS	+= aec.c
+
+include mk/mod.mk
@@ -22,7 +22,11 @@
  \verbatim
   audio_player            aubridge,pseudo0
   audio_source            aubridge,pseudo0
+  aubridge_threads        4       # Media clock workers, default #CPUs
  \endverbatim
+ *
+ * All devices are driven by a shared media clock, see the "aubridge"
+ * command for its statistics.
  */
 
 
@@ -32,6 +36,11 @@ static struct auplay *auplay;
 struct hash *ht_device;
 
 
+static const struct cmd cmdv[] = {
+	{"aubridge", 0, 0, "Audio bridge clock statistics", mclock_debug},
+};
+
+
 static int module_init(void)
 {
 	int err;
@@ -43,16 +52,22 @@ static int module_init(void)
 	err  = ausrc_register(&ausrc, baresip_ausrcl(), "aubridge", src_alloc);
 	err |= auplay_register(&auplay, baresip_auplayl(),
 			       "aubridge", play_alloc);
+	if (err)
+		return err;
 
-	return err;
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
+
 	ausrc  = mem_deref(ausrc);
 	auplay = mem_deref(auplay);
 
+	mclock_close();
+
 	ht_device = mem_deref(ht_device);
 
 	return 0;
@@ -5,6 +5,10 @@
  */
 
 
+/* The packet-time is fixed to 20 milliseconds */
+enum {PTIME = 20};
+
+
 struct device;
 
 struct ausrc_st {
@@ -39,3 +43,22 @@ int src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 int  device_connect(struct device **devp, const char *device,
 		    struct auplay_st *auplay, struct ausrc_st *ausrc);
 void device_stop(struct device *dev);
+
+
+/* media clock */
+
+struct worker;
+
+typedef void (mclock_h)(void *arg);
+
+struct mclock_ent {
+	struct le le;
+	struct worker *w;
+	mclock_h *h;
+	void *arg;
+};
+
+int  mclock_register(struct mclock_ent *ent, mclock_h *h, void *arg);
+void mclock_unregister(struct mclock_ent *ent);
+void mclock_close(void);
+int  mclock_debug(struct re_printf *pf, void *arg);
@@ -0,0 +1,362 @@
+/**
+ * @file aubridge/clock.c Audio bridge -- shared media clock
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <re.h>
+#include <baresip.h>
+#include "aubridge.h"
+
+
+/*
+ * A small pool of worker threads drives all bridge devices. Each worker
+ * sleeps until an absolute deadline and then runs every device assigned
+ * to it as one batch. Devices are assigned to the least loaded worker,
+ * and the workers are phase-shifted within the packet-time so that
+ * their batches are spread over the period.
+ */
+
+
+enum {
+	PERIOD_NS     = PTIME * 1000000,
+	MAX_LAG       = 5,   /* periods behind before ticks are skipped */
+	MAX_WORKERS   = 16,
+	DEFAULT_MAX   = 4,
+};
+
+
+struct worker {
+	struct list entl;
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	uint64_t phase;
+	unsigned entc;
+	bool rt;
+
+	/* statistics, per tick */
+	uint64_t ticks;
+	uint64_t overruns;
+	uint64_t skipped;
+	uint64_t busy_sum;
+	uint64_t late_max;
+	uint64_t busy_max;
+};
+
+
+static struct {
+	struct worker *workerv;
+	unsigned workerc;
+	volatile bool run;
+} mclock;
+
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+#ifdef __APPLE__
+	const uint64_t now = now_ns();
+
+	if (deadline <= now)
+		return;
+
+	deadline -= now;
+
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	(void)nanosleep(&ts, NULL);
+#else
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       &ts, NULL) == EINTR)
+		;
+#endif
+}
+
+
+static bool set_realtime(void)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+
+	return 0 == pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t deadline = now_ns() + w->phase;
+	bool rt = set_realtime();
+
+	pthread_mutex_lock(&w->mutex);
+	w->rt = rt;
+	pthread_mutex_unlock(&w->mutex);
+
+	while (mclock.run) {
+
+		uint64_t start, end;
+		struct le *le;
+
+		sleep_until(deadline);
+
+		if (!mclock.run)
+			break;
+
+		start = now_ns();
+
+		pthread_mutex_lock(&w->mutex);
+
+		for (le = w->entl.head; le; le = le->next) {
+			struct mclock_ent *ent = le->data;
+
+			ent->h(ent->arg);
+		}
+
+		end = now_ns();
+
+		++w->ticks;
+		w->busy_sum += end - start;
+		w->busy_max  = max(w->busy_max, end - start);
+		if (start > deadline)
+			w->late_max = max(w->late_max, start - deadline);
+
+		deadline += PERIOD_NS;
+
+		/* the batch ran into the next tick */
+		if (end > deadline) {
+
+			const uint64_t lag = (end - deadline) / PERIOD_NS;
+
+			++w->overruns;
+
+			/* give up catching up, the devices lose audio */
+			if (lag >= MAX_LAG) {
+				w->skipped += lag;
+				deadline   += lag * PERIOD_NS;
+			}
+		}
+
+		pthread_mutex_unlock(&w->mutex);
+	}
+
+	return NULL;
+}
+
+
+static unsigned worker_count(void)
+{
+	uint32_t n = 0;
+	long cpus;
+
+	if (0 == conf_get_u32(conf_cur(), "aubridge_threads", &n) && n)
+		return min(n, MAX_WORKERS);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpus > 0 ? min((unsigned)cpus, DEFAULT_MAX) : 1;
+}
+
+
+static int mclock_start(void)
+{
+	unsigned i, n = worker_count();
+	int err = 0;
+
+	mclock.workerv = mem_zalloc(n * sizeof(*mclock.workerv), NULL);
+	if (!mclock.workerv)
+		return ENOMEM;
+
+	mclock.run = true;
+
+	for (i=0; i<n; i++) {
+
+		struct worker *w = &mclock.workerv[i];
+
+		w->phase = (uint64_t)PERIOD_NS * i / n;
+
+		err = pthread_mutex_init(&w->mutex, NULL);
+		if (err)
+			break;
+
+		err = pthread_create(&w->thread, NULL, worker_thread, w);
+		if (err) {
+			pthread_mutex_destroy(&w->mutex);
+			break;
+		}
+
+		++mclock.workerc;
+	}
+
+	if (!mclock.workerc) {
+		mclock.run = false;
+		mclock.workerv = mem_deref(mclock.workerv);
+		return err;
+	}
+
+	info("aubridge: media clock started with %u workers\n",
+	     mclock.workerc);
+
+	return 0;
+}
+
+
+/**
+ * Add an entry to the media clock, called every packet-time
+ *
+ * @param ent Clock entry, owned by the caller
+ * @param h   Tick handler, called from a worker thread
+ * @param arg Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mclock_register(struct mclock_ent *ent, mclock_h *h, void *arg)
+{
+	struct worker *w;
+	unsigned i;
+
+	if (!ent || !h)
+		return EINVAL;
+
+	if (!mclock.workerc) {
+		int err = mclock_start();
+		if (err)
+			return err;
+	}
+
+	w = &mclock.workerv[0];
+	for (i=1; i<mclock.workerc; i++) {
+		if (mclock.workerv[i].entc < w->entc)
+			w = &mclock.workerv[i];
+	}
+
+	ent->h   = h;
+	ent->arg = arg;
+	ent->w   = w;
+
+	pthread_mutex_lock(&w->mutex);
+	list_append(&w->entl, &ent->le, ent);
+	++w->entc;
+	pthread_mutex_unlock(&w->mutex);
+
+	return 0;
+}
+
+
+/**
+ * Remove an entry from the media clock. When this function returns
+ * the tick handler is not running and will not be called again.
+ *
+ * @param ent Clock entry
+ */
+void mclock_unregister(struct mclock_ent *ent)
+{
+	struct worker *w;
+
+	if (!ent || !ent->w)
+		return;
+
+	w = ent->w;
+
+	pthread_mutex_lock(&w->mutex);
+	list_unlink(&ent->le);
+	--w->entc;
+	pthread_mutex_unlock(&w->mutex);
+
+	ent->w = NULL;
+}
+
+
+/**
+ * Stop all worker threads of the media clock
+ */
+void mclock_close(void)
+{
+	unsigned i;
+
+	if (!mclock.workerc)
+		return;
+
+	mclock.run = false;
+
+	for (i=0; i<mclock.workerc; i++) {
+		pthread_join(mclock.workerv[i].thread, NULL);
+		pthread_mutex_destroy(&mclock.workerv[i].mutex);
+	}
+
+	mclock.workerc = 0;
+	mclock.workerv = mem_deref(mclock.workerv);
+}
+
+
+/**
+ * Print the media clock statistics
+ *
+ * @param pf  Print handler
+ * @param arg Handler argument (not used)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mclock_debug(struct re_printf *pf, void *arg)
+{
+	unsigned i;
+	int err;
+	(void)arg;
+
+	err = re_hprintf(pf, "aubridge media clock: %u workers, period %ums\n",
+			 mclock.workerc, PTIME);
+
+	for (i=0; i<mclock.workerc; i++) {
+
+		struct worker *w = &mclock.workerv[i];
+		uint64_t ticks, overruns, skipped;
+		uint64_t busy_sum, busy_max, late_max;
+		unsigned entc;
+		bool rt;
+
+		/* snapshot, not to hold up the worker while printing */
+		pthread_mutex_lock(&w->mutex);
+		entc     = w->entc;
+		rt       = w->rt;
+		ticks    = w->ticks;
+		overruns = w->overruns;
+		skipped  = w->skipped;
+		busy_sum = w->busy_sum;
+		busy_max = w->busy_max;
+		late_max = w->late_max;
+		pthread_mutex_unlock(&w->mutex);
+
+		err |= re_hprintf(pf, "  #%u: devices=%u rt=%s ticks=%llu"
+				  " overruns=%llu skipped=%llu\n",
+				  i, entc, rt ? "yes" : "no",
+				  ticks, overruns, skipped);
+		err |= re_hprintf(pf, "       busy avg=%lluus max=%lluus"
+				  "  late max=%lluus\n",
+				  ticks ? busy_sum / ticks / 1000 : 0,
+				  busy_max / 1000, late_max / 1000);
+	}
+
+	return err;
+}
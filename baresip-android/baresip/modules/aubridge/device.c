@@ -6,21 +6,19 @@
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
-#include <pthread.h>
 #include "aubridge.h"
 
 
-/* The packet-time is fixed to 20 milliseconds */
-enum {PTIME = 20};
-
-
 struct device {
 	struct le le;
+	struct mclock_ent ent;
 	const struct ausrc_st *ausrc;
 	const struct auplay_st *auplay;
 	char name[64];
-	pthread_t thread;
-	volatile bool run;
+	struct auresamp rs;
+	int16_t *sampv_in, *sampv_out;
+	size_t sampc_in, sampc_out;
+	bool run;
 };
 
 
@@ -49,78 +47,68 @@ static struct device *find_device(const char *device)
 }
 
 
-static void *device_thread(void *arg)
+/* Called from the media clock every packet-time */
+static void device_tick(void *arg)
 {
-	uint64_t now, ts = tmr_jiffies();
 	struct device *dev = arg;
-	struct auresamp rs;
-	int16_t *sampv_in, *sampv_out;
-	size_t sampc_in;
-	size_t sampc_out;
+	size_t sampc_out = dev->sampc_out;
 	int err;
 
-	sampc_in = dev->auplay->prm.srate * dev->auplay->prm.ch * PTIME/1000;
-	sampc_out = dev->ausrc->prm.srate * dev->ausrc->prm.ch * PTIME/1000;
+	dev->auplay->wh(dev->sampv_in, dev->sampc_in, dev->auplay->arg);
 
-	auresamp_init(&rs);
+	if (dev->rs.resample) {
+		err = auresamp(&dev->rs,
+			       dev->sampv_out, &sampc_out,
+			       dev->sampv_in, dev->sampc_in);
+		if (err) {
+			warning("aubridge: auresamp error"
+				" sampc_out=%zu, sampc_in=%zu (%m)\n",
+				sampc_out, dev->sampc_in, err);
+		}
 
-	sampv_in  = mem_alloc(2 * sampc_in, NULL);
-	sampv_out = mem_alloc(2 * sampc_out, NULL);
-	if (!sampv_in || !sampv_out)
-		goto out;
+		dev->ausrc->rh(dev->sampv_out, sampc_out, dev->ausrc->arg);
+	}
+	else {
+		dev->ausrc->rh(dev->sampv_in, dev->sampc_in, dev->ausrc->arg);
+	}
+}
 
-	err = auresamp_setup(&rs,
-			     dev->auplay->prm.srate, dev->auplay->prm.ch,
-			     dev->ausrc->prm.srate, dev->ausrc->prm.ch);
-	if (err)
-		goto out;
 
-	while (dev->run) {
+static int device_start(struct device *dev)
+{
+	int err;
 
-		(void)sys_msleep(4);
+	if (!dev->auplay->wh || !dev->ausrc->rh)
+		return 0;
 
-		if (!dev->run)
-			break;
+	dev->sampc_in  = dev->auplay->prm.srate * dev->auplay->prm.ch
+		* PTIME/1000;
+	dev->sampc_out = dev->ausrc->prm.srate * dev->ausrc->prm.ch
+		* PTIME/1000;
 
-		now = tmr_jiffies();
+	auresamp_init(&dev->rs);
 
-		if (ts > now)
-			continue;
+	dev->sampv_in  = mem_deref(dev->sampv_in);
+	dev->sampv_out = mem_deref(dev->sampv_out);
 
-		if (dev->auplay && dev->auplay->wh) {
-			dev->auplay->wh(sampv_in, sampc_in, dev->auplay->arg);
-		}
+	dev->sampv_in  = mem_alloc(2 * dev->sampc_in, NULL);
+	dev->sampv_out = mem_alloc(2 * dev->sampc_out, NULL);
+	if (!dev->sampv_in || !dev->sampv_out)
+		return ENOMEM;
 
-		if (rs.resample) {
-			err = auresamp(&rs,
-				       sampv_out, &sampc_out,
-				       sampv_in, sampc_in);
-			if (err) {
-				warning("aubridge: auresamp error"
-					" sampc_out=%zu, sampc_in=%zu (%m)\n",
-					sampc_out, sampc_in, err);
-			}
-
-			if (dev->ausrc && dev->ausrc->rh) {
-				dev->ausrc->rh(sampv_out, sampc_out,
-					       dev->ausrc->arg);
-			}
-		}
-		else {
-			if (dev->ausrc && dev->ausrc->rh) {
-				dev->ausrc->rh(sampv_in, sampc_in,
-					       dev->ausrc->arg);
-			}
-		}
+	err = auresamp_setup(&dev->rs,
+			     dev->auplay->prm.srate, dev->auplay->prm.ch,
+			     dev->ausrc->prm.srate, dev->ausrc->prm.ch);
+	if (err)
+		return err;
 
-		ts += PTIME;
-	}
+	err = mclock_register(&dev->ent, device_tick, dev);
+	if (err)
+		return err;
 
- out:
-	mem_deref(sampv_in);
-	mem_deref(sampv_out);
+	dev->run = true;
 
-	return NULL;
+	return 0;
 }
 
 
@@ -159,14 +147,8 @@ int device_connect(struct device **devp, const char *device,
 		dev->ausrc = ausrc;
 
 	/* wait until we have both SRC+PLAY */
-	if (dev->ausrc && dev->auplay && !dev->run) {
-
-		dev->run = true;
-		err = pthread_create(&dev->thread, NULL, device_thread, dev);
-		if (err) {
-			dev->run = false;
-		}
-	}
+	if (dev->ausrc && dev->auplay && !dev->run)
+		err = device_start(dev);
 
 	return err;
 }
@@ -177,11 +159,14 @@ void device_stop(struct device *dev)
 	if (!dev)
 		return;
 
-	dev->auplay = NULL;
-	dev->ausrc = NULL;
-
 	if (dev->run) {
+		mclock_unregister(&dev->ent);
 		dev->run = false;
-		pthread_join(dev->thread, NULL);
 	}
+
+	dev->auplay = NULL;
+	dev->ausrc = NULL;
+
+	dev->sampv_in  = mem_deref(dev->sampv_in);
+	dev->sampv_out = mem_deref(dev->sampv_out);
 }
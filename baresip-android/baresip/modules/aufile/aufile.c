@@ -5,6 +5,13 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
 #include <pthread.h>
 #include <re.h>
 #include <rem.h>
@@ -15,18 +22,46 @@
  * @defgroup aufile aufile
  *
  * Audio module for using a WAV-file as audio input
+ *
+ * The file is mapped into memory once and shared read-only by all
+ * sources playing it. Samples are converted as each frame is needed,
+ * and all sources are driven by one player thread with absolute
+ * deadlines.
  */
 
 
+enum {
+	WINDOW = 1024 * 1024,  /* Mapped bytes released behind a reader */
+	MAX_LAG = 5,           /* Frames behind before skipping ahead   */
+	IDLE_NS = 10000000,    /* Player sleep without sources          */
+};
+
+
+/** A mapped WAV file, shared by all sources playing it */
+struct afmap {
+	struct le le;
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	struct aufile_prm prm;
+	uint8_t *base;
+	size_t size;
+	const uint8_t *data;
+	size_t datasize;
+};
+
 struct ausrc_st {
 	const struct ausrc *as;  /* base class */
+	struct le le;
 	struct tmr tmr;
-	struct aufile *aufile;
-	struct aubuf *aubuf;
+	struct afmap *map;
+	size_t pos;
+	uint64_t next;
 	uint32_t ptime;
 	size_t sampc;
-	bool run;
-	pthread_t thread;
+	int16_t *sampv;
+	volatile bool eof;
 	ausrc_read_h *rh;
 	ausrc_error_h *errh;
 	void *arg;
@@ -34,125 +69,335 @@ struct ausrc_st {
 
 
 static struct ausrc *ausrc;
+static struct list mapl;
+
+static struct {
+	struct list srcl;
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	volatile bool run;
+} player = {
+	LIST_INIT,
+	PTHREAD_MUTEX_INITIALIZER,
+	0,
+	false
+};
 
 
-static void destructor(void *arg)
+static uint64_t now_ns(void)
 {
-	struct ausrc_st *st = arg;
+	struct timespec ts;
 
-	if (st->run) {
-		st->run = false;
-		pthread_join(st->thread, NULL);
-	}
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	tmr_cancel(&st->tmr);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+#ifdef __APPLE__
+	const uint64_t now = now_ns();
+
+	if (deadline <= now)
+		return;
+
+	deadline -= now;
+
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
 
-	mem_deref(st->aufile);
-	mem_deref(st->aubuf);
+	(void)nanosleep(&ts, NULL);
+#else
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       &ts, NULL) == EINTR)
+		;
+#endif
 }
 
 
-static void *play_thread(void *arg)
+static void map_destructor(void *arg)
 {
-	uint64_t now, ts = tmr_jiffies();
-	struct ausrc_st *st = arg;
-	int16_t *sampv;
+	struct afmap *map = arg;
 
-	sampv = mem_alloc(st->sampc * 2, NULL);
-	if (!sampv)
-		return NULL;
+	list_unlink(&map->le);
 
-	while (st->run) {
+	if (map->base)
+		(void)munmap(map->base, map->size);
 
-		sys_msleep(4);
+	mem_deref(map->path);
+}
 
-		now = tmr_jiffies();
 
-		if (ts > now)
-			continue;
+static struct afmap *map_find(const char *path, const struct stat *st)
+{
+	struct le *le;
 
-		aubuf_read_samp(st->aubuf, sampv, st->sampc);
+	for (le = mapl.head; le; le = le->next) {
 
-		st->rh(sampv, st->sampc, st->arg);
+		struct afmap *map = le->data;
 
-		ts += st->ptime;
+		if (map->dev == st->st_dev && map->ino == st->st_ino &&
+		    map->mtime == st->st_mtime &&
+		    0 == str_cmp(map->path, path))
+			return map;
 	}
 
-	mem_deref(sampv);
+	return NULL;
+}
 
-	info("aufile: player thread exited\n");
 
-	return NULL;
+static int map_open(struct afmap **mapp, const char *path)
+{
+	struct aufile *af = NULL;
+	struct afmap *map;
+	struct stat st;
+	size_t offset;
+	int fd, err;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		(void)close(fd);
+		return err;
+	}
+
+	map = map_find(path, &st);
+	if (map) {
+		(void)close(fd);
+		*mapp = mem_ref(map);
+		return 0;
+	}
+
+	map = mem_zalloc(sizeof(*map), map_destructor);
+	if (!map) {
+		(void)close(fd);
+		return ENOMEM;
+	}
+
+	map->dev   = st.st_dev;
+	map->ino   = st.st_ino;
+	map->mtime = st.st_mtime;
+	map->size  = st.st_size;
+
+	err = str_dup(&map->path, path);
+	if (err)
+		goto out;
+
+	/* the header is parsed by the WAV reader */
+	err = aufile_open(&af, &map->prm, path, AUFILE_READ);
+	if (err)
+		goto out;
+
+	offset = aufile_get_offset(af);
+	if (offset > map->size) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	map->base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map->base == MAP_FAILED) {
+		map->base = NULL;
+		err = errno;
+		goto out;
+	}
+
+	(void)madvise(map->base, map->size, MADV_SEQUENTIAL);
+
+	map->data     = map->base + offset;
+	map->datasize = min(aufile_get_size(af), map->size - offset);
+
+	list_append(&mapl, &map->le, map);
+
+ out:
+	(void)close(fd);
+	mem_deref(af);
+
+	if (err)
+		mem_deref(map);
+	else
+		*mapp = map;
+
+	return err;
 }
 
 
-static void timeout(void *arg)
+/* Convert one frame from Little-Endian to Native-Endian */
+static void src_read(struct ausrc_st *st)
 {
-	struct ausrc_st *st = arg;
+	const struct afmap *map = st->map;
+	const size_t window = st->pos / WINDOW;
+	size_t i, n = 0;
 
-	tmr_start(&st->tmr, 1000, timeout, st);
+	if (st->pos < map->datasize) {
 
-	/* check if audio buffer is empty */
-	if (aubuf_cur_size(st->aubuf) < (2 * st->sampc)) {
+		const uint8_t *p = map->data + st->pos;
 
-		info("aufile: end of file\n");
+		n = min(st->sampc, (map->datasize - st->pos) / 2);
 
-		/* error handler must be called from re_main thread */
-		if (st->errh)
-			st->errh(0, "end of file", st->arg);
+		for (i=0; i<n; i++)
+			st->sampv[i] = (int16_t)(p[2*i] | p[2*i+1] << 8);
+
+		st->pos += 2 * n;
+	}
+	else {
+		st->eof = true;
+	}
+
+	memset(&st->sampv[n], 0, (st->sampc - n) * 2);
+
+	/* Pages read are not needed by this source anymore */
+	if (st->pos / WINDOW != window) {
+
+		const size_t pgsz = sysconf(_SC_PAGESIZE);
+		size_t start = (map->data - map->base) + window * WINDOW;
+		size_t end   = (map->data - map->base) + st->pos;
+
+		start = (start + pgsz - 1) & ~(pgsz - 1);
+		end   = end & ~(pgsz - 1);
+
+		if (end > start)
+			(void)madvise(map->base + start, end - start,
+				      MADV_DONTNEED);
 	}
 }
 
 
-static int read_file(struct ausrc_st *st)
+static void *play_thread(void *arg)
 {
-	struct mbuf *mb;
-	int err;
+	(void)arg;
 
-	for (;;) {
-		uint16_t *sampv;
-		size_t i;
+	while (player.run) {
 
-		mb = mbuf_alloc(4096);
-		if (!mb)
-			return ENOMEM;
+		uint64_t now, next = 0;
+		struct le *le;
 
-		mb->end = mb->size;
+		pthread_mutex_lock(&player.mutex);
 
-		err = aufile_read(st->aufile, mb->buf, &mb->end);
-		if (err)
-			break;
+		now = now_ns();
 
-		if (mb->end == 0) {
-			info("aufile: end of file\n");
-			break;
-		}
+		for (le = player.srcl.head; le; le = le->next) {
 
-		/* convert from Little-Endian to Native-Endian */
-		sampv = (void *)mb->buf;
-		for (i=0; i<mb->end/2; i++) {
-			sampv[i] = sys_ltohs(sampv[i]);
+			struct ausrc_st *st = le->data;
+			const uint64_t ptime = st->ptime * 1000000ULL;
+
+			if (st->next <= now) {
+
+				src_read(st);
+
+				st->rh(st->sampv, st->sampc, st->arg);
+
+				st->next += ptime;
+
+				if (now > st->next + MAX_LAG * ptime)
+					st->next = now + ptime;
+			}
+
+			if (!next || st->next < next)
+				next = st->next;
 		}
 
-		aubuf_append(st->aubuf, mb);
+		pthread_mutex_unlock(&player.mutex);
+
+		/* no sources, the thread is about to be stopped */
+		if (!next)
+			next = now + IDLE_NS;
+
+		sleep_until(next);
+	}
+
+	return NULL;
+}
 
-		mb = mem_deref(mb);
+
+static void player_remove(struct ausrc_st *st)
+{
+	bool stop;
+
+	pthread_mutex_lock(&player.mutex);
+	list_unlink(&st->le);
+	stop = list_isempty(&player.srcl);
+	pthread_mutex_unlock(&player.mutex);
+
+	if (stop && player.run) {
+		player.run = false;
+		pthread_join(player.thread, NULL);
+
+		info("aufile: player thread exited\n");
 	}
+}
 
-	info("aufile: loaded %zu bytes\n", aubuf_cur_size(st->aubuf));
 
-	mem_deref(mb);
+static int player_add(struct ausrc_st *st)
+{
+	int err = 0;
+
+	st->next = now_ns() + st->ptime * 1000000ULL;
+
+	pthread_mutex_lock(&player.mutex);
+	list_append(&player.srcl, &st->le, st);
+	pthread_mutex_unlock(&player.mutex);
+
+	if (!player.run) {
+
+		player.run = true;
+
+		err = pthread_create(&player.thread, NULL, play_thread, NULL);
+		if (err) {
+			player.run = false;
+			player_remove(st);
+		}
+	}
+
 	return err;
 }
 
 
+static void destructor(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	player_remove(st);
+
+	tmr_cancel(&st->tmr);
+
+	mem_deref(st->sampv);
+	mem_deref(st->map);
+}
+
+
+static void timeout(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	tmr_start(&st->tmr, 1000, timeout, st);
+
+	if (st->eof) {
+
+		info("aufile: end of file\n");
+
+		/* error handler must be called from re_main thread */
+		if (st->errh)
+			st->errh(0, "end of file", st->arg);
+	}
+}
+
+
 static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 			 struct media_ctx **ctx,
 			 struct ausrc_prm *prm, const char *dev,
 			 ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
 {
+	const struct aufile_prm *fprm;
 	struct ausrc_st *st;
-	struct aufile_prm fprm;
 	int err;
 	(void)ctx;
 
@@ -170,28 +415,30 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	st->errh = errh;
 	st->arg  = arg;
 
-	err = aufile_open(&st->aufile, &fprm, dev, AUFILE_READ);
+	err = map_open(&st->map, dev);
 	if (err) {
 		warning("aufile: failed to open file '%s' (%m)\n", dev, err);
 		goto out;
 	}
 
+	fprm = &st->map->prm;
+
 	info("aufile: %s: %u Hz, %d channels\n",
-	     dev, fprm.srate, fprm.channels);
+	     dev, fprm->srate, fprm->channels);
 
-	if (fprm.srate != prm->srate) {
+	if (fprm->srate != prm->srate) {
 		warning("aufile: input file (%s) must have sample-rate"
 			" %u Hz\n", dev, prm->srate);
 		err = ENODEV;
 		goto out;
 	}
-	if (fprm.channels != prm->ch) {
+	if (fprm->channels != prm->ch) {
 		warning("aufile: input file (%s) must have channels = %d\n",
 			dev, prm->ch);
 		err = ENODEV;
 		goto out;
 	}
-	if (fprm.fmt != AUFMT_S16LE) {
+	if (fprm->fmt != AUFMT_S16LE) {
 		warning("aufile: input file must have format S16LE\n");
 		err = ENODEV;
 		goto out;
@@ -201,30 +448,18 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 
 	st->ptime = prm->ptime;
 
-	info("aufile: audio ptime=%u sampc=%zu aubuf=[%u:%u]\n",
-	     st->ptime, st->sampc,
-	     prm->srate * prm->ch * 2,
-	     prm->srate * prm->ch * 40);
+	info("aufile: audio ptime=%u sampc=%zu, %zu bytes mapped\n",
+	     st->ptime, st->sampc, st->map->datasize);
 
-	/* 1 - inf seconds of audio */
-	err = aubuf_alloc(&st->aubuf,
-			  prm->srate * prm->ch * 2,
-			  0);
-	if (err)
-		goto out;
-
-	err = read_file(st);
-	if (err)
+	st->sampv = mem_alloc(st->sampc * 2, NULL);
+	if (!st->sampv) {
+		err = ENOMEM;
 		goto out;
+	}
 
 	tmr_start(&st->tmr, 1000, timeout, st);
 
-	st->run = true;
-	err = pthread_create(&st->thread, NULL, play_thread, st);
-	if (err) {
-		st->run = false;
-		goto out;
-	}
+	err = player_add(st);
 
  out:
 	if (err)
@@ -150,6 +150,7 @@ static struct vidcodec h264 = {
 	decode_h264,
 	h264_fmtp_enc,
 	h264_fmtp_cmp,
+	(1u << VID_FMT_YUV420P) | (1u << VID_FMT_NV12),
 };
 
 static struct vidcodec h263 = {
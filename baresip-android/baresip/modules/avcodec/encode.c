@@ -47,6 +47,7 @@ struct videnc_state {
 	struct mbuf *mb_frag;
 	struct videnc_param encprm;
 	struct vidsz encsize;
+	enum vidfmt encfmt;
 	enum AVCodecID codec_id;
 	videnc_packet_h *pkth;
 	void *arg;
@@ -585,11 +586,14 @@ int encode_x264(struct videnc_state *st, bool update,
 		return ENOTSUP;
 	}
 
-	if (!st->x264 || !vidsz_cmp(&st->encsize, &frame->size)) {
+	if (!st->x264 || !vidsz_cmp(&st->encsize, &frame->size) ||
+	    st->encfmt != frame->fmt) {
 
 		err = open_encoder_x264(st, &st->encprm, &frame->size, csp);
 		if (err)
 			return err;
+
+		st->encfmt = frame->fmt;
 	}
 
 	if (update) {
@@ -675,13 +679,16 @@ int encode(struct videnc_state *st, bool update, const struct vidframe *frame)
 		return ENOTSUP;
 	}
 
-	if (!st->ctx || !vidsz_cmp(&st->encsize, &frame->size)) {
+	if (!st->ctx || !vidsz_cmp(&st->encsize, &frame->size) ||
+	    st->encfmt != frame->fmt) {
 
 		err = open_encoder(st, &st->encprm, &frame->size, pix_fmt);
 		if (err) {
 			warning("avcodec: open_encoder: %m\n", err);
 			return err;
 		}
+
+		st->encfmt = frame->fmt;
 	}
 
 	for (i=0; i<4; i++) {
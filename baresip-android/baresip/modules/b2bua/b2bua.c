@@ -16,6 +16,10 @@
  *
  * N session objects
  * 1 session object has 2 call objects (left, right leg)
+ *
+ * When both legs have negotiated the same codec, RTP is relayed
+ * between the two media streams without decoding. Otherwise the media
+ * is transcoded via the aubridge and vidbridge devices.
  */
 
 
@@ -51,6 +55,20 @@ static void destructor(void *arg)
 }
 
 
+static void relay_media(struct stream *s1, struct stream *s2)
+{
+	int err;
+
+	if (!s1 || !s2)
+		return;
+
+	err = stream_set_relay(s1, s2);
+	if (err && err != ENOTSUP) {
+		warning("b2bua: could not relay media (%m)\n", err);
+	}
+}
+
+
 static void call_event_handler(struct call *call, enum call_event ev,
 			       const char *str, void *arg)
 {
@@ -63,6 +81,14 @@ static void call_event_handler(struct call *call, enum call_event ev,
 		debug("b2bua: CALL_ESTABLISHED: peer_uri=%s\n",
 		      call_peeruri(call));
 		ua_answer(call_get_ua(call2), call2);
+
+		/* the inbound leg is established last */
+		if (call == sess->call_in) {
+			relay_media(audio_strm(call_audio(call)),
+				    audio_strm(call_audio(call2)));
+			relay_media(video_strm(call_video(call)),
+				    video_strm(call_video(call2)));
+		}
 		break;
 
 	case CALL_EVENT_CLOSED:
@@ -173,10 +199,15 @@ static int b2bua_status(struct re_printf *pf, void *arg)
 	for (le = sessionl.head; le; le = le->next) {
 
 		struct session *sess = le->data;
+		const struct stream *strm;
+
+		strm = audio_strm(call_audio(sess->call_in));
 
-		err |= re_hprintf(pf, "%-42s  --->  %42s\n",
+		err |= re_hprintf(pf, "%-42s  --->  %42s  (%s)\n",
 				  call_peeruri(sess->call_in),
-				  call_peeruri(sess->call_out));
+				  call_peeruri(sess->call_out),
+				  stream_is_relayed(strm) ? "relay"
+							  : "transcode");
 
 		err |= re_hprintf(pf, " %H\n", call_status, sess->call_in);
 		err |= re_hprintf(pf, " %H\n", call_status, sess->call_out);
@@ -6,6 +6,5 @@
 
 MOD		:= plc
 $(MOD)_SRCS	+= plc.c
-$(MOD)_LFLAGS	+= "-lspandsp"
 
 include mk/mod.mk
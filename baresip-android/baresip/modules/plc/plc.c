@@ -3,25 +3,25 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
-
-#define SPANDSP_EXPOSE_INTERNAL_STRUCTURES
-
-#include <spandsp.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 
 
 /**
  * @defgroup plc plc
  *
- * Packet Loss Concealment (PLC) audio-filter using spandsp
+ * Packet Loss Concealment (PLC) audio-filter using librem
  *
+ * Lost frames are extrapolated from the pitch of the audio before the
+ * loss, and faded out to comfort noise if the loss goes on. The first
+ * frame after a loss is merged with the concealed audio.
  */
 
 
 struct plc_st {
 	struct aufilt_dec_st af; /* base class */
-	plc_state_t plc;
+	struct auplc *plc;
 	size_t sampc;
 };
 
@@ -31,6 +31,7 @@ static void destructor(void *arg)
 	struct plc_st *st = arg;
 
 	list_unlink(&st->af.le);
+	mem_deref(st->plc);
 }
 
 
@@ -58,10 +59,9 @@ static int update(struct aufilt_dec_st **stp, void **ctx,
 	if (!st)
 		return ENOMEM;
 
-	if (!plc_init(&st->plc)) {
-		err = ENOMEM;
+	err = auplc_alloc(&st->plc, prm->srate);
+	if (err)
 		goto out;
-	}
 
 	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
 
@@ -84,10 +84,13 @@ static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct plc_st *plc = (struct plc_st *)st;
 
-	if (*sampc)
-		plc_rx(&plc->plc, sampv, (int)*sampc);
-	else
-		*sampc = plc_fillin(&plc->plc, sampv, (int)plc->sampc);
+	if (*sampc) {
+		auplc_rx(plc->plc, sampv, *sampc);
+	}
+	else {
+		auplc_conceal(plc->plc, sampv, plc->sampc);
+		*sampc = plc->sampc;
+	}
 
 	return 0;
 }
@@ -4,7 +4,9 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <sndfile.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include <re.h>
 #include <baresip.h>
 
@@ -14,106 +16,610 @@
  *
  * Audio filter that writes audio samples to WAV-file
  *
+ * The audio filters only copy the samples into a lock-free ring buffer
+ * per direction. A background thread writes the buffered samples to
+ * disk in large batches, so a slow disk never blocks the audio path.
+ * If the disk cannot keep up, frames are dropped and counted.
+ *
+ * With snd_stereo enabled the encoded (left) and decoded (right) audio
+ * of a call are written into one stereo file. snd_format selects the
+ * file format, "flac" and "ogg" are compressed.
+ *
  * Example Configuration:
  \verbatim
   snd_path 					/tmp/
+  snd_stereo					no
+  snd_format					wav	# {wav,flac,ogg}
  \endverbatim
  */
 
 
+enum {
+	RING_MS  = 4000,   /* Buffered audio per direction            */
+	BATCH_MS = 200,    /* Interval between batched writes         */
+	MIX_LAG_MS = 500,  /* Lag before a silent direction is padded */
+	JOIN_MS  = 500,    /* Wait for the other direction to join    */
+};
+
+
+/* Single-producer, single-consumer ring of samples */
+struct ring {
+	int16_t *sampv;
+	size_t size;       /* Number of samples, a power of two */
+	size_t head;       /* Written by the audio thread       */
+	size_t tail;       /* Written by the writer thread      */
+};
+
+struct recdir {
+	struct ring ring;
+	struct aufilt_prm prm;
+	SNDFILE *sf;
+	bool active;       /* Set up, may join a started recording */
+	bool opened;
+	bool done;
+	uint64_t frames;
+	uint64_t dropped;
+	uint32_t lag_max;  /* Most audio waiting for the writer [ms] */
+};
+
+/*
+ * Recording of one audio stream, shared by its encoder and decoder.
+ * The filters own it until it is started, then the writer thread owns
+ * it and frees it when both filters are done.
+ */
+struct rec {
+	struct le le;
+	struct tm tm;
+	uint64_t ts;         /* Creation time [ms]                     */
+	struct recdir tx, rx;
+	SNDFILE *sf_mix;
+	unsigned nfilt;      /* Filters using it, main thread only     */
+	bool started;        /* Handed to the writer, main thread only */
+	bool mix;
+	bool opened;
+	int16_t *bufv;       /* Interleaved and planar scratch buffer */
+	size_t bufc;         /* Samples per direction in a batch      */
+	uint32_t write_max;  /* Slowest batch write [ms]               */
+};
+
+struct rec_stats {
+	unsigned recc;
+	uint64_t frames;
+	uint64_t dropped;
+	uint32_t lag_max;
+	uint32_t write_max;
+};
+
 struct sndfile_enc {
 	struct aufilt_enc_st af;  /* base class */
-	SNDFILE *enc;
+	struct rec *rec;
 };
 
 struct sndfile_dec {
 	struct aufilt_dec_st af;  /* base class */
-	SNDFILE *dec;
+	struct rec *rec;
 };
 
 static char file_path[256] = ".";
+static char file_format[16] = "wav";
+static bool stereo;
+
+/* The writer thread owns recl, new recordings are queued on newl */
+static struct {
+	struct list recl;
+	struct list newl;
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	volatile bool run;
+	struct rec_stats done;  /* Finished recordings       */
+	struct rec_stats stats; /* All, after the last batch */
+} writer = {
+	.recl  = LIST_INIT,
+	.newl  = LIST_INIT,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
 
-static int timestamp_print(struct re_printf *pf, const struct tm *tm)
+static int ring_alloc(struct ring *r, size_t min_size)
 {
-	if (!tm)
-		return 0;
+	size_t size = 1;
 
-	return re_hprintf(pf, "%d-%02d-%02d-%02d-%02d-%02d",
-			  1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
-			  tm->tm_hour, tm->tm_min, tm->tm_sec);
+	while (size < min_size)
+		size <<= 1;
+
+	r->sampv = mem_alloc(size * sizeof(int16_t), NULL);
+	if (!r->sampv)
+		return ENOMEM;
+
+	r->size = size;
+
+	return 0;
 }
 
 
-static void enc_destructor(void *arg)
+static size_t ring_used(const struct ring *r)
 {
-	struct sndfile_enc *st = arg;
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
 
-	if (st->enc)
-		sf_close(st->enc);
 
-	list_unlink(&st->af.le);
+/* Called by the producer, all or nothing */
+static bool ring_write(struct ring *r, const int16_t *sampv, size_t sampc)
+{
+	const size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	const size_t pos = r->head & (r->size - 1);
+	const size_t n = min(sampc, r->size - pos);
+
+	if (r->size - (r->head - tail) < sampc)
+		return false;
+
+	memcpy(&r->sampv[pos], sampv, n * sizeof(int16_t));
+	memcpy(r->sampv, &sampv[n], (sampc - n) * sizeof(int16_t));
+
+	__atomic_store_n(&r->head, r->head + sampc, __ATOMIC_RELEASE);
+
+	return true;
 }
 
 
-static void dec_destructor(void *arg)
+/* Called by the consumer, at most ring_used() samples */
+static void ring_read(struct ring *r, int16_t *sampv, size_t sampc)
 {
-	struct sndfile_dec *st = arg;
+	const size_t pos = r->tail & (r->size - 1);
+	const size_t n = min(sampc, r->size - pos);
 
-	if (st->dec)
-		sf_close(st->dec);
+	memcpy(sampv, &r->sampv[pos], n * sizeof(int16_t));
+	memcpy(&sampv[n], r->sampv, (sampc - n) * sizeof(int16_t));
 
-	list_unlink(&st->af.le);
+	__atomic_store_n(&r->tail, r->tail + sampc, __ATOMIC_RELEASE);
 }
 
 
-static SNDFILE *openfile(const struct aufilt_prm *prm, bool enc)
+static uint32_t samp_ms(const struct recdir *d, size_t sampc)
+{
+	return (uint32_t)(sampc * 1000 / (d->prm.srate * d->prm.ch));
+}
+
+
+static int timestamp_print(struct re_printf *pf, const struct tm *tm)
+{
+	if (!tm)
+		return 0;
+
+	return re_hprintf(pf, "%d-%02d-%02d-%02d-%02d-%02d",
+			  1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
+			  tm->tm_hour, tm->tm_min, tm->tm_sec);
+}
+
+
+static int sf_format(const char **ext)
+{
+	if (0 == str_casecmp(file_format, "flac")) {
+		*ext = "flac";
+		return SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+	}
+	else if (0 == str_casecmp(file_format, "ogg")) {
+		*ext = "ogg";
+		return SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+	}
+
+	*ext = "wav";
+	return SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+}
+
+
+static SNDFILE *openfile(const struct tm *tm, uint32_t srate, uint8_t ch,
+			 const char *suffix)
 {
 	char filename[128];
 	SF_INFO sfinfo;
-	time_t tnow = time(0);
-	struct tm *tm = localtime(&tnow);
+	const char *ext;
 	SNDFILE *sf;
 
-	(void)re_snprintf(filename, sizeof(filename),
-			  "%s/dump-%H-%s.wav",
-				file_path,
-			  timestamp_print, tm, enc ? "enc" : "dec");
+	memset(&sfinfo, 0, sizeof(sfinfo));
+	sfinfo.samplerate = srate;
+	sfinfo.channels   = ch;
+	sfinfo.format     = sf_format(&ext);
 
-	sfinfo.samplerate = prm->srate;
-	sfinfo.channels   = prm->ch;
-	sfinfo.format     = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+	(void)re_snprintf(filename, sizeof(filename),
+			  "%s/dump-%H%s.%s",
+			  file_path, timestamp_print, tm, suffix, ext);
 
 	sf = sf_open(filename, SFM_WRITE, &sfinfo);
 	if (!sf) {
-		warning("sndfile: could not open: %s\n", filename);
-		puts(sf_strerror(NULL));
+		warning("sndfile: could not open: %s (%s)\n",
+			filename, sf_strerror(NULL));
 		return NULL;
 	}
 
-	info("sndfile: dumping %s audio to %s\n",
-	     enc ? "encode" : "decode", filename);
+	info("sndfile: dumping audio to %s\n", filename);
 
 	return sf;
 }
 
 
+static bool dir_active(const struct recdir *d)
+{
+	return __atomic_load_n(&d->active, __ATOMIC_ACQUIRE);
+}
+
+
+static void rec_open(struct rec *rec)
+{
+	rec->opened = true;
+
+	rec->mix = stereo && dir_active(&rec->tx) && dir_active(&rec->rx) &&
+		rec->tx.prm.srate == rec->rx.prm.srate &&
+		rec->tx.prm.ch == 1 && rec->rx.prm.ch == 1;
+
+	if (rec->mix)
+		rec->sf_mix = openfile(&rec->tm, rec->tx.prm.srate, 2, "");
+}
+
+
+/* A direction gets its own file, also when it joins late */
+static void dir_open(struct rec *rec, struct recdir *d, const char *suffix)
+{
+	d->opened = true;
+	d->sf = openfile(&rec->tm, d->prm.srate, d->prm.ch, suffix);
+}
+
+
+static void dir_drain(struct recdir *d, int16_t *bufv, size_t bufc)
+{
+	size_t n = ring_used(&d->ring);
+
+	d->lag_max = max(d->lag_max, samp_ms(d, n));
+
+	while (n) {
+
+		const size_t c = min(n, bufc);
+
+		ring_read(&d->ring, bufv, c);
+
+		if (d->sf)
+			(void)sf_write_short(d->sf, bufv, c);
+
+		n -= c;
+	}
+}
+
+
+/* The filter of this direction is gone, no more samples will come */
+static bool dir_done(const struct recdir *d)
+{
+	return __atomic_load_n(&d->done, __ATOMIC_ACQUIRE);
+}
+
+
+/* Interleave both directions, padding a stalled one with silence */
+static void mix_drain(struct rec *rec, bool flush)
+{
+	const size_t lag = rec->tx.prm.srate * MIX_LAG_MS / 1000;
+	size_t ntx = ring_used(&rec->tx.ring);
+	size_t nrx = ring_used(&rec->rx.ring);
+	size_t n, pad_tx = 0, pad_rx = 0;
+
+	rec->tx.lag_max = max(rec->tx.lag_max, samp_ms(&rec->tx, ntx));
+	rec->rx.lag_max = max(rec->rx.lag_max, samp_ms(&rec->rx, nrx));
+
+	if (flush || ntx > nrx + lag || dir_done(&rec->rx))
+		pad_rx = ntx > nrx ? ntx - nrx : 0;
+	if (flush || nrx > ntx + lag || dir_done(&rec->tx))
+		pad_tx = nrx > ntx ? nrx - ntx : 0;
+
+	n = min(ntx + pad_tx, nrx + pad_rx);
+
+	while (n) {
+
+		const size_t c = min(n, rec->bufc);
+		int16_t *l = rec->bufv + 2 * rec->bufc, *r = l + rec->bufc;
+		const size_t ctx = min(c, ntx), crx = min(c, nrx);
+		size_t i;
+
+		ring_read(&rec->tx.ring, l, ctx);
+		ring_read(&rec->rx.ring, r, crx);
+		memset(&l[ctx], 0, (c - ctx) * sizeof(int16_t));
+		memset(&r[crx], 0, (c - crx) * sizeof(int16_t));
+
+		ntx -= ctx;
+		nrx -= crx;
+		n   -= c;
+
+		for (i=0; i<c; i++) {
+			rec->bufv[2*i]   = l[i];
+			rec->bufv[2*i+1] = r[i];
+		}
+
+		if (rec->sf_mix)
+			(void)sf_write_short(rec->sf_mix, rec->bufv, 2 * c);
+	}
+}
+
+
+static void rec_close(struct rec *rec)
+{
+	if (rec->tx.sf)
+		sf_close(rec->tx.sf);
+	if (rec->rx.sf)
+		sf_close(rec->rx.sf);
+	if (rec->sf_mix)
+		sf_close(rec->sf_mix);
+
+	rec->tx.sf = rec->rx.sf = rec->sf_mix = NULL;
+}
+
+
+static void rec_write(struct rec *rec, bool flush)
+{
+	const uint64_t start = tmr_jiffies();
+	uint32_t dur;
+
+	if (!rec->opened) {
+
+		/* give a stereo recording the chance to get both sides */
+		if (!flush && start < rec->ts + JOIN_MS &&
+		    !(dir_active(&rec->tx) && dir_active(&rec->rx)))
+			return;
+
+		rec_open(rec);
+	}
+
+	if (rec->mix) {
+		mix_drain(rec, flush);
+	}
+	else {
+		if (dir_active(&rec->tx)) {
+			if (!rec->tx.opened)
+				dir_open(rec, &rec->tx, "-enc");
+			dir_drain(&rec->tx, rec->bufv, rec->bufc);
+		}
+		if (dir_active(&rec->rx)) {
+			if (!rec->rx.opened)
+				dir_open(rec, &rec->rx, "-dec");
+			dir_drain(&rec->rx, rec->bufv, rec->bufc);
+		}
+	}
+
+	dur = (uint32_t)(tmr_jiffies() - start);
+	rec->write_max = max(rec->write_max, dur);
+}
+
+
+static void rec_destructor(void *arg)
+{
+	struct rec *rec = arg;
+
+	list_unlink(&rec->le);
+
+	rec_close(rec);
+
+	mem_deref(rec->tx.ring.sampv);
+	mem_deref(rec->rx.ring.sampv);
+	mem_deref(rec->bufv);
+}
+
+
+static bool rec_done(const struct rec *rec)
+{
+	return (!dir_active(&rec->tx) || dir_done(&rec->tx)) &&
+	       (!dir_active(&rec->rx) || dir_done(&rec->rx));
+}
+
+
+static void stats_add(struct rec_stats *stats, const struct rec *rec)
+{
+	++stats->recc;
+	stats->frames   += rec->tx.frames + rec->rx.frames;
+	stats->dropped  += rec->tx.dropped + rec->rx.dropped;
+	stats->lag_max   = max(stats->lag_max,
+			       max(rec->tx.lag_max, rec->rx.lag_max));
+	stats->write_max = max(stats->write_max, rec->write_max);
+}
+
+
+static void writer_batch(bool flush)
+{
+	struct rec_stats stats, done;
+	struct le *le;
+
+	pthread_mutex_lock(&writer.mutex);
+	while (writer.newl.head) {
+		le = writer.newl.head;
+		list_unlink(le);
+		list_append(&writer.recl, le, le->data);
+	}
+	done = writer.done;
+	pthread_mutex_unlock(&writer.mutex);
+
+	memset(&stats, 0, sizeof(stats));
+
+	le = writer.recl.head;
+	while (le) {
+		struct rec *rec = le->data;
+
+		le = le->next;
+
+		if (rec_done(rec)) {
+			rec_write(rec, true);
+			rec_close(rec);
+
+			stats_add(&done, rec);
+
+			list_unlink(&rec->le);
+			mem_deref(rec);
+		}
+		else if (flush) {
+			rec_write(rec, true);
+			rec_close(rec);
+
+			stats_add(&done, rec);
+		}
+		else {
+			rec_write(rec, false);
+
+			stats_add(&stats, rec);
+		}
+	}
+
+	pthread_mutex_lock(&writer.mutex);
+	writer.done  = done;
+	writer.stats = stats;
+	pthread_mutex_unlock(&writer.mutex);
+}
+
+
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+
+	while (writer.run) {
+
+		(void)sys_msleep(BATCH_MS);
+
+		writer_batch(false);
+	}
+
+	writer_batch(true);
+
+	return NULL;
+}
+
+
+static int rec_alloc(struct rec **recp, void **ctx)
+{
+	struct rec *rec;
+	time_t tnow;
+
+	if (*ctx) {
+		rec = *ctx;
+		++rec->nfilt;
+		*recp = rec;
+		return 0;
+	}
+
+	rec = mem_zalloc(sizeof(*rec), rec_destructor);
+	if (!rec)
+		return ENOMEM;
+
+	tnow = time(0);
+	rec->tm = *localtime(&tnow);
+	rec->ts = tmr_jiffies();
+	rec->nfilt = 1;
+
+	*ctx = rec;
+	*recp = rec;
+
+	return 0;
+}
+
+
+static int recdir_setup(struct recdir *d, const struct aufilt_prm *prm)
+{
+	int err;
+
+	err = ring_alloc(&d->ring, prm->srate * prm->ch * RING_MS / 1000);
+	if (err)
+		return err;
+
+	d->prm = *prm;
+
+	/* the writer may already own the recording */
+	__atomic_store_n(&d->active, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+/*
+ * The first filter hands the recording to the writer, so that a call
+ * with only an encoder or only a decoder is recorded too. The other
+ * direction joins the started recording.
+ */
+static int rec_start(struct rec *rec)
+{
+	size_t bufc;
+
+	if (rec->started)
+		return 0;
+
+	bufc = max(rec->tx.ring.size, rec->rx.ring.size);
+
+	rec->bufc = bufc;
+	rec->bufv = mem_alloc(4 * bufc * sizeof(int16_t), NULL);
+	if (!rec->bufv)
+		return ENOMEM;
+
+	rec->started = true;
+
+	pthread_mutex_lock(&writer.mutex);
+	list_append(&writer.newl, &rec->le, rec);
+	pthread_mutex_unlock(&writer.mutex);
+
+	return 0;
+}
+
+
+/*
+ * A filter of the recording is gone. The recording must not be touched
+ * after the done flag is set, the writer thread may free it any time.
+ */
+static void rec_release(struct rec *rec, struct recdir *d)
+{
+	--rec->nfilt;
+
+	if (rec->started)
+		__atomic_store_n(&d->done, true, __ATOMIC_RELEASE);
+	else if (!rec->nfilt)
+		mem_deref(rec);
+}
+
+
+static void enc_destructor(void *arg)
+{
+	struct sndfile_enc *st = arg;
+
+	list_unlink(&st->af.le);
+	if (st->rec)
+		rec_release(st->rec, &st->rec->tx);
+}
+
+
+static void dec_destructor(void *arg)
+{
+	struct sndfile_dec *st = arg;
+
+	list_unlink(&st->af.le);
+	if (st->rec)
+		rec_release(st->rec, &st->rec->rx);
+}
+
+
 static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 			 const struct aufilt *af, struct aufilt_prm *prm)
 {
 	struct sndfile_enc *st;
-	int err = 0;
-	(void)ctx;
+	int err;
 	(void)af;
 
+	if (!stp || !ctx || !prm)
+		return EINVAL;
+
 	st = mem_zalloc(sizeof(*st), enc_destructor);
 	if (!st)
-		return EINVAL;
+		return ENOMEM;
+
+	err = rec_alloc(&st->rec, ctx);
+	if (err)
+		goto out;
+
+	err = recdir_setup(&st->rec->tx, prm);
+	if (err)
+		goto out;
 
-	st->enc = openfile(prm, true);
-	if (!st->enc)
-		err = ENOMEM;
+	err = rec_start(st->rec);
 
+ out:
 	if (err)
 		mem_deref(st);
 	else
@@ -127,18 +633,27 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 			 const struct aufilt *af, struct aufilt_prm *prm)
 {
 	struct sndfile_dec *st;
-	int err = 0;
-	(void)ctx;
+	int err;
 	(void)af;
 
+	if (!stp || !ctx || !prm)
+		return EINVAL;
+
 	st = mem_zalloc(sizeof(*st), dec_destructor);
 	if (!st)
-		return EINVAL;
+		return ENOMEM;
 
-	st->dec = openfile(prm, false);
-	if (!st->dec)
-		err = ENOMEM;
+	err = rec_alloc(&st->rec, ctx);
+	if (err)
+		goto out;
 
+	err = recdir_setup(&st->rec->rx, prm);
+	if (err)
+		goto out;
+
+	err = rec_start(st->rec);
+
+ out:
 	if (err)
 		mem_deref(st);
 	else
@@ -148,11 +663,20 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 }
 
 
+static void record(struct recdir *d, const int16_t *sampv, size_t sampc)
+{
+	++d->frames;
+
+	if (!ring_write(&d->ring, sampv, sampc))
+		++d->dropped;
+}
+
+
 static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct sndfile_enc *sf = (struct sndfile_enc *)st;
 
-	sf_write_short(sf->enc, sampv, *sampc);
+	record(&sf->rec->tx, sampv, *sampc);
 
 	return 0;
 }
@@ -162,32 +686,95 @@ static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct sndfile_dec *sf = (struct sndfile_dec *)st;
 
-	sf_write_short(sf->dec, sampv, *sampc);
+	record(&sf->rec->rx, sampv, *sampc);
 
 	return 0;
 }
 
 
+static int stats_print(struct re_printf *pf, const struct rec_stats *stats)
+{
+	return re_hprintf(pf, "%u recordings, frames=%llu dropped=%llu"
+			  " max lag=%ums max write=%ums",
+			  stats->recc, stats->frames, stats->dropped,
+			  stats->lag_max, stats->write_max);
+}
+
+
+static int sndfile_status(struct re_printf *pf, void *arg)
+{
+	struct rec_stats stats, done;
+	(void)arg;
+
+	pthread_mutex_lock(&writer.mutex);
+	stats = writer.stats;
+	done  = writer.done;
+	pthread_mutex_unlock(&writer.mutex);
+
+	return re_hprintf(pf, "sndfile: format %s%s\n"
+			  "  active:   %H\n"
+			  "  finished: %H\n",
+			  file_format, stereo ? " (stereo)" : "",
+			  stats_print, &stats, stats_print, &done);
+}
+
+
 static struct aufilt sndfile = {
 	LE_INIT, "sndfile", encode_update, encode, decode_update, decode
 };
 
 
+static const struct cmd cmdv[] = {
+	{"sndfile", 0, 0, "Call recording status", sndfile_status },
+};
+
+
 static int module_init(void)
 {
-	aufilt_register(baresip_aufiltl(), &sndfile);
+	int err;
 
 	conf_get_str(conf_cur(), "snd_path", file_path, sizeof(file_path));
+	conf_get_str(conf_cur(), "snd_format",
+		     file_format, sizeof(file_format));
+	conf_get_bool(conf_cur(), "snd_stereo", &stereo);
 
 	info("sndfile: saving files in %s\n", file_path);
 
-	return 0;
+	writer.run = true;
+	err = pthread_create(&writer.thread, NULL, writer_thread, NULL);
+	if (err) {
+		writer.run = false;
+		return err;
+	}
+
+	aufilt_register(baresip_aufiltl(), &sndfile);
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
 	aufilt_unregister(&sndfile);
+
+	if (writer.run) {
+		writer.run = false;
+		pthread_join(writer.thread, NULL);
+	}
+
+	/* recordings of filters still alive go back to the filters */
+	while (writer.recl.head) {
+
+		struct rec *rec = writer.recl.head->data;
+
+		list_unlink(&rec->le);
+		rec->started = false;
+
+		if (!rec->nfilt)
+			mem_deref(rec);
+	}
+
 	return 0;
 }
 
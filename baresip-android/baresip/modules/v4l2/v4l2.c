@@ -41,12 +41,23 @@
  * @defgroup v4l2 v4l2
  *
  * V4L2 (Video for Linux 2) video-source module
+ *
+ * The capture buffers are memory mapped, and every dequeued buffer is
+ * passed on in place as a video frame. The frame planes of each buffer
+ * are set up once, after the format is negotiated. The buffer goes back
+ * to the driver when the frame handler returns, i.e. when the encoder
+ * and all video filters are done with it.
+ *
+ * Formats are chosen in the order NV12, YUV420, YUYV, so that encoders
+ * taking NV12 natively get the frames without any conversion. The
+ * vivid driver (modprobe vivid) can be used as a virtual device.
  */
 
 
 struct buffer {
 	void  *start;
 	size_t length;
+	struct vidframe frame;  /**< Frame in place of the buffer */
 };
 
 struct vidsrc_st {
@@ -57,6 +68,7 @@ struct vidsrc_st {
 	bool run;
 	struct vidsz sz;
 	u_int32_t pixfmt;
+	unsigned bpl;             /**< Bytes per line of plane 0 */
 	struct buffer *buffers;
 	unsigned int   n_buffers;
 	vidsrc_frame_h *frameh;
@@ -84,6 +96,66 @@ static enum vidfmt match_fmt(u_int32_t fmt)
 }
 
 
+/* Preference of pixel formats, the lowest rank is tried first */
+static int fmt_rank(u_int32_t fmt)
+{
+	switch (fmt) {
+
+	case V4L2_PIX_FMT_NV12:   return 0;
+	case V4L2_PIX_FMT_YUV420: return 1;
+	case V4L2_PIX_FMT_YUYV:   return 2;
+	default:                  return 3;
+	}
+}
+
+
+/* Smallest line length of plane 0, in bytes */
+static unsigned min_bpl(u_int32_t fmt, unsigned width)
+{
+	switch (fmt) {
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:   return width;
+	case V4L2_PIX_FMT_RGB32:  return width * 4;
+	default:                  return width * 2;
+	}
+}
+
+
+/* Set up the frame planes in place of a capture buffer */
+static void frame_init(struct vidframe *f, enum vidfmt fmt,
+		       const struct vidsz *sz, unsigned bpl, uint8_t *buf)
+{
+	memset(f, 0, sizeof(*f));
+
+	f->fmt  = fmt;
+	f->size = *sz;
+
+	f->data[0]     = buf;
+	f->linesize[0] = bpl;
+
+	switch (fmt) {
+
+	case VID_FMT_YUV420P:
+		f->data[1]     = buf + bpl * sz->h;
+		f->linesize[1] = bpl / 2;
+		f->data[2]     = f->data[1] + bpl / 2 * (sz->h / 2);
+		f->linesize[2] = bpl / 2;
+		break;
+
+	case VID_FMT_NV12:
+	case VID_FMT_NV21:
+		f->data[1]     = buf + bpl * sz->h;
+		f->linesize[1] = bpl;
+		break;
+
+	default:
+		break;
+	}
+}
+
+
 static void print_video_input(struct vidsrc_st *st)
 {
 	struct v4l2_input input;
@@ -175,6 +247,10 @@ static int init_mmap(struct vidsrc_st *st, const char *dev_name)
 			warning("v4l2: mmap failed\n");
 			return ENODEV;
 		}
+
+		frame_init(&st->buffers[st->n_buffers].frame,
+			   match_fmt(st->pixfmt), &st->sz, st->bpl,
+			   st->buffers[st->n_buffers].start);
 	}
 
 	return 0;
@@ -219,10 +295,13 @@ static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
 	fmts.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	for (fmts.index=0; !v4l2_ioctl(st->fd, VIDIOC_ENUM_FMT, &fmts);
 			fmts.index++) {
-		if (match_fmt(fmts.pixelformat) != VID_FMT_N) {
+
+		if (match_fmt(fmts.pixelformat) == VID_FMT_N)
+			continue;
+
+		if (!st->pixfmt ||
+		    fmt_rank(fmts.pixelformat) < fmt_rank(st->pixfmt))
 			st->pixfmt = fmts.pixelformat;
-			break;
-		}
 	}
 
 	if (!st->pixfmt) {
@@ -248,7 +327,7 @@ static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
 	/* Note VIDIOC_S_FMT may change width and height. */
 
 	/* Buggy driver paranoia. */
-	min = fmt.fmt.pix.width * 2;
+	min = min_bpl(fmt.fmt.pix.pixelformat, fmt.fmt.pix.width);
 	if (fmt.fmt.pix.bytesperline < min)
 		fmt.fmt.pix.bytesperline = min;
 	min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
@@ -257,6 +336,7 @@ static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
 
 	st->sz.w = fmt.fmt.pix.width;
 	st->sz.h = fmt.fmt.pix.height;
+	st->bpl  = fmt.fmt.pix.bytesperline;
 
 	err = init_mmap(st, dev_name);
 	if (err)
@@ -331,16 +411,6 @@ static int start_capturing(struct vidsrc_st *st)
 }
 
 
-static void call_frame_handler(struct vidsrc_st *st, uint8_t *buf)
-{
-	struct vidframe frame;
-
-	vidframe_init_buf(&frame, match_fmt(st->pixfmt), &st->sz, buf);
-
-	st->frameh(&frame, st->arg);
-}
-
-
 static int read_frame(struct vidsrc_st *st)
 {
 	struct v4l2_buffer buf;
@@ -367,11 +437,15 @@ static int read_frame(struct vidsrc_st *st)
 		}
 	}
 
+	/* a buffer we do not know is skipped, but given back */
 	if (buf.index >= st->n_buffers) {
-		warning("v4l2: index >= n_buffers\n");
+		warning("v4l2: index %u >= n_buffers %u, frame skipped\n",
+			buf.index, st->n_buffers);
+	}
+	else {
+		/* the frame is released when the handler returns */
+		st->frameh(&st->buffers[buf.index].frame, st->arg);
 	}
-
-	call_frame_handler(st, st->buffers[buf.index].start);
 
 	if (-1 == xioctl (st->fd, VIDIOC_QBUF, &buf)) {
 		warning("v4l2: VIDIOC_QBUF\n");
@@ -53,7 +53,8 @@
  */
 
 enum {
-	AUDIO_SAMPSZ    = 3*1920  /* Max samples, 48000Hz 2ch at 60ms */
+	AUDIO_SAMPSZ    = 3*1920, /* Max samples, 48000Hz 2ch at 60ms */
+	LOST_MAX        = 10,     /* Max frames concealed per loss    */
 };
 
 
@@ -134,6 +135,8 @@ struct aurx {
 	int16_t *sampv_rs;            /**< Sample buffer for resampler     */
 	uint32_t ptime;               /**< Packet time for receiving       */
 	int pt;                       /**< Payload type for incoming RTP   */
+	uint16_t seq;                 /**< Last received sequence number   */
+	bool seq_valid;               /**< Sequence number is set          */
 };
 
 
@@ -483,6 +486,10 @@ static void ausrc_read_handler(const int16_t *sampv, size_t sampc, void *arg)
 	struct audio *a = arg;
 	struct autx *tx = &a->tx;
 
+	/* RTP is relayed from the peer stream, no need to encode */
+	if (stream_is_relayed(a->strm))
+		return;
+
 	if (tx->muted)
 		memset((void *)sampv, 0, sampc*2);
 
@@ -623,8 +630,25 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	struct aurx *rx = &a->rx;
 	int err;
 
-	if (!mb)
-		goto out;
+	/*
+	 * Packet loss, the header is that of the packet after the gap.
+	 * Every lost frame is concealed, so that the concealment sees
+	 * the whole burst.
+	 */
+	if (!mb) {
+		uint16_t lostc = hdr->seq - rx->seq - 1;
+
+		if (!rx->seq_valid || !lostc || lostc > LOST_MAX)
+			lostc = 1;
+
+		while (lostc--)
+			(void)aurx_stream_decode(&a->rx, NULL);
+
+		return;
+	}
+
+	rx->seq       = hdr->seq;
+	rx->seq_valid = true;
 
 	/* Telephone event? */
 	if (hdr->pt != rx->pt) {
@@ -651,7 +675,6 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 			return;
 	}
 
- out:
 	(void)aurx_stream_decode(&a->rx, mb);
 }
 
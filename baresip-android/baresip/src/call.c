@@ -548,6 +548,9 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	if (err)
 		goto out;
 
+	/* re-INVITEs mostly re-send unchanged media sections */
+	sdp_session_set_encode_cache(call->sdp, true);
+
 	err = sdp_session_set_lattr(call->sdp, true,
 				    "tool", "baresip " BARESIP_VERSION);
 	if (err)
@@ -421,6 +421,9 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 #endif
 #ifdef HAVE_KQUEUE
 				", kqueue .."
+#endif
+#ifdef HAVE_IO_URING
+				", io_uring .."
 #endif
 				"\n"
 			  "\n# SIP\n"
@@ -627,6 +630,7 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "module\t\t\t" MOD_PRE "vumeter" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "sndfile" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "speex_aec" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "aec" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "speex_pp" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" MOD_PRE "plc" MOD_EXT "\n");
 
@@ -780,6 +784,9 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "\n# Opus codec parameters\n");
 	(void)re_fprintf(f, "opus_bitrate\t\t28000 # 6000-510000\n");
 
+	(void)re_fprintf(f, "\n# Echo canceller\n");
+	(void)re_fprintf(f, "#aec_tail\t\t128 # Echo tail length in [ms]\n");
+
 	(void)re_fprintf(f,
 			"\n# Selfview\n"
 			"video_selfview\t\twindow # {window,pip}\n"
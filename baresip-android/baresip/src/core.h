@@ -128,7 +128,6 @@ int  audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		       int pt_tx, const char *params);
 int  audio_decoder_set(struct audio *a, const struct aucodec *ac,
 		       int pt_rx, const char *params);
-struct stream *audio_strm(const struct audio *a);
 int  audio_send_digit(struct audio *a, char key);
 void audio_sdp_attr_decode(struct audio *a);
 int  audio_print_rtpstat(struct re_printf *pf, const struct audio *au);
@@ -367,6 +366,10 @@ struct stream {
 	uint64_t ts_last;        /**< Timestamp of last received RTP pkt    */
 	bool terminated;         /**< Stream is terminated flag             */
 	uint32_t rtp_timeout_ms; /**< RTP Timeout value in [ms]             */
+	struct stream *relay;    /**< Peer stream for RTP pass-through      */
+	uint32_t relay_ts;       /**< Timestamp offset for relayed RTP      */
+	int relay_pt_in;         /**< Last relayed incoming payload type    */
+	int relay_pt_out;        /**< Payload type of relay_pt_in on peer   */
 };
 
 int  stream_alloc(struct stream **sp, const struct config_avt *cfg,
@@ -459,7 +462,6 @@ int  video_encoder_set(struct video *v, struct vidcodec *vc,
 		       int pt_tx, const char *params);
 int  video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 		       const char *fmtp);
-struct stream *video_strm(const struct video *v);
 void video_update_picture(struct video *v);
 void video_sdp_attr_decode(struct video *v);
 int  video_print(struct re_printf *pf, const struct video *v);
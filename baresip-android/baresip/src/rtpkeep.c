@@ -27,10 +27,9 @@ enum {
 struct rtpkeep {
 	struct rtp_sock *rtp;
 	struct sdp_media *sdp;
-	struct tmr tmr;
+	struct kalive ka;
 	char *method;
 	uint32_t ts;
-	bool flag;
 };
 
 
@@ -38,7 +37,7 @@ static void destructor(void *arg)
 {
 	struct rtpkeep *rk = arg;
 
-	tmr_cancel(&rk->tmr);
+	kalive_cancel(&rk->ka);
 	mem_deref(rk->method);
 }
 
@@ -96,11 +95,11 @@ static int send_keepalive(struct rtpkeep *rk)
 /**
  * Logic:
  *
- * We check for RTP activity every 15 seconds, and clear the flag.
- * The flag is set for every transmitted RTP packet. If the flag
- * is not set, it means that we have not sent any RTP packet in the
- * last period of 0 - 15 seconds. Start transmitting RTP keepalives
- * now and every 15 seconds after that.
+ * Every transmitted RTP packet is recorded as activity on the keepalive
+ * timer, which postpones the keepalive until no RTP packet was sent for
+ * 15 seconds. Then start transmitting RTP keepalives every 15 seconds.
+ * The keepalive timers of all streams share the buckets of the
+ * keepalive scheduler, and their packets are sent in batches.
  *
  * @param arg Handler argument
  */
@@ -109,11 +108,9 @@ static void timeout(void *arg)
 	struct rtpkeep *rk = arg;
 	int err;
 
-	tmr_start(&rk->tmr, Tr_UDP * 1000, timeout, rk);
-
-	if (rk->flag) {
-		rk->flag = false;
-		return;
+	err = kalive_start(&rk->ka, Tr_UDP * 1000, timeout, rk);
+	if (err) {
+		warning("rtpkeep: start keepalive timer failed: %m\n", err);
 	}
 
 	err = send_keepalive(rk);
@@ -143,7 +140,9 @@ int rtpkeep_alloc(struct rtpkeep **rkp, const char *method, int proto,
 	if (err)
 		goto out;
 
-	tmr_start(&rk->tmr, 20, timeout, rk);
+	kalive_init(&rk->ka, Tr_UDP * 1000);
+
+	err = kalive_start(&rk->ka, 20, timeout, rk);
 
  out:
 	if (err)
@@ -161,5 +160,5 @@ void rtpkeep_refresh(struct rtpkeep *rk, uint32_t ts)
 		return;
 
 	rk->ts = ts;
-	rk->flag = true;
+	kalive_activity(&rk->ka);
 }
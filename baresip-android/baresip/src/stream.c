@@ -12,7 +12,8 @@
 
 enum {
 	RTP_RECV_SIZE = 8192,
-	RTP_CHECK_INTERVAL = 1000  /* how often to check for RTP [ms] */
+	RTP_CHECK_INTERVAL = 1000, /* how often to check for RTP [ms] */
+	RELAY_MAX_GAP = 100        /* max. seq numbers skipped per loss */
 };
 
 
@@ -135,6 +136,8 @@ static void stream_destructor(void *arg)
 	metric_reset(&s->metric_tx);
 	metric_reset(&s->metric_rx);
 
+	stream_set_relay(s, NULL);
+
 	tmr_cancel(&s->tmr_rtp);
 	list_unlink(&s->le);
 	mem_deref(s->rtpkeep);
@@ -148,6 +151,67 @@ static void stream_destructor(void *arg)
 }
 
 
+/* Payload type used by the peer for an incoming payload type */
+static int relay_pt(struct stream *s, uint8_t pt)
+{
+	const struct sdp_format *lf, *rf;
+
+	if (pt == s->relay_pt_in)
+		return s->relay_pt_out;
+
+	lf = sdp_media_lformat(s->sdp, pt);
+	if (!lf)
+		return -1;
+
+	rf = sdp_media_format(s->relay->sdp, false, NULL, -1,
+			      lf->name, lf->srate, lf->ch);
+
+	s->relay_pt_in  = pt;
+	s->relay_pt_out = rf ? rf->pt : -1;
+
+	return s->relay_pt_out;
+}
+
+
+/*
+ * Forward an RTP packet to the peer stream without decoding it.
+ * The peer's RTP socket stamps its own SSRC and sequence number,
+ * so the RTCP sender reports of each leg stay consistent.
+ */
+static void relay_recv(struct stream *s, const struct rtp_header *hdr,
+		       struct mbuf *mb, bool flush)
+{
+	struct stream *peer = s->relay;
+	int lostc, pt, err;
+
+	lostc = lostcalc(s, hdr->seq);
+	if (lostc < 0)
+		return;
+
+	if (!sa_isset(sdp_media_raddr(peer->sdp), SA_ALL))
+		return;
+	if (sdp_media_dir(peer->sdp) != SDP_SENDRECV)
+		return;
+
+	pt = relay_pt(s, hdr->pt);
+	if (pt < 0) {
+		s->metric_rx.n_err++;
+		return;
+	}
+
+	/* consume sequence numbers on the peer, so that loss stays visible */
+	if (lostc > 0)
+		rtp_seq_skip(peer->rtp, min(lostc, RELAY_MAX_GAP));
+
+	metric_add_packet(&peer->metric_tx, mbuf_get_left(mb));
+
+	err = rtp_send(peer->rtp, sdp_media_raddr(peer->sdp),
+		       hdr->m || flush, pt, hdr->ts + s->relay_ts, mb);
+	if (err)
+		peer->metric_tx.n_err++;
+}
+
+
 static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 		     struct mbuf *mb, void *arg)
 {
@@ -176,6 +240,11 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 		s->ssrc_rx = hdr->ssrc;
 	}
 
+	if (s->relay) {
+		relay_recv(s, hdr, mb, flush);
+		return;
+	}
+
 	if (s->jbuf) {
 
 		struct rtp_header hdr2;
@@ -204,7 +273,7 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 		s->jbuf_started = true;
 
 		if (lostcalc(s, hdr2.seq) > 0)
-			s->rtph(hdr, NULL, s->arg);
+			s->rtph(&hdr2, NULL, s->arg);
 
 		s->rtph(&hdr2, mb2, s->arg);
 
@@ -236,6 +305,18 @@ static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 			call_set_xrtpstat(s->call);
 
 		break;
+
+	case RTCP_FIR:
+		/* Reports are terminated per leg, only
+		   requests for a new picture cross the relay */
+		if (s->relay)
+			stream_send_fir(s->relay, false);
+		break;
+
+	case RTCP_PSFB:
+		if (s->relay && msg->hdr.count == RTCP_PSFB_PLI)
+			stream_send_fir(s->relay, true);
+		break;
 	}
 }
 
@@ -375,6 +456,7 @@ int stream_alloc(struct stream **sp, const struct config_avt *cfg,
 		goto out;
 
 	s->pt_enc = -1;
+	s->relay_pt_in = -1;
 
 	metric_init(&s->metric_tx);
 	metric_init(&s->metric_rx);
@@ -432,6 +514,10 @@ int stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 	if (sdp_media_dir(s->sdp) != SDP_SENDRECV)
 		return 0;
 
+	/* the peer stream is the only source while relaying */
+	if (s->relay)
+		return 0;
+
 	metric_add_packet(&s->metric_tx, mbuf_get_left(mb));
 
 	if (pt < 0)
@@ -450,6 +536,27 @@ int stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 }
 
 
+static bool relay_match(const struct stream *s1, const struct stream *s2)
+{
+	const struct sdp_format *f1, *f2;
+
+	f1 = sdp_media_rformat(s1->sdp, NULL);
+	f2 = sdp_media_rformat(s2->sdp, NULL);
+	if (!f1 || !f2)
+		return false;
+
+	if (str_casecmp(f1->name, f2->name))
+		return false;
+	if (f1->srate != f2->srate || f1->ch != f2->ch)
+		return false;
+
+	if (f1->cmph)
+		return f1->cmph(f1->rparams, f2->rparams, f1->data);
+
+	return true;
+}
+
+
 static void stream_remote_set(struct stream *s)
 {
 	struct sa rtcp;
@@ -487,6 +594,19 @@ void stream_update(struct stream *s)
 
 	s->pt_enc = fmt ? fmt->pt : -1;
 
+	/* payload types may have been renumbered */
+	s->relay_pt_in = -1;
+	if (s->relay) {
+
+		s->relay->relay_pt_in = -1;
+
+		if (!relay_match(s, s->relay)) {
+			info("stream: %s: codec changed, stopping relay\n",
+			     sdp_media_name(s->sdp));
+			stream_set_relay(s, NULL);
+		}
+	}
+
 	if (sdp_media_has_media(s->sdp))
 		stream_remote_set(s);
 
@@ -660,3 +780,64 @@ int stream_print(struct re_printf *pf, const struct stream *s)
 			  s->metric_tx.cur_bitrate,
 			  s->metric_rx.cur_bitrate);
 }
+
+
+/**
+ * Relay RTP between two streams without decoding it
+ *
+ * Both streams must have negotiated the same codec. Packets received on
+ * one stream are sent on the other with that stream's SSRC, sequence
+ * numbers and payload type. Local media is not sent while relaying.
+ *
+ * @param s    Media stream
+ * @param peer Peer media stream, or NULL to stop relaying
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_set_relay(struct stream *s, struct stream *peer)
+{
+	if (!s || s == peer)
+		return EINVAL;
+
+	if (peer && !relay_match(s, peer))
+		return ENOTSUP;
+
+	/* both sides resume with an empty jitter buffer */
+	if (s->relay) {
+		jbuf_flush(s->relay->jbuf);
+		s->relay->relay = NULL;
+		s->relay = NULL;
+	}
+
+	jbuf_flush(s->jbuf);
+
+	if (!peer)
+		return 0;
+
+	stream_set_relay(peer, NULL);
+
+	s->relay    = peer;
+	peer->relay = s;
+
+	s->relay_ts    = rand_u32();
+	peer->relay_ts = rand_u32();
+	s->relay_pt_in = peer->relay_pt_in = -1;
+
+	info("stream: %s: relaying RTP (%s)\n", sdp_media_name(s->sdp),
+	     sdp_media_rformat(s->sdp, NULL)->name);
+
+	return 0;
+}
+
+
+/**
+ * Check if a media stream is relaying RTP to a peer stream
+ *
+ * @param s Media stream
+ *
+ * @return True if relaying, otherwise false
+ */
+bool stream_is_relayed(const struct stream *s)
+{
+	return s ? s->relay != NULL : false;
+}
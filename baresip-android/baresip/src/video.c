@@ -35,6 +35,9 @@ enum {
 	BURST_MAX       = 8192,                /**< in bytes            */
 	RTP_PRESZ       = 4 + RTP_HEADER_SIZE, /**< TURN and RTP header */
 	RTP_TRAILSZ     = 12 + 4,              /**< SRTP/SRTCP trailer  */
+	PKT_SIZE        = 1024,                /**< Encoder packet size */
+	PKT_HDRSZ       = 64,                  /**< Payload header room */
+	SENDQ_MIN       = 64,                  /**< in packets          */
 	PICUP_INTERVAL  = 500,
 };
 
@@ -93,7 +96,7 @@ struct vtx {
 	struct vidframe *frame;            /**< Source frame              */
 	struct vidframe *mute_frame;       /**< Frame with muted video    */
 	struct lock *lock_tx;              /**< Protect the sendq         */
-	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
+	struct vidqueue *sendq;            /**< Tx-Queue (struct vidqent) */
 	struct tmr tmr_rtp;                /**< Timer for sending RTP     */
 	unsigned skipc;                    /**< Number of frames skipped  */
 	struct list filtl;                 /**< Filters in encoding order */
@@ -160,28 +163,99 @@ struct video {
 
 
 struct vidqent {
-	struct le le;
-	struct sa dst;
 	bool marker;
 	uint8_t pt;
 	uint32_t ts;
 	struct mbuf *mb;
 };
 
+/**
+ * Ring of outgoing RTP packets, paced out by the RTP timer. The packet
+ * buffers are allocated up front and reused, and the ring only grows
+ * if an encoded frame does not fit into it.
+ */
+struct vidqueue {
+	struct vidqent *entv;
+	size_t sz;
+	size_t head;
+	size_t n;
+};
+
 
 static void request_picture_update(struct vrx *vrx);
 
 
-static void vidqent_destructor(void *arg)
+static void vidqueue_destructor(void *arg)
 {
-	struct vidqent *qent = arg;
+	struct vidqueue *q = arg;
+	size_t i;
+
+	for (i=0; i<q->sz; i++)
+		mem_deref(q->entv[i].mb);
 
-	list_unlink(&qent->le);
-	mem_deref(qent->mb);
+	mem_deref(q->entv);
 }
 
 
-static int vidqent_alloc(struct vidqent **qentp,
+/* Resize the ring to sz entries, keeping the queued packets in order */
+static int vidqueue_resize(struct vidqueue *q, size_t sz)
+{
+	struct vidqent *entv;
+	size_t i;
+
+	entv = mem_zalloc(sz * sizeof(*entv), NULL);
+	if (!entv)
+		return ENOMEM;
+
+	for (i=0; i<sz; i++) {
+
+		if (i < q->sz) {
+			entv[i] = q->entv[(q->head + i) % q->sz];
+			continue;
+		}
+
+		entv[i].mb = mbuf_alloc(RTP_PRESZ + PKT_HDRSZ + PKT_SIZE +
+					RTP_TRAILSZ);
+		if (!entv[i].mb) {
+
+			while (i-- > q->sz)
+				mem_deref(entv[i].mb);
+
+			mem_deref(entv);
+			return ENOMEM;
+		}
+	}
+
+	mem_deref(q->entv);
+
+	q->entv = entv;
+	q->sz   = sz;
+	q->head = 0;
+
+	return 0;
+}
+
+
+static int vidqueue_alloc(struct vidqueue **qp, size_t sz)
+{
+	struct vidqueue *q;
+	int err;
+
+	q = mem_zalloc(sizeof(*q), vidqueue_destructor);
+	if (!q)
+		return ENOMEM;
+
+	err = vidqueue_resize(q, sz);
+	if (err)
+		mem_deref(q);
+	else
+		*qp = q;
+
+	return err;
+}
+
+
+static int vidqueue_push(struct vidqueue *q,
 			 bool marker, uint8_t pt, uint32_t ts,
 			 const uint8_t *hdr, size_t hdr_len,
 			 const uint8_t *pld, size_t pld_len)
@@ -189,55 +263,52 @@ static int vidqent_alloc(struct vidqent **qentp,
 	struct vidqent *qent;
 	int err = 0;
 
-	if (!qentp || !pld)
+	if (!q || !pld)
 		return EINVAL;
 
-	qent = mem_zalloc(sizeof(*qent), vidqent_destructor);
-	if (!qent)
-		return ENOMEM;
+	if (q->n == q->sz) {
+		err = vidqueue_resize(q, 2 * q->sz);
+		if (err)
+			return err;
+
+		debug("video: send queue grown to %zu packets\n", q->sz);
+	}
+
+	qent = &q->entv[(q->head + q->n) % q->sz];
 
 	qent->marker = marker;
 	qent->pt     = pt;
 	qent->ts     = ts;
 
-	qent->mb = mbuf_alloc(RTP_PRESZ + hdr_len + pld_len + RTP_TRAILSZ);
-	if (!qent->mb) {
-		err = ENOMEM;
-		goto out;
-	}
-
 	qent->mb->pos = qent->mb->end = RTP_PRESZ;
 
 	if (hdr)
-		(void)mbuf_write_mem(qent->mb, hdr, hdr_len);
+		err |= mbuf_write_mem(qent->mb, hdr, hdr_len);
 
-	(void)mbuf_write_mem(qent->mb, pld, pld_len);
+	err |= mbuf_write_mem(qent->mb, pld, pld_len);
+	if (err)
+		return err;
 
 	qent->mb->pos = RTP_PRESZ;
+	++q->n;
 
- out:
-	if (err)
-		mem_deref(qent);
-	else
-		*qentp = qent;
-
-	return err;
+	return 0;
 }
 
 
 static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 {
+	struct vidqueue *q;
 	size_t burst, sent;
 	uint64_t bandwidth_kbps;
-	struct le *le;
 
 	if (!vtx)
 		return;
 
 	lock_write_get(vtx->lock_tx);
 
-	le = vtx->sendq.head;
-	if (!le)
+	q = vtx->sendq;
+	if (!q->n)
 		goto out;
 
 	/*
@@ -249,17 +320,17 @@ static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 	burst = min(burst, BURST_MAX);
 	sent  = 0;
 
-	while (le) {
+	while (q->n) {
 
-		struct vidqent *qent = le->data;
+		struct vidqent *qent = &q->entv[q->head];
 
 		sent += mbuf_get_left(qent->mb);
 
 		stream_send(vtx->video->strm, qent->marker, qent->pt,
 			    qent->ts, qent->mb);
 
-		le = le->next;
-		mem_deref(qent);
+		q->head = (q->head + 1) % q->sz;
+		--q->n;
 
 		if (sent > burst) {
 			break;
@@ -290,12 +361,7 @@ static void video_destructor(void *arg)
 	struct vtx *vtx = &v->vtx;
 	struct vrx *vrx = &v->vrx;
 
-	/* transmit */
-	lock_write_get(vtx->lock_tx);
-	list_flush(&vtx->sendq);
-	lock_rel(vtx->lock_tx);
-	mem_deref(vtx->lock_tx);
-
+	/* transmit, the send queue is used until the source is stopped */
 	tmr_cancel(&vtx->tmr_rtp);
 	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock);
@@ -306,6 +372,11 @@ static void video_destructor(void *arg)
 	lock_rel(vtx->lock);
 	mem_deref(vtx->lock);
 
+	lock_write_get(vtx->lock_tx);
+	vtx->sendq = mem_deref(vtx->sendq);
+	lock_rel(vtx->lock_tx);
+	mem_deref(vtx->lock_tx);
+
 	/* receive */
 	tmr_cancel(&vrx->tmr_picup);
 	lock_write_get(vrx->lock);
@@ -342,23 +413,29 @@ static int packet_handler(bool marker, const uint8_t *hdr, size_t hdr_len,
 {
 	struct vtx *vtx = arg;
 	struct stream *strm = vtx->video->strm;
-	struct vidqent *qent;
 	int err;
 
-	err = vidqent_alloc(&qent, marker, strm->pt_enc, vtx->ts_tx,
-			    hdr, hdr_len, pld, pld_len);
-	if (err)
-		return err;
-
 	lock_write_get(vtx->lock_tx);
-	qent->dst = *sdp_media_raddr(strm->sdp);
-	list_append(&vtx->sendq, &qent->le, qent);
+	err = vidqueue_push(vtx->sendq, marker, strm->pt_enc, vtx->ts_tx,
+			    hdr, hdr_len, pld, pld_len);
 	lock_rel(vtx->lock_tx);
 
 	return err;
 }
 
 
+/*
+ * Frames are passed to the encoder as captured, without conversion,
+ * if it takes their pixel format natively and no video-filter has to
+ * see them.
+ */
+static bool enc_native(const struct vtx *vtx, enum vidfmt fmt)
+{
+	return vtx->vc && (vtx->vc->encfmts & (1u << fmt)) &&
+		!vtx->filtl.head;
+}
+
+
 /**
  * Encode video and send via RTP stream
  *
@@ -377,7 +454,7 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame)
 		return;
 
 	lock_write_get(vtx->lock_tx);
-	sendq_empty = (vtx->sendq.head == NULL);
+	sendq_empty = (vtx->sendq->n == 0);
 	lock_rel(vtx->lock_tx);
 
 	if (!sendq_empty) {
@@ -388,7 +465,8 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame)
 	lock_write_get(vtx->lock);
 
 	/* Convert image */
-	if (frame->fmt != VIDENC_INTERNAL_FMT) {
+	if (frame->fmt != VIDENC_INTERNAL_FMT &&
+	    !enc_native(vtx, frame->fmt)) {
 
 		vtx->vsrc_size = frame->size;
 
@@ -443,6 +521,10 @@ static void vidsrc_frame_handler(struct vidframe *frame, void *arg)
 
 	++vtx->frames;
 
+	/* RTP is relayed from the peer stream, no need to encode */
+	if (stream_is_relayed(vtx->video->strm))
+		return;
+
 	/* Is the video muted? If so insert video mute image */
 	if (vtx->muted)
 		frame = vtx->mute_frame;
@@ -468,6 +550,7 @@ static void vidsrc_error_handler(int err, void *arg)
 
 static int vtx_alloc(struct vtx *vtx, struct video *video)
 {
+	size_t qsz;
 	int err;
 
 	err = lock_alloc(&vtx->lock);
@@ -475,6 +558,13 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	if (err)
 		return err;
 
+	/* room for a key-frame of half a second at the configured bitrate */
+	qsz = max(video->cfg.bitrate / 8 / PKT_SIZE / 2, SENDQ_MIN);
+
+	err = vidqueue_alloc(&vtx->sendq, qsz);
+	if (err)
+		return err;
+
 	tmr_init(&vtx->tmr_rtp);
 
 	vtx->video = video;
@@ -1108,7 +1198,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		struct videnc_param prm;
 
 		prm.bitrate = v->cfg.bitrate;
-		prm.pktsize = 1024;
+		prm.pktsize = PKT_SIZE;
 		prm.fps     = get_fps(v);
 		prm.max_fs  = -1;
 
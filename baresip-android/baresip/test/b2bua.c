@@ -0,0 +1,346 @@
+/**
+ * @file test/b2bua.c  Baresip selftest -- back-to-back user agent
+ *
+ * Copyright (C) 2010 - 2016 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define MAGIC 0xb2b0a000
+#define PRM ";regint=0;ptime=1"
+
+
+/*
+ * A calls D through a B2BUA, which answers on B and calls out on C.
+ * Like the b2bua module, the B2BUA relays the RTP of the two legs once
+ * the inbound leg is established.
+ *
+ *   A ----> B [b2bua] C ----> D
+ */
+
+enum {
+	NUM_SESSIONS = 2,
+	NUM_DIGITS   = 2,
+};
+
+struct leg {
+	struct fixture *fix;
+	struct call *call;
+	char rxv[NUM_DIGITS + 1];
+	size_t rxc;
+	const char *txv;
+};
+
+struct session {
+	struct leg in, out;  /* B2BUA legs, facing A and D */
+};
+
+struct fixture {
+	uint32_t magic;
+	struct ua *ua_a, *ua_b, *ua_c, *ua_d;
+	struct leg legv_a[NUM_SESSIONS];
+	struct leg legv_d[NUM_SESSIONS];
+	struct session sessv[NUM_SESSIONS];
+	unsigned n_d, n_sess;
+	unsigned n_relay;
+	unsigned n_dtmf;
+	char duri[256];
+	int err;
+};
+
+
+/* digits sent by the callers and by the callees */
+static const char *digitv_a[NUM_SESSIONS] = {"12", "34"};
+static const char *digitv_d[NUM_SESSIONS] = {"56", "78"};
+
+
+#define fixture_abort(f, error)			\
+	do {					\
+		(f)->err = (error);		\
+		re_cancel();			\
+	} while (0)
+
+
+static struct session *session_find(struct fixture *f,
+				    const struct call *call)
+{
+	unsigned i;
+
+	for (i=0; i<f->n_sess; i++) {
+
+		struct session *sess = &f->sessv[i];
+
+		if (sess->in.call == call || sess->out.call == call)
+			return sess;
+	}
+
+	return NULL;
+}
+
+
+static int session_alloc(struct fixture *f, struct call *call)
+{
+	struct session *sess;
+
+	if (f->n_sess >= NUM_SESSIONS)
+		return EOVERFLOW;
+
+	sess = &f->sessv[f->n_sess++];
+
+	sess->in.fix  = f;
+	sess->in.call = call;
+	sess->out.fix = f;
+
+	return ua_connect(f->ua_c, &sess->out.call, NULL, f->duri, NULL,
+			  VIDMODE_OFF);
+}
+
+
+static void event_handler(struct ua *ua, enum ua_event ev,
+			  struct call *call, const char *prm, void *arg)
+{
+	struct fixture *f = arg;
+	struct session *sess;
+	int err = 0;
+	(void)prm;
+
+	ASSERT_TRUE(f != NULL);
+	ASSERT_EQ(MAGIC, f->magic);
+
+	switch (ev) {
+
+	case UA_EVENT_CALL_INCOMING:
+		if (ua == f->ua_b) {
+			err = session_alloc(f, call);
+			TEST_ERR(err);
+		}
+		else if (ua == f->ua_d) {
+			ASSERT_TRUE(f->n_d < NUM_SESSIONS);
+			f->legv_d[f->n_d++].call = call;
+
+			err = ua_answer(ua, call);
+			TEST_ERR(err);
+		}
+		break;
+
+	case UA_EVENT_CALL_ESTABLISHED:
+		sess = session_find(f, call);
+		if (!sess)
+			break;
+
+		/* the outbound leg is up, answer the inbound leg */
+		if (call == sess->out.call) {
+			err = ua_answer(f->ua_b, sess->in.call);
+			TEST_ERR(err);
+			break;
+		}
+
+		err = stream_set_relay(audio_strm(call_audio(sess->in.call)),
+				       audio_strm(call_audio(sess->out.call)));
+		TEST_ERR(err);
+
+		if (++f->n_relay >= NUM_SESSIONS)
+			re_cancel();
+		break;
+
+	default:
+		break;
+	}
+
+ out:
+	if (err) {
+		warning("error in event-handler (%m)\n", err);
+		fixture_abort(f, err);
+	}
+}
+
+
+static void dtmf_handler(struct call *call, char key, void *arg)
+{
+	struct leg *leg = arg;
+	struct fixture *f = leg->fix;
+	int err = 0;
+	(void)call;
+
+	/* ignore key-release */
+	if (key == KEYCODE_REL)
+		return;
+
+	/* the B2BUA must not decode relayed audio */
+	ASSERT_TRUE(leg->txv != NULL);
+	ASSERT_TRUE(leg->rxc < NUM_DIGITS);
+
+	leg->rxv[leg->rxc++] = key;
+
+	if (++f->n_dtmf >= 2 * NUM_SESSIONS * NUM_DIGITS)
+		re_cancel();
+
+ out:
+	if (err)
+		fixture_abort(f, err);
+}
+
+
+static void leg_init(struct fixture *f, struct leg *leg, const char *txv)
+{
+	leg->fix = f;
+	leg->txv = txv;
+
+	call_set_handlers(leg->call, NULL, dtmf_handler, leg);
+}
+
+
+static int leg_send(struct leg *leg)
+{
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<NUM_DIGITS; i++)
+		err |= call_send_digit(leg->call, leg->txv[i]);
+
+	return err;
+}
+
+
+/* Find the leg that received the digits of a sender */
+static struct leg *leg_find_rx(struct leg *legv, const char *txv)
+{
+	unsigned i;
+
+	for (i=0; i<NUM_SESSIONS; i++) {
+
+		if (0 == str_cmp(legv[i].rxv, txv))
+			return &legv[i];
+	}
+
+	return NULL;
+}
+
+
+int test_b2bua_relay(void)
+{
+	struct fixture fix, *f = &fix;
+	struct ausrc *ausrc = NULL;
+	struct sa laddr;
+	struct le *le;
+	unsigned i;
+	int err = 0;
+
+	memset(f, 0, sizeof(*f));
+	f->magic = MAGIC;
+
+	err = ua_init("test", true, true, true, false);
+	TEST_ERR(err);
+
+	mock_aucodec_register();
+
+	/* audio-source is needed for dtmf/telev to work */
+	err = mock_ausrc_register(&ausrc);
+	TEST_ERR(err);
+
+	/* Use a low packet time, so the test completes quickly */
+	err  = ua_alloc(&f->ua_a, "A <sip:a:xxx@127.0.0.1>" PRM);
+	err |= ua_alloc(&f->ua_b, "B <sip:b:xxx@127.0.0.1>" PRM);
+	err |= ua_alloc(&f->ua_c, "C <sip:c:xxx@127.0.0.1>" PRM);
+	err |= ua_alloc(&f->ua_d, "D <sip:d:xxx@127.0.0.1>" PRM);
+	TEST_ERR(err);
+
+	err = uag_event_register(event_handler, f);
+	TEST_ERR(err);
+
+	err = sip_transp_laddr(uag_sip(), &laddr, SIP_TRANSP_UDP, NULL);
+	TEST_ERR(err);
+
+	re_snprintf(f->duri, sizeof(f->duri), "sip:d@%J", &laddr);
+
+	/* Make two calls from A to the B2BUA */
+	for (i=0; i<NUM_SESSIONS; i++) {
+
+		char buri[256];
+
+		re_snprintf(buri, sizeof(buri), "sip:b@%J", &laddr);
+
+		err = ua_connect(f->ua_a, &f->legv_a[i].call, NULL, buri,
+				 NULL, VIDMODE_OFF);
+		TEST_ERR(err);
+	}
+
+	/* run main-loop with timeout, wait for both relays */
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	err = f->err;
+	TEST_ERR(err);
+
+	ASSERT_EQ(NUM_SESSIONS, f->n_sess);
+	ASSERT_EQ(NUM_SESSIONS, f->n_relay);
+	ASSERT_EQ(NUM_SESSIONS, f->n_d);
+
+	for (i=0; i<NUM_SESSIONS; i++) {
+
+		struct session *sess = &f->sessv[i];
+
+		ASSERT_TRUE(stream_is_relayed(
+			    audio_strm(call_audio(sess->in.call))));
+		ASSERT_TRUE(stream_is_relayed(
+			    audio_strm(call_audio(sess->out.call))));
+
+		leg_init(f, &f->legv_a[i], digitv_a[i]);
+		leg_init(f, &f->legv_d[i], digitv_d[i]);
+		leg_init(f, &sess->in, NULL);
+		leg_init(f, &sess->out, NULL);
+	}
+
+	/* the callers are not relaying */
+	for (le = list_head(ua_calls(f->ua_a)); le; le = le->next) {
+		ASSERT_TRUE(!stream_is_relayed(
+			    audio_strm(call_audio(le->data))));
+	}
+
+	/* send DTMF digits both ways, as RTP telephone-events */
+	for (i=0; i<NUM_SESSIONS; i++) {
+
+		err  = leg_send(&f->legv_a[i]);
+		err |= leg_send(&f->legv_d[i]);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	err = f->err;
+	TEST_ERR(err);
+
+	/* each session relays the digits of its own caller and callee */
+	for (i=0; i<NUM_SESSIONS; i++) {
+
+		struct leg *leg_a = &f->legv_a[i];
+		struct leg *leg_d;
+
+		leg_d = leg_find_rx(f->legv_d, leg_a->txv);
+		ASSERT_TRUE(leg_d != NULL);
+
+		TEST_STRCMP(leg_d->txv, NUM_DIGITS, leg_a->rxv, leg_a->rxc);
+
+		ASSERT_EQ(0, f->sessv[i].in.rxc);
+		ASSERT_EQ(0, f->sessv[i].out.rxc);
+	}
+
+ out:
+	mem_deref(f->ua_d);
+	mem_deref(f->ua_c);
+	mem_deref(f->ua_b);
+	mem_deref(f->ua_a);
+
+	mock_aucodec_unregister();
+
+	uag_event_unregister(event_handler);
+
+	ua_stop_all(true);
+	ua_close();
+
+	mem_deref(ausrc);
+
+	return err;
+}
@@ -0,0 +1,1167 @@
+/**
+ * @file test/bench.c  Baresip selftest -- media pipeline benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _DEFAULT_SOURCE 1
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+/*
+ * N calls are made between two user-agents in this process, over the
+ * loopback interface. Each call runs the full media pipeline of both
+ * ends: audio and video source, encoder, RTP and SRTP, jitter buffer,
+ * decoder, and audio player or video display. The sources send a
+ * fixed test signal and the sinks discard it, so no devices are
+ * involved.
+ *
+ * The media is not paced by the wall clock. The sources and players
+ * are stepped on a virtual clock, as fast as the pipeline runs: at
+ * every step the sources that are due send a frame, the main loop is
+ * run until the packets are received and decoded, and then the
+ * players that are due take a frame. The only wait is for the pacing
+ * timer of the video sender, which sends the encoded frames; the
+ * process does not use CPU time while it waits.
+ *
+ * The video codec is the mock codec of the selftest by default. It
+ * only packetizes the frames, so a codec module has to be loaded to
+ * measure the cost of video coding.
+ *
+ * The following environment variables are used:
+ *
+ \verbatim
+  BENCH_MODULES   Codec and media encryption modules to load,
+                  default "g711.so,srtp.so"
+  BENCH_CODEC     Audio codec to use, default "PCMU"
+  BENCH_VIDCODEC  Video codec to use, or "none" for audio only,
+                  default "H266" (the mock codec)
+  BENCH_MENC      Media encryption to use, default "srtp"
+  BENCH_CALLS     Number of concurrent calls, default "1,4,16"
+  BENCH_SECONDS   Seconds of call to run, default 10
+ \endverbatim
+ *
+ * One line of JSON is printed per run, with the CPU time per second
+ * of call (both ends), how it is spent in the audio transmit path
+ * (source to network), the video transmit path (source to the send
+ * queue), the receive path (network to jitter buffer, decoder and
+ * display, signalling and timers), the playout path and the rest,
+ * the peak RSS of the process and the number of calls that one core
+ * can handle.
+ *
+ * The packet loss concealment benchmark runs the same test signal
+ * through loss traces, and compares the concealed audio with the
+ * original, for silence, repetition of the last frame and the
+ * concealment of librem. One line of JSON is printed per trace, with
+ * the R-factor and MOS of the loss rate, and for each method, over the
+ * concealed audio and its edges, the segmental SNR [dB] and the
+ * log-spectral distance [dB]. The SNR compares waveforms, and
+ * favours silence over any extrapolation that drifts in phase. The
+ * spectral distance ignores the phase, and is closer to what is heard.
+ */
+
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+enum {
+	SIGNAL_MS    = 2000,
+	SETUP_MS     = 10000,
+	WARMUP_MS    = 500,
+	SECONDS      = 10,
+	VIDEO_WAIT   = 5,     /* Send interval of the video sender [ms] */
+	PUMP_MAX     = 64,
+	PLC_SRATE    = 8000,
+	PLC_FRAME    = 160,
+	PLC_FRAMES   = 1500,
+	PLC_BINS     = PLC_FRAME / 2,
+};
+
+/* Gilbert-Elliott loss model, random loss if lost + found = 1 */
+struct loss_trace {
+	const char *name;
+	double lost;         /* Probability of loss after a good frame  */
+	double found;        /* Probability of a good frame after loss  */
+};
+
+enum plc_method {
+	PLC_SILENCE = 0,
+	PLC_REPEAT,
+	PLC_AUPLC,
+	PLC_METHODS
+};
+
+typedef void (vtmr_h)(void *arg);
+
+/* Periodic timer on the virtual clock */
+struct vtmr {
+	struct le le;
+	uint64_t next;       /* Virtual time of the next period [ms]    */
+	uint32_t period;     /* Period [ms]                             */
+	vtmr_h *th;
+	void *arg;
+};
+
+struct bench {
+	struct ua *a, *b;
+	struct sa laddr;
+	char buri[256];
+	unsigned ncalls;
+	unsigned n_estab;
+	uint64_t tx_ns;
+	uint64_t vtx_ns;
+	uint64_t rx_ns;
+	uint64_t play_ns;
+	uint64_t n_decode;   /* Audio frames decoded                    */
+	uint64_t n_display;  /* Video frames displayed                  */
+	int err;
+};
+
+struct ausrc_st {
+	const struct ausrc *as;      /* inheritance */
+
+	struct vtmr vtmr;
+	struct ausrc_prm prm;
+	int16_t *sigv;
+	size_t sigc;
+	size_t pos;
+	size_t sampc;
+	ausrc_read_h *rh;
+	void *arg;
+};
+
+struct auplay_st {
+	const struct auplay *ap;     /* inheritance */
+
+	struct vtmr vtmr;
+	struct auplay_prm prm;
+	int16_t *sampv;
+	size_t sampc;
+	auplay_write_h *wh;
+	void *arg;
+};
+
+struct vidsrc_st {
+	const struct vidsrc *vs;     /* inheritance */
+
+	struct vtmr vtmr;
+	struct vidframe *frame;
+	unsigned x;
+	vidsrc_frame_h *frameh;
+	void *arg;
+};
+
+struct vidisp_st {
+	const struct vidisp *vd;     /* inheritance */
+};
+
+
+static struct bench *cur;
+static struct list ausrcl;
+static struct list auplayl;
+static struct list vidsrcl;
+static uint64_t vnow;
+
+
+static uint64_t thread_nsec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static uint64_t process_usec(void)
+{
+	struct rusage ru;
+
+	(void)getrusage(RUSAGE_SELF, &ru);
+
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+static long peak_rss_kb(void)
+{
+	struct rusage ru;
+
+	(void)getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_maxrss;
+}
+
+
+static void vtmr_start(struct vtmr *vt, struct list *lst, uint32_t period,
+		       vtmr_h *th, void *arg)
+{
+	vt->next   = vnow;
+	vt->period = period ? period : 1;
+	vt->th     = th;
+	vt->arg    = arg;
+
+	list_append(lst, &vt->le, vt);
+}
+
+
+static uint64_t vtmr_next(const struct list *lst, uint64_t next)
+{
+	struct le *le;
+
+	for (le = list_head(lst); le; le = le->next) {
+
+		const struct vtmr *vt = le->data;
+
+		next = min(next, vt->next);
+	}
+
+	return next;
+}
+
+
+/* Run the handlers of all timers that are due, returns the count */
+static unsigned vtmr_poll(const struct list *lst)
+{
+	struct le *le = list_head(lst);
+	unsigned n = 0;
+
+	while (le) {
+
+		struct vtmr *vt = le->data;
+
+		le = le->next;
+
+		if (vt->next > vnow)
+			continue;
+
+		vt->next += vt->period;
+		vt->th(vt->arg);
+		++n;
+	}
+
+	return n;
+}
+
+
+/*
+ * Speech-like test signal: a gliding harmonic tone, switched on and
+ * off at syllable rate, plus a little noise. The same signal is
+ * generated on every run.
+ */
+static void signal_generate(int16_t *sampv, size_t n, uint32_t srate,
+			    uint8_t ch)
+{
+	uint32_t seed = 42;
+	double ph = 0;
+	size_t i;
+	uint8_t c;
+
+	for (i=0; i<n; i++) {
+
+		const double f0 = 120 + 40 * ((i / (srate / 4)) % 3);
+		const bool voiced = (i / (srate / 5)) % 3 != 2;
+		double s;
+
+		seed = seed * 1664525 + 1013904223;
+
+		ph += f0 / srate;
+		if (ph >= 1.0)
+			ph -= 1.0;
+
+		s = (double)(int32_t)seed / (1 << 22);
+
+		if (voiced)
+			s += 4000 * (ph - 0.5) * (1 - 2 * ph * ph);
+
+		for (c=0; c<ch; c++)
+			sampv[i * ch + c] = (int16_t)s;
+	}
+}
+
+
+static void src_handler(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	if (st->pos + st->sampc > st->sigc)
+		st->pos = 0;
+
+	st->rh(st->sigv + st->pos, st->sampc, st->arg);
+
+	st->pos += st->sampc;
+}
+
+
+static void ausrc_destructor(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	list_unlink(&st->vtmr.le);
+	mem_deref(st->sigv);
+}
+
+
+static int bench_ausrc_alloc(struct ausrc_st **stp, const struct ausrc *as,
+			     struct media_ctx **ctx,
+			     struct ausrc_prm *prm, const char *device,
+			     ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
+{
+	struct ausrc_st *st;
+	size_t n;
+	int err = 0;
+	(void)ctx;
+	(void)device;
+	(void)errh;
+
+	if (!stp || !as || !prm || !rh)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), ausrc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->as  = as;
+	st->prm = *prm;
+	st->rh  = rh;
+	st->arg = arg;
+
+	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
+
+	n = prm->srate * SIGNAL_MS / 1000;
+	st->sigc = n * prm->ch;
+
+	st->sigv = mem_alloc(st->sigc * sizeof(*st->sigv), NULL);
+	if (!st->sigv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	signal_generate(st->sigv, n, prm->srate, prm->ch);
+
+	vtmr_start(&st->vtmr, &ausrcl, prm->ptime, src_handler, st);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+static void play_handler(void *arg)
+{
+	struct auplay_st *st = arg;
+
+	st->wh(st->sampv, st->sampc, st->arg);
+}
+
+
+static void auplay_destructor(void *arg)
+{
+	struct auplay_st *st = arg;
+
+	list_unlink(&st->vtmr.le);
+	mem_deref(st->sampv);
+}
+
+
+static int bench_auplay_alloc(struct auplay_st **stp, const struct auplay *ap,
+			      struct auplay_prm *prm, const char *device,
+			      auplay_write_h *wh, void *arg)
+{
+	struct auplay_st *st;
+	int err = 0;
+	(void)device;
+
+	if (!stp || !ap || !prm || !wh)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), auplay_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->ap  = ap;
+	st->prm = *prm;
+	st->wh  = wh;
+	st->arg = arg;
+
+	st->sampc = prm->srate * prm->ch * prm->ptime / 1000;
+
+	st->sampv = mem_zalloc(st->sampc * sizeof(*st->sampv), NULL);
+	if (!st->sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	vtmr_start(&st->vtmr, &auplayl, prm->ptime, play_handler, st);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+/* Counts the decoded audio frames, to see when the receive path is idle */
+static int decode_update(struct aufilt_dec_st **stp, void **ctx,
+			 const struct aufilt *af, struct aufilt_prm *prm)
+{
+	struct aufilt_dec_st *st;
+	(void)ctx;
+	(void)prm;
+
+	if (!stp || !af)
+		return EINVAL;
+
+	if (*stp)
+		return 0;
+
+	st = mem_zalloc(sizeof(*st), NULL);
+	if (!st)
+		return ENOMEM;
+
+	*stp = st;
+
+	return 0;
+}
+
+
+static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
+{
+	(void)st;
+	(void)sampv;
+	(void)sampc;
+
+	if (cur)
+		++cur->n_decode;
+
+	return 0;
+}
+
+
+static struct aufilt bench_aufilt = {
+	LE_INIT, "bench", NULL, NULL, decode_update, decode
+};
+
+
+#ifdef USE_VIDEO
+static void vidsrc_handler(void *arg)
+{
+	struct vidsrc_st *st = arg;
+
+	/* a moving line, so that the frames differ */
+	vidframe_draw_vline(st->frame, st->x, 0, st->frame->size.h,
+			    st->x, 255 - st->x, 128);
+
+	st->x = (st->x + 1) % st->frame->size.w;
+
+	st->frameh(st->frame, st->arg);
+}
+
+
+static void vidsrc_destructor(void *arg)
+{
+	struct vidsrc_st *st = arg;
+
+	list_unlink(&st->vtmr.le);
+	mem_deref(st->frame);
+}
+
+
+static int bench_vidsrc_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
+			      struct media_ctx **ctx, struct vidsrc_prm *prm,
+			      const struct vidsz *size, const char *fmt,
+			      const char *dev, vidsrc_frame_h *frameh,
+			      vidsrc_error_h *errorh, void *arg)
+{
+	struct vidsrc_st *st;
+	int err;
+	(void)ctx;
+	(void)fmt;
+	(void)dev;
+	(void)errorh;
+
+	if (!stp || !prm || !size || !frameh || prm->fps <= 0)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), vidsrc_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->vs     = vs;
+	st->frameh = frameh;
+	st->arg    = arg;
+
+	err = vidframe_alloc(&st->frame, VID_FMT_YUV420P, size);
+	if (err)
+		goto out;
+
+	vidframe_fill(st->frame, 64, 128, 192);
+
+	vtmr_start(&st->vtmr, &vidsrcl, 1000 / prm->fps, vidsrc_handler, st);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+static int bench_vidisp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
+			      struct vidisp_prm *prm, const char *dev,
+			      vidisp_resize_h *resizeh, void *arg)
+{
+	struct vidisp_st *st;
+	(void)prm;
+	(void)dev;
+	(void)resizeh;
+	(void)arg;
+
+	if (!stp || !vd)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), NULL);
+	if (!st)
+		return ENOMEM;
+
+	st->vd = vd;
+
+	*stp = st;
+
+	return 0;
+}
+
+
+static int bench_display(struct vidisp_st *st, const char *title,
+			 const struct vidframe *frame)
+{
+	(void)st;
+	(void)title;
+	(void)frame;
+
+	if (cur)
+		++cur->n_display;
+
+	return 0;
+}
+#endif
+
+
+static void event_handler(struct ua *ua, enum ua_event ev,
+			  struct call *call, const char *prm, void *arg)
+{
+	struct bench *b = arg;
+	int err;
+
+	switch (ev) {
+
+	case UA_EVENT_CALL_INCOMING:
+		if (ua != b->b)
+			break;
+
+		err = ua_answer(ua, call);
+		if (err) {
+			warning("bench: ua_answer failed (%m)\n", err);
+			b->err = err;
+			re_cancel();
+		}
+		break;
+
+	case UA_EVENT_CALL_ESTABLISHED:
+		if (++b->n_estab == 2 * b->ncalls)
+			re_cancel();
+		break;
+
+	case UA_EVENT_CALL_CLOSED:
+		warning("bench: call closed (%s)\n", prm);
+		b->err = EPROTO;
+		re_cancel();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static void stop_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+/* Run the main loop for a fixed time */
+static void run_for(uint32_t ms)
+{
+	struct tmr tmr;
+
+	tmr_init(&tmr);
+	tmr_start(&tmr, ms, stop_handler, NULL);
+
+	(void)re_main(NULL);
+
+	tmr_cancel(&tmr);
+}
+
+
+/*
+ * Run the main loop until the packets that were sent are received.
+ * One packet per socket is read in a pass, so it is run until a pass
+ * does not decode anything.
+ */
+static void pump(struct bench *b)
+{
+	unsigned i;
+
+	for (i=0; i<PUMP_MAX; i++) {
+
+		const uint64_t n = b->n_decode + b->n_display;
+
+		run_for(0);
+
+		if (b->n_decode + b->n_display == n)
+			break;
+	}
+}
+
+
+/* Advance the virtual clock to the next period of a source or player */
+static void bench_step(struct bench *b)
+{
+	uint64_t t0;
+	unsigned nvid;
+
+	vnow = vtmr_next(&auplayl, vtmr_next(&vidsrcl,
+					     vtmr_next(&ausrcl, (uint64_t)-1)));
+
+	t0 = thread_nsec();
+	(void)vtmr_poll(&ausrcl);
+	b->tx_ns += thread_nsec() - t0;
+
+	t0 = thread_nsec();
+	nvid = vtmr_poll(&vidsrcl);
+	b->vtx_ns += thread_nsec() - t0;
+
+	t0 = thread_nsec();
+
+	/* the video frames are sent from the send queue by a timer */
+	if (nvid)
+		run_for(VIDEO_WAIT);
+
+	pump(b);
+	b->rx_ns += thread_nsec() - t0;
+
+	t0 = thread_nsec();
+	(void)vtmr_poll(&auplayl);
+	b->play_ns += thread_nsec() - t0;
+}
+
+
+/* Run the calls for a time on the virtual clock */
+static void bench_steps(struct bench *b, uint32_t ms)
+{
+	const uint64_t end = vnow + ms;
+
+	while (vnow < end && !b->err)
+		bench_step(b);
+}
+
+
+static const char *env_str(const char *name, const char *def)
+{
+	const char *val = getenv(name);
+
+	return str_isset(val) ? val : def;
+}
+
+
+static int bench_modules_load(void)
+{
+	struct pl val, mod;
+	char name[64];
+	int err;
+
+	pl_set_str(&val, env_str("BENCH_MODULES", "g711.so,srtp.so"));
+
+	while (0 == re_regex(val.p, val.l, "[ ,]*[^ ,]+", NULL, &mod)) {
+
+		pl_advance(&val, mod.p + mod.l - val.p);
+
+		(void)pl_strcpy(&mod, name, sizeof(name));
+
+		err = module_preload(name);
+		if (err) {
+			warning("bench: could not load module '%s' (%m)\n",
+				name, err);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+
+static int bench_run(unsigned ncalls, uint32_t seconds, const char *codec,
+		     const char *vidcodec, const char *menc)
+{
+	struct bench b;
+	char aor[256];
+	uint64_t t0, cpu, tx, vtx, rx, play, other;
+	double call_sec;
+	unsigned i;
+	int err;
+
+	memset(&b, 0, sizeof(b));
+	b.ncalls = ncalls;
+
+	err = ua_init("bench", true, false, false, false);
+	if (err)
+		return err;
+
+	err = uag_event_register(event_handler, &b);
+	if (err)
+		goto out;
+
+	for (i=0; i<2; i++) {
+
+		const char *user = i ? "b" : "a";
+
+		re_snprintf(aor, sizeof(aor), "<sip:%s:xxx@127.0.0.1>;regint=0"
+			    ";audio_codecs=%s%s%s%s%s", user, codec,
+			    *vidcodec ? ";video_codecs=" : "", vidcodec,
+			    str_isset(menc) ? ";mediaenc=" : "", menc);
+
+		err = ua_alloc(i ? &b.b : &b.a, aor);
+		if (err)
+			goto out;
+	}
+
+	err = sip_transp_laddr(uag_sip(), &b.laddr, SIP_TRANSP_UDP, NULL);
+	if (err)
+		goto out;
+
+	re_snprintf(b.buri, sizeof(b.buri), "sip:b@%J", &b.laddr);
+
+	cur = &b;
+
+	for (i=0; i<ncalls; i++) {
+
+		err = ua_connect(b.a, NULL, NULL, b.buri, NULL,
+				 *vidcodec ? VIDMODE_ON : VIDMODE_OFF);
+		if (err)
+			goto out;
+	}
+
+	err = re_main_timeout(SETUP_MS);
+	if (err || b.err) {
+		err = err ? err : b.err;
+		goto out;
+	}
+
+	if (list_isempty(&ausrcl) || list_isempty(&auplayl)) {
+		warning("bench: no audio\n");
+		err = ENOENT;
+		goto out;
+	}
+
+	bench_steps(&b, WARMUP_MS);
+
+	b.tx_ns = b.vtx_ns = b.rx_ns = b.play_ns = 0;
+	b.n_decode = b.n_display = 0;
+	t0 = process_usec();
+
+	bench_steps(&b, seconds * 1000);
+
+	cpu = process_usec() - t0;
+
+	if (b.err) {
+		err = b.err;
+		goto out;
+	}
+
+	if (!b.n_decode || (*vidcodec && !b.n_display)) {
+		warning("bench: no media received (audio=%llu video=%llu)\n",
+			b.n_decode, b.n_display);
+		err = EPROTO;
+		goto out;
+	}
+
+	/* all figures in microseconds per second of call */
+	call_sec = (double)ncalls * seconds;
+	tx    = b.tx_ns / 1000;
+	vtx   = b.vtx_ns / 1000;
+	rx    = b.rx_ns / 1000;
+	play  = b.play_ns / 1000;
+	other = cpu > tx + vtx + rx + play ? cpu - tx - vtx - rx - play : 0;
+
+	re_printf("{\"bench\":\"call\",\"codec\":\"%s\",\"vidcodec\":\"%s\","
+		  "\"menc\":\"%s\",\"calls\":%u,\"seconds\":%u,"
+		  "\"cpu_us_per_call_sec\":%.1f,"
+		  "\"stages\":{\"audio_tx\":%.1f,\"video_tx\":%.1f,"
+		  "\"rx\":%.1f,\"play\":%.1f,\"other\":%.1f},"
+		  "\"video_fps\":%.1f,"
+		  "\"peak_rss_kb\":%ld,\"calls_per_core\":%u}\n",
+		  codec, vidcodec, menc, ncalls, seconds,
+		  cpu / call_sec,
+		  tx / call_sec, vtx / call_sec, rx / call_sec,
+		  play / call_sec, other / call_sec,
+		  b.n_display / call_sec / 2,
+		  peak_rss_kb(),
+		  cpu ? (unsigned)(1e6 * call_sec / cpu) : 0);
+
+ out:
+	cur = NULL;
+	uag_event_unregister(event_handler);
+
+	mem_deref(b.b);
+	mem_deref(b.a);
+
+	ua_stop_all(true);
+	ua_close();
+
+	return err;
+}
+
+
+int test_bench_call(void)
+{
+	struct config *cfg = conf_config();
+	const char *codec = env_str("BENCH_CODEC", "PCMU");
+	const char *vidcodec = env_str("BENCH_VIDCODEC", "H266");
+	const char *menc  = env_str("BENCH_MENC", "srtp");
+	struct ausrc *ausrc = NULL;
+	struct auplay *auplay = NULL;
+	struct config_audio audio;
+	struct config_video video;
+	uint32_t max_calls, seconds = SECONDS;
+	struct pl val, num;
+	int err;
+#ifdef USE_VIDEO
+	struct vidsrc *vidsrc = NULL;
+	struct vidisp *vidisp = NULL;
+	bool mock = false;
+#endif
+
+	if (getenv("BENCH_SECONDS"))
+		seconds = atoi(getenv("BENCH_SECONDS"));
+	if (!seconds)
+		return EINVAL;
+
+	err = bench_modules_load();
+	if (err)
+		return err;
+
+	err  = ausrc_register(&ausrc, baresip_ausrcl(), "bench",
+			      bench_ausrc_alloc);
+	err |= auplay_register(&auplay, baresip_auplayl(), "bench",
+			       bench_auplay_alloc);
+	if (err)
+		goto out;
+
+	aufilt_register(baresip_aufiltl(), &bench_aufilt);
+
+#ifdef USE_VIDEO
+	if (0 == str_casecmp(vidcodec, "none")) {
+		vidcodec = "";
+	}
+	else {
+		if (0 == str_casecmp(vidcodec, "H266")) {
+			mock_vidcodec_register();
+			mock = true;
+		}
+
+		err  = vidsrc_register(&vidsrc, baresip_vidsrcl(), "bench",
+				       bench_vidsrc_alloc, NULL);
+		err |= vidisp_register(&vidisp, "bench", bench_vidisp_alloc,
+				       NULL, bench_display, NULL);
+		if (err)
+			goto out;
+	}
+#else
+	vidcodec = "";
+#endif
+
+	audio     = cfg->audio;
+	video     = cfg->video;
+	max_calls = cfg->call.max_calls;
+
+	str_ncpy(cfg->audio.src_mod, "bench", sizeof(cfg->audio.src_mod));
+	str_ncpy(cfg->audio.play_mod, "bench", sizeof(cfg->audio.play_mod));
+	str_ncpy(cfg->video.src_mod, "bench", sizeof(cfg->video.src_mod));
+	str_ncpy(cfg->video.disp_mod, "bench", sizeof(cfg->video.disp_mod));
+	cfg->call.max_calls = 0;
+
+	pl_set_str(&val, env_str("BENCH_CALLS", "1,4,16"));
+
+	while (0 == re_regex(val.p, val.l, "[ ,]*[0-9]+", NULL, &num)) {
+
+		pl_advance(&val, num.p + num.l - val.p);
+
+		err = bench_run(pl_u32(&num), seconds, codec, vidcodec, menc);
+		if (err)
+			break;
+	}
+
+	cfg->audio = audio;
+	cfg->video = video;
+	cfg->call.max_calls = max_calls;
+
+ out:
+#ifdef USE_VIDEO
+	mem_deref(vidisp);
+	mem_deref(vidsrc);
+	if (mock)
+		mock_vidcodec_unregister();
+#endif
+	aufilt_unregister(&bench_aufilt);
+	mem_deref(auplay);
+	mem_deref(ausrc);
+
+	return err;
+}
+
+
+static double segsnr(const int16_t *ref, const int16_t *x, size_t n)
+{
+	double sig = 0, err = 0, snr;
+	size_t i;
+
+	for (i=0; i<n; i++) {
+		sig += (double)ref[i] * ref[i];
+		err += (double)(ref[i] - x[i]) * (ref[i] - x[i]);
+	}
+
+	snr = 10 * log10((sig + 1) / (err + 1));
+
+	return max(-10.0, min(snr, 35.0));
+}
+
+
+/* Power spectrum of a frame, with a Hann window */
+static void spectrum(double *pv, const int16_t *x)
+{
+	static double cosv[PLC_FRAME], sinv[PLC_FRAME], winv[PLC_FRAME];
+	unsigned k, n;
+
+	if (!winv[1]) {
+		for (n=0; n<PLC_FRAME; n++) {
+			const double a = 2 * M_PI * n / PLC_FRAME;
+
+			cosv[n] = cos(a);
+			sinv[n] = sin(a);
+			winv[n] = 0.5 - 0.5 * cos(a);
+		}
+	}
+
+	for (k=0; k<PLC_BINS; k++) {
+
+		double re = 0, im = 0;
+
+		for (n=0; n<PLC_FRAME; n++) {
+			const double v = winv[n] * x[n];
+
+			re += v * cosv[(k * n) % PLC_FRAME];
+			im -= v * sinv[(k * n) % PLC_FRAME];
+		}
+
+		pv[k] = re * re + im * im;
+	}
+}
+
+
+/*
+ * Log-spectral distance, with a floor 40 dB below the mean power of
+ * the reference, so that silence scores a finite distance.
+ */
+static double lsd(const int16_t *ref, const int16_t *x)
+{
+	double pr[PLC_BINS], px[PLC_BINS];
+	double floor = 0, sum = 0;
+	unsigned k;
+
+	spectrum(pr, ref);
+	spectrum(px, x);
+
+	for (k=0; k<PLC_BINS; k++)
+		floor += pr[k];
+
+	floor = max(floor / PLC_BINS * 1e-4, 1.0);
+
+	for (k=0; k<PLC_BINS; k++) {
+		const double d = 10 * log10((pr[k] + floor) / (px[k] + floor));
+
+		sum += d * d;
+	}
+
+	return sqrt(sum / PLC_BINS);
+}
+
+
+static int plc_run(enum plc_method method, const int16_t *refv,
+		   const bool *lostv, int16_t *outv)
+{
+	struct auplc *plc = NULL;
+	unsigned i;
+	int err;
+
+	if (method == PLC_AUPLC) {
+		err = auplc_alloc(&plc, PLC_SRATE);
+		if (err)
+			return err;
+	}
+
+	for (i=0; i<PLC_FRAMES; i++) {
+
+		int16_t *frame = outv + i * PLC_FRAME;
+
+		if (!lostv[i]) {
+			memcpy(frame, refv + i * PLC_FRAME,
+			       PLC_FRAME * sizeof(*frame));
+			auplc_rx(plc, frame, PLC_FRAME);
+		}
+		else if (method == PLC_SILENCE || !i) {
+			memset(frame, 0, PLC_FRAME * sizeof(*frame));
+		}
+		else if (method == PLC_REPEAT) {
+			memcpy(frame, frame - PLC_FRAME,
+			       PLC_FRAME * sizeof(*frame));
+		}
+		else {
+			auplc_conceal(plc, frame, PLC_FRAME);
+		}
+	}
+
+	mem_deref(plc);
+
+	return 0;
+}
+
+
+/*
+ * Compare the output with the original, in windows of one frame with
+ * a hop of half a frame, over all windows that overlap a lost frame.
+ * So the edges of the concealed audio are compared as well.
+ */
+static void plc_score(const int16_t *refv, const int16_t *outv,
+		      const bool *lostv, double *snrp, double *lsdp)
+{
+	const size_t hop = PLC_FRAME / 2;
+	double snr = 0, dist = 0;
+	size_t pos, n = 0;
+
+	for (pos=hop; pos + PLC_FRAME <= PLC_FRAMES * PLC_FRAME; pos += hop) {
+
+		const size_t f = pos / PLC_FRAME;
+
+		if (!lostv[f] && !(pos % PLC_FRAME && lostv[f + 1]))
+			continue;
+
+		snr  += segsnr(refv + pos, outv + pos, PLC_FRAME);
+		dist += lsd(refv + pos, outv + pos);
+		++n;
+	}
+
+	*snrp = n ? snr / n : 0;
+	*lsdp = n ? dist / n : 0;
+}
+
+
+int test_bench_plc(void)
+{
+	static const struct loss_trace tracev[] = {
+		{"random-3",  0.03, 0.97},
+		{"random-10", 0.10, 0.90},
+		{"random-20", 0.20, 0.80},
+		{"bursty-10", 0.04, 0.35},
+		{"bursty-20", 0.08, 0.30},
+	};
+	int16_t *refv, *outv;
+	bool lostv[PLC_FRAMES];
+	double snrv[PLC_METHODS], lsdv[PLC_METHODS];
+	unsigned i, m, lostc;
+	int err = 0;
+
+	refv = mem_alloc(PLC_FRAMES * PLC_FRAME * sizeof(*refv), NULL);
+	outv = mem_alloc(PLC_FRAMES * PLC_FRAME * sizeof(*outv), NULL);
+	if (!refv || !outv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	signal_generate(refv, PLC_FRAMES * PLC_FRAME, PLC_SRATE, 1);
+
+	for (i=0; i<ARRAY_SIZE(tracev); i++) {
+
+		const struct loss_trace *tr = &tracev[i];
+		uint32_t seed = 1234 + i;
+		double r_factor, mos;
+		bool lost = false;
+		unsigned k;
+
+		lostc = 0;
+
+		for (k=0; k<PLC_FRAMES; k++) {
+
+			const double u = (double)(seed >> 8) / (1 << 24);
+
+			seed = seed * 1664525 + 1013904223;
+
+			lost = lost ? (u >= tr->found) : (u < tr->lost);
+
+			/* keep the first second, for the history */
+			lostv[k] = lost && k >= 50;
+			lostc += lostv[k];
+		}
+
+		for (m=0; m<PLC_METHODS; m++) {
+
+			err = plc_run(m, refv, lostv, outv);
+			if (err)
+				goto out;
+
+			plc_score(refv, outv, lostv, &snrv[m], &lsdv[m]);
+		}
+
+		mos = mos_calculate(&r_factor, 0, 0,
+				    100 * lostc / PLC_FRAMES);
+
+		re_printf("{\"bench\":\"plc\",\"trace\":\"%s\","
+			  "\"loss_pct\":%.1f,\"r_factor\":%.1f,"
+			  "\"mos\":%.2f,\"segsnr\":{\"silence\":%.1f,"
+			  "\"repeat\":%.1f,\"auplc\":%.1f},"
+			  "\"lsd\":{\"silence\":%.1f,"
+			  "\"repeat\":%.1f,\"auplc\":%.1f}}\n",
+			  tr->name, 100.0 * lostc / PLC_FRAMES,
+			  r_factor, mos, snrv[PLC_SILENCE],
+			  snrv[PLC_REPEAT], snrv[PLC_AUPLC],
+			  lsdv[PLC_SILENCE], lsdv[PLC_REPEAT],
+			  lsdv[PLC_AUPLC]);
+	}
+
+ out:
+	mem_deref(refv);
+	mem_deref(outv);
+
+	return err;
+}
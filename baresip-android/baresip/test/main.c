@@ -24,6 +24,7 @@ struct test {
 static const struct test tests[] = {
 	TEST(test_account),
 	TEST(test_aulevel),
+	TEST(test_b2bua_relay),
 	TEST(test_call_af_mismatch),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
@@ -53,6 +54,11 @@ static const struct test tests[] = {
 	TEST(test_uag_find_param),
 };
 
+static const struct test benchmarks[] = {
+	TEST(test_bench_call),
+	TEST(test_bench_plc),
+};
+
 
 static int run_one_test(const struct test *test)
 {
@@ -73,19 +79,19 @@ static int run_one_test(const struct test *test)
 }
 
 
-static int run_tests(void)
+static int run_tests(const struct test *testv, size_t n)
 {
 	size_t i;
 	int err;
 
-	for (i=0; i<ARRAY_SIZE(tests); i++) {
+	for (i=0; i<n; i++) {
 
-		re_printf("[ RUN      ] %s\n", tests[i].name);
+		re_printf("[ RUN      ] %s\n", testv[i].name);
 
-		err = tests[i].exec();
+		err = testv[i].exec();
 		if (err) {
 			warning("%s: test failed (%m)\n",
-				tests[i].name, err);
+				testv[i].name, err);
 			return err;
 		}
 
@@ -125,6 +131,12 @@ static const struct test *find_test(const char *name)
 			return &tests[i];
 	}
 
+	for (i=0; i<ARRAY_SIZE(benchmarks); i++) {
+
+		if (0 == str_casecmp(name, benchmarks[i].name))
+			return &benchmarks[i];
+	}
+
 	return NULL;
 }
 
@@ -144,6 +156,7 @@ static void usage(void)
 			 "Usage: selftest [options] <testcases..>\n"
 			 "options:\n"
 			 "\t-l               List all testcases and exit\n"
+			 "\t-p               Run benchmarks\n"
 			 "\t-v               Verbose output (INFO level)\n"
 			 );
 }
@@ -154,6 +167,7 @@ int main(int argc, char *argv[])
 	struct config *config;
 	size_t i, ntests;
 	bool verbose = false;
+	bool do_bench = false;
 	int err;
 
 	err = libre_init();
@@ -163,7 +177,7 @@ int main(int argc, char *argv[])
 	log_enable_info(false);
 
 	for (;;) {
-		const int c = getopt(argc, argv, "hlv");
+		const int c = getopt(argc, argv, "hlpv");
 		if (0 > c)
 			break;
 
@@ -178,6 +192,10 @@ int main(int argc, char *argv[])
 			test_listcases();
 			return 0;
 
+		case 'p':
+			do_bench = true;
+			break;
+
 		case 'v':
 			if (verbose)
 				log_enable_debug(true);
@@ -193,6 +211,8 @@ int main(int argc, char *argv[])
 
 	if (argc >= (optind + 1))
 		ntests = argc - optind;
+	else if (do_bench)
+		ntests = ARRAY_SIZE(benchmarks);
 	else
 		ntests = ARRAY_SIZE(tests);
 
@@ -235,8 +255,13 @@ int main(int argc, char *argv[])
 			}
 		}
 	}
+	else if (do_bench) {
+		err = run_tests(benchmarks, ARRAY_SIZE(benchmarks));
+		if (err)
+			goto out;
+	}
 	else {
-		err = run_tests();
+		err = run_tests(tests, ARRAY_SIZE(tests));
 		if (err)
 			goto out;
 	}
@@ -258,6 +283,8 @@ int main(int argc, char *argv[])
 
 	baresip_close();
 
+	mod_close();
+
 	libre_close();
 
 	tmr_debug();
@@ -10,6 +10,8 @@
 #
 TEST_SRCS	+= account.c
 TEST_SRCS	+= aulevel.c
+TEST_SRCS	+= b2bua.c
+TEST_SRCS	+= bench.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
 TEST_SRCS	+= contact.c
@@ -205,6 +205,16 @@ int test_call_max(void);
 int test_call_dtmf(void);
 int test_call_video(void);
 
+int test_b2bua_relay(void);
+
+
+/*
+ * Benchmarks
+ */
+
+int test_bench_call(void);
+int test_bench_plc(void);
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,3 +31,9 @@ uint32_t hash_joaat_pl(const struct pl *pl);
 uint32_t hash_joaat_pl_ci(const struct pl *pl);
 uint32_t hash_fast(const char *k, size_t len);
 uint32_t hash_fast_str(const char *str);
+uint32_t hash_wy(const uint8_t *key, size_t len);
+uint32_t hash_wy_ci(const char *str, size_t len);
+uint32_t hash_wy_str(const char *str);
+uint32_t hash_wy_str_ci(const char *str);
+uint32_t hash_wy_pl(const struct pl *pl);
+uint32_t hash_wy_pl_ci(const struct pl *pl);
@@ -48,3 +48,45 @@ int json_decode(const char *str, size_t len, unsigned maxdepth,
 int json_decode_odict(struct odict **op, uint32_t hash_size, const char *str,
 		      size_t len, unsigned maxdepth);
 int json_encode_odict(struct re_printf *pf, const struct odict *o);
+
+
+/* Zero-copy JSON document */
+
+/** Decoded JSON node, offsets refer to the document source buffer */
+struct json_node {
+	enum odict_type type;     /**< Node type                        */
+	uint32_t next;            /**< Index of next sibling, or 0      */
+	uint32_t child;           /**< Index of first child, or 0       */
+	uint32_t count;           /**< Number of children               */
+	uint32_t key_off;         /**< Offset of raw key                */
+	uint32_t key_len;         /**< Length of raw key                */
+	uint32_t val_off;         /**< Offset of raw text               */
+	uint32_t val_len;         /**< Length of raw text               */
+	union {
+		int64_t integer;  /**< ODICT_INT                        */
+		double dbl;       /**< ODICT_DOUBLE                     */
+		bool boolean;     /**< ODICT_BOOL                       */
+	} u;
+};
+
+struct json_doc;
+
+int  json_doc_decode(struct json_doc **docp, const char *str, size_t len,
+		     unsigned maxdepth);
+int  json_doc_alloc(struct json_doc **docp, unsigned maxdepth);
+int  json_doc_feed(struct json_doc *doc, const char *buf, size_t len);
+bool json_doc_complete(const struct json_doc *doc);
+int  json_doc_odict(struct odict **op, uint32_t hash_size,
+		    const struct json_doc *doc);
+const struct json_node *json_doc_root(const struct json_doc *doc);
+const struct json_node *json_node_child(const struct json_doc *doc,
+				       const struct json_node *n);
+const struct json_node *json_node_next(const struct json_doc *doc,
+				      const struct json_node *n);
+const struct json_node *json_node_lookup(const struct json_doc *doc,
+					 const struct json_node *obj,
+					 const char *key);
+void json_node_key(struct pl *pl, const struct json_doc *doc,
+		   const struct json_node *n);
+void json_node_str(struct pl *pl, const struct json_doc *doc,
+		   const struct json_node *n);
@@ -0,0 +1,44 @@
+/**
+ * @file re_kalive.h  Interface to keepalive scheduler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/**
+ * Defines the keepalive handler
+ *
+ * @param arg Handler argument
+ */
+typedef void (kalive_h)(void *arg);
+
+/** Defines a keepalive timer */
+struct kalive {
+	struct le le;          /**< Linked list element             */
+	kalive_h *kh;          /**< Keepalive handler               */
+	void *arg;             /**< Handler argument                */
+	uint64_t jfs;          /**< Jiffies for keepalive           */
+	uint64_t act;          /**< Jiffies of last media activity  */
+	uint32_t ival;         /**< Media suppression interval [ms] */
+};
+
+
+void kalive_init(struct kalive *ka, uint32_t ival);
+int  kalive_start(struct kalive *ka, uint64_t delay, kalive_h *kh,
+		  void *arg);
+void kalive_cancel(struct kalive *ka);
+void kalive_activity(struct kalive *ka);
+int  kalive_status(struct re_printf *pf, void *unused);
+
+
+/**
+ * Check if the keepalive timer is running
+ *
+ * @param ka Keepalive timer to check
+ *
+ * @return true if running, false if not running
+ */
+static inline bool kalive_isrunning(const struct kalive *ka)
+{
+	return ka ? NULL != ka->kh : false;
+}
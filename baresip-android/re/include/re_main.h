@@ -4,6 +4,8 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
+struct sa;
+
 
 enum {
 #ifndef FD_READ
@@ -24,6 +26,18 @@ enum {
  */
 typedef void (fd_h)(int flags, void *arg);
 
+/**
+ * Datagram receive handler, for sockets read by the polling loop
+ *
+ * @param err  Receive or send error, 0 if success
+ * @param src  Source address
+ * @param buf  Datagram, only valid in the handler
+ * @param len  Length of datagram
+ * @param arg  Handler argument
+ */
+typedef void (fd_recv_h)(int err, const struct sa *src, const uint8_t *buf,
+			 size_t len, void *arg);
+
 /**
  * Thread-safe signal handler
  *
@@ -34,6 +48,9 @@ typedef void (re_signal_h)(int sig);
 
 int   fd_listen(int fd, int flags, fd_h *fh, void *arg);
 void  fd_close(int fd);
+int   fd_recv_set(int fd, fd_recv_h *recvh);
+int   fd_sendto(int fd, const uint8_t *buf, size_t len,
+		const struct sa *dst);
 int   fd_setsize(int maxfds);
 void  fd_debug(void);
 
@@ -59,11 +76,13 @@ enum poll_method {
 	METHOD_SELECT,
 	METHOD_EPOLL,
 	METHOD_KQUEUE,
+	METHOD_IO_URING,
 	/* sep */
 	METHOD_MAX
 };
 
 int              poll_method_set(enum poll_method method);
+enum poll_method poll_method_get(void);
 enum poll_method poll_method_best(void);
 const char      *poll_method_name(enum poll_method method);
 int poll_method_type(enum poll_method *method, const struct pl *name);
@@ -212,6 +212,7 @@ int   rtp_send(struct rtp_sock *rs, const struct sa *dst,
 int   rtp_debug(struct re_printf *pf, const struct rtp_sock *rs);
 void *rtp_sock(const struct rtp_sock *rs);
 uint32_t rtp_sess_ssrc(const struct rtp_sock *rs);
+void  rtp_seq_skip(struct rtp_sock *rs, uint16_t n);
 const struct sa *rtp_local(const struct rtp_sock *rs);
 
 /* RTCP session api */
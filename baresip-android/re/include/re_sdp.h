@@ -63,6 +63,7 @@ struct sdp_session;
 
 int  sdp_session_alloc(struct sdp_session **sessp, const struct sa *laddr);
 void sdp_session_set_laddr(struct sdp_session *sess, const struct sa *laddr);
+void sdp_session_set_encode_cache(struct sdp_session *sess, bool enable);
 void sdp_session_set_lbandwidth(struct sdp_session *sess,
 				enum sdp_bandwidth type, int32_t bw);
 int  sdp_session_set_lattr(struct sdp_session *sess, bool replace,
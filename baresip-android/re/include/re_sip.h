@@ -364,6 +364,23 @@ int sip_via_decode(struct sip_via *via, const struct pl *pl);
 int sip_cseq_decode(struct sip_cseq *cseq, const struct pl *pl);
 
 
+/* framer */
+
+/** SIP stream frame types */
+enum sip_frame {
+	SIP_FRAME_MSG,   /**< SIP message                     */
+	SIP_FRAME_CRLF,  /**< Keep-alive pong (CRLF)          */
+	SIP_FRAME_PING,  /**< Keep-alive ping (double CRLF)   */
+};
+
+struct sip_framer;
+
+int sip_framer_alloc(struct sip_framer **frp, size_t maxsz);
+int sip_framer_input(struct sip_framer *fr, struct mbuf *mb);
+int sip_framer_next(struct sip_framer *fr, enum sip_frame *typep,
+		    struct mbuf **mbp);
+
+
 /* keepalive */
 int sip_keepalive_start(struct sip_keepalive **kap, struct sip *sip,
 			const struct sip_msg *msg, uint32_t interval,
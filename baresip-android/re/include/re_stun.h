@@ -154,6 +154,45 @@ struct stun_attr {
 };
 
 
+/** STUN Message header */
+struct stun_hdr {
+	uint16_t type;               /**< Message type   */
+	uint16_t len;                /**< Payload length */
+	uint32_t cookie;             /**< Magic cookie   */
+	uint8_t tid[STUN_TID_SIZE];  /**< Transaction ID */
+};
+
+/**
+ * Defines a decoded STUN Message. The attributes are stored in an
+ * array, and string attributes in one buffer after it. The message is
+ * either allocated by stun_msg_decode(), or decoded into caller storage
+ * by stun_msg_decode_fixed()
+ */
+struct stun_msg {
+	struct stun_hdr hdr;      /**< STUN Header                    */
+	struct stun_attr *attrv;  /**< Attributes                     */
+	uint32_t attrc;           /**< Number of attributes           */
+	uint32_t attrn;           /**< Size of attribute array        */
+	char *strv;               /**< Storage for string attributes  */
+	size_t strsz;             /**< Size of string storage         */
+	struct mbuf *mb;          /**< Buffer with the raw message    */
+	size_t start;             /**< Start of the message in buffer */
+};
+
+/** Size of struct stun_msg_fixed */
+enum {
+	STUN_MSG_FIXED_ATTRS = 16,    /**< Number of attributes          */
+	STUN_MSG_FIXED_STRSZ = 1024,  /**< Bytes of string attributes    */
+};
+
+/** STUN Message with fixed storage, decoded without heap allocation */
+struct stun_msg_fixed {
+	struct stun_msg msg;                            /**< The message */
+	struct stun_attr attrv[STUN_MSG_FIXED_ATTRS];   /**< Attributes  */
+	char strv[STUN_MSG_FIXED_STRSZ];                /**< Strings     */
+};
+
+
 /** STUN Configuration */
 struct stun_conf {
 	uint32_t rto;  /**< RTO Retransmission TimeOut [ms]        */
@@ -166,8 +205,8 @@ struct stun_conf {
 
 extern const char *stun_software;
 struct stun;
-struct stun_msg;
 struct stun_ctrans;
+struct hmac;
 
 typedef void(stun_resp_h)(int err, uint16_t scode, const char *reason,
 			  const struct stun_msg *msg, void *arg);
@@ -209,6 +248,8 @@ int  stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t cls,
 		     uint8_t padding, uint32_t attrc, ...);
 int  stun_msg_decode(struct stun_msg **msgpp, struct mbuf *mb,
 		     struct stun_unknown_attr *ua);
+int  stun_msg_decode_fixed(struct stun_msg_fixed *fm, struct mbuf *mb,
+			   struct stun_unknown_attr *ua);
 uint16_t stun_msg_type(const struct stun_msg *msg);
 uint16_t stun_msg_class(const struct stun_msg *msg);
 uint16_t stun_msg_method(const struct stun_msg *msg);
@@ -219,6 +260,7 @@ struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 				      stun_attr_h *h, void *arg);
 int  stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		     size_t keylen);
+int  stun_msg_chk_mi_hmac(const struct stun_msg *msg, struct hmac *hmac);
 int  stun_msg_chk_fingerprint(const struct stun_msg *msg);
 void stun_msg_dump(const struct stun_msg *msg);
 
@@ -7,6 +7,7 @@
 
 struct sa;
 struct udp_sock;
+struct udp_batch;
 
 
 /**
@@ -40,6 +41,10 @@ int  udp_sock_fd(const struct udp_sock *us, int af);
 int  udp_multicast_join(struct udp_sock *us, const struct sa *group);
 int  udp_multicast_leave(struct udp_sock *us, const struct sa *group);
 
+int  udp_batch_alloc(struct udp_batch **ubp);
+void udp_batch_begin(struct udp_batch *ub);
+void udp_batch_end(struct udp_batch *ub);
+
 
 /* Helper API */
 typedef bool (udp_helper_send_h)(int *err, struct sa *dst,
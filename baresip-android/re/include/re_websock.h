@@ -50,6 +50,8 @@ typedef void (websock_estab_h)(void *arg);
 typedef void (websock_recv_h)(const struct websock_hdr *hdr, struct mbuf *mb,
 			      void *arg);
 typedef void (websock_close_h)(int err, void *arg);
+typedef void (websock_chunk_h)(const struct websock_hdr *hdr,
+			       uint64_t offset, struct mbuf *mb, void *arg);
 
 
 int websock_connect(struct websock_conn **connp, struct websock *sock,
@@ -66,6 +68,11 @@ int websock_send(struct websock_conn *conn, enum websock_opcode opcode,
 int websock_close(struct websock_conn *conn, enum websock_scode scode,
 		  const char *fmt, ...);
 const struct sa *websock_peer(const struct websock_conn *conn);
+void websock_chunk_handler_set(struct websock_conn *conn,
+			       websock_chunk_h *chunkh);
+int  websock_hdr_decode(struct websock_hdr *hdr, struct mbuf *mb);
+void websock_mask(uint8_t *p, size_t len, const uint8_t mkey[4],
+		  uint64_t offset);
 
 typedef void (websock_shutdown_h)(void *arg);
 
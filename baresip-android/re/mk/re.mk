@@ -566,6 +566,11 @@ HAVE_EPOLL   := $(shell [ -f $(SYSROOT)/include/sys/epoll.h ] || \
 			[ -f $(SYSROOT)/include/$(MACHINE)/sys/epoll.h ] \
 			&& echo "1")
 endif
+ifeq ($(OS),linux)
+HAVE_IO_URING := $(shell grep -qs IORING_OP_SEND_ZC \
+			$(SYSROOT)/include/linux/io_uring.h && echo "1")
+HAVE_SENDMMSG := 1
+endif
 
 HAVE_RESOLV := $(shell [ -f $(SYSROOT)/include/resolv.h ] && echo "1")
 
@@ -601,6 +606,12 @@ endif
 ifneq ($(HAVE_KQUEUE),)
 CFLAGS  += -DHAVE_KQUEUE
 endif
+ifneq ($(HAVE_IO_URING),)
+CFLAGS  += -DHAVE_IO_URING
+endif
+ifneq ($(HAVE_SENDMMSG),)
+CFLAGS  += -DHAVE_SENDMMSG
+endif
 CFLAGS  += -DHAVE_UNAME
 CFLAGS  += -DHAVE_UNISTD_H
 ifneq ($(OS),cygwin)
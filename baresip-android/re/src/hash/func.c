@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_list.h>
@@ -367,3 +368,240 @@ uint32_t hash_fast_str(const char *str)
 {
 	return hash_fast(str, str_len(str));
 }
+
+
+/*
+ * Word-at-a-time hash, after wyhash (final version 4) by Wang Yi, which
+ * is in the public domain. Keys are read four or eight bytes at a time
+ * and mixed with 64x64 to 128 bit multiplications; the case-insensitive
+ * variants fold ASCII upper case letters to lower case a word at a time.
+ */
+static const uint64_t wyp[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+
+static inline void wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	const uint64_t ha = *a >> 32, la = (uint32_t)*a;
+	const uint64_t hb = *b >> 32, lb = (uint32_t)*b;
+	const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la;
+	const uint64_t rl = la * lb;
+	const uint64_t t = rl + (rm0 << 32);
+	const uint64_t lo = t + (rm1 << 32);
+	const uint64_t c = (t < rl) + (lo < t);
+
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+
+static inline uint64_t wymix(uint64_t a, uint64_t b)
+{
+	wymum(&a, &b);
+
+	return a ^ b;
+}
+
+
+/* ASCII 'A'..'Z' to lower case, in all bytes of a word */
+static inline uint64_t wylower(uint64_t w)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t high = ones * 0x80;
+	const uint64_t low7 = w & ~high;
+	const uint64_t ge_a = low7 + ones * (0x80 - 'A');
+	const uint64_t gt_z = low7 + ones * (0x80 - 'Z' - 1);
+
+	return w | (((ge_a & ~gt_z) & ~w & high) >> 2);
+}
+
+
+static inline uint64_t wyr8(const uint8_t *p, bool ci)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return ci ? wylower(v) : v;
+}
+
+
+static inline uint64_t wyr4(const uint8_t *p, bool ci)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return ci ? wylower(v) : v;
+}
+
+
+static inline uint64_t wyr3(const uint8_t *p, size_t k, bool ci)
+{
+	const uint64_t v = ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) |
+		p[k - 1];
+
+	return ci ? wylower(v) : v;
+}
+
+
+static inline uint32_t wyhash(const uint8_t *p, size_t len, bool ci)
+{
+	uint64_t seed = wymix(wyp[0], wyp[1]);
+	uint64_t a, b, h;
+
+	if (len <= 16) {
+
+		if (len >= 4) {
+			const size_t o = (len >> 3) << 2;
+
+			a = (wyr4(p, ci) << 32) | wyr4(p + o, ci);
+			b = (wyr4(p + len - 4, ci) << 32) |
+				wyr4(p + len - 4 - o, ci);
+		}
+		else if (len > 0) {
+			a = wyr3(p, len, ci);
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t i = len;
+
+		if (i > 48) {
+
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = wymix(wyr8(p, ci) ^ wyp[1],
+					     wyr8(p + 8, ci) ^ seed);
+				see1 = wymix(wyr8(p + 16, ci) ^ wyp[2],
+					     wyr8(p + 24, ci) ^ see1);
+				see2 = wymix(wyr8(p + 32, ci) ^ wyp[3],
+					     wyr8(p + 40, ci) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = wymix(wyr8(p, ci) ^ wyp[1],
+				     wyr8(p + 8, ci) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = wyr8(p + i - 16, ci);
+		b = wyr8(p + i - 8, ci);
+	}
+
+	a ^= wyp[1];
+	b ^= seed;
+	wymum(&a, &b);
+
+	h = wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+
+/**
+ * Calculate hash-value with the word-at-a-time hash algorithm.
+ *
+ * @param key  Pointer to key
+ * @param len  Key length
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy(const uint8_t *key, size_t len)
+{
+	if (!key)
+		return 0;
+
+	return wyhash(key, len, false);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive string
+ *
+ * @param str  String
+ * @param len  Length of string
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_ci(const char *str, size_t len)
+{
+	if (!str)
+		return 0;
+
+	return wyhash((const uint8_t *)str, len, true);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str(const char *str)
+{
+	return hash_wy((const uint8_t *)str, str_len(str));
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive
+ * NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str_ci(const char *str)
+{
+	return hash_wy_ci(str, str_len(str));
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl(const struct pl *pl)
+{
+	return pl ? hash_wy((const uint8_t *)pl->p, pl->l) : 0;
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive
+ * pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl_ci(const struct pl *pl)
+{
+	return pl ? hash_wy_ci(pl->p, pl->l) : 0;
+}
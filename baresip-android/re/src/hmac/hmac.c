@@ -10,9 +10,15 @@
 #include <re_hmac.h>
 
 
+enum {
+	SHA_BLOCKSIZE = 64
+};
+
+
+/** HMAC-SHA1, with the SHA-1 states of the padded key */
 struct hmac {
-	uint8_t key[SHA_DIGEST_LENGTH];
-	size_t key_len;
+	SHA_CTX ictx;
+	SHA_CTX octx;
 };
 
 
@@ -24,9 +30,28 @@ static void destructor(void *arg)
 }
 
 
+static void pad_init(SHA_CTX *ctx, const uint8_t *key, size_t key_len,
+		     uint8_t pad)
+{
+	uint8_t buf[SHA_BLOCKSIZE];
+	size_t i;
+
+	for (i=0; i<key_len; i++)
+		buf[i] = key[i] ^ pad;
+	for (; i<sizeof(buf); i++)
+		buf[i] = pad;
+
+	SHA1_Init(ctx);
+	SHA1_Update(ctx, buf, sizeof(buf));
+
+	memset(buf, 0, sizeof(buf));
+}
+
+
 int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 		const uint8_t *key, size_t key_len)
 {
+	uint8_t khash[SHA_DIGEST_LENGTH];
 	struct hmac *hmac;
 
 	if (!hmacp || !key || !key_len)
@@ -35,15 +60,23 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 	if (hash != HMAC_HASH_SHA1)
 		return ENOTSUP;
 
-	if (key_len > SHA_DIGEST_LENGTH)
-		return EINVAL;
-
 	hmac = mem_zalloc(sizeof(*hmac), destructor);
 	if (!hmac)
 		return ENOMEM;
 
-	memcpy(hmac->key, key, key_len);
-	hmac->key_len = key_len;
+	if (key_len > SHA_BLOCKSIZE) {
+		SHA_CTX ctx;
+
+		SHA1_Init(&ctx);
+		SHA1_Update(&ctx, key, key_len);
+		SHA1_Final(khash, &ctx);
+
+		key = khash;
+		key_len = sizeof(khash);
+	}
+
+	pad_init(&hmac->ictx, key, key_len, 0x36);
+	pad_init(&hmac->octx, key, key_len, 0x5c);
 
 	*hmacp = hmac;
 
@@ -54,10 +87,21 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 int hmac_digest(struct hmac *hmac, uint8_t *md, size_t md_len,
 		const uint8_t *data, size_t data_len)
 {
+	uint8_t isha[SHA_DIGEST_LENGTH], osha[SHA_DIGEST_LENGTH];
+	SHA_CTX ctx;
+
 	if (!hmac || !md || !md_len || !data || !data_len)
 		return EINVAL;
 
-	hmac_sha1(hmac->key, hmac->key_len, data, data_len, md, md_len);
+	ctx = hmac->ictx;
+	SHA1_Update(&ctx, data, data_len);
+	SHA1_Final(isha, &ctx);
+
+	ctx = hmac->octx;
+	SHA1_Update(&ctx, isha, sizeof(isha));
+	SHA1_Final(osha, &ctx);
+
+	memcpy(md, osha, min(md_len, sizeof(osha)));
 
 	return 0;
 }
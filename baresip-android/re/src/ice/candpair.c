@@ -9,7 +9,9 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_stun.h>
 #include <re_ice.h>
@@ -26,9 +28,14 @@ static void candpair_destructor(void *arg)
 	struct ice_candpair *cp = arg;
 
 	list_unlink(&cp->le);
+	hash_unlink(&cp->he);
+	icem_conncheck_heap_remove(cp);
 	mem_deref(cp->ct_conn);
 	mem_deref(cp->lcand);
 	mem_deref(cp->rcand);
+
+	if (cp->icem)
+		--cp->icem->pairc;
 }
 
 
@@ -79,11 +86,23 @@ static void list_add_sorted(struct list *list, struct ice_candpair *cp)
 }
 
 
+/**
+ * Allocate a candidate pair and append it to the check list. The check
+ * list must be ordered with icem_candpair_prio_order() afterwards.
+ *
+ * @param cpp   Pointer to allocated candidate pair (optional)
+ * @param icem  ICE Media object
+ * @param lcand Local candidate
+ * @param rcand Remote candidate
+ *
+ * @return 0 if success, otherwise errorcode
+ */
 int icem_candpair_alloc(struct ice_candpair **cpp, struct icem *icem,
 			struct ice_cand *lcand, struct ice_cand *rcand)
 {
 	struct ice_candpair *cp;
 	struct icem_comp *comp;
+	int err;
 
 	if (!icem || !lcand || !rcand)
 		return EINVAL;
@@ -92,10 +111,16 @@ int icem_candpair_alloc(struct ice_candpair **cpp, struct icem *icem,
 	if (!comp)
 		return ENOENT;
 
+	err = icem_conncheck_heap_reserve(icem);
+	if (err)
+		return err;
+
 	cp = mem_zalloc(sizeof(*cp), candpair_destructor);
 	if (!cp)
 		return ENOMEM;
 
+	++icem->pairc;
+
 	cp->icem  = icem;
 	cp->comp  = comp;
 	cp->lcand = mem_ref(lcand);
@@ -105,7 +130,10 @@ int icem_candpair_alloc(struct ice_candpair **cpp, struct icem *icem,
 
 	candpair_set_pprio(cp);
 
-	list_add_sorted(&icem->checkl, cp);
+	list_append(&icem->checkl, &cp->le, cp);
+	hash_append(icem->ht_pair, sa_hash(&rcand->addr, SA_ALL), &cp->he, cp);
+
+	icem_conncheck_heap_update(cp);
 
 	if (cpp)
 		*cpp = cp;
@@ -118,14 +146,21 @@ int icem_candpair_clone(struct ice_candpair **cpp, struct ice_candpair *cp0,
 			struct ice_cand *lcand, struct ice_cand *rcand)
 {
 	struct ice_candpair *cp;
+	int err;
 
 	if (!cp0)
 		return EINVAL;
 
+	err = icem_conncheck_heap_reserve(cp0->icem);
+	if (err)
+		return err;
+
 	cp = mem_zalloc(sizeof(*cp), candpair_destructor);
 	if (!cp)
 		return ENOMEM;
 
+	++cp0->icem->pairc;
+
 	cp->icem      = cp0->icem;
 	cp->comp      = cp0->comp;
 	cp->lcand     = mem_ref(lcand ? lcand : cp0->lcand);
@@ -139,6 +174,10 @@ int icem_candpair_clone(struct ice_candpair **cpp, struct ice_candpair *cp0,
 	cp->scode     = cp0->scode;
 
 	list_add_sorted(&cp0->icem->checkl, cp);
+	hash_append(cp->icem->ht_pair, sa_hash(&cp->rcand->addr, SA_ALL),
+		    &cp->he, cp);
+
+	icem_conncheck_heap_update(cp);
 
 	if (cpp)
 		*cpp = cp;
@@ -150,6 +189,7 @@ int icem_candpair_clone(struct ice_candpair **cpp, struct ice_candpair *cp0,
 /** Computing Pair Priority and Ordering Pairs */
 void icem_candpair_prio_order(struct list *lst)
 {
+	struct ice_candpair *cp0 = list_ledata(list_head(lst));
 	struct le *le;
 
 	for (le = list_head(lst); le; le = le->next) {
@@ -159,6 +199,10 @@ void icem_candpair_prio_order(struct list *lst)
 	}
 
 	list_sort(lst, sort_handler, NULL);
+
+	/* the priorities of the pairs in the heap may have changed */
+	if (cp0)
+		icem_conncheck_heap_build(cp0->icem);
 }
 
 
@@ -185,6 +229,7 @@ void icem_candpair_make_valid(struct ice_candpair *cp)
 
 	list_unlink(&cp->le);
 	list_add_sorted(&cp->icem->validl, cp);
+	icem_conncheck_heap_remove(cp);
 }
 
 
@@ -217,6 +262,8 @@ void icem_candpair_set_state(struct ice_candpair *cp,
 		       ice_candpair_state2name(state));
 
 	cp->state = state;
+
+	icem_conncheck_heap_update(cp);
 }
 
 
@@ -273,6 +320,25 @@ bool icem_candpair_cmp(const struct ice_candpair *cp1,
 }
 
 
+static bool candpair_match(const struct ice_candpair *cp,
+			   const struct ice_cand *lcand,
+			   const struct ice_cand *rcand)
+{
+	if (!cp->lcand || !cp->rcand) {
+		DEBUG_WARNING("corrupt candpair %p\n", cp);
+		return false;
+	}
+
+	if (lcand && cp->lcand != lcand)
+		return false;
+
+	if (rcand && cp->rcand != rcand)
+		return false;
+
+	return true;
+}
+
+
 /**
  * Find the highest-priority candidate-pair in a given list, with
  * optional match parameters
@@ -283,33 +349,51 @@ bool icem_candpair_cmp(const struct ice_candpair *cp1,
  *
  * @return Matching candidate pair if found, otherwise NULL
  *
- * note: assume list is sorted by priority
+ * note: assume list is sorted by priority. With a remote candidate,
+ *       only the pairs with its address are searched, in the hash
+ *       of the pairs by remote address.
  */
 struct ice_candpair *icem_candpair_find(const struct list *lst,
 				    const struct ice_cand *lcand,
 				    const struct ice_cand *rcand)
 {
+	const struct ice_candpair *cp0 = list_ledata(list_head(lst));
+	struct ice_candpair *best = NULL;
 	struct le *le;
 
-	for (le = list_head(lst); le; le = le->next) {
+	if (!cp0)
+		return NULL;
 
-		struct ice_candpair *cp = le->data;
+	if (!rcand) {
+		for (le = list_head(lst); le; le = le->next) {
 
-		if (!cp->lcand || !cp->rcand) {
-			DEBUG_WARNING("corrupt candpair %p\n", cp);
-			continue;
+			struct ice_candpair *cp = le->data;
+
+			if (candpair_match(cp, lcand, rcand))
+				return cp;
 		}
 
-		if (lcand && cp->lcand != lcand)
+		return NULL;
+	}
+
+	le = list_head(hash_list(cp0->icem->ht_pair,
+				 sa_hash(&rcand->addr, SA_ALL)));
+
+	for (; le; le = le->next) {
+
+		struct ice_candpair *cp = le->data;
+
+		if (cp->le.list != lst)
 			continue;
 
-		if (rcand && cp->rcand != rcand)
+		if (!candpair_match(cp, lcand, rcand))
 			continue;
 
-		return cp;
+		if (!best || cp->pprio > best->pprio)
+			best = cp;
 	}
 
-	return NULL;
+	return best;
 }
 
 
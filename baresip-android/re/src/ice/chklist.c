@@ -9,7 +9,9 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_stun.h>
 #include <re_ice.h>
@@ -69,20 +71,38 @@ static const struct sa *cand_srflx_addr(const struct ice_cand *c)
 }
 
 
-/* return: NULL to keep, pointer to remove object */
-static void *unique_handler(struct le *le1, struct le *le2)
+/*
+ * A pair is redundant if there is another pair on the check list with
+ * the same local and remote candidates. All such pairs have the same
+ * remote address, and are found in the same bucket of the pair hash.
+ */
+static bool candpair_redundant(const struct icem *icem,
+			       const struct ice_candpair *cp)
 {
-	struct ice_candpair *cp1 = le1->data, *cp2 = le2->data;
+	struct le *le;
 
-	if (cp1->comp->id != cp2->comp->id)
-		return NULL;
+	le = list_head(hash_list(icem->ht_pair,
+				 sa_hash(&cp->rcand->addr, SA_ALL)));
 
-	if (!sa_cmp(cand_srflx_addr(cp1->lcand),
-		    cand_srflx_addr(cp2->lcand), SA_ALL) ||
-	    !sa_cmp(&cp1->rcand->addr, &cp2->rcand->addr, SA_ALL))
-		return NULL;
+	for (; le; le = le->next) {
+
+		const struct ice_candpair *cp2 = le->data;
+
+		if (cp2 == cp || cp2->le.list != &icem->checkl)
+			continue;
+
+		if (cp2->comp->id != cp->comp->id)
+			continue;
+
+		if (!sa_cmp(cand_srflx_addr(cp->lcand),
+			    cand_srflx_addr(cp2->lcand), SA_ALL) ||
+		    !sa_cmp(&cp->rcand->addr, &cp2->rcand->addr, SA_ALL))
+			continue;
+
+		return true;
+	}
 
-	return cp1->pprio < cp2->pprio ? cp1 : cp2;
+	return false;
 }
 
 
@@ -96,10 +116,26 @@ static void candpair_prune(struct icem *icem)
 	   candidates are identical to the local and remote candidates
 	   of a pair higher up on the priority list.
 
-	   NOTE: This logic assumes the list is sorted by priority
+	   NOTE: This logic assumes the list is sorted by priority.
+	   The list is walked from the lowest priority, so that of the
+	   identical pairs only the highest one is left.
 	*/
 
-	uint32_t n = ice_list_unique(&icem->checkl, unique_handler);
+	struct le *le = icem->checkl.tail;
+	uint32_t n = 0;
+
+	while (le) {
+
+		struct ice_candpair *cp = le->data;
+
+		le = le->prev;
+
+		if (candpair_redundant(icem, cp)) {
+			mem_deref(cp);
+			++n;
+		}
+	}
+
 	if (n > 0) {
 		DEBUG_NOTICE("%s: pruned candidate pairs: %u\n",
 			     icem->name, n);
@@ -107,38 +143,87 @@ static void candpair_prune(struct icem *icem)
 }
 
 
+static uint32_t fnd_hash(const struct ice_candpair *cp)
+{
+	return hash_joaat_str(cp->lcand->foundation) ^
+		hash_joaat_str(cp->rcand->foundation);
+}
+
+
+/*
+ * Of the pairs from le onwards with the same foundation as cp, find the
+ * one with the lowest component ID
+ */
+static struct ice_candpair *fnd_lowest(struct ice_candpair *cp,
+				       struct le *le)
+{
+	for (; le; le = le->next) {
+
+		struct ice_candpair *cp2 = le->data;
+
+		if (!icem_candpair_cmp_fnd(cp, cp2))
+			continue;
+
+		if (cp2->lcand->compid < cp->lcand->compid &&
+		    cp2->pprio > cp->pprio)
+			cp = cp2;
+	}
+
+	return cp;
+}
+
+
 /**
  * Computing States
  */
 void ice_candpair_set_states(struct icem *icem)
 {
-	struct le *le, *le2;
+	struct hash *ht = NULL;
+	struct le *lev = NULL, *le;
+	uint32_t n, i = 0;
+
+	if (!icem)
+		return;
 
 	/*
 	For all pairs with the same foundation, it sets the state of
 	the pair with the lowest component ID to Waiting.  If there is
 	more than one such pair, the one with the highest priority is
 	used.
+
+	The pairs are grouped by foundation in a temporary hash, in the
+	order of the check list. Without memory for it, all of the check
+	list is searched for every pair.
 	*/
 
-	for (le = icem->checkl.head; le; le = le->next) {
+	n = list_count(&icem->checkl);
+
+	if (n && !hash_alloc(&ht, hash_valid_size(n)))
+		lev = mem_zalloc(n * sizeof(*lev), NULL);
+
+	for (le = lev ? icem->checkl.head : NULL; le; le = le->next) {
 
 		struct ice_candpair *cp = le->data;
 
-		for (le2 = icem->checkl.head; le2; le2 = le2->next) {
+		hash_append(ht, fnd_hash(cp), &lev[i++], cp);
+	}
 
-			struct ice_candpair *cp2 = le2->data;
+	for (le = icem->checkl.head; le; le = le->next) {
 
-			if (!icem_candpair_cmp_fnd(cp, cp2))
-				continue;
+		struct ice_candpair *cp = le->data;
+		struct le *first;
 
-			if (cp2->lcand->compid < cp->lcand->compid &&
-			    cp2->pprio > cp->pprio)
-				cp = cp2;
-		}
+		if (lev)
+			first = list_head(hash_list(ht, fnd_hash(cp)));
+		else
+			first = icem->checkl.head;
 
-		icem_candpair_set_state(cp, ICE_CANDPAIR_WAITING);
+		icem_candpair_set_state(fnd_lowest(cp, first),
+					ICE_CANDPAIR_WAITING);
 	}
+
+	mem_deref(ht);
+	mem_deref(lev);
 }
 
 
@@ -193,6 +278,10 @@ static bool iscompleted(const struct icem *icem)
 {
 	struct le *le;
 
+	/* the pairs in the heap are Waiting or Frozen */
+	if (icem->heapc)
+		return false;
+
 	for (le = icem->checkl.head; le; le = le->next) {
 
 		const struct ice_candpair *cp = le->data;
@@ -10,6 +10,7 @@
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sys.h>
 #include <re_sa.h>
 #include <re_udp.h>
@@ -31,18 +32,25 @@ static bool helper_recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 {
 	struct icem_comp *comp = arg;
 	struct icem *icem = comp->icem;
-	struct stun_msg *msg = NULL;
+	struct stun_msg *msg, *hmsg = NULL;
 	struct stun_unknown_attr ua;
+	struct stun_msg_fixed fm;
 	const size_t start = mb->pos;
+	int err;
 
 #if 0
 	re_printf("{%d} UDP recv_helper: %u bytes from %J\n",
 		  comp->id, mbuf_get_left(mb), src);
 #endif
 
-	if (stun_msg_decode(&msg, mb, &ua))
+	err = stun_msg_decode_fixed(&fm, mb, &ua);
+	if (err == EOVERFLOW)
+		err = stun_msg_decode(&hmsg, mb, &ua);
+	if (err)
 		return false;
 
+	msg = hmsg ? hmsg : &fm.msg;
+
 	if (STUN_METHOD_BINDING == stun_msg_method(msg)) {
 
 		switch (stun_msg_class(msg)) {
@@ -57,17 +65,33 @@ static bool helper_recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 		}
 	}
 
-	mem_deref(msg);
+	mem_deref(hmsg);
 
 	return true;  /* handled */
 }
 
 
+/* media on the selected pair makes the keep-alives unnecessary */
+static bool helper_send_handler(int *err, struct sa *dst, struct mbuf *mb,
+				void *arg)
+{
+	struct icem_comp *comp = arg;
+	(void)err;
+	(void)mb;
+
+	if (!comp->ka_send && kalive_isrunning(&comp->ka) && comp->cp_sel &&
+	    sa_cmp(dst, &comp->cp_sel->rcand->addr, SA_ALL))
+		kalive_activity(&comp->ka);
+
+	return false;
+}
+
+
 static void destructor(void *arg)
 {
 	struct icem_comp *comp = arg;
 
-	tmr_cancel(&comp->tmr_ka);
+	kalive_cancel(&comp->ka);
 	mem_deref(comp->ct_gath);
 	mem_deref(comp->turnc);
 	mem_deref(comp->cp_sel);
@@ -134,8 +158,11 @@ int icem_comp_alloc(struct icem_comp **cp, struct icem *icem, int id,
 	comp->sock = mem_ref(sock);
 	comp->icem = icem;
 
+	kalive_init(&comp->ka, ICE_DEFAULT_Tr * 1000);
+
 	err = udp_register_helper(&comp->uh, sock, icem->layer,
-				  NULL, helper_recv_handler, comp);
+				  helper_send_handler, helper_recv_handler,
+				  comp);
 	if (err)
 		goto out;
 
@@ -234,17 +261,18 @@ static void timeout(void *arg)
 	struct icem_comp *comp = arg;
 	struct ice_candpair *cp;
 
-	tmr_start(&comp->tmr_ka, ICE_DEFAULT_Tr * 1000 + rand_u16() % 1000,
-		  timeout, comp);
+	(void)kalive_start(&comp->ka, ICE_DEFAULT_Tr * 1000, timeout, comp);
 
 	/* find selected candidate-pair */
 	cp = comp->cp_sel;
 	if (!cp)
 		return;
 
+	comp->ka_send = true;
 	(void)stun_indication(comp->icem->proto, comp->sock, &cp->rcand->addr,
 			      (cp->lcand->type == ICE_CAND_TYPE_RELAY) ? 4 : 0,
 			      STUN_METHOD_BINDING, NULL, 0, true, 0);
+	comp->ka_send = false;
 }
 
 
@@ -254,10 +282,11 @@ void icem_comp_keepalive(struct icem_comp *comp, bool enable)
 		return;
 
 	if (enable) {
-		tmr_start(&comp->tmr_ka, ICE_DEFAULT_Tr * 1000, timeout, comp);
+		(void)kalive_start(&comp->ka, ICE_DEFAULT_Tr * 1000,
+				   timeout, comp);
 	}
 	else {
-		tmr_cancel(&comp->tmr_ka);
+		kalive_cancel(&comp->ka);
 	}
 }
 
@@ -9,6 +9,7 @@
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_stun.h>
 #include <re_turn.h>
@@ -21,6 +22,197 @@
 #include <re_dbg.h>
 
 
+/*
+ * The pairs of the check list that are Waiting or Frozen are kept in a
+ * binary heap, ordered by state and then by pair priority, so that the
+ * scheduler finds the next pair to check without walking the list. Every
+ * pair knows its position in the heap.
+ */
+
+
+static bool heap_before(const struct ice_candpair *cp1,
+			const struct ice_candpair *cp2)
+{
+	if (cp1->state != cp2->state)
+		return cp1->state == ICE_CANDPAIR_WAITING;
+
+	return cp1->pprio > cp2->pprio;
+}
+
+
+static void heap_set(struct icem *icem, uint32_t i, struct ice_candpair *cp)
+{
+	icem->heapv[i] = cp;
+	cp->hidx = i + 1;
+}
+
+
+static void heap_up(struct icem *icem, uint32_t i)
+{
+	struct ice_candpair *cp = icem->heapv[i];
+
+	while (i > 0) {
+
+		const uint32_t parent = (i - 1) / 2;
+
+		if (!heap_before(cp, icem->heapv[parent]))
+			break;
+
+		heap_set(icem, i, icem->heapv[parent]);
+		i = parent;
+	}
+
+	heap_set(icem, i, cp);
+}
+
+
+static void heap_down(struct icem *icem, uint32_t i)
+{
+	struct ice_candpair *cp = icem->heapv[i];
+
+	for (;;) {
+
+		uint32_t child = 2 * i + 1;
+
+		if (child >= icem->heapc)
+			break;
+
+		if (child + 1 < icem->heapc &&
+		    heap_before(icem->heapv[child + 1], icem->heapv[child]))
+			++child;
+
+		if (!heap_before(icem->heapv[child], cp))
+			break;
+
+		heap_set(icem, i, icem->heapv[child]);
+		i = child;
+	}
+
+	heap_set(icem, i, cp);
+}
+
+
+static bool heap_member(const struct ice_candpair *cp)
+{
+	if (cp->le.list != &cp->icem->checkl)
+		return false;
+
+	return cp->state == ICE_CANDPAIR_WAITING ||
+		cp->state == ICE_CANDPAIR_FROZEN;
+}
+
+
+/**
+ * Reserve a place in the check heap for one more candidate pair, to be
+ * called before a pair is allocated. Every pair has its place, so that
+ * updating the check heap never fails.
+ *
+ * @param icem ICE Media object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int icem_conncheck_heap_reserve(struct icem *icem)
+{
+	struct ice_candpair **heapv;
+	uint32_t sz;
+
+	if (!icem)
+		return EINVAL;
+
+	if (icem->pairc < icem->heapsz)
+		return 0;
+
+	sz = icem->heapsz ? icem->heapsz * 2 : 16;
+
+	heapv = mem_reallocarray(icem->heapv, sz, sizeof(*heapv), NULL);
+	if (!heapv)
+		return ENOMEM;
+
+	icem->heapv  = heapv;
+	icem->heapsz = sz;
+
+	return 0;
+}
+
+
+/**
+ * Update the position of a candidate pair in the check heap, after its
+ * state or its list has changed
+ *
+ * @param cp Candidate pair
+ */
+void icem_conncheck_heap_update(struct ice_candpair *cp)
+{
+	struct icem *icem;
+
+	if (!cp)
+		return;
+
+	if (!heap_member(cp)) {
+		icem_conncheck_heap_remove(cp);
+		return;
+	}
+
+	icem = cp->icem;
+
+	if (cp->hidx) {
+		heap_up(icem, cp->hidx - 1);
+		heap_down(icem, cp->hidx - 1);
+		return;
+	}
+
+	/* the place was reserved when the pair was allocated */
+	heap_set(icem, icem->heapc++, cp);
+	heap_up(icem, cp->hidx - 1);
+}
+
+
+/**
+ * Remove a candidate pair from the check heap
+ *
+ * @param cp Candidate pair
+ */
+void icem_conncheck_heap_remove(struct ice_candpair *cp)
+{
+	struct ice_candpair *last;
+	struct icem *icem;
+	uint32_t i;
+
+	if (!cp || !cp->hidx)
+		return;
+
+	icem = cp->icem;
+	i = cp->hidx - 1;
+	cp->hidx = 0;
+
+	last = icem->heapv[--icem->heapc];
+	if (last == cp)
+		return;
+
+	heap_set(icem, i, last);
+	heap_up(icem, i);
+	heap_down(icem, last->hidx - 1);
+}
+
+
+/**
+ * Restore the order of the check heap, after the pair priorities have
+ * been recomputed
+ *
+ * @param icem ICE Media object
+ */
+void icem_conncheck_heap_build(struct icem *icem)
+{
+	uint32_t i;
+
+	if (!icem || icem->heapc < 2)
+		return;
+
+	for (i = icem->heapc / 2; i-- > 0;)
+		heap_down(icem, i);
+}
+
+
 static void pace_next(struct icem *icem)
 {
 	if (icem->state != ICE_CHECKLIST_RUNNING)
@@ -341,19 +533,11 @@ void icem_conncheck_schedule_check(struct icem *icem)
 	struct ice_candpair *cp;
 
 	/* Find the highest priority pair in that check list that is in the
-	   Waiting state. */
-	cp = icem_candpair_find_st(&icem->checkl, 0, ICE_CANDPAIR_WAITING);
+	   Waiting state. If there is no such pair, find the highest
+	   priority pair in that check list that is in the Frozen state.
+	   The top of the heap is either. */
+	cp = icem->heapc ? icem->heapv[0] : NULL;
 	if (cp) {
-		do_check(cp);
-		return;
-	}
-
-	/* If there is no such pair: */
-
-	/* Find the highest priority pair in that check list that is in
-	   the Frozen state. */
-	cp = icem_candpair_find_st(&icem->checkl, 0, ICE_CANDPAIR_FROZEN);
-	if (cp) { /* If there is such a pair: */
 
 		/* Unfreeze the pair.
 		   Perform a check for that pair, causing its state to
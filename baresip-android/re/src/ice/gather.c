@@ -9,6 +9,7 @@
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_stun.h>
 #include <re_turn.h>
@@ -32,6 +32,10 @@ enum {
 	ICE_DEFAULT_RC          =   7  /**< Retransmission count            */
 };
 
+enum {
+	ICE_PAIR_HASH_SIZE = 128       /**< Candidate pairs hash size       */
+};
+
 
 /** Defines a media-stream component */
 struct icem_comp {
@@ -47,7 +51,8 @@ struct icem_comp {
 	bool concluded;              /**< Concluded flag                    */
 	struct turnc *turnc;         /**< TURN Client                       */
 	struct stun_ctrans *ct_gath; /**< STUN Transaction for gathering    */
-	struct tmr tmr_ka;           /**< Keep-alive timer                  */
+	struct kalive ka;            /**< Keep-alive timer                  */
+	bool ka_send;                /**< Sending a keep-alive              */
 };
 
 /** Defines an ICE media-stream */
@@ -60,6 +65,11 @@ struct icem {
 	struct list rcandl;          /**< List of remote candidates          */
 	struct list checkl;          /**< Check List of cand pairs (sorted)  */
 	struct list validl;          /**< Valid List of cand pairs (sorted)  */
+	struct hash *ht_pair;        /**< Cand pairs by remote address       */
+	struct ice_candpair **heapv; /**< Waiting and Frozen pairs (heap)    */
+	uint32_t heapc;              /**< Number of pairs in the heap        */
+	uint32_t heapsz;             /**< Size of the heap array             */
+	uint32_t pairc;              /**< Number of candidate pairs          */
 	uint64_t tiebrk;             /**< Tie-break value for roleconflict   */
 	bool mismatch;               /**< ICE mismatch flag                  */
 	enum ice_mode lmode;         /**< Local mode                         */
@@ -99,6 +109,7 @@ struct ice_cand {
 /** Defines a candidate pair */
 struct ice_candpair {
 	struct le le;                /**< List element                       */
+	struct le he;                /**< Hash element, by remote address    */
 	struct icem *icem;           /**< Pointer to parent ICE media        */
 	struct icem_comp *comp;      /**< Pointer to media-stream component  */
 	struct ice_cand *lcand;      /**< Local candidate                    */
@@ -111,6 +122,7 @@ struct ice_candpair {
 	struct stun_ctrans *ct_conn; /**< STUN Transaction for conncheck     */
 	int err;                     /**< Saved error code, if failed        */
 	uint16_t scode;              /**< Saved STUN code, if failed         */
+	uint32_t hidx;               /**< Heap position + 1, 0 if not there  */
 };
 
 
@@ -199,6 +211,10 @@ int  icecomp_debug(struct re_printf *pf, const struct icem_comp *comp);
 void icem_conncheck_schedule_check(struct icem *icem);
 void icem_conncheck_continue(struct icem *icem);
 int  icem_conncheck_send(struct ice_candpair *cp, bool use_cand, bool trigged);
+int  icem_conncheck_heap_reserve(struct icem *icem);
+void icem_conncheck_heap_update(struct ice_candpair *cp);
+void icem_conncheck_heap_remove(struct ice_candpair *cp);
+void icem_conncheck_heap_build(struct icem *icem);
 
 
 /* icestr */
@@ -8,7 +8,9 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_stun.h>
 #include <re_turn.h>
@@ -59,6 +61,8 @@ static void icem_destructor(void *data)
 	list_flush(&icem->checkl);
 	list_flush(&icem->lcandl);
 	list_flush(&icem->rcandl);
+	mem_deref(icem->ht_pair);
+	mem_deref(icem->heapv);
 	mem_deref(icem->lufrag);
 	mem_deref(icem->lpwd);
 	mem_deref(icem->rufrag);
@@ -130,6 +134,10 @@ int  icem_alloc(struct icem **icemp,
 	icem->lmode = mode;
 	icem->tiebrk = tiebrk;
 
+	err = hash_alloc(&icem->ht_pair, ICE_PAIR_HASH_SIZE);
+	if (err)
+		goto out;
+
 	err |= str_dup(&icem->lufrag, lufrag);
 	err |= str_dup(&icem->lpwd, lpwd);
 	if (err)
@@ -0,0 +1,907 @@
+/**
+ * @file json/doc.c  JSON document decoder -- zero-copy, incremental
+ *
+ * Copyright (C) 2010 - 2015 Creytiv.com
+ */
+
+#include <string.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_odict.h>
+#include <re_json.h>
+
+
+/*
+ * All nodes of a document live in one array, linked by index. String
+ * values, keys and numbers are referenced by offset into the source
+ * buffer, which is either the caller's buffer (json_doc_decode) or an
+ * internal buffer the chunks are appended to (json_doc_feed). Offsets
+ * stay valid when the internal buffer grows.
+ */
+
+
+enum {
+	NODE_MIN = 64,
+};
+
+enum state {
+	ST_START,         /* before the root container          */
+	ST_KEY_OR_END,    /* after '{'                          */
+	ST_KEY,           /* after ',' in an object             */
+	ST_KEY_STR,       /* inside a key                       */
+	ST_COLON,         /* after a key                        */
+	ST_VALUE_OR_END,  /* after '['                          */
+	ST_VALUE,         /* after ':', or after ',' in an array */
+	ST_VALUE_STR,     /* inside a string value              */
+	ST_NEXT,          /* after a value                      */
+	ST_DONE,          /* root container closed              */
+};
+
+struct level {
+	uint32_t node;
+	uint32_t last;
+};
+
+struct json_doc {
+	struct mbuf *mb;          /* Received chunks, or NULL         */
+	const char *buf;          /* Source buffer                    */
+	size_t len;               /* Bytes in source buffer           */
+	size_t pos;               /* Parse position                   */
+	struct json_node *nodev;  /* Node arena                       */
+	uint32_t nodec;           /* Nodes in use                     */
+	uint32_t nodesz;          /* Nodes allocated                  */
+	struct level *stack;      /* Open containers                  */
+	unsigned depth;
+	unsigned maxdepth;
+	enum state state;
+	size_t tok;               /* Start of current string          */
+	bool esc;                 /* Escape pending in current string */
+	uint32_t key_off;         /* Pending object key               */
+	uint32_t key_len;
+};
+
+
+static const double pow10v[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static void destructor(void *arg)
+{
+	struct json_doc *doc = arg;
+
+	mem_deref(doc->stack);
+	mem_deref(doc->nodev);
+	mem_deref(doc->mb);
+}
+
+
+static int doc_alloc(struct json_doc **docp, unsigned maxdepth,
+		     uint32_t nodesz)
+{
+	struct json_doc *doc;
+
+	doc = mem_zalloc(sizeof(*doc), destructor);
+	if (!doc)
+		return ENOMEM;
+
+	doc->maxdepth = maxdepth;
+	doc->nodesz   = max(nodesz, NODE_MIN);
+	doc->nodev    = mem_alloc(doc->nodesz * sizeof(*doc->nodev), NULL);
+	doc->stack    = mem_alloc((maxdepth + 1) * sizeof(*doc->stack), NULL);
+	if (!doc->nodev || !doc->stack) {
+		mem_deref(doc);
+		return ENOMEM;
+	}
+
+	*docp = doc;
+
+	return 0;
+}
+
+
+static int node_add(uint32_t *idxp, struct json_doc *doc,
+		    enum odict_type type, size_t off, size_t len)
+{
+	struct json_node *n;
+	uint32_t idx;
+
+	if (doc->nodec == doc->nodesz) {
+
+		struct json_node *nodev;
+
+		if (doc->nodesz > UINT32_MAX / 2)
+			return EOVERFLOW;
+
+		nodev = mem_realloc(doc->nodev,
+				    2 * doc->nodesz * sizeof(*nodev));
+		if (!nodev)
+			return ENOMEM;
+
+		doc->nodev   = nodev;
+		doc->nodesz *= 2;
+	}
+
+	idx = doc->nodec++;
+	n = &doc->nodev[idx];
+
+	n->type    = type;
+	n->next    = 0;
+	n->child   = 0;
+	n->count   = 0;
+	n->val_off = (uint32_t)off;
+	n->val_len = (uint32_t)len;
+	n->key_off = 0;
+	n->key_len = 0;
+
+	if (doc->depth) {
+
+		struct level *lvl = &doc->stack[doc->depth - 1];
+		struct json_node *parent = &doc->nodev[lvl->node];
+
+		if (parent->type == ODICT_OBJECT) {
+			n->key_off = doc->key_off;
+			n->key_len = doc->key_len;
+		}
+
+		if (lvl->last)
+			doc->nodev[lvl->last].next = idx;
+		else
+			parent->child = idx;
+
+		lvl->last = idx;
+		++parent->count;
+	}
+
+	*idxp = idx;
+
+	return 0;
+}
+
+
+static int container_open(struct json_doc *doc, enum odict_type type)
+{
+	uint32_t idx;
+	int err;
+
+	if (doc->depth > doc->maxdepth)
+		return EOVERFLOW;
+
+	err = node_add(&idx, doc, type, doc->pos, 0);
+	if (err)
+		return err;
+
+	doc->stack[doc->depth].node = idx;
+	doc->stack[doc->depth].last = 0;
+	++doc->depth;
+
+	if (type == ODICT_OBJECT)
+		doc->state = ST_KEY_OR_END;
+	else
+		doc->state = ST_VALUE_OR_END;
+
+	return 0;
+}
+
+
+static int container_close(struct json_doc *doc, enum odict_type type)
+{
+	struct json_node *n;
+
+	if (!doc->depth)
+		return EBADMSG;
+
+	n = &doc->nodev[doc->stack[doc->depth - 1].node];
+	if (n->type != type)
+		return EBADMSG;
+
+	n->val_len = (uint32_t)(doc->pos + 1 - n->val_off);
+
+	--doc->depth;
+
+	doc->state = doc->depth ? ST_NEXT : ST_DONE;
+
+	return 0;
+}
+
+
+static bool is_token_char(char ch)
+{
+	return ('0' <= ch && ch <= '9') || ('a' <= ch && ch <= 'z') ||
+		ch == '-' || ch == '+' || ch == '.' || ch == 'E';
+}
+
+
+static int number_decode(struct json_node *n, const char *p, size_t len)
+{
+	const char *end = p + len;
+	uint64_t mant = 0;
+	int exp10 = 0, e = 0;
+	bool neg = false, eneg = false, isfloat = false;
+	unsigned digits = 0;
+	double d;
+
+	if (p < end && *p == '-') {
+		neg = true;
+		++p;
+	}
+
+	if (p == end || *p < '0' || *p > '9')
+		return EBADMSG;
+
+	/* keep up to 19 significant digits in the mantissa */
+	for (; p < end && '0' <= *p && *p <= '9'; p++) {
+		if (digits < 19) {
+			mant = mant * 10 + (*p - '0');
+			digits += (mant != 0);
+		}
+		else
+			++exp10;
+	}
+
+	if (p < end && *p == '.') {
+
+		const char *frac = ++p;
+
+		for (; p < end && '0' <= *p && *p <= '9'; p++) {
+			if (digits < 19) {
+				mant = mant * 10 + (*p - '0');
+				digits += (mant != 0);
+				--exp10;
+			}
+		}
+
+		if (p == frac)
+			return EBADMSG;
+
+		isfloat = true;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+
+		const char *ep;
+
+		++p;
+		if (p < end && (*p == '-' || *p == '+'))
+			eneg = (*p++ == '-');
+
+		for (ep = p; p < end && '0' <= *p && *p <= '9'; p++) {
+			if (e < 10000)
+				e = e * 10 + (*p - '0');
+		}
+
+		if (p == ep)
+			return EBADMSG;
+
+		if (eneg)
+			isfloat = true;
+
+		exp10 += eneg ? -e : e;
+	}
+
+	if (p != end)
+		return EBADMSG;
+
+	if (!isfloat && exp10 >= 0 && exp10 < 19) {
+
+		uint64_t v = mant;
+		int i;
+
+		for (i=0; i<exp10 && v <= INT64_MAX / 10; i++)
+			v *= 10;
+
+		if (i == exp10 && v <= (uint64_t)INT64_MAX) {
+			n->type      = ODICT_INT;
+			n->u.integer = neg ? -(int64_t)v : (int64_t)v;
+			return 0;
+		}
+	}
+
+	d = (double)mant;
+
+	while (exp10 > 22) {
+		d *= 1e22;
+		exp10 -= 22;
+	}
+	while (exp10 < -22) {
+		d /= 1e22;
+		exp10 += 22;
+	}
+
+	if (exp10 >= 0)
+		d *= pow10v[exp10];
+	else
+		d /= pow10v[-exp10];
+
+	/* fractions, and integers out of int64 range */
+	n->type  = ODICT_DOUBLE;
+	n->u.dbl = neg ? -d : d;
+
+	return 0;
+}
+
+
+static int scalar_decode(struct json_doc *doc, size_t len)
+{
+	const char *p = doc->buf + doc->pos;
+	struct json_node *n;
+	uint32_t idx;
+	int err;
+
+	err = node_add(&idx, doc, ODICT_NULL, doc->pos, len);
+	if (err)
+		return err;
+
+	n = &doc->nodev[idx];
+
+	if (len == 4 && !memcmp(p, "null", 4)) {
+		n->type = ODICT_NULL;
+	}
+	else if (len == 4 && !memcmp(p, "true", 4)) {
+		n->type      = ODICT_BOOL;
+		n->u.boolean = true;
+	}
+	else if (len == 5 && !memcmp(p, "false", 5)) {
+		n->type      = ODICT_BOOL;
+		n->u.boolean = false;
+	}
+	else {
+		err = number_decode(n, p, len);
+	}
+
+	return err;
+}
+
+
+/* Scan a string from doc->pos, returns true when the closing quote
+ * was found. doc->pos is left on the quote. */
+static bool string_scan(struct json_doc *doc)
+{
+	const char *p   = doc->buf + doc->pos;
+	const char *end = doc->buf + doc->len;
+	bool esc = doc->esc;
+
+	for (; p < end; p++) {
+
+		if (esc)
+			esc = false;
+		else if (*p == '\\')
+			esc = true;
+		else if (*p == '"')
+			break;
+	}
+
+	doc->esc = esc;
+	doc->pos = p - doc->buf;
+
+	return p < end;
+}
+
+
+static int value_start(struct json_doc *doc, char ch)
+{
+	size_t i;
+
+	switch (ch) {
+
+	case '{':
+		return container_open(doc, ODICT_OBJECT);
+
+	case '[':
+		return container_open(doc, ODICT_ARRAY);
+
+	case '"':
+		doc->tok   = doc->pos + 1;
+		doc->esc   = false;
+		doc->state = ST_VALUE_STR;
+		return 0;
+
+	default:
+		break;
+	}
+
+	for (i=doc->pos; i<doc->len && is_token_char(doc->buf[i]); i++)
+		;
+
+	if (i == doc->pos)
+		return EBADMSG;
+
+	/* the token may continue in the next chunk */
+	if (i == doc->len)
+		return EAGAIN;
+
+	if (scalar_decode(doc, i - doc->pos))
+		return EBADMSG;
+
+	doc->pos   = i - 1;
+	doc->state = ST_NEXT;
+
+	return 0;
+}
+
+
+static int parse(struct json_doc *doc)
+{
+	uint32_t idx;
+	int err;
+
+	for (; doc->pos < doc->len; ++doc->pos) {
+
+		const char ch = doc->buf[doc->pos];
+
+		if (doc->state == ST_KEY_STR || doc->state == ST_VALUE_STR) {
+
+			if (!string_scan(doc))
+				return 0;
+
+			if (doc->state == ST_KEY_STR) {
+				doc->key_off = (uint32_t)doc->tok;
+				doc->key_len = (uint32_t)(doc->pos - doc->tok);
+				doc->state   = ST_COLON;
+				continue;
+			}
+
+			err = node_add(&idx, doc, ODICT_STRING, doc->tok,
+				       doc->pos - doc->tok);
+			if (err)
+				return err;
+
+			doc->state = ST_NEXT;
+			continue;
+		}
+
+		if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+			continue;
+
+		switch (doc->state) {
+
+		case ST_START:
+			if (ch != '{' && ch != '[')
+				return EBADMSG;
+
+			err = value_start(doc, ch);
+			break;
+
+		case ST_KEY_OR_END:
+			if (ch == '}') {
+				err = container_close(doc, ODICT_OBJECT);
+				break;
+			}
+			/*@fallthrough@*/
+
+		case ST_KEY:
+			if (ch != '"')
+				return EBADMSG;
+
+			doc->tok   = doc->pos + 1;
+			doc->esc   = false;
+			doc->state = ST_KEY_STR;
+			err = 0;
+			break;
+
+		case ST_COLON:
+			if (ch != ':')
+				return EBADMSG;
+
+			doc->state = ST_VALUE;
+			err = 0;
+			break;
+
+		case ST_VALUE_OR_END:
+			if (ch == ']') {
+				err = container_close(doc, ODICT_ARRAY);
+				break;
+			}
+			/*@fallthrough@*/
+
+		case ST_VALUE:
+			err = value_start(doc, ch);
+			if (err == EAGAIN)
+				return 0;
+			break;
+
+		case ST_NEXT:
+			if (ch == '}')
+				err = container_close(doc, ODICT_OBJECT);
+			else if (ch == ']')
+				err = container_close(doc, ODICT_ARRAY);
+			else if (ch != ',')
+				err = EBADMSG;
+			else {
+				const struct json_node *n;
+
+				n = &doc->nodev[doc->stack[doc->depth-1].node];
+				doc->state = (n->type == ODICT_OBJECT)
+					? ST_KEY : ST_VALUE;
+				err = 0;
+			}
+			break;
+
+		case ST_DONE:
+			/* trailing data is left to the caller */
+			return 0;
+
+		default:
+			return EBADMSG;
+		}
+
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Decode a JSON document without copying. The document refers to the
+ * source buffer, which must outlive it.
+ *
+ * @param docp     Pointer to allocated JSON document
+ * @param str      Source buffer
+ * @param len      Length of source buffer
+ * @param maxdepth Maximum nesting depth
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int json_doc_decode(struct json_doc **docp, const char *str, size_t len,
+		    unsigned maxdepth)
+{
+	struct json_doc *doc;
+	int err;
+
+	if (!docp || !str)
+		return EINVAL;
+
+	if (len > UINT32_MAX)
+		return EOVERFLOW;
+
+	/* roughly one node per 16 bytes of typical JSON */
+	err = doc_alloc(&doc, maxdepth, (uint32_t)(len / 16));
+	if (err)
+		return err;
+
+	doc->buf = str;
+	doc->len = len;
+
+	err = parse(doc);
+	if (!err && doc->state != ST_DONE)
+		err = EBADMSG;
+
+	if (err)
+		mem_deref(doc);
+	else
+		*docp = doc;
+
+	return err;
+}
+
+
+/**
+ * Allocate a JSON document for incremental decoding with json_doc_feed()
+ *
+ * @param docp     Pointer to allocated JSON document
+ * @param maxdepth Maximum nesting depth
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int json_doc_alloc(struct json_doc **docp, unsigned maxdepth)
+{
+	struct json_doc *doc;
+	int err;
+
+	if (!docp)
+		return EINVAL;
+
+	err = doc_alloc(&doc, maxdepth, NODE_MIN);
+	if (err)
+		return err;
+
+	doc->mb = mbuf_alloc(4096);
+	if (!doc->mb) {
+		mem_deref(doc);
+		return ENOMEM;
+	}
+
+	*docp = doc;
+
+	return 0;
+}
+
+
+/**
+ * Feed a chunk of a JSON document to the decoder. The chunk is copied,
+ * and decoding continues where the previous chunk ended.
+ *
+ * @param doc JSON document
+ * @param buf Chunk
+ * @param len Length of chunk
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int json_doc_feed(struct json_doc *doc, const char *buf, size_t len)
+{
+	int err;
+
+	if (!doc || !doc->mb || (!buf && len))
+		return EINVAL;
+
+	if (doc->state == ST_DONE)
+		return EALREADY;
+
+	if (doc->mb->end + len > UINT32_MAX)
+		return EOVERFLOW;
+
+	doc->mb->pos = doc->mb->end;
+
+	err = mbuf_write_mem(doc->mb, (const uint8_t *)buf, len);
+	if (err)
+		return err;
+
+	doc->buf = (const char *)doc->mb->buf;
+	doc->len = doc->mb->end;
+
+	return parse(doc);
+}
+
+
+/**
+ * Check if the root container of a JSON document has been decoded
+ *
+ * @param doc JSON document
+ *
+ * @return true if complete, otherwise false
+ */
+bool json_doc_complete(const struct json_doc *doc)
+{
+	return doc ? doc->state == ST_DONE : false;
+}
+
+
+/**
+ * Get the root container of a JSON document
+ *
+ * @param doc JSON document
+ *
+ * @return Root node, or NULL if none
+ */
+const struct json_node *json_doc_root(const struct json_doc *doc)
+{
+	if (!doc || !doc->nodec)
+		return NULL;
+
+	return &doc->nodev[0];
+}
+
+
+/**
+ * Get the first child of an object or array node
+ *
+ * @param doc JSON document
+ * @param n   Container node
+ *
+ * @return First child node, or NULL if none
+ */
+const struct json_node *json_node_child(const struct json_doc *doc,
+				       const struct json_node *n)
+{
+	if (!doc || !n || !n->child)
+		return NULL;
+
+	return &doc->nodev[n->child];
+}
+
+
+/**
+ * Get the next sibling of a node
+ *
+ * @param doc JSON document
+ * @param n   Node
+ *
+ * @return Next node, or NULL if none
+ */
+const struct json_node *json_node_next(const struct json_doc *doc,
+				      const struct json_node *n)
+{
+	if (!doc || !n || !n->next)
+		return NULL;
+
+	return &doc->nodev[n->next];
+}
+
+
+/**
+ * Get the raw key of an object member. Escape sequences are not decoded.
+ *
+ * @param pl  Returned key
+ * @param doc JSON document
+ * @param n   Node
+ */
+void json_node_key(struct pl *pl, const struct json_doc *doc,
+		   const struct json_node *n)
+{
+	if (!pl)
+		return;
+
+	if (!doc || !n) {
+		*pl = pl_null;
+		return;
+	}
+
+	pl->p = doc->buf + n->key_off;
+	pl->l = n->key_len;
+}
+
+
+/**
+ * Get the raw text of a node. For strings this is the value without
+ * quotes and with escape sequences not decoded (see utf8_decode).
+ *
+ * @param pl  Returned text
+ * @param doc JSON document
+ * @param n   Node
+ */
+void json_node_str(struct pl *pl, const struct json_doc *doc,
+		   const struct json_node *n)
+{
+	if (!pl)
+		return;
+
+	if (!doc || !n) {
+		*pl = pl_null;
+		return;
+	}
+
+	pl->p = doc->buf + n->val_off;
+	pl->l = n->val_len;
+}
+
+
+/**
+ * Find an object member by its raw key
+ *
+ * @param doc JSON document
+ * @param obj Object node
+ * @param key Key to look up
+ *
+ * @return Member node, or NULL if not found
+ */
+const struct json_node *json_node_lookup(const struct json_doc *doc,
+					 const struct json_node *obj,
+					 const char *key)
+{
+	const struct json_node *n;
+	size_t len;
+
+	if (!doc || !obj || obj->type != ODICT_OBJECT || !key)
+		return NULL;
+
+	len = strlen(key);
+
+	for (n = json_node_child(doc, obj); n; n = json_node_next(doc, n)) {
+
+		if (n->key_len == len &&
+		    !memcmp(doc->buf + n->key_off, key, len))
+			return n;
+	}
+
+	return NULL;
+}
+
+
+static int odict_fill(struct odict *o, const struct json_doc *doc,
+		      const struct json_node *parent)
+{
+	const struct json_node *n;
+	unsigned idx = 0;
+	int err = 0;
+
+	for (n = json_node_child(doc, parent); n && !err;
+	     n = json_node_next(doc, n), idx++) {
+
+		struct odict *oc;
+		char *key, *str;
+		struct pl pl;
+
+		if (parent->type == ODICT_OBJECT) {
+			json_node_key(&pl, doc, n);
+			err = re_sdprintf(&key, "%H", utf8_decode, &pl);
+		}
+		else {
+			err = re_sdprintf(&key, "%u", idx);
+		}
+		if (err)
+			break;
+
+		switch (n->type) {
+
+		case ODICT_OBJECT:
+		case ODICT_ARRAY:
+			err = odict_alloc(&oc, hash_bsize(o->ht));
+			if (err)
+				break;
+
+			err = odict_fill(oc, doc, n);
+			if (!err)
+				err = odict_entry_add(o, key, n->type, oc);
+			mem_deref(oc);
+			break;
+
+		case ODICT_STRING:
+			json_node_str(&pl, doc, n);
+			err = re_sdprintf(&str, "%H", utf8_decode, &pl);
+			if (err)
+				break;
+
+			err = odict_entry_add(o, key, ODICT_STRING, str);
+			mem_deref(str);
+			break;
+
+		case ODICT_INT:
+			err = odict_entry_add(o, key, ODICT_INT, n->u.integer);
+			break;
+
+		case ODICT_DOUBLE:
+			err = odict_entry_add(o, key, ODICT_DOUBLE, n->u.dbl);
+			break;
+
+		case ODICT_BOOL:
+			err = odict_entry_add(o, key, ODICT_BOOL,
+					      n->u.boolean);
+			break;
+
+		case ODICT_NULL:
+			err = odict_entry_add(o, key, ODICT_NULL);
+			break;
+
+		default:
+			err = ENOSYS;
+			break;
+		}
+
+		mem_deref(key);
+	}
+
+	return err;
+}
+
+
+/**
+ * Convert a decoded JSON document to an Ordered Dictionary
+ *
+ * @param op        Pointer to allocated dictionary
+ * @param hash_size Hash table size of each dictionary
+ * @param doc       Complete JSON document
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int json_doc_odict(struct odict **op, uint32_t hash_size,
+		   const struct json_doc *doc)
+{
+	struct odict *o;
+	int err;
+
+	if (!op || !doc)
+		return EINVAL;
+
+	if (doc->state != ST_DONE)
+		return EBADMSG;
+
+	err = odict_alloc(&o, hash_size);
+	if (err)
+		return err;
+
+	err = odict_fill(o, doc, json_doc_root(doc));
+	if (err)
+		mem_deref(o);
+	else
+		*op = o;
+
+	return err;
+}
@@ -7,3 +7,4 @@
 SRCS	+= json/decode.c
 SRCS	+= json/decode_odict.c
 SRCS	+= json/encode.c
+SRCS	+= json/doc.c
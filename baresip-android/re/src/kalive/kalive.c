@@ -0,0 +1,335 @@
+/**
+ * @file kalive.c  Keepalive scheduler
+ *
+ * Keepalives and refreshes of many flows share a wheel of time buckets,
+ * with one timer per slot of the wheel instead of one timer per flow.
+ * The keepalives of a bucket are sent in one go, in a UDP batch, so
+ * that the datagrams of the handlers are sent together. Other threads
+ * sending on the same sockets, such as media threads, are not batched.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sys.h>
+#include <re_tmr.h>
+#include <re_udp.h>
+#include <re_kalive.h>
+
+
+#define DEBUG_MODULE "kalive"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	KALIVE_TICK   = 250,  /**< Width of a bucket in [ms]             */
+	KALIVE_SLOTS  = 256,  /**< Number of slots on the wheel          */
+	KALIVE_JITTER = 10,   /**< Spread by up to 1/10 of the delay     */
+};
+
+/** Defines a slot of the wheel, with keepalives sorted by jiffies */
+struct slot {
+	struct list kal;
+	struct tmr tmr;
+};
+
+/** Defines the keepalive scheduler of a thread */
+struct kasched {
+	struct slot slotv[KALIVE_SLOTS];
+	struct udp_batch *batch;  /**< Datagrams sent during a run  */
+	uint32_t n;               /**< Number of running keepalives */
+	bool running;             /**< Running keepalive handlers   */
+};
+
+
+extern struct kasched **kaschedp_get(void);
+
+
+static void sched_destructor(void *data)
+{
+	struct kasched *ks = data;
+	uint32_t i;
+
+	for (i=0; i<KALIVE_SLOTS; i++)
+		tmr_cancel(&ks->slotv[i].tmr);
+
+	mem_deref(ks->batch);
+}
+
+
+static struct kasched *sched_get(void)
+{
+	struct kasched **ksp = kaschedp_get();
+	struct kasched *ks = *ksp;
+	uint32_t i;
+
+	if (ks)
+		return ks;
+
+	ks = mem_zalloc(sizeof(*ks), sched_destructor);
+	if (!ks)
+		return NULL;
+
+	for (i=0; i<KALIVE_SLOTS; i++)
+		tmr_init(&ks->slotv[i].tmr);
+
+	if (udp_batch_alloc(&ks->batch))
+		return mem_deref(ks);
+
+	*ksp = ks;
+
+	return ks;
+}
+
+
+static void sched_release(struct kasched *ks)
+{
+	if (ks->n || ks->running)
+		return;
+
+	*kaschedp_get() = mem_deref(ks);
+}
+
+
+static void slot_handler(void *arg);
+
+
+static void slot_arm(struct slot *slot)
+{
+	const struct kalive *ka = list_ledata(slot->kal.head);
+	uint64_t jfs, now;
+
+	if (!ka) {
+		tmr_cancel(&slot->tmr);
+		return;
+	}
+
+	jfs = ka->jfs - ka->jfs % KALIVE_TICK;
+	now = tmr_jiffies();
+
+	tmr_start(&slot->tmr, jfs > now ? jfs - now : 0, slot_handler, slot);
+}
+
+
+static void sched_add(struct kasched *ks, struct kalive *ka, uint64_t delay)
+{
+	struct slot *slot;
+	struct le *le;
+
+	ka->jfs = tmr_jiffies() + delay;
+
+	slot = &ks->slotv[(ka->jfs / KALIVE_TICK) % KALIVE_SLOTS];
+
+	/* keepalives are mostly added last */
+	for (le = slot->kal.tail; le; le = le->prev) {
+
+		const struct kalive *ka0 = le->data;
+
+		if (ka0->jfs <= ka->jfs)
+			break;
+	}
+
+	if (le)
+		list_insert_after(&slot->kal, le, &ka->le, ka);
+	else
+		list_prepend(&slot->kal, &ka->le, ka);
+
+	++ks->n;
+
+	if (slot->kal.head == &ka->le)
+		slot_arm(slot);
+}
+
+
+/* the slot timer is left armed, and rearmed when it fires */
+static void sched_remove(struct kasched *ks, struct kalive *ka)
+{
+	list_unlink(&ka->le);
+	--ks->n;
+}
+
+
+static void slot_handler(void *arg)
+{
+	struct slot *slot = arg;
+	struct kasched *ks = *kaschedp_get();
+	const uint64_t now = tmr_jiffies();
+	struct list runl = LIST_INIT;
+	struct le *le;
+
+	while ((le = slot->kal.head)) {
+
+		struct kalive *ka = le->data;
+
+		if (ka->jfs / KALIVE_TICK > now / KALIVE_TICK)
+			break;
+
+		list_unlink(le);
+		list_append(&runl, le, ka);
+	}
+
+	ks->running = true;
+	udp_batch_begin(ks->batch);
+
+	while ((le = runl.head)) {
+
+		struct kalive *ka = le->data;
+		kalive_h *kh = ka->kh;
+		uint64_t act;
+
+		sched_remove(ks, ka);
+
+		/* the flow carried media, wait until it was idle */
+		act = __atomic_load_n(&ka->act, __ATOMIC_RELAXED);
+		if (ka->ival && act &&
+		    (act + ka->ival) / KALIVE_TICK > now / KALIVE_TICK) {
+			sched_add(ks, ka, act + ka->ival - now);
+			continue;
+		}
+
+		ka->kh = NULL;
+		kh(ka->arg);
+	}
+
+	udp_batch_end(ks->batch);
+	ks->running = false;
+
+	slot_arm(slot);
+	sched_release(ks);
+}
+
+
+/**
+ * Initialise a keepalive timer
+ *
+ * @param ka   Keepalive timer to initialise
+ * @param ival Media suppression interval in [ms], 0 to never suppress
+ */
+void kalive_init(struct kalive *ka, uint32_t ival)
+{
+	if (!ka)
+		return;
+
+	memset(ka, 0, sizeof(*ka));
+
+	ka->ival = ival;
+}
+
+
+/**
+ * Start a keepalive timer. The keepalive handler is called within
+ * the delay, up to 1/10 of the delay and the width of a bucket early,
+ * to spread the keepalives of flows that were started together.
+ *
+ * If the keepalive timer has a suppression interval and the flow
+ * carried media in the last interval, the keepalive is postponed
+ * until the flow was idle for the interval.
+ *
+ * @param ka    Keepalive timer
+ * @param delay Keepalive delay in [ms]
+ * @param kh    Keepalive handler, NULL to stop
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int kalive_start(struct kalive *ka, uint64_t delay, kalive_h *kh, void *arg)
+{
+	struct kasched *ks;
+	uint64_t jit;
+
+	if (!ka)
+		return EINVAL;
+
+	kalive_cancel(ka);
+
+	if (!kh)
+		return 0;
+
+	ks = sched_get();
+	if (!ks)
+		return ENOMEM;
+
+	ka->kh  = kh;
+	ka->arg = arg;
+
+	jit = delay / KALIVE_JITTER;
+	if (jit)
+		delay -= rand_u32() % (jit + 1);
+
+	sched_add(ks, ka, delay);
+
+	return 0;
+}
+
+
+/**
+ * Cancel a running keepalive timer
+ *
+ * @param ka Keepalive timer to cancel
+ */
+void kalive_cancel(struct kalive *ka)
+{
+	struct kasched *ks;
+
+	if (!ka)
+		return;
+
+	ka->kh  = NULL;
+	ka->arg = NULL;
+
+	if (!ka->le.list)
+		return;
+
+	ks = *kaschedp_get();
+
+	sched_remove(ks, ka);
+	sched_release(ks);
+}
+
+
+/**
+ * Record that a flow carried media, to suppress its keepalives.
+ * This function may be called from any thread.
+ *
+ * @param ka Keepalive timer of the flow
+ */
+void kalive_activity(struct kalive *ka)
+{
+	if (!ka || !ka->ival)
+		return;
+
+	__atomic_store_n(&ka->act, tmr_jiffies(), __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Print the keepalive scheduler status
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int kalive_status(struct re_printf *pf, void *unused)
+{
+	const struct kasched *ks = *kaschedp_get();
+	uint32_t i, slotc = 0;
+
+	(void)unused;
+
+	if (!ks)
+		return 0;
+
+	for (i=0; i<KALIVE_SLOTS; i++) {
+		if (tmr_isrunning(&ks->slotv[i].tmr))
+			++slotc;
+	}
+
+	return re_hprintf(pf, "Keepalives (%u): %u of %u slots armed\n",
+			  ks->n, slotc, KALIVE_SLOTS);
+}
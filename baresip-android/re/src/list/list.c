@@ -246,37 +246,82 @@ void list_unlink(struct le *le)
  * @param list  Linked list
  * @param sh    Sort handler
  * @param arg   Handler argument
+ *
+ * @note The sort is a bottom-up merge sort, O(n log n), and it is stable
+ *       if the sort handler returns true for equal elements
  */
 void list_sort(struct list *list, list_sort_h *sh, void *arg)
 {
-	struct le *le;
-	bool sort;
+	struct le *head, *tail;
+	size_t k = 1;
 
-	if (!list || !sh)
+	if (!list || !sh || !list->head)
 		return;
 
- retry:
-	le = list->head;
-	sort = false;
+	head = list->head;
 
-	while (le && le->next) {
+	for (;;) {
 
-		if (sh(le, le->next, arg)) {
+		struct le *p = head;
+		size_t merges = 0;
 
-			le = le->next;
-		}
-		else {
-			struct le *tle = le->next;
+		head = tail = NULL;
+
+		/* merge every pair of runs of length k */
+		while (p) {
+
+			struct le *q = p;
+			size_t psize = 0, qsize = k;
+
+			++merges;
+
+			while (psize < k && q) {
+				q = q->next;
+				++psize;
+			}
+
+			while (psize || (qsize && q)) {
 
-			list_unlink(le);
-			list_insert_after(list, tle, le, le->data);
-			sort = true;
+				struct le *le;
+
+				if (!psize) {
+					le = q;
+					q = q->next;
+					--qsize;
+				}
+				else if (!qsize || !q || sh(p, q, arg)) {
+					le = p;
+					p = p->next;
+					--psize;
+				}
+				else {
+					le = q;
+					q = q->next;
+					--qsize;
+				}
+
+				if (tail)
+					tail->next = le;
+				else
+					head = le;
+
+				le->prev = tail;
+				tail = le;
+			}
+
+			p = q;
 		}
-	}
 
-	if (sort) {
-		goto retry;
+		tail->next = NULL;
+
+		if (merges <= 1)
+			break;
+
+		k *= 2;
 	}
+
+	list->head = head;
+	list->tail = tail;
 }
 
 
@@ -90,6 +90,7 @@ struct re {
 	struct {
 		int flags;           /**< Polling flags (Read, Write, etc.) */
 		fd_h *fh;            /**< Event handler                     */
+		fd_recv_h *recvh;    /**< Datagram receive handler          */
 		void *arg;           /**< Handler argument                  */
 	} *fhs;
 	int maxfds;                  /**< Maximum number of polling fds     */
@@ -99,6 +100,8 @@ struct re {
 	bool polling;                /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
 	struct list tmrl;            /**< List of timers                    */
+	struct kasched *kasched;     /**< Keepalive scheduler               */
+	struct udp_batch *udpbatch;  /**< Begun UDP batch of the thread     */
 
 #ifdef HAVE_POLL
 	struct pollfd *fds;          /**< Event set for poll()              */
@@ -114,9 +117,14 @@ struct re {
 	int kqfd;
 #endif
 
+#ifdef HAVE_IO_URING
+	struct uring *uring;         /**< io_uring instance                 */
+#endif
+
 #ifdef HAVE_PTHREAD
 	pthread_mutex_t mutex;       /**< Mutex for thread synchronization  */
 	pthread_mutex_t *mutexp;     /**< Pointer to active mutex           */
+	pthread_t tid;               /**< Thread running the polling loop   */
 #endif
 };
 
@@ -129,6 +137,8 @@ static struct re global_re = {
 	false,
 	0,
 	LIST_INIT,
+	NULL,
+	NULL,
 #ifdef HAVE_POLL
 	NULL,
 #endif
@@ -140,6 +150,9 @@ static struct re global_re = {
 	NULL,
 	-1,
 #endif
+#ifdef HAVE_IO_URING
+	NULL,
+#endif
 #ifdef HAVE_PTHREAD
 #if MAIN_DEBUG && defined (PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP)
 	PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP,
@@ -147,6 +160,7 @@ static struct re global_re = {
 	PTHREAD_MUTEX_INITIALIZER,
 #endif
 	&global_re.mutex,
+	0,
 #endif
 };
 
@@ -407,6 +421,13 @@ static int rebuild_fds(struct re *re)
 			break;
 #endif
 
+#ifdef HAVE_IO_URING
+		case METHOD_IO_URING:
+			err = uring_set(re->uring, i, re->fhs[i].flags,
+					re->fhs[i].recvh != NULL);
+			break;
+#endif
+
 		default:
 			break;
 		}
@@ -484,6 +505,16 @@ static int poll_init(struct re *re)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		if (!re->uring) {
+			int err = uring_alloc(&re->uring, re->maxfds);
+			if (err)
+				return err;
+		}
+		break;
+#endif
+
 	default:
 		break;
 	}
@@ -521,6 +552,10 @@ static void poll_close(struct re *re)
 
 	re->evlist = mem_deref(re->evlist);
 #endif
+
+#ifdef HAVE_IO_URING
+	re->uring = mem_deref(re->uring);
+#endif
 }
 
 
@@ -593,6 +628,9 @@ int fd_listen(int fd, int flags, fd_h *fh, void *arg)
 		re->fhs[fd].flags = flags;
 		re->fhs[fd].fh    = fh;
 		re->fhs[fd].arg   = arg;
+
+		if (!flags)
+			re->fhs[fd].recvh = NULL;
 	}
 
 	re->nfds = max(re->nfds, fd+1);
@@ -619,6 +657,13 @@ int fd_listen(int fd, int flags, fd_h *fh, void *arg)
 		break;
 #endif
 
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		err = uring_set(re->uring, fd, flags,
+				re->fhs && re->fhs[fd].recvh);
+		break;
+#endif
+
 	default:
 		break;
 	}
@@ -646,6 +691,124 @@ void fd_close(int fd)
 }
 
 
+/**
+ * Let the polling loop read datagrams from a socket, if the polling
+ * method supports it. The socket must be listened to with FD_READ,
+ * and the receive handler gets the argument of the event handler.
+ * Polling methods that do not read sockets call the event handler.
+ *
+ * @param fd     Socket file descriptor
+ * @param recvh  Datagram receive handler, NULL to read with FD_READ
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fd_recv_set(int fd, fd_recv_h *recvh)
+{
+	struct re *re = re_get();
+
+	if (fd < 0 || fd >= re->maxfds || !re->fhs || !re->fhs[fd].flags)
+		return EINVAL;
+
+	re->fhs[fd].recvh = recvh;
+
+#ifdef HAVE_IO_URING
+	if (re->method == METHOD_IO_URING)
+		return uring_set(re->uring, fd, re->fhs[fd].flags, !!recvh);
+#endif
+
+	return 0;
+}
+
+
+/**
+ * Send a datagram through the polling loop, if the polling method
+ * supports it. The datagram is copied and sent with the next wait for
+ * events, together with the other datagrams queued in this round.
+ * Errors after queueing go to the receive handler of the socket.
+ *
+ * @param fd   Socket file descriptor
+ * @param buf  Datagram
+ * @param len  Length of datagram
+ * @param dst  Destination address, NULL for a connected socket
+ *
+ * @return 0 if queued, ENOTSUP if the caller must send it
+ */
+int fd_sendto(int fd, const uint8_t *buf, size_t len, const struct sa *dst)
+{
+#ifdef HAVE_IO_URING
+	struct re *re = re_get();
+
+	if (re->method != METHOD_IO_URING || !re->polling)
+		return ENOTSUP;
+
+#ifdef HAVE_PTHREAD
+	/* only the polling thread submits with the wait */
+	if (!pthread_equal(re->tid, pthread_self()))
+		return ENOTSUP;
+#endif
+
+	return uring_sendto(re->uring, fd, buf, len, dst);
+#else
+	(void)fd;
+	(void)buf;
+	(void)len;
+	(void)dst;
+
+	return ENOTSUP;
+#endif
+}
+
+
+#ifdef HAVE_IO_URING
+/**
+ * Polling loop for io_uring, which also reads datagrams
+ *
+ * @param re Poll state.
+ * @param to Timeout in [ms], 0 for no timeout
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int fd_poll_uring(struct re *re, uint64_t to)
+{
+	struct uring_ev ev;
+	int err;
+
+	re_unlock(re);
+	err = uring_wait(re->uring, to);
+	re_lock(re);
+
+	if (err)
+		return err;
+
+	while (uring_event(re->uring, &ev)) {
+
+		if (ev.fd >= re->nfds)
+			continue;
+
+		if (ev.flags && re->fhs[ev.fd].fh) {
+#if MAIN_DEBUG
+			fd_handler(re, ev.fd, ev.flags);
+#else
+			re->fhs[ev.fd].fh(ev.flags, re->fhs[ev.fd].arg);
+#endif
+		}
+		else if (!ev.flags && re->fhs[ev.fd].recvh) {
+			re->fhs[ev.fd].recvh(ev.err, ev.src, ev.buf, ev.len,
+					     re->fhs[ev.fd].arg);
+		}
+
+		/* Check if polling method was changed */
+		if (re->update) {
+			re->update = false;
+			return 0;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+
 /**
  * Polling loop
  *
@@ -663,6 +826,11 @@ static int fd_poll(struct re *re)
 
 	DEBUG_INFO("next timer: %llu ms\n", to);
 
+#ifdef HAVE_IO_URING
+	if (re->method == METHOD_IO_URING)
+		return fd_poll_uring(re, to);
+#endif
+
 	/* Wait for I/O */
 	switch (re->method) {
 
@@ -960,6 +1128,9 @@ int re_main(re_signal_h *signalh)
 		   poll_method_name(re->method));
 
 	re->polling = true;
+#ifdef HAVE_PTHREAD
+	re->tid = pthread_self();
+#endif
 
 	re_lock(re);
 	for (;;) {
@@ -1077,6 +1248,12 @@ int poll_method_set(enum poll_method method)
 #ifdef HAVE_KQUEUE
 	case METHOD_KQUEUE:
 		break;
+#endif
+#ifdef HAVE_IO_URING
+	case METHOD_IO_URING:
+		if (!uring_check())
+			return ENOSYS;
+		break;
 #endif
 	default:
 		DEBUG_WARNING("poll method not supported: '%s'\n",
@@ -1084,6 +1261,12 @@ int poll_method_set(enum poll_method method)
 		return EINVAL;
 	}
 
+#ifdef HAVE_IO_URING
+	/* the ring holds references to the polled files */
+	if (method != METHOD_IO_URING)
+		re->uring = mem_deref(re->uring);
+#endif
+
 	re->method = method;
 	re->update = true;
 
@@ -1098,6 +1281,17 @@ int poll_method_set(enum poll_method method)
 }
 
 
+/**
+ * Get the async I/O polling method of this thread
+ *
+ * @return Polling method
+ */
+enum poll_method poll_method_get(void)
+{
+	return re_get()->method;
+}
+
+
 /**
  * Add a worker thread for this thread
  *
@@ -1212,3 +1406,39 @@ struct list *tmrl_get(void)
 {
 	return &re_get()->tmrl;
 }
+
+
+/**
+ * Get the keepalive scheduler for this thread
+ *
+ * @return Pointer to keepalive scheduler
+ *
+ * @note only used by kalive module
+ */
+struct kasched **kaschedp_get(void);
+struct kasched **kaschedp_get(void)
+{
+	return &re_get()->kasched;
+}
+
+
+/**
+ * Get the UDP batch for this thread
+ *
+ * @return Pointer to UDP batch, NULL if not called from the thread
+ *         running the polling loop
+ *
+ * @note only used by udp module
+ */
+struct udp_batch **udpbatchp_get(void);
+struct udp_batch **udpbatchp_get(void)
+{
+	struct re *re = re_get();
+
+#ifdef HAVE_PTHREAD
+	if (!pthread_equal(re->tid, pthread_self()))
+		return NULL;
+#endif
+
+	return &re->udpbatch;
+}
@@ -10,6 +10,30 @@ bool epoll_check(void);
 #endif
 
 
+#ifdef HAVE_IO_URING
+struct uring;
+struct sa;
+
+/** io_uring event, readiness or a received datagram */
+struct uring_ev {
+	int fd;               /**< File descriptor                      */
+	int flags;            /**< Event flags, 0 for a datagram        */
+	int err;              /**< Receive or send error                */
+	const struct sa *src; /**< Source address of datagram           */
+	const uint8_t *buf;   /**< Datagram                             */
+	size_t len;           /**< Length of datagram                   */
+};
+
+bool uring_check(void);
+int  uring_alloc(struct uring **urp, int maxfds);
+int  uring_set(struct uring *ur, int fd, int flags, bool recv);
+int  uring_wait(struct uring *ur, uint64_t to);
+bool uring_event(struct uring *ur, struct uring_ev *ev);
+int  uring_sendto(struct uring *ur, int fd, const uint8_t *buf, size_t len,
+		  const struct sa *dst);
+#endif
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
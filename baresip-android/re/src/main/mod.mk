@@ -12,6 +12,10 @@ ifneq ($(HAVE_EPOLL),)
 SRCS	+= main/epoll.c
 endif
 
+ifneq ($(HAVE_IO_URING),)
+SRCS	+= main/uring.c
+endif
+
 ifneq ($(USE_OPENSSL),)
 SRCS    += main/openssl.c
 endif
@@ -0,0 +1,795 @@
+/**
+ * @file uring.c  io_uring specific routines
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _DEFAULT_SOURCE 1
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/time_types.h>
+#include <linux/io_uring.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_main.h>
+#include "main.h"
+
+
+#define DEBUG_MODULE "uring"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * One ring per polling loop. File descriptors are polled with one-shot
+ * poll requests that are armed again after each event, which keeps the
+ * level-triggered semantics of the other polling methods.
+ *
+ * Sockets that the loop reads itself get a multishot recvmsg instead,
+ * which takes its buffers from a provided buffer ring, so a datagram
+ * costs no system call. Datagrams sent from the loop thread are copied
+ * to a registered buffer and queued. The queued requests are submitted
+ * by the next wait, so a whole loop iteration is one io_uring_enter().
+ */
+
+
+enum {
+	SQ_ENTRIES  = 256,
+	CQ_ENTRIES  = 4096,
+	RECV_BUFS   = 128,     /* Provided buffers, power of two       */
+	RECV_BUFSZ  = 8192,
+	SEND_BUFS   = 256,
+	SEND_BUFSZ  = 2048,
+	RECV_BGID   = 0,
+};
+
+/* user_data: generation, file descriptor and request type */
+enum req {
+	REQ_NONE = 0,
+	REQ_POLL,
+	REQ_RECV,
+	REQ_SEND,
+};
+
+#define UD(gen, fd, req) \
+	((uint64_t)(gen) << 32 | (uint64_t)(fd) << 2 | (req))
+#define UD_REQ(ud) ((enum req)((ud) & 3))
+#define UD_FD(ud)  ((int)(((ud) & 0xffffffff) >> 2))
+#define UD_GEN(ud) ((uint32_t)((ud) >> 32))
+
+
+/** Submission or completion queue */
+struct queue {
+	void *ring;
+	size_t ringsz;
+	uint32_t *head;
+	uint32_t *tail;
+	uint32_t mask;
+};
+
+/** Send slot, the destination address and the datagram */
+struct slot {
+	struct sockaddr_in6 dst;
+	uint8_t buf[SEND_BUFSZ - sizeof(struct sockaddr_in6)];
+};
+
+/** Socket of a queued datagram, for reporting a send error */
+struct sender {
+	int fd;
+	uint32_t gen;
+};
+
+/** Polled file descriptor */
+struct ufd {
+	int flags;              /**< Polled events                       */
+	bool recv;              /**< Read by the loop                    */
+	uint32_t gen;           /**< Generation, for stale completions   */
+};
+
+/** io_uring instance */
+struct uring {
+	int fd;                 /**< Ring file descriptor                */
+	struct queue sq;        /**< Submission queue                    */
+	struct queue cq;        /**< Completion queue                    */
+	struct io_uring_sqe *sqev;
+	struct io_uring_cqe *cqev;
+	uint32_t sqe_tail;      /**< Local submission queue tail         */
+
+	struct ufd *fdv;        /**< Polled file descriptors             */
+	int maxfds;
+
+	/* receive */
+	struct io_uring_buf_ring *br;
+	uint8_t *rxbuf;
+	struct msghdr msg;
+	struct sa src;          /**< Source address of the current event */
+	int bid;                /**< Buffer of the current event, or -1  */
+
+	/* send */
+	struct slot *slotv;
+	struct sender senderv[SEND_BUFS];
+	uint16_t freev[SEND_BUFS];
+	unsigned nfree;
+};
+
+
+static inline int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static inline int sys_enter(int fd, unsigned to_submit, unsigned min,
+			    unsigned flags, const void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min, flags,
+			    arg, argsz);
+}
+
+
+static inline int sys_register(int fd, unsigned op, const void *arg,
+			       unsigned n)
+{
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+
+/* Create a ring with the setup flags we use */
+static int ring_setup(unsigned sq_entries, unsigned cq_entries,
+		      struct io_uring_params *p)
+{
+	memset(p, 0, sizeof(*p));
+	p->flags      = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+		IORING_SETUP_COOP_TASKRUN;
+	p->cq_entries = cq_entries;
+
+	return sys_setup(sq_entries, p);
+}
+
+
+/* Check that the kernel has everything we use, from Linux 6.0 */
+static bool features_check(int fd, const struct io_uring_params *p)
+{
+	const uint32_t feat = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+		IORING_FEAT_EXT_ARG;
+	struct io_uring_probe *probe;
+	size_t sz = sizeof(*probe) + 256 * sizeof(probe->ops[0]);
+	bool ok = false;
+
+	if ((p->features & feat) != feat)
+		return false;
+
+	probe = mem_zalloc(sz, NULL);
+	if (!probe)
+		return false;
+
+	if (sys_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		goto out;
+
+	ok = probe->last_op >= IORING_OP_SEND_ZC &&
+		(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+
+ out:
+	mem_deref(probe);
+
+	return ok;
+}
+
+
+/**
+ * Check for working io_uring kernel support
+ *
+ * @return true if support, false if not
+ */
+bool uring_check(void)
+{
+	struct io_uring_params p;
+	bool ok;
+	int fd;
+
+	fd = ring_setup(4, 8, &p);
+	if (fd < 0) {
+		DEBUG_INFO("io_uring_setup: %m\n", errno);
+		return false;
+	}
+
+	ok = features_check(fd, &p);
+	if (!ok) {
+		DEBUG_INFO("io_uring: kernel features missing\n");
+	}
+
+	(void)close(fd);
+
+	return ok;
+}
+
+
+static void destructor(void *arg)
+{
+	struct uring *ur = arg;
+
+	/* closing the ring cancels all requests */
+	if (ur->fd >= 0)
+		(void)close(ur->fd);
+
+	if (ur->sq.ring && ur->sq.ring != MAP_FAILED)
+		(void)munmap(ur->sq.ring, ur->sq.ringsz);
+	if (ur->sqev && (void *)ur->sqev != MAP_FAILED)
+		(void)munmap(ur->sqev, SQ_ENTRIES * sizeof(*ur->sqev));
+	if (ur->br && (void *)ur->br != MAP_FAILED)
+		(void)munmap(ur->br, RECV_BUFS * sizeof(struct io_uring_buf));
+
+	mem_deref(ur->fdv);
+	mem_deref(ur->rxbuf);
+	mem_deref(ur->slotv);
+}
+
+
+static int submit(struct uring *ur)
+{
+	const uint32_t head = __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE);
+	int n;
+
+	if (ur->sqe_tail == head)
+		return 0;
+
+	n = sys_enter(ur->fd, ur->sqe_tail - head, 0, 0, NULL, 0);
+
+	return n < 0 ? errno : 0;
+}
+
+
+static struct io_uring_sqe *sqe_get(struct uring *ur)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t head = __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE);
+
+	if (ur->sqe_tail - head > ur->sq.mask) {
+
+		if (submit(ur))
+			return NULL;
+
+		head = __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE);
+		if (ur->sqe_tail - head > ur->sq.mask)
+			return NULL;
+	}
+
+	sqe = &ur->sqev[ur->sqe_tail & ur->sq.mask];
+	memset(sqe, 0, sizeof(*sqe));
+
+	++ur->sqe_tail;
+	__atomic_store_n(ur->sq.tail, ur->sqe_tail, __ATOMIC_RELEASE);
+
+	return sqe;
+}
+
+
+static int poll_arm(struct uring *ur, int fd)
+{
+	const struct ufd *u = &ur->fdv[fd];
+	struct io_uring_sqe *sqe;
+	uint32_t events = 0;
+
+	if (u->flags & FD_READ && !u->recv)
+		events |= POLLIN;
+	if (u->flags & FD_WRITE)
+		events |= POLLOUT;
+	if (u->flags & FD_EXCEPT)
+		events |= POLLERR;
+
+	if (!events)
+		return 0;
+
+	sqe = sqe_get(ur);
+	if (!sqe)
+		return ENOSPC;
+
+	sqe->opcode        = IORING_OP_POLL_ADD;
+	sqe->fd            = fd;
+	sqe->poll32_events = events;
+	sqe->user_data     = UD(u->gen, fd, REQ_POLL);
+
+	return 0;
+}
+
+
+static int recv_arm(struct uring *ur, int fd)
+{
+	const struct ufd *u = &ur->fdv[fd];
+	struct io_uring_sqe *sqe;
+
+	if (!u->recv)
+		return 0;
+
+	sqe = sqe_get(ur);
+	if (!sqe)
+		return ENOSPC;
+
+	sqe->opcode    = IORING_OP_RECVMSG;
+	sqe->fd        = fd;
+	sqe->addr      = (uintptr_t)&ur->msg;
+	sqe->len       = 1;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = RECV_BGID;
+	sqe->user_data = UD(u->gen, fd, REQ_RECV);
+
+	return 0;
+}
+
+
+static void buf_recycle(struct uring *ur, int bid)
+{
+	struct io_uring_buf *buf;
+	uint16_t tail = ur->br->tail;
+
+	buf = &ur->br->bufs[tail & (RECV_BUFS - 1)];
+	buf->addr = (uintptr_t)(ur->rxbuf + (size_t)bid * RECV_BUFSZ);
+	buf->len  = RECV_BUFSZ;
+	buf->bid  = (uint16_t)bid;
+
+	__atomic_store_n(&ur->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+static int mmap_rings(struct uring *ur, const struct io_uring_params *p)
+{
+	const size_t sqsz = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+	const size_t cqsz = p->cq_off.cqes +
+		p->cq_entries * sizeof(struct io_uring_cqe);
+	uint8_t *ring;
+	uint32_t *arr, i;
+
+	ur->sq.ringsz = max(sqsz, cqsz);
+	ur->sq.ring = mmap(NULL, ur->sq.ringsz, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ur->fd,
+			   IORING_OFF_SQ_RING);
+	if (ur->sq.ring == MAP_FAILED)
+		return errno;
+
+	ur->sqev = mmap(NULL, p->sq_entries * sizeof(*ur->sqev),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ur->fd, IORING_OFF_SQES);
+	if ((void *)ur->sqev == MAP_FAILED)
+		return errno;
+
+	ring = ur->sq.ring;
+
+	ur->sq.head = (uint32_t *)(void *)(ring + p->sq_off.head);
+	ur->sq.tail = (uint32_t *)(void *)(ring + p->sq_off.tail);
+	ur->sq.mask = *(uint32_t *)(void *)(ring + p->sq_off.ring_mask);
+	ur->cq.head = (uint32_t *)(void *)(ring + p->cq_off.head);
+	ur->cq.tail = (uint32_t *)(void *)(ring + p->cq_off.tail);
+	ur->cq.mask = *(uint32_t *)(void *)(ring + p->cq_off.ring_mask);
+	ur->cqev    = (struct io_uring_cqe *)(void *)(ring + p->cq_off.cqes);
+
+	arr = (uint32_t *)(void *)(ring + p->sq_off.array);
+	for (i=0; i<p->sq_entries; i++)
+		arr[i] = i;
+
+	ur->sqe_tail = *ur->sq.tail;
+
+	return 0;
+}
+
+
+/* Provided buffer ring for receiving */
+static int recv_setup(struct uring *ur)
+{
+	struct io_uring_buf_reg reg;
+	int i;
+
+	ur->br = mmap(NULL, RECV_BUFS * sizeof(struct io_uring_buf),
+		      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		      -1, 0);
+	if ((void *)ur->br == MAP_FAILED)
+		return errno;
+
+	ur->rxbuf = mem_alloc(RECV_BUFS * RECV_BUFSZ, NULL);
+	if (!ur->rxbuf)
+		return ENOMEM;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr    = (uintptr_t)ur->br;
+	reg.ring_entries = RECV_BUFS;
+	reg.bgid         = RECV_BGID;
+
+	if (sys_register(ur->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return errno;
+
+	for (i=0; i<RECV_BUFS; i++)
+		buf_recycle(ur, i);
+
+	/* the source address, and no control data */
+	ur->msg.msg_namelen = sizeof(struct sockaddr_in6);
+
+	return 0;
+}
+
+
+/* Registered buffers for sending */
+static int send_setup(struct uring *ur)
+{
+	struct iovec iov;
+	unsigned i;
+
+	ur->slotv = mem_zalloc(SEND_BUFS * sizeof(*ur->slotv), NULL);
+	if (!ur->slotv)
+		return ENOMEM;
+
+	iov.iov_base = ur->slotv;
+	iov.iov_len  = SEND_BUFS * sizeof(*ur->slotv);
+
+	if (sys_register(ur->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+		return errno;
+
+	for (i=0; i<SEND_BUFS; i++)
+		ur->freev[i] = (uint16_t)(SEND_BUFS - 1 - i);
+
+	ur->nfree = SEND_BUFS;
+
+	return 0;
+}
+
+
+/**
+ * Allocate an io_uring instance for a polling loop
+ *
+ * @param urp    Pointer to allocated io_uring instance
+ * @param maxfds Maximum number of file descriptors
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_alloc(struct uring **urp, int maxfds)
+{
+	struct io_uring_params p;
+	struct uring *ur;
+	int err;
+
+	if (!urp || maxfds <= 0)
+		return EINVAL;
+
+	ur = mem_zalloc(sizeof(*ur), destructor);
+	if (!ur)
+		return ENOMEM;
+
+	ur->bid    = -1;
+	ur->maxfds = maxfds;
+
+	ur->fdv = mem_zalloc(maxfds * sizeof(*ur->fdv), NULL);
+	if (!ur->fdv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	ur->fd = ring_setup(SQ_ENTRIES, CQ_ENTRIES, &p);
+	if (ur->fd < 0) {
+		err = errno;
+		DEBUG_WARNING("io_uring_setup: %m\n", err);
+		goto out;
+	}
+
+	if (!features_check(ur->fd, &p)) {
+		err = ENOSYS;
+		goto out;
+	}
+
+	err = mmap_rings(ur, &p);
+	if (err)
+		goto out;
+
+	err = recv_setup(ur);
+	if (err) {
+		DEBUG_WARNING("provided buffers: %m\n", err);
+		goto out;
+	}
+
+	err = send_setup(ur);
+	if (err) {
+		DEBUG_WARNING("registered buffers: %m\n", err);
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(ur);
+	else
+		*urp = ur;
+
+	return err;
+}
+
+
+/**
+ * Set the polled events of a file descriptor. The change is submitted
+ * at once, so that a closed socket is released by the kernel.
+ *
+ * @param ur    io_uring instance
+ * @param fd    File descriptor
+ * @param flags Wanted event flags, 0 to stop polling
+ * @param recv  True to read datagrams in the loop, instead of FD_READ
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_set(struct uring *ur, int fd, int flags, bool recv)
+{
+	struct ufd *u;
+	int err;
+
+	if (!ur || fd < 0 || fd >= ur->maxfds)
+		return EINVAL;
+
+	u = &ur->fdv[fd];
+
+	if (u->flags) {
+		struct io_uring_sqe *sqe = sqe_get(ur);
+		if (!sqe)
+			return ENOSPC;
+
+		sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+		sqe->fd           = fd;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_FD |
+			IORING_ASYNC_CANCEL_ALL;
+		sqe->user_data    = UD(0, 0, REQ_NONE);
+	}
+
+	++u->gen;
+	u->flags = flags;
+	u->recv  = recv && (flags & FD_READ);
+
+	err  = poll_arm(ur, fd);
+	err |= recv_arm(ur, fd);
+	if (err)
+		return err;
+
+	return submit(ur);
+}
+
+
+/**
+ * Submit the queued requests and wait for completions
+ *
+ * @param ur io_uring instance
+ * @param to Timeout in [ms], 0 for no timeout
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int uring_wait(struct uring *ur, uint64_t to)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	uint32_t head;
+	int n;
+
+	if (!ur)
+		return EINVAL;
+
+	memset(&arg, 0, sizeof(arg));
+
+	if (to) {
+		ts.tv_sec  = (int64_t)(to / 1000);
+		ts.tv_nsec = (long long)(to % 1000) * 1000000;
+		arg.ts = (uintptr_t)&ts;
+	}
+
+	head = __atomic_load_n(ur->sq.head, __ATOMIC_ACQUIRE);
+
+	n = sys_enter(ur->fd, ur->sqe_tail - head, 1,
+		      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		      &arg, sizeof(arg));
+	if (n < 0 && errno != ETIME)
+		return errno;
+
+	return 0;
+}
+
+
+static void ev_datagram(struct uring *ur, struct uring_ev *ev, uint8_t *buf,
+			size_t len)
+{
+	const struct io_uring_recvmsg_out *out = (void *)buf;
+	const size_t hdr = sizeof(*out) + sizeof(struct sockaddr_in6);
+
+	if (len < hdr || out->flags & MSG_TRUNC) {
+		DEBUG_WARNING("recv: truncated datagram on fd=%d\n", ev->fd);
+		ev->err = EMSGSIZE;
+		return;
+	}
+
+	memset(&ur->src, 0, sizeof(ur->src));
+	memcpy(&ur->src.u, buf + sizeof(*out),
+	       min(out->namelen, sizeof(struct sockaddr_in6)));
+	ur->src.len = out->namelen;
+
+	ev->src = &ur->src;
+	ev->buf = buf + hdr;
+	ev->len = out->payloadlen;
+}
+
+
+/**
+ * Get the next event. The buffer of a datagram is valid until the
+ * next call.
+ *
+ * @param ur io_uring instance
+ * @param ev Returned event
+ *
+ * @return true if an event was returned, false if there are no more
+ */
+bool uring_event(struct uring *ur, struct uring_ev *ev)
+{
+	if (!ur || !ev)
+		return false;
+
+	if (ur->bid >= 0) {
+		buf_recycle(ur, ur->bid);
+		ur->bid = -1;
+	}
+
+	for (;;) {
+		const uint32_t head = *ur->cq.head;
+		const struct io_uring_cqe *cqe;
+		uint64_t ud;
+		uint32_t cflags;
+		int res, fd;
+		struct ufd *u;
+
+		if (head == __atomic_load_n(ur->cq.tail, __ATOMIC_ACQUIRE))
+			return false;
+
+		cqe    = &ur->cqev[head & ur->cq.mask];
+		ud     = cqe->user_data;
+		res    = cqe->res;
+		cflags = cqe->flags;
+
+		__atomic_store_n(ur->cq.head, head + 1, __ATOMIC_RELEASE);
+
+		if (UD_REQ(ud) == REQ_SEND) {
+
+			const struct sender s = ur->senderv[UD_FD(ud)];
+
+			/* the slot is free after the notification */
+			if (!(cflags & IORING_CQE_F_MORE))
+				ur->freev[ur->nfree++] = (uint16_t)UD_FD(ud);
+
+			/* the error goes to the socket, if still polled */
+			if (res >= 0 || cflags & IORING_CQE_F_NOTIF ||
+			    s.gen != ur->fdv[s.fd].gen)
+				continue;
+
+			memset(ev, 0, sizeof(*ev));
+			ev->fd  = s.fd;
+			ev->err = -res;
+
+			return true;
+		}
+
+		if (UD_REQ(ud) == REQ_NONE)
+			continue;
+
+		fd = UD_FD(ud);
+		u  = &ur->fdv[fd];
+
+		if (cflags & IORING_CQE_F_BUFFER) {
+			ur->bid = (int)(cflags >> IORING_CQE_BUFFER_SHIFT);
+		}
+
+		if (res == -ECANCELED || UD_GEN(ud) != u->gen) {
+			if (ur->bid >= 0) {
+				buf_recycle(ur, ur->bid);
+				ur->bid = -1;
+			}
+			continue;
+		}
+
+		memset(ev, 0, sizeof(*ev));
+		ev->fd = fd;
+
+		if (UD_REQ(ud) == REQ_POLL) {
+
+			(void)poll_arm(ur, fd);
+
+			if (res < 0) {
+				ev->flags = FD_EXCEPT;
+				return true;
+			}
+
+			if (res & POLLIN)
+				ev->flags |= FD_READ;
+			if (res & POLLOUT)
+				ev->flags |= FD_WRITE;
+			if (res & (POLLERR|POLLHUP|POLLNVAL))
+				ev->flags |= FD_EXCEPT;
+
+			if (ev->flags)
+				return true;
+
+			continue;
+		}
+
+		/* multishot receive ended, buffers are recycled by then */
+		if (!(cflags & IORING_CQE_F_MORE))
+			(void)recv_arm(ur, fd);
+
+		if (res == -ENOBUFS)
+			continue;
+
+		if (res < 0) {
+			ev->err = -res;
+			return true;
+		}
+
+		if (ur->bid < 0)
+			continue;
+
+		ev_datagram(ur, ev, ur->rxbuf + (size_t)ur->bid * RECV_BUFSZ,
+			    (size_t)res);
+
+		return true;
+	}
+}
+
+
+/**
+ * Queue a datagram for sending, with the next wait
+ *
+ * @param ur  io_uring instance
+ * @param fd  Socket file descriptor
+ * @param buf Datagram
+ * @param len Length of datagram
+ * @param dst Destination address, NULL for a connected socket
+ *
+ * @return 0 if queued, ENOTSUP if it must be sent directly
+ */
+int uring_sendto(struct uring *ur, int fd, const uint8_t *buf, size_t len,
+		 const struct sa *dst)
+{
+	struct io_uring_sqe *sqe;
+	struct slot *slot;
+	uint16_t idx;
+
+	if (!ur || fd < 0 || fd >= ur->maxfds || !buf)
+		return EINVAL;
+
+	/* too large or no free slot, sent directly after the queued ones */
+	if (len > sizeof(slot->buf) || (dst && dst->len > sizeof(slot->dst)) ||
+	    !ur->nfree) {
+		(void)submit(ur);
+		return ENOTSUP;
+	}
+
+	sqe = sqe_get(ur);
+	if (!sqe)
+		return ENOTSUP;
+
+	idx  = ur->freev[--ur->nfree];
+	slot = &ur->slotv[idx];
+
+	memcpy(slot->buf, buf, len);
+
+	ur->senderv[idx].fd  = fd;
+	ur->senderv[idx].gen = ur->fdv[fd].gen;
+
+	sqe->opcode    = IORING_OP_SEND_ZC;
+	sqe->fd        = fd;
+	sqe->addr      = (uintptr_t)slot->buf;
+	sqe->len       = (uint32_t)len;
+	sqe->ioprio    = IORING_RECVSEND_FIXED_BUF;
+	sqe->buf_index = 0;
+	sqe->user_data = UD(0, idx, REQ_SEND);
+
+	if (dst) {
+		memcpy(&slot->dst, &dst->u, dst->len);
+		sqe->addr2    = (uintptr_t)&slot->dst;
+		sqe->addr_len = (uint16_t)dst->len;
+	}
+
+	return 0;
+}
@@ -506,6 +506,21 @@ uint32_t rtp_sess_ssrc(const struct rtp_sock *rs)
 }
 
 
+/**
+ * Skip sequence numbers of the RTP encoder, as if packets were sent
+ *
+ * @param rs RTP Socket
+ * @param n  Number of sequence numbers to skip
+ */
+void rtp_seq_skip(struct rtp_sock *rs, uint16_t n)
+{
+	if (!rs)
+		return;
+
+	rs->enc.seq += n;
+}
+
+
 /**
  * Get the RTCP-Session for an RTP/RTCP Socket
  *
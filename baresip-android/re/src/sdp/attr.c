@@ -128,6 +128,16 @@ int sdp_attr_print(struct re_printf *pf, const struct sdp_attr *attr)
 }
 
 
+int sdp_attr_enc_key(struct mbuf *mb, const struct sdp_attr *attr)
+{
+	if (!mb || !attr)
+		return EINVAL;
+
+	return sdp_enc_key_str(mb, attr->name) |
+		sdp_enc_key_str(mb, attr->val);
+}
+
+
 int sdp_attr_debug(struct re_printf *pf, const struct sdp_attr *attr)
 {
 	if (!attr)
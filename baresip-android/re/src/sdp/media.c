@@ -24,6 +24,7 @@ static void destructor(void *arg)
 	list_flush(&m->rfmtl);
 	list_flush(&m->rattrl);
 	list_flush(&m->lattrl);
+	sdp_media_enc_flush(m);
 
 	if (m->le.list) {
 		m->disabled = true;
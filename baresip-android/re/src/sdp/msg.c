@@ -3,6 +3,8 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -13,6 +15,247 @@
 #include "sdp.h"
 
 
+/*
+ * Hand-written matchers for the SDP line grammars. Each one is the
+ * re_regex() expression in its comment, matched at the start of the
+ * line with the same semantics (case-insensitive literals, greedy
+ * character classes). Well-formed lines always match there; anything
+ * else falls back to re_regex(), which also tries later positions.
+ */
+
+
+static size_t span_not(const struct pl *pl, size_t i, char c)
+{
+	const char *p;
+
+	if (i >= pl->l)
+		return pl->l;
+
+	p = memchr(pl->p + i, c, pl->l - i);
+
+	return p ? (size_t)(p - pl->p) : pl->l;
+}
+
+
+static size_t span_digit(const struct pl *pl, size_t i)
+{
+	while (i < pl->l && '0' <= pl->p[i] && pl->p[i] <= '9')
+		++i;
+
+	return i;
+}
+
+
+static bool match_lit(const struct pl *pl, size_t *i, const char *lit)
+{
+	size_t j = *i;
+
+	for (; *lit; lit++, j++) {
+
+		if (j >= pl->l)
+			return false;
+
+		if (tolower(*lit) != tolower((unsigned char)pl->p[j]))
+			return false;
+	}
+
+	*i = j;
+
+	return true;
+}
+
+
+static void pl_range(struct pl *pl, const struct pl *src, size_t a, size_t b)
+{
+	pl->p = src->p + a;
+	pl->l = b - a;
+}
+
+
+/* "[^ ]+ [^]*" */
+static bool fmtp_match(const struct pl *pl, struct pl *id, struct pl *params)
+{
+	size_t i = span_not(pl, 0, ' ');
+
+	if (!i || i == pl->l)
+		return false;
+
+	pl_range(id, pl, 0, i);
+	pl_range(params, pl, i + 1, pl->l);
+
+	return true;
+}
+
+
+/* "[0-9]+ IN IP[46]1 [^ ]+" */
+static bool rtcp_match(const struct pl *pl, struct pl *port, struct pl *addr)
+{
+	size_t i, j, k;
+
+	i = span_digit(pl, 0);
+	if (!i)
+		return false;
+
+	j = i;
+	if (!match_lit(pl, &j, " IN IP"))
+		return false;
+
+	if (j >= pl->l || (pl->p[j] != '4' && pl->p[j] != '6'))
+		return false;
+
+	++j;
+	if (!match_lit(pl, &j, " "))
+		return false;
+
+	k = span_not(pl, j, ' ');
+	if (k == j)
+		return false;
+
+	pl_range(port, pl, 0, i);
+	pl_range(addr, pl, j, k);
+
+	return true;
+}
+
+
+/* "[^ ]+ [^/]+/[0-9]+[/]*[^]*" */
+static bool rtpmap_match(const struct pl *pl, struct pl *id, struct pl *name,
+			 struct pl *srate, struct pl *ch)
+{
+	size_t i, j, k, d;
+
+	i = span_not(pl, 0, ' ');
+	if (!i || i == pl->l)
+		return false;
+
+	j = i + 1;
+	k = span_not(pl, j, '/');
+	if (k == j || k == pl->l)
+		return false;
+
+	d = span_digit(pl, k + 1);
+	if (d == k + 1)
+		return false;
+
+	pl_range(id, pl, 0, i);
+	pl_range(name, pl, j, k);
+	pl_range(srate, pl, k + 1, d);
+
+	while (d < pl->l && pl->p[d] == '/')
+		++d;
+
+	pl_range(ch, pl, d, pl->l);
+
+	return true;
+}
+
+
+/* "[^:]+:[^]+" */
+static bool attr_match(const struct pl *pl, struct pl *name, struct pl *val)
+{
+	size_t i = span_not(pl, 0, ':');
+
+	if (!i || i + 1 >= pl->l)
+		return false;
+
+	pl_range(name, pl, 0, i);
+	pl_range(val, pl, i + 1, pl->l);
+
+	return true;
+}
+
+
+/* "[^:]+:[0-9]+" */
+static bool bandwidth_match(const struct pl *pl, struct pl *type,
+			    struct pl *bw)
+{
+	size_t i = span_not(pl, 0, ':'), d;
+
+	if (!i || i == pl->l)
+		return false;
+
+	d = span_digit(pl, i + 1);
+	if (d == i + 1)
+		return false;
+
+	pl_range(type, pl, 0, i);
+	pl_range(bw, pl, i + 1, d);
+
+	return true;
+}
+
+
+/* "IN IP[46]1 [^ ]+" */
+static bool conn_match(const struct pl *pl, struct pl *addr)
+{
+	size_t i = 0, j;
+
+	if (!match_lit(pl, &i, "IN IP"))
+		return false;
+
+	if (i >= pl->l || (pl->p[i] != '4' && pl->p[i] != '6'))
+		return false;
+
+	++i;
+	if (!match_lit(pl, &i, " "))
+		return false;
+
+	j = span_not(pl, i, ' ');
+	if (j == i)
+		return false;
+
+	pl_range(addr, pl, i, j);
+
+	return true;
+}
+
+
+/* "[a-z]+ [^ ]+ [^ ]+[^]*" */
+static bool media_match(const struct pl *pl, struct pl *name, struct pl *port,
+			struct pl *proto, struct pl *fmtv)
+{
+	size_t i = 0, j, k;
+
+	while (i < pl->l && isalpha((unsigned char)pl->p[i]))
+		++i;
+
+	if (!i || i == pl->l || pl->p[i] != ' ')
+		return false;
+
+	j = span_not(pl, i + 1, ' ');
+	if (j == i + 1 || j == pl->l)
+		return false;
+
+	k = span_not(pl, j + 1, ' ');
+	if (k == j + 1)
+		return false;
+
+	pl_range(name, pl, 0, i);
+	pl_range(port, pl, i + 1, j);
+	pl_range(proto, pl, j + 1, k);
+	pl_range(fmtv, pl, k, pl->l);
+
+	return true;
+}
+
+
+/* " [^ ]+" */
+static bool fmt_next(const struct pl *pl, struct pl *fmt)
+{
+	size_t i;
+
+	for (i=0; i+1 < pl->l; i++) {
+
+		if (pl->p[i] == ' ' && pl->p[i+1] != ' ') {
+			pl_range(fmt, pl, i + 1, span_not(pl, i + 1, ' '));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 static int attr_decode_fmtp(struct sdp_media *m, const struct pl *pl)
 {
 	struct sdp_format *fmt;
@@ -21,7 +264,8 @@ static int attr_decode_fmtp(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (re_regex(pl->p, pl->l, "[^ ]+ [^]*", &id, &params))
+	if (!fmtp_match(pl, &id, &params) &&
+	    re_regex(pl->p, pl->l, "[^ ]+ [^]*", &id, &params))
 		return EBADMSG;
 
 	fmt = sdp_format_find(&m->rfmtl, &id);
@@ -42,7 +286,8 @@ static int attr_decode_rtcp(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (!re_regex(pl->p, pl->l, "[0-9]+ IN IP[46]1 [^ ]+",
+	if (rtcp_match(pl, &port, &addr) ||
+	    !re_regex(pl->p, pl->l, "[0-9]+ IN IP[46]1 [^ ]+",
 		      &port, NULL, &addr)) {
 		(void)sa_set(&m->raddr_rtcp, &addr, pl_u32(&port));
 	}
@@ -65,7 +310,8 @@ static int attr_decode_rtpmap(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (re_regex(pl->p, pl->l, "[^ ]+ [^/]+/[0-9]+[/]*[^]*",
+	if (!rtpmap_match(pl, &id, &name, &srate, &ch) &&
+	    re_regex(pl->p, pl->l, "[^ ]+ [^/]+/[0-9]+[/]*[^]*",
 		     &id, &name, &srate, NULL, &ch))
 		return EBADMSG;
 
@@ -92,7 +338,8 @@ static int attr_decode(struct sdp_session *sess, struct sdp_media *m,
 	struct pl name, val;
 	int err = 0;
 
-	if (re_regex(pl->p, pl->l, "[^:]+:[^]+", &name, &val)) {
+	if (!attr_match(pl, &name, &val) &&
+	    re_regex(pl->p, pl->l, "[^:]+:[^]+", &name, &val)) {
 		name = *pl;
 		val  = pl_null;
 	}
@@ -130,7 +377,8 @@ static int bandwidth_decode(int32_t *bwv, const struct pl *pl)
 {
 	struct pl type, bw;
 
-	if (re_regex(pl->p, pl->l, "[^:]+:[0-9]+", &type, &bw))
+	if (!bandwidth_match(pl, &type, &bw) &&
+	    re_regex(pl->p, pl->l, "[^:]+:[0-9]+", &type, &bw))
 		return EBADMSG;
 
 	if (!pl_strcmp(&type, "CT"))
@@ -156,7 +404,8 @@ static int conn_decode(struct sa *sa, const struct pl *pl)
 {
 	struct pl v;
 
-	if (re_regex(pl->p, pl->l, "IN IP[46]1 [^ ]+", NULL, &v))
+	if (!conn_match(pl, &v) &&
+	    re_regex(pl->p, pl->l, "IN IP[46]1 [^ ]+", NULL, &v))
 		return EBADMSG;
 
 	(void)sa_set(sa, &v, sa_port(sa));
@@ -172,7 +421,8 @@ static int media_decode(struct sdp_media **mp, struct sdp_session *sess,
 	struct sdp_media *m;
 	int err;
 
-	if (re_regex(pl->p, pl->l, "[a-z]+ [^ ]+ [^ ]+[^]*",
+	if (!media_match(pl, &name, &port, &proto, &fmtv) &&
+	    re_regex(pl->p, pl->l, "[a-z]+ [^ ]+ [^ ]+[^]*",
 		     &name, &port, &proto, &fmtv))
 		return EBADMSG;
 
@@ -208,7 +458,7 @@ static int media_decode(struct sdp_media **mp, struct sdp_session *sess,
 		}
 	}
 
-	while (!re_regex(fmtv.p, fmtv.l, " [^ ]+", &fmt)) {
+	while (fmt_next(&fmtv, &fmt)) {
 
 		pl_advance(&fmtv, fmt.p + fmt.l - fmtv.p);
 
@@ -346,7 +596,36 @@ int sdp_decode(struct sdp_session *sess, struct mbuf *mb, bool offer)
 }
 
 
-static int media_encode(const struct sdp_media *m, struct mbuf *mb, bool offer)
+/*
+ * Encode handler output is not cached. When a hooks buffer is given,
+ * media_encode() records the position of each handler call instead of
+ * calling it, and media_replay() calls the handlers at those positions.
+ */
+enum enc_hook_type {
+	ENC_HOOK_FMT,
+	ENC_HOOK_MEDIA,
+};
+
+struct enc_hook {
+	size_t pos;
+	enum enc_hook_type type;
+};
+
+
+static int enc_hook_add(struct mbuf *hooks, const struct mbuf *mb,
+			enum enc_hook_type type)
+{
+	struct enc_hook hook;
+
+	hook.pos  = mb->pos;
+	hook.type = type;
+
+	return mbuf_write_mem(hooks, (uint8_t *)&hook, sizeof(hook));
+}
+
+
+static int media_encode(const struct sdp_media *m, struct mbuf *mb, bool offer,
+			struct mbuf *hooks)
 {
 	enum sdp_bandwidth i;
 	const char *proto;
@@ -430,7 +709,9 @@ static int media_encode(const struct sdp_media *m, struct mbuf *mb, bool offer)
 		if (str_isset(fmt->params))
 			err |= mbuf_printf(mb, "a=fmtp:%s %s\r\n",
 					   fmt->id, fmt->params);
-		if (fmt->ench)
+		if (fmt->ench && hooks)
+			err |= enc_hook_add(hooks, mb, ENC_HOOK_FMT);
+		else if (fmt->ench)
 			err |= fmt->ench(mb, fmt, offer, fmt->data);
 	}
 
@@ -449,13 +730,224 @@ static int media_encode(const struct sdp_media *m, struct mbuf *mb, bool offer)
 	for (le = m->lattrl.head; le; le = le->next)
 		err |= mbuf_printf(mb, "%H", sdp_attr_print, le->data);
 
-	if (m->ench)
+	if (m->ench && hooks)
+		err |= enc_hook_add(hooks, mb, ENC_HOOK_MEDIA);
+	else if (m->ench)
 		err |= m->ench(mb, offer, m->arg);
 
 	return err;
 }
 
 
+int sdp_enc_key_str(struct mbuf *mb, const char *str)
+{
+	size_t len;
+	int err;
+
+	if (!str)
+		return mbuf_write_u32(mb, UINT32_MAX);
+
+	len = strlen(str);
+
+	err  = mbuf_write_u32(mb, (uint32_t)len);
+	err |= mbuf_write_mem(mb, (const uint8_t *)str, len);
+
+	return err;
+}
+
+
+static int enc_key_sa(struct mbuf *mb, const struct sa *sa)
+{
+	uint8_t addr[16];
+	int err;
+
+	err  = mbuf_write_u16(mb, sa_af(sa));
+	err |= mbuf_write_u16(mb, sa_port(sa));
+
+	switch (sa_af(sa)) {
+
+	case AF_INET:
+		err |= mbuf_write_u32(mb, sa_in(sa));
+		break;
+
+#ifdef HAVE_INET6
+	case AF_INET6:
+		sa_in6(sa, addr);
+		err |= mbuf_write_mem(mb, addr, sizeof(addr));
+		break;
+#endif
+
+	default:
+		(void)addr;
+		break;
+	}
+
+	return err;
+}
+
+
+/*
+ * Serialise everything media_encode() reads, except the output of
+ * the encode handlers. Equal keys give equal encoded text.
+ */
+static int media_enc_key(struct mbuf *mb, const struct sdp_media *m,
+			 bool offer)
+{
+	enum sdp_bandwidth i;
+	struct le *le;
+	int err;
+
+	err  = mbuf_write_u8(mb, offer);
+	err |= mbuf_write_u8(mb, m->disabled);
+	err |= mbuf_write_u8(mb, m->ench != NULL);
+	err |= mbuf_write_u16(mb, sa_port(&m->raddr));
+	err |= mbuf_write_u32(mb, m->ldir);
+	err |= mbuf_write_u32(mb, m->rdir);
+	err |= sdp_enc_key_str(mb, m->name);
+	err |= sdp_enc_key_str(mb, m->proto);
+	err |= sdp_enc_key_str(mb, m->uproto);
+	err |= enc_key_sa(mb, &m->laddr);
+	err |= enc_key_sa(mb, &m->laddr_rtcp);
+
+	for (i=SDP_BANDWIDTH_MIN; i<SDP_BANDWIDTH_MAX; i++)
+		err |= mbuf_write_u32(mb, (uint32_t)m->lbwv[i]);
+
+	for (le=m->lfmtl.head; le; le=le->next) {
+
+		const struct sdp_format *fmt = le->data;
+
+		err |= mbuf_write_u8(mb, 1);
+		err |= mbuf_write_u8(mb, fmt->sup);
+		err |= mbuf_write_u8(mb, fmt->ench != NULL);
+		err |= mbuf_write_u32(mb, fmt->srate);
+		err |= mbuf_write_u8(mb, fmt->ch);
+		err |= sdp_enc_key_str(mb, fmt->id);
+		err |= sdp_enc_key_str(mb, fmt->name);
+		err |= sdp_enc_key_str(mb, fmt->params);
+	}
+
+	err |= mbuf_write_u8(mb, 0);
+
+	for (le=m->lattrl.head; le; le=le->next) {
+
+		err |= mbuf_write_u8(mb, 1);
+		err |= sdp_attr_enc_key(mb, le->data);
+	}
+
+	err |= mbuf_write_u8(mb, 0);
+
+	return err;
+}
+
+
+static int media_replay(const struct sdp_media *m, struct mbuf *mb,
+			bool offer)
+{
+	const struct mbuf *text = m->enc_text;
+	struct mbuf *hooks = m->enc_hooks;
+	struct le *le = m->lfmtl.head;
+	size_t pos = 0;
+	int err = 0;
+
+	hooks->pos = 0;
+
+	while (mbuf_get_left(hooks) >= sizeof(struct enc_hook)) {
+
+		const struct sdp_format *fmt = NULL;
+		struct enc_hook hook;
+
+		(void)mbuf_read_mem(hooks, (uint8_t *)&hook, sizeof(hook));
+
+		err |= mbuf_write_mem(mb, text->buf + pos, hook.pos - pos);
+		pos = hook.pos;
+
+		if (hook.type == ENC_HOOK_MEDIA) {
+			err |= m->ench(mb, offer, m->arg);
+			continue;
+		}
+
+		for (; le; le=le->next) {
+
+			fmt = le->data;
+
+			if (fmt->sup && str_isset(fmt->name) && fmt->ench)
+				break;
+		}
+
+		if (!le)
+			return EPROTO;
+
+		le = le->next;
+
+		err |= fmt->ench(mb, fmt, offer, fmt->data);
+	}
+
+	err |= mbuf_write_mem(mb, text->buf + pos, text->end - pos);
+
+	return err;
+}
+
+
+static int media_encode_cached(struct sdp_session *sess, struct sdp_media *m,
+			       struct mbuf *mb, bool offer)
+{
+	struct mbuf *key;
+	int err;
+
+	if (!sess->enc_key) {
+		sess->enc_key = mbuf_alloc(512);
+		if (!sess->enc_key)
+			return ENOMEM;
+	}
+
+	key = sess->enc_key;
+	mbuf_rewind(key);
+
+	err = media_enc_key(key, m, offer);
+	if (err)
+		return err;
+
+	if (m->enc_key && m->enc_key->end == key->end &&
+	    !memcmp(m->enc_key->buf, key->buf, key->end))
+		return media_replay(m, mb, offer);
+
+	if (!m->enc_text) {
+		m->enc_text  = mbuf_alloc(1024);
+		m->enc_hooks = mbuf_alloc(4 * sizeof(struct enc_hook));
+		if (!m->enc_text || !m->enc_hooks) {
+			sdp_media_enc_flush(m);
+			return ENOMEM;
+		}
+	}
+
+	mbuf_rewind(m->enc_text);
+	mbuf_rewind(m->enc_hooks);
+
+	err = media_encode(m, m->enc_text, offer, m->enc_hooks);
+	if (err) {
+		sdp_media_enc_flush(m);
+		return err;
+	}
+
+	/* the new key becomes the cache key, the old one the scratch */
+	sess->enc_key = m->enc_key;
+	m->enc_key = key;
+
+	return media_replay(m, mb, offer);
+}
+
+
+void sdp_media_enc_flush(struct sdp_media *m)
+{
+	if (!m)
+		return;
+
+	m->enc_key   = mem_deref(m->enc_key);
+	m->enc_text  = mem_deref(m->enc_text);
+	m->enc_hooks = mem_deref(m->enc_hooks);
+}
+
+
 /**
  * Encode an SDP Session into a memory buffer
  *
@@ -517,7 +1009,10 @@ int sdp_encode(struct mbuf **mbp, struct sdp_session *sess, bool offer)
 
 		struct sdp_media *m = le->data;
 
-		err |= media_encode(m, mb, offer);
+		if (sess->enc_cache)
+			err |= media_encode_cached(sess, m, mb, offer);
+		else
+			err |= media_encode(m, mb, offer, NULL);
 	}
 
 	mb->pos = 0;
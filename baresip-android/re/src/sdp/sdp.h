@@ -23,6 +23,8 @@ struct sdp_session {
 	uint32_t id;
 	uint32_t ver;
 	enum sdp_dir rdir;
+	struct mbuf *enc_key;   /* scratch buffer for media encode keys */
+	bool enc_cache;
 };
 
 struct sdp_media {
@@ -48,6 +50,9 @@ struct sdp_media {
 	bool fmt_ignore;
 	bool disabled;
 	int dynpt;
+	struct mbuf *enc_key;   /* encoder inputs of the cached text   */
+	struct mbuf *enc_text;  /* encoded media section               */
+	struct mbuf *enc_hooks; /* positions of encode handler output  */
 };
 
 
@@ -74,6 +79,11 @@ struct sdp_format *sdp_format_find(const struct list *lst,
 				   const struct pl *id);
 
 
+/* message */
+int  sdp_enc_key_str(struct mbuf *mb, const char *str);
+void sdp_media_enc_flush(struct sdp_media *m);
+
+
 /* attribute */
 struct sdp_attr;
 
@@ -85,3 +95,4 @@ const char *sdp_attr_apply(const struct list *lst, const char *name,
 			   sdp_attr_h *attrh, void *arg);
 int sdp_attr_print(struct re_printf *pf, const struct sdp_attr *attr);
 int sdp_attr_debug(struct re_printf *pf, const struct sdp_attr *attr);
+int sdp_attr_enc_key(struct mbuf *mb, const struct sdp_attr *attr);
@@ -23,6 +23,7 @@ static void destructor(void *arg)
 	list_flush(&sess->medial);
 	list_flush(&sess->rattrl);
 	list_flush(&sess->lattrl);
+	mem_deref(sess->enc_key);
 }
 
 
@@ -105,6 +106,36 @@ void sdp_session_set_laddr(struct sdp_session *sess, const struct sa *laddr)
 }
 
 
+/**
+ * Enable or disable caching of encoded media sections. When enabled,
+ * sdp_encode() re-uses the text of media sections whose encoder inputs
+ * are unchanged since the previous encode; the output is identical.
+ * Format and media encode handlers are still called on every encode.
+ *
+ * @param sess   SDP Session
+ * @param enable True to enable, false to disable
+ */
+void sdp_session_set_encode_cache(struct sdp_session *sess, bool enable)
+{
+	struct le *le;
+
+	if (!sess)
+		return;
+
+	sess->enc_cache = enable;
+
+	if (enable)
+		return;
+
+	sess->enc_key = mem_deref(sess->enc_key);
+
+	for (le=sess->lmedial.head; le; le=le->next)
+		sdp_media_enc_flush(le->data);
+	for (le=sess->medial.head; le; le=le->next)
+		sdp_media_enc_flush(le->data);
+}
+
+
 /**
  * Set the local bandwidth of an SDP Session
  *
@@ -14,6 +14,107 @@
 #include <re_sip.h>
 
 
+static bool is_lws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/*
+ * Name-addr form "[~ \t\r\n<]*[ \t\r\n]*<[^>]+>[^]*" matched at the
+ * start of pl, with the same quote and escape handling as re_regex().
+ *
+ * Returns 0 on match, EAGAIN if a later start position may match, and
+ * ENOENT if the input ended before a literal, which ends the search.
+ */
+static int name_addr_match(const struct pl *pl, struct sip_addr *addr)
+{
+	bool quote = false, esc = false;
+	size_t i, j;
+
+	for (i=0; i<pl->l; i++) {
+
+		const char c = pl->p[i];
+
+		if (esc) {
+			esc = false;
+			continue;
+		}
+
+		if (c == '\\') {
+			esc = true;
+			continue;
+		}
+
+		if (c == '"') {
+			quote = !quote;
+			continue;
+		}
+
+		if (quote)
+			continue;
+
+		if (is_lws(c) || c == '<')
+			break;
+	}
+
+	addr->dname.p = pl->p;
+	addr->dname.l = i;
+
+	/* Strip quotes */
+	if (i > 1 && pl->p[0] == '"' && pl->p[i - 1] == '"') {
+		addr->dname.p += 1;
+		addr->dname.l -= 2;
+	}
+
+	while (i < pl->l && is_lws(pl->p[i]))
+		++i;
+
+	if (i == pl->l)
+		return ENOENT;
+
+	if (pl->p[i] != '<')
+		return EAGAIN;
+
+	for (j = ++i; j < pl->l && pl->p[j] != '>'; j++)
+		;
+
+	if (j == i)
+		return EAGAIN;
+
+	if (j == pl->l)
+		return ENOENT;
+
+	addr->auri.p = pl->p + i;
+	addr->auri.l = j - i;
+
+	addr->params.p = pl->p + j + 1;
+	addr->params.l = pl->l - j - 1;
+
+	return 0;
+}
+
+
+/*
+ * Search the start positions for the name-addr form, like re_regex()
+ * does. A display-name with unquoted spaces matches from its last word.
+ */
+static bool name_addr_find(const struct pl *pl, struct sip_addr *addr)
+{
+	struct pl s = *pl;
+
+	for (; s.l; pl_advance(&s, 1)) {
+
+		int err = name_addr_match(&s, addr);
+
+		if (err != EAGAIN)
+			return err == 0;
+	}
+
+	return false;
+}
+
+
 /**
  * Decode a pointer-length string into a SIP Address object
  *
@@ -31,8 +132,7 @@ int sip_addr_decode(struct sip_addr *addr, const struct pl *pl)
 
 	memset(addr, 0, sizeof(*addr));
 
-	if (0 == re_regex(pl->p, pl->l, "[~ \t\r\n<]*[ \t\r\n]*<[^>]+>[^]*",
-			  &addr->dname, NULL, &addr->auri, &addr->params)) {
+	if (pl->p && name_addr_find(pl, addr)) {
 
 		if (!addr->dname.l)
 			addr->dname.p = NULL;
@@ -41,11 +141,25 @@ int sip_addr_decode(struct sip_addr *addr, const struct pl *pl)
 			addr->params.p = NULL;
 	}
 	else {
+		struct pl s = *pl;
+		const char *p;
+
 		memset(addr, 0, sizeof(*addr));
 
-		if (re_regex(pl->p, pl->l, "[^;]+[^]*",
-			     &addr->auri, &addr->params))
+		/* "[^;]+[^]*" */
+		while (s.l && *s.p == ';')
+			pl_advance(&s, 1);
+
+		if (!s.l)
 			return EBADMSG;
+
+		p = pl_strchr(&s, ';');
+
+		addr->auri.p = s.p;
+		addr->auri.l = p ? (size_t)(p - s.p) : s.l;
+
+		addr->params.p = s.p + addr->auri.l;
+		addr->params.l = s.l - addr->auri.l;
 	}
 
 	err = uri_decode(&addr->uri, &addr->auri);
@@ -267,7 +267,7 @@ static bool response_handler(const struct sip_msg *msg, void *arg)
 	struct sip *sip = arg;
 
 	ct = list_ledata(hash_lookup(sip->ht_ctrans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (!ct)
 		return false;
@@ -322,7 +322,7 @@ int sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 	if (!ct)
 		return ENOMEM;
 
-	hash_append(sip->ht_ctrans, hash_joaat_str(branch), &ct->he, ct);
+	hash_append(sip->ht_ctrans, hash_wy_str(branch), &ct->he, ct);
 
 	ct->invite = !strcmp(met, "INVITE");
 	ct->branch = mem_ref(branch);
@@ -0,0 +1,333 @@
+/**
+ * @file sip/framer.c  SIP stream framer
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_list.h>
+#include <re_fmt.h>
+#include <re_uri.h>
+#include <re_msg.h>
+#include <re_sip.h>
+
+
+/*
+ * Splits a stream into SIP messages and keep-alives. Headers are
+ * collected in one buffer that is scanned only from where the previous
+ * chunk ended. Once the header is complete, Content-Length is parsed
+ * and the body is copied straight into a buffer of the final message
+ * size, so every byte is scanned and copied once.
+ */
+
+
+/** SIP Stream Framer */
+struct sip_framer {
+	struct mbuf *mb;     /**< Unframed data                      */
+	struct mbuf *body;   /**< Message being completed, or NULL    */
+	size_t need;         /**< Bytes missing from body message     */
+	size_t scan;         /**< Header bytes already scanned        */
+	unsigned lf;         /**< Consecutive LFs at scan position    */
+	size_t maxsz;        /**< Maximum message size                */
+};
+
+
+static void destructor(void *arg)
+{
+	struct sip_framer *fr = arg;
+
+	mem_deref(fr->mb);
+	mem_deref(fr->body);
+}
+
+
+/**
+ * Allocate a SIP stream framer
+ *
+ * @param frp   Pointer to allocated framer
+ * @param maxsz Maximum size of a message, including its body
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_framer_alloc(struct sip_framer **frp, size_t maxsz)
+{
+	struct sip_framer *fr;
+
+	if (!frp || !maxsz)
+		return EINVAL;
+
+	fr = mem_zalloc(sizeof(*fr), destructor);
+	if (!fr)
+		return ENOMEM;
+
+	fr->maxsz = maxsz;
+
+	*frp = fr;
+
+	return 0;
+}
+
+
+static int append(struct sip_framer *fr, struct mbuf *mb)
+{
+	int err;
+
+	if (!fr->mb) {
+		fr->mb = mem_ref(mb);
+		return 0;
+	}
+
+	/* drop framed data, at most once per frame */
+	if (fr->mb->pos) {
+		const size_t left = mbuf_get_left(fr->mb);
+
+		memmove(fr->mb->buf, mbuf_buf(fr->mb), left);
+		fr->mb->pos = 0;
+		fr->mb->end = left;
+	}
+
+	fr->mb->pos = fr->mb->end;
+
+	err = mbuf_write_mem(fr->mb, mbuf_buf(mb), mbuf_get_left(mb));
+
+	fr->mb->pos = 0;
+
+	return err;
+}
+
+
+/**
+ * Add a chunk of received stream data to the framer
+ *
+ * @param fr SIP stream framer
+ * @param mb Received data, may be referenced by the framer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_framer_input(struct sip_framer *fr, struct mbuf *mb)
+{
+	if (!fr || !mb)
+		return EINVAL;
+
+	if (fr->body && fr->need) {
+
+		const size_t n = min(fr->need, mbuf_get_left(mb));
+		int err;
+
+		err = mbuf_write_mem(fr->body, mbuf_buf(mb), n);
+		if (err)
+			return err;
+
+		fr->need -= n;
+		mb->pos  += n;
+	}
+
+	if (!mbuf_get_left(mb))
+		return 0;
+
+	return append(fr, mb);
+}
+
+
+static bool is_lws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/* Content-Length, or its compact form, of a complete header */
+static int content_length(size_t *clenp, const char *p, size_t len)
+{
+	const char *end = p + len;
+	const char *line = NULL;
+
+	while (p < end) {
+
+		const char *eol = memchr(p, '\n', end - p);
+		const char *colon, *name;
+		struct pl n;
+		uint64_t v = 0;
+		bool digits = false;
+
+		if (!eol)
+			break;
+
+		/* skip the start line */
+		if (!line) {
+			line = p;
+			p = eol + 1;
+			continue;
+		}
+
+		name = p;
+		p = eol + 1;
+
+		colon = memchr(name, ':', eol - name);
+		if (!colon)
+			continue;
+
+		n.p = name;
+		n.l = colon - name;
+		while (n.l && is_lws(n.p[n.l - 1]))
+			--n.l;
+
+		if (pl_strcasecmp(&n, "content-length") &&
+		    pl_strcasecmp(&n, "l"))
+			continue;
+
+		for (name = colon + 1; name < eol && is_lws(*name); name++)
+			;
+
+		for (; name < eol && '0' <= *name && *name <= '9'; name++) {
+			if (v <= (uint64_t)UINT32_MAX)
+				v = v * 10 + (*name - '0');
+			digits = true;
+		}
+
+		if (!digits || v > UINT32_MAX)
+			return EBADMSG;
+
+		*clenp = (size_t)v;
+
+		return 0;
+	}
+
+	return EBADMSG;
+}
+
+
+/* Complete header of `hlen' bytes at fr->mb->pos */
+static int header_done(struct sip_framer *fr, struct mbuf **mbp, size_t hlen)
+{
+	struct mbuf *mb = fr->mb;
+	size_t clen, total;
+	int err;
+
+	err = content_length(&clen, (const char *)mbuf_buf(mb), hlen);
+	if (err)
+		return err;
+
+	total = hlen + clen;
+	if (total > fr->maxsz)
+		return EOVERFLOW;
+
+	fr->scan = 0;
+	fr->lf   = 0;
+
+	/* whole message buffered and nothing after it */
+	if (mbuf_get_left(mb) == total) {
+
+		*mbp = mb;
+		fr->mb = NULL;
+
+		return 0;
+	}
+
+	fr->body = mbuf_alloc(total);
+	if (!fr->body)
+		return ENOMEM;
+
+	if (mbuf_get_left(mb) > total) {
+
+		(void)mbuf_write_mem(fr->body, mbuf_buf(mb), total);
+		mb->pos += total;
+
+		fr->body->pos = 0;
+		*mbp = fr->body;
+		fr->body = NULL;
+
+		return 0;
+	}
+
+	fr->need = total - mbuf_get_left(mb);
+
+	(void)mbuf_write_mem(fr->body, mbuf_buf(mb), mbuf_get_left(mb));
+	fr->mb = mem_deref(fr->mb);
+
+	return ENODATA;
+}
+
+
+/**
+ * Get the next frame from a SIP stream framer
+ *
+ * @param fr    SIP stream framer
+ * @param typep Returned frame type
+ * @param mbp   Returned message starting at its position, for
+ *              SIP_FRAME_MSG only. The caller owns the reference.
+ *
+ * @return 0 if a frame was returned, ENODATA if more data is needed,
+ *         otherwise errorcode
+ */
+int sip_framer_next(struct sip_framer *fr, enum sip_frame *typep,
+		    struct mbuf **mbp)
+{
+	struct mbuf *mb;
+	const char *p;
+	size_t left, i;
+
+	if (!fr || !typep || !mbp)
+		return EINVAL;
+
+	if (fr->body) {
+
+		if (fr->need)
+			return ENODATA;
+
+		fr->body->pos = 0;
+		*mbp = fr->body;
+		*typep = SIP_FRAME_MSG;
+		fr->body = NULL;
+
+		return 0;
+	}
+
+	mb = fr->mb;
+	if (!mb || mbuf_get_left(mb) < 2)
+		return ENODATA;
+
+	p    = (const char *)mbuf_buf(mb);
+	left = mbuf_get_left(mb);
+
+	if (!fr->scan && p[0] == '\r' && p[1] == '\n') {
+
+		if (left >= 4 && p[2] == '\r' && p[3] == '\n') {
+			mb->pos += 4;
+			*typep = SIP_FRAME_PING;
+		}
+		else {
+			mb->pos += 2;
+			*typep = SIP_FRAME_CRLF;
+		}
+
+		if (!mbuf_get_left(mb))
+			fr->mb = mem_deref(fr->mb);
+
+		return 0;
+	}
+
+	for (i = fr->scan; i < left; i++) {
+
+		if (p[i] == '\n') {
+
+			if (++fr->lf < 2)
+				continue;
+
+			*typep = SIP_FRAME_MSG;
+			return header_done(fr, mbp, i + 1);
+		}
+		else if (p[i] != '\r') {
+			fr->lf = 0;
+		}
+	}
+
+	fr->scan = left;
+
+	if (left > fr->maxsz)
+		return EOVERFLOW;
+
+	return ENODATA;
+}
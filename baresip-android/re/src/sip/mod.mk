@@ -10,6 +10,7 @@ SRCS	+= sip/contact.c
 SRCS	+= sip/cseq.c
 SRCS	+= sip/ctrans.c
 SRCS	+= sip/dialog.c
+SRCS	+= sip/framer.c
 SRCS	+= sip/keepalive.c
 SRCS	+= sip/keepalive_udp.c
 SRCS	+= sip/msg.c
@@ -53,7 +53,7 @@ struct sip_conn {
 	struct sa paddr;
 	struct tls_conn *sc;
 	struct tcp_conn *tc;
-	struct mbuf *mb;
+	struct sip_framer *fr;
 	struct sip *sip;
 	uint32_t ka_interval;
 	bool established;
@@ -103,7 +103,7 @@ static void conn_destructor(void *arg)
 	hash_unlink(&conn->he);
 	mem_deref(conn->sc);
 	mem_deref(conn->tc);
-	mem_deref(conn->mb);
+	mem_deref(conn->fr);
 }
 
 
@@ -271,14 +271,21 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 {
 	struct sip_transport *transp = arg;
 	struct stun_unknown_attr ua;
-	struct stun_msg *stun_msg;
+	struct stun_msg_fixed stun_fm;
+	struct stun_msg *stun_msg, *stun_hmsg = NULL;
 	struct sip_msg *msg;
 	int err;
 
 	if (mb->end <= 4)
 		return;
 
-	if (!stun_msg_decode(&stun_msg, mb, &ua)) {
+	err = stun_msg_decode_fixed(&stun_fm, mb, &ua);
+	if (err == EOVERFLOW)
+		err = stun_msg_decode(&stun_hmsg, mb, &ua);
+
+	if (!err) {
+
+		stun_msg = stun_hmsg ? stun_hmsg : &stun_fm.msg;
 
 		if (stun_msg_method(stun_msg) == STUN_METHOD_BINDING) {
 
@@ -301,7 +308,7 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 			}
 		}
 
-		mem_deref(stun_msg);
+		mem_deref(stun_hmsg);
 
 		return;
 	}
@@ -326,97 +333,69 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 static void tcp_recv_handler(struct mbuf *mb, void *arg)
 {
 	struct sip_conn *conn = arg;
-	size_t pos;
 	int err = 0;
 
-	if (conn->mb) {
-		pos = conn->mb->pos;
-
-		conn->mb->pos = conn->mb->end;
-
-		err = mbuf_write_mem(conn->mb, mbuf_buf(mb),mbuf_get_left(mb));
+	if (!conn->fr) {
+		err = sip_framer_alloc(&conn->fr, TCP_BUFSIZE_MAX);
 		if (err)
 			goto out;
-
-		conn->mb->pos = pos;
-
-		if (mbuf_get_left(conn->mb) > TCP_BUFSIZE_MAX) {
-			err = EOVERFLOW;
-			goto out;
-		}
-	}
-	else {
-		conn->mb = mem_ref(mb);
 	}
 
+	err = sip_framer_input(conn->fr, mb);
+	if (err)
+		goto out;
+
 	for (;;) {
+		enum sip_frame type;
 		struct sip_msg *msg;
-		uint32_t clen;
-		size_t end;
+		struct mbuf *mbm;
+		size_t clen;
 
-		if (mbuf_get_left(conn->mb) < 2)
+		err = sip_framer_next(conn->fr, &type, &mbm);
+		if (err) {
+			if (err == ENODATA)
+				err = 0;
 			break;
+		}
 
-		if (!memcmp(mbuf_buf(conn->mb), "\r\n", 2)) {
-
-			tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
-				  conn_tmr_handler, conn);
-
-			conn->mb->pos += 2;
-
-			if (mbuf_get_left(conn->mb) >= 2 &&
-			    !memcmp(mbuf_buf(conn->mb), "\r\n", 2)) {
-
-				struct mbuf mbr;
+		tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
+			  conn_tmr_handler, conn);
 
-				conn->mb->pos += 2;
+		if (type == SIP_FRAME_PING) {
 
-				mbr.buf  = crlfcrlf;
-				mbr.size = sizeof(crlfcrlf);
-				mbr.pos  = 0;
-				mbr.end  = 2;
+			struct mbuf mbr;
 
-				err = tcp_send(conn->tc, &mbr);
-				if (err)
-					break;
-			}
+			mbr.buf  = crlfcrlf;
+			mbr.size = sizeof(crlfcrlf);
+			mbr.pos  = 0;
+			mbr.end  = 2;
 
-			if (mbuf_get_left(conn->mb))
-				continue;
+			err = tcp_send(conn->tc, &mbr);
+			if (err)
+				break;
 
-			conn->mb = mem_deref(conn->mb);
-			break;
+			continue;
+		}
+		else if (type != SIP_FRAME_MSG) {
+			continue;
 		}
 
-		pos = conn->mb->pos;
-
-		err = sip_msg_decode(&msg, conn->mb);
+		err = sip_msg_decode(&msg, mbm);
+		clen = mbuf_get_left(mbm);
+		mem_deref(mbm);
 		if (err) {
 			if (err == ENODATA)
-				err = 0;
+				err = EBADMSG;
 			break;
 		}
 
-		if (!msg->clen.p) {
+		/* the framer sized the body from the same header */
+		if (!msg->clen.p || pl_u32(&msg->clen) != clen) {
 			mem_deref(msg);
 			err = EBADMSG;
 			break;
 		}
 
-		clen = pl_u32(&msg->clen);
-
-		if (mbuf_get_left(conn->mb) < clen) {
-			conn->mb->pos = pos;
-			mem_deref(msg);
-			break;
-		}
-
-		tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT * 1000,
-			  conn_tmr_handler, conn);
-
-		end = conn->mb->end;
-
-		msg->mb->end = msg->mb->pos + clen;
 		msg->sock = mem_ref(conn);
 		msg->src = conn->paddr;
 		msg->dst = conn->laddr;
@@ -424,25 +403,6 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 
 		sip_recv(conn->sip, msg);
 		mem_deref(msg);
-
-		if (end <= conn->mb->end) {
-			conn->mb = mem_deref(conn->mb);
-			break;
-		}
-
-		mb = mbuf_alloc(end - conn->mb->end);
-		if (!mb) {
-			err = ENOMEM;
-			goto out;
-		}
-
-		(void)mbuf_write_mem(mb, &conn->mb->buf[conn->mb->end],
-				     end - conn->mb->end);
-
-		mb->pos = 0;
-
-		mem_deref(conn->mb);
-		conn->mb = mb;
 	}
 
  out:
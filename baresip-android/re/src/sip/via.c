@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <ctype.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mbuf.h>
@@ -13,17 +14,89 @@
 #include <re_sip.h>
 
 
-static int decode_hostport(const struct pl *hostport, struct pl *host,
-			   struct pl *port)
+static bool is_lws(char c)
 {
-	/* Try IPv6 first */
-	if (!re_regex(hostport->p, hostport->l, "\\[[0-9a-f:]+\\][:]*[0-9]*",
-		      host, NULL, port))
-		return 0;
-
-	/* Then non-IPv6 host */
-	return re_regex(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
-			host, NULL, port);
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+static size_t skip_lws(const struct pl *pl, size_t i)
+{
+	while (i < pl->l && is_lws(pl->p[i]))
+		++i;
+
+	return i;
+}
+
+
+static bool match_lit(const struct pl *pl, size_t *i, const char *lit)
+{
+	size_t j = *i;
+
+	for (; *lit; lit++, j++) {
+
+		if (j >= pl->l)
+			return false;
+
+		if (tolower(*lit) != tolower((unsigned char)pl->p[j]))
+			return false;
+	}
+
+	*i = j;
+
+	return true;
+}
+
+
+/*
+ * Hand-written matcher for the Via expression used with re_regex() in
+ * sip_via_decode(), anchored at the start of the header value. A
+ * well-formed Via always matches here.
+ */
+static bool via_match(const struct pl *pl, struct pl *transp,
+		      struct pl *sentby, struct pl *params)
+{
+	size_t i = 0, j;
+
+	if (!match_lit(pl, &i, "SIP"))
+		return false;
+
+	i = skip_lws(pl, i);
+	if (!match_lit(pl, &i, "/"))
+		return false;
+
+	i = skip_lws(pl, i);
+	if (!match_lit(pl, &i, "2.0"))
+		return false;
+
+	i = skip_lws(pl, i);
+	if (!match_lit(pl, &i, "/"))
+		return false;
+
+	i = skip_lws(pl, i);
+	for (j = i; j < pl->l && isalpha((unsigned char)pl->p[j]); j++)
+		;
+	if (j == i)
+		return false;
+
+	transp->p = pl->p + i;
+	transp->l = j - i;
+
+	i = skip_lws(pl, j);
+	for (j = i; j < pl->l && pl->p[j] != ';' && !is_lws(pl->p[j]); j++)
+		;
+	if (j == i)
+		return false;
+
+	sentby->p = pl->p + i;
+	sentby->l = j - i;
+
+	i = skip_lws(pl, j);
+
+	params->p = pl->p + i;
+	params->l = pl->l - i;
+
+	return true;
 }
 
 
@@ -43,13 +116,17 @@ int sip_via_decode(struct sip_via *via, const struct pl *pl)
 	if (!via || !pl)
 		return EINVAL;
 
-	err = re_regex(pl->p, pl->l,
-		       "SIP[  \t\r\n]*/[ \t\r\n]*2.0[ \t\r\n]*/[ \t\r\n]*"
-		       "[A-Z]+[ \t\r\n]*[^; \t\r\n]+[ \t\r\n]*[^]*",
-		       NULL, NULL, NULL, NULL, &transp,
-		       NULL, &via->sentby, NULL, &via->params);
-	if (err)
-		return err;
+	if (!via_match(pl, &transp, &via->sentby, &via->params)) {
+
+		err = re_regex(pl->p, pl->l,
+			       "SIP[  \t\r\n]*/[ \t\r\n]*2.0[ \t\r\n]*/"
+			       "[ \t\r\n]*[A-Z]+[ \t\r\n]*[^; \t\r\n]+"
+			       "[ \t\r\n]*[^]*",
+			       NULL, NULL, NULL, NULL, &transp,
+			       NULL, &via->sentby, NULL, &via->params);
+		if (err)
+			return err;
+	}
 
 	if (!pl_strcmp(&transp, "TCP"))
 		via->tp = SIP_TRANSP_TCP;
@@ -60,7 +137,7 @@ int sip_via_decode(struct sip_via *via, const struct pl *pl)
 	else
 		via->tp = SIP_TRANSP_NONE;
 
-	err = decode_hostport(&via->sentby, &host, &port);
+	err = uri_decode_hostport(&via->sentby, &host, &port);
 	if (err)
 		return err;
 
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
@@ -14,39 +15,24 @@
 #include "stun.h"
 
 
-static int str_decode(struct mbuf *mb, char **str, size_t len)
+/* Strings are copied into the string storage of the message */
+static int str_decode(struct mbuf *mb, char **str, size_t len,
+		      char **strv, size_t *strsz)
 {
 	if (mbuf_get_left(mb) < len)
 		return EBADMSG;
 
-	return mbuf_strdup(mb, str, len);
-}
-
-
-static void destructor(void *arg)
-{
-	struct stun_attr *attr = arg;
-
-	switch (attr->type) {
-
-	case STUN_ATTR_USERNAME:
-	case STUN_ATTR_REALM:
-	case STUN_ATTR_NONCE:
-	case STUN_ATTR_SOFTWARE:
-		mem_deref(attr->v.str);
-		break;
+	if (*strsz < len + 1)
+		return EOVERFLOW;
 
-	case STUN_ATTR_ERR_CODE:
-		mem_deref(attr->v.err_code.reason);
-		break;
+	(void)mbuf_read_mem(mb, (uint8_t *)*strv, len);
+	(*strv)[len] = '\0';
 
-	case STUN_ATTR_DATA:
-	case STUN_ATTR_PADDING:
-		mem_deref(attr->v.mb.buf);
-		break;
-	}
+	*str    = *strv;
+	*strv  += len + 1;
+	*strsz -= len + 1;
 
-	list_unlink(&attr->le);
+	return 0;
 }
 
 
@@ -176,23 +162,21 @@ int stun_attr_encode(struct mbuf *mb, uint16_t type, const void *v,
 }
 
 
-int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
-		     const uint8_t *tid, struct stun_unknown_attr *ua)
+int stun_attr_decode(struct stun_attr *attr, struct mbuf *mb,
+		     const uint8_t *tid, struct stun_unknown_attr *ua,
+		     char **strv, size_t *strsz)
 {
-	struct stun_attr *attr;
 	size_t start, len;
 	uint32_t i, n;
 	int err = 0;
 
-	if (!mb || !attrp)
+	if (!mb || !attr || !strv || !strsz)
 		return EINVAL;
 
 	if (mbuf_get_left(mb) < 4)
 		return EBADMSG;
 
-	attr = mem_zalloc(sizeof(*attr), destructor);
-	if (!attr)
-		return ENOMEM;
+	memset(attr, 0, sizeof(*attr));
 
 	attr->type = ntohs(mbuf_read_u16(mb));
 	len = ntohs(mbuf_read_u16(mb));
@@ -229,7 +213,7 @@ int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
 	case STUN_ATTR_REALM:
 	case STUN_ATTR_NONCE:
 	case STUN_ATTR_SOFTWARE:
-		err = str_decode(mb, &attr->v.str, len);
+		err = str_decode(mb, &attr->v.str, len, strv, strsz);
 		break;
 
 	case STUN_ATTR_MSG_INTEGRITY:
@@ -246,7 +230,8 @@ int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
 		mb->pos += 2;
 		attr->v.err_code.code  = (mbuf_read_u8(mb) & 0x7) * 100;
 		attr->v.err_code.code += mbuf_read_u8(mb);
-		err = str_decode(mb, &attr->v.err_code.reason, len - 4);
+		err = str_decode(mb, &attr->v.err_code.reason, len - 4,
+				 strv, strsz);
 		break;
 
 	case STUN_ATTR_UNKNOWN_ATTR:
@@ -280,7 +265,8 @@ int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
 
 	case STUN_ATTR_DATA:
 	case STUN_ATTR_PADDING:
-		attr->v.mb.buf  = mem_ref(mb->buf);
+		/* points into the message buffer */
+		attr->v.mb.buf  = mb->buf;
 		attr->v.mb.size = mb->size;
 		attr->v.mb.pos  = mb->pos;
 		attr->v.mb.end  = mb->pos + len;
@@ -331,22 +317,16 @@ int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
 	}
 
 	if (err)
-		goto error;
+		return err;
 
 	/* padding */
 	while (((mb->pos - start) & 0x03) && mbuf_get_left(mb))
 		++mb->pos;
 
-	*attrp = attr;
-
 	return 0;
 
  badmsg:
-	err = EBADMSG;
- error:
-	mem_deref(attr);
-
-	return err;
+	return EBADMSG;
 }
 
 
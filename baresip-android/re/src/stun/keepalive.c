@@ -7,7 +7,7 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
-#include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_udp.h>
 #include <re_stun.h>
@@ -26,7 +26,7 @@ struct stun_keepalive {
 	int proto;
 	void *sock;
 	struct sa dst;
-	struct tmr tmr;           /**< Refresh timer                        */
+	struct kalive ka;         /**< Refresh timer                        */
 	uint32_t interval;        /**< Refresh interval in seconds          */
 	stun_mapped_addr_h *mah;  /**< Mapped address handler               */
 	void *arg;                /**< Handler argument                     */
@@ -42,7 +42,7 @@ static void keepalive_destructor(void *data)
 {
 	struct stun_keepalive *ska = data;
 
-	tmr_cancel(&ska->tmr);
+	kalive_cancel(&ska->ka);
 
 	mem_deref(ska->ct);
 	mem_deref(ska->uh);
@@ -67,8 +67,12 @@ static void stun_response_handler(int err, uint16_t scode, const char *reason,
 	(void)reason;
 
 	/* Restart timer */
-	if (ska->interval > 0)
-		tmr_start(&ska->tmr, ska->interval*1000, timeout, ska);
+	if (ska->interval > 0) {
+		int terr = kalive_start(&ska->ka, ska->interval*1000,
+					timeout, ska);
+		if (terr)
+			call_handler(ska, terr, NULL);
+	}
 
 	if (err || scode) {
 		/* Clear current mapped addr to force new notification */
@@ -114,7 +118,7 @@ static void timeout(void *arg)
 
 	/* Restart timer */
 	if (ska->interval > 0)
-		tmr_start(&ska->tmr, ska->interval*1000, timeout, ska);
+		(void)kalive_start(&ska->ka, ska->interval*1000, timeout, ska);
 
 	/* Error */
 	call_handler(ska, err, NULL);
@@ -195,7 +199,7 @@ int stun_keepalive_alloc(struct stun_keepalive **skap,
 	if (err)
 		goto out;
 
-	tmr_init(&ska->tmr);
+	kalive_init(&ska->ka, 0);
 
 	ska->proto = proto;
 	ska->sock = mem_ref(sock);
@@ -242,7 +246,7 @@ void stun_keepalive_enable(struct stun_keepalive *ska, uint32_t interval)
 
 	ska->interval = interval;
 
-	tmr_cancel(&ska->tmr);
+	kalive_cancel(&ska->ka);
 	if (interval > 0)
-		tmr_start(&ska->tmr, 1, timeout, ska);
+		(void)kalive_start(&ska->ka, 1, timeout, ska);
 }
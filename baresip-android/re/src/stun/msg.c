@@ -24,8 +24,8 @@ enum {
 };
 
 
-/**
-   Defines a STUN Message object
+/*
+   Layout of a STUN Message
 
    <pre>
 
@@ -42,12 +42,6 @@ enum {
    '---------------------'
    </pre>
 */
-struct stun_msg {
-	struct stun_hdr hdr;
-	struct list attrl;
-	struct mbuf *mb;
-	size_t start;
-};
 
 
 static uint32_t fingerprint(const uint8_t *buf, size_t len)
@@ -60,11 +54,65 @@ static void destructor(void *arg)
 {
 	struct stun_msg *msg = arg;
 
-	list_flush(&msg->attrl);
 	mem_deref(msg->mb);
 }
 
 
+/* Count the attributes of the message, from their headers */
+static uint32_t attr_count(const struct mbuf *mb, size_t len)
+{
+	const uint8_t *p = mbuf_buf(mb);
+	uint32_t n = 0;
+
+	while (len >= 4) {
+
+		const size_t alen = (size_t)(p[2] << 8 | p[3]);
+		const size_t step = 4 + ((alen + 3) & ~(size_t)3);
+
+		++n;
+
+		if (step >= len)
+			break;
+
+		p   += step;
+		len -= step;
+	}
+
+	return n;
+}
+
+
+static int attrs_decode(struct stun_msg *msg, struct mbuf *mb,
+			struct stun_unknown_attr *ua)
+{
+	char *strv = msg->strv;
+	size_t strsz = msg->strsz;
+	size_t extra;
+	int err = 0;
+
+	if (ua)
+		ua->typec = 0;
+
+	/* mbuf_get_left(mb) >= hdr.len checked in stun_hdr_decode() */
+	extra = mbuf_get_left(mb) - msg->hdr.len;
+
+	while (mbuf_get_left(mb) - extra >= 4) {
+
+		if (msg->attrc >= msg->attrn)
+			return EOVERFLOW;
+
+		err = stun_attr_decode(&msg->attrv[msg->attrc], mb,
+				       msg->hdr.tid, ua, &strv, &strsz);
+		if (err)
+			break;
+
+		++msg->attrc;
+	}
+
+	return err;
+}
+
+
 /**
  * Decode a buffer to a STUN Message
  *
@@ -81,7 +129,8 @@ int stun_msg_decode(struct stun_msg **msgpp, struct mbuf *mb,
 {
 	struct stun_msg *msg;
 	struct stun_hdr hdr;
-	size_t start, extra;
+	size_t start;
+	uint32_t attrn;
 	int err;
 
 	if (!msgpp || !mb)
@@ -95,37 +144,79 @@ int stun_msg_decode(struct stun_msg **msgpp, struct mbuf *mb,
 		return err;
 	}
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
+	/* one allocation, with the attributes and strings after it */
+	attrn = attr_count(mb, hdr.len);
+
+	msg = mem_zalloc(sizeof(*msg) + attrn * sizeof(struct stun_attr)
+			 + hdr.len, destructor);
 	if (!msg) {
 		mb->pos = start;
 		return ENOMEM;
 	}
 
-	msg->hdr = hdr;
-	msg->mb = mem_ref(mb);
+	msg->hdr   = hdr;
+	msg->attrv = (struct stun_attr *)(msg + 1);
+	msg->attrn = attrn;
+	msg->strv  = (char *)(msg->attrv + attrn);
+	msg->strsz = hdr.len;
+	msg->mb    = mem_ref(mb);
 	msg->start = start;
 
-	if (ua)
-		ua->typec = 0;
+	err = attrs_decode(msg, mb, ua);
+	if (err)
+		mem_deref(msg);
+	else
+		*msgpp = msg;
 
-	/* mbuf_get_left(mb) >= hdr.len checked in stun_hdr_decode() above */
-	extra = mbuf_get_left(mb) - hdr.len;
+	mb->pos = start;
 
-	while (mbuf_get_left(mb) - extra >= 4) {
+	return err;
+}
 
-		struct stun_attr *attr;
 
-		err = stun_attr_decode(&attr, mb, hdr.tid, ua);
-		if (err)
-			break;
+/**
+ * Decode a buffer to a STUN Message in caller storage, without heap
+ * allocation. The message is valid as long as the buffer is not
+ * modified or freed, and must not be referenced or dereferenced.
+ *
+ * @param fm  STUN Message storage
+ * @param mb  Buffer containing the raw STUN packet
+ * @param ua  Unknown attributes (optional)
+ *
+ * @return 0 if success, EOVERFLOW if the message does not fit in the
+ *         storage, otherwise errorcode
+ *
+ * @note The message is in fm->msg. On EOVERFLOW the caller can decode
+ *       it with stun_msg_decode() instead
+ */
+int stun_msg_decode_fixed(struct stun_msg_fixed *fm, struct mbuf *mb,
+			  struct stun_unknown_attr *ua)
+{
+	struct stun_msg *msg;
+	size_t start;
+	int err;
+
+	if (!fm || !mb)
+		return EINVAL;
+
+	msg = &fm->msg;
+	start = mb->pos;
 
-		list_append(&msg->attrl, &attr->le, attr);
+	err = stun_hdr_decode(mb, &msg->hdr);
+	if (err) {
+		mb->pos = start;
+		return err;
 	}
 
-	if (err)
-		mem_deref(msg);
-	else
-		*msgpp = msg;
+	msg->attrv = fm->attrv;
+	msg->attrc = 0;
+	msg->attrn = ARRAY_SIZE(fm->attrv);
+	msg->strv  = fm->strv;
+	msg->strsz = sizeof(fm->strv);
+	msg->mb    = mb;
+	msg->start = start;
+
+	err = attrs_decode(msg, mb, ua);
 
 	mb->pos = start;
 
@@ -208,15 +299,15 @@ bool stun_msg_mcookie(const struct stun_msg *msg)
  */
 struct stun_attr *stun_msg_attr(const struct stun_msg *msg, uint16_t type)
 {
-	struct le *le = msg ? list_head(&msg->attrl) : NULL;
+	uint32_t i;
 
-	while (le) {
-		struct stun_attr *attr = le->data;
+	if (!msg)
+		return NULL;
 
-		le = le->next;
+	for (i=0; i<msg->attrc; i++) {
 
-		if (attr->type == type)
-			return attr;
+		if (msg->attrv[i].type == type)
+			return &msg->attrv[i];
 	}
 
 	return NULL;
@@ -235,15 +326,15 @@ struct stun_attr *stun_msg_attr(const struct stun_msg *msg, uint16_t type)
 struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 				      stun_attr_h *h, void *arg)
 {
-	struct le *le = msg ? list_head(&msg->attrl) : NULL;
+	uint32_t i;
 
-	while (le) {
-		struct stun_attr *attr = le->data;
+	if (!msg || !h)
+		return NULL;
 
-		le = le->next;
+	for (i=0; i<msg->attrc; i++) {
 
-		if (h && h(attr, arg))
-			return (attr);
+		if (h(&msg->attrv[i], arg))
+			return &msg->attrv[i];
 	}
 
 	return NULL;
@@ -376,20 +467,12 @@ int stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t class,
 }
 
 
-/**
- * Verify the Message-Integrity of a STUN message
- *
- * @param msg    STUN Message
- * @param key    Authentication key
- * @param keylen Number of bytes in authentication key
- *
- * @return 0 if verified, otherwise errorcode
- */
-int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
-		    size_t keylen)
+static int chk_mi(const struct stun_msg *msg, const uint8_t *key,
+		  size_t keylen, struct hmac *hmac)
 {
-	uint8_t hmac[SHA_DIGEST_LENGTH];
+	uint8_t md[SHA_DIGEST_LENGTH];
 	struct stun_attr *mi, *fp;
+	int err = 0;
 
 	if (!msg)
 		return EINVAL;
@@ -407,9 +490,15 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	hmac_sha1(key, keylen, mbuf_buf(msg->mb),
-		  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE,
-		  hmac, sizeof(hmac));
+	if (hmac) {
+		err = hmac_digest(hmac, md, sizeof(md), mbuf_buf(msg->mb),
+				  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE);
+	}
+	else {
+		hmac_sha1(key, keylen, mbuf_buf(msg->mb),
+			  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE,
+			  md, sizeof(md));
+	}
 
 	if (fp) {
 		((struct stun_msg *)msg)->hdr.len += FP_SIZE;
@@ -417,13 +506,51 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	if (memcmp(mi->v.msg_integrity, hmac, SHA_DIGEST_LENGTH))
+	if (err)
+		return err;
+
+	if (memcmp(mi->v.msg_integrity, md, SHA_DIGEST_LENGTH))
 		return EBADMSG;
 
 	return 0;
 }
 
 
+/**
+ * Verify the Message-Integrity of a STUN message
+ *
+ * @param msg    STUN Message
+ * @param key    Authentication key
+ * @param keylen Number of bytes in authentication key
+ *
+ * @return 0 if verified, otherwise errorcode
+ */
+int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
+		    size_t keylen)
+{
+	return chk_mi(msg, key, keylen, NULL);
+}
+
+
+/**
+ * Verify the Message-Integrity of a STUN message, with a HMAC-SHA1 of
+ * the authentication key. The HMAC holds the padded key, so this is
+ * faster than stun_msg_chk_mi() when the same key is used again.
+ *
+ * @param msg  STUN Message
+ * @param hmac HMAC-SHA1 of the authentication key
+ *
+ * @return 0 if verified, otherwise errorcode
+ */
+int stun_msg_chk_mi_hmac(const struct stun_msg *msg, struct hmac *hmac)
+{
+	if (!hmac)
+		return EINVAL;
+
+	return chk_mi(msg, NULL, 0, hmac);
+}
+
+
 /**
  * Check the Fingerprint of a STUN message
  *
@@ -136,16 +136,21 @@ int stun_send(int proto, void *sock, const struct sa *dst, struct mbuf *mb)
 int stun_recv(struct stun *stun, struct mbuf *mb)
 {
 	struct stun_unknown_attr ua;
-	struct stun_msg *msg;
+	struct stun_msg_fixed fm;
+	struct stun_msg *msg, *hmsg = NULL;
 	int err;
 
 	if (!stun || !mb)
 		return EINVAL;
 
-	err = stun_msg_decode(&msg, mb, &ua);
+	err = stun_msg_decode_fixed(&fm, mb, &ua);
+	if (err == EOVERFLOW)
+		err = stun_msg_decode(&hmsg, mb, &ua);
 	if (err)
 		return err;
 
+	msg = hmsg ? hmsg : &fm.msg;
+
 	switch (stun_msg_class(msg)) {
 
 	case STUN_CLASS_INDICATION:
@@ -165,7 +170,7 @@ int stun_recv(struct stun *stun, struct mbuf *mb)
 		break;
 	}
 
-	mem_deref(msg);
+	mem_deref(hmsg);
 
 	return err;
 }
@@ -28,14 +28,6 @@ enum {
 	((type&0x3e00)>>2 | (type&0x00e0)>>1 | (type&0x000f))
 
 
-struct stun_hdr {
-	uint16_t type;               /**< Message type   */
-	uint16_t len;                /**< Payload length */
-	uint32_t cookie;             /**< Magic cookie   */
-	uint8_t tid[STUN_TID_SIZE];  /**< Transaction ID */
-};
-
-
 struct stun {
 	struct list ctl;
 	struct stun_conf conf;
@@ -48,8 +40,9 @@ int stun_hdr_decode(struct mbuf *mb, struct stun_hdr *hdr);
 
 int stun_attr_encode(struct mbuf *mb, uint16_t type, const void *v,
 		     const uint8_t *tid, uint8_t padding);
-int stun_attr_decode(struct stun_attr **attrp, struct mbuf *mb,
-		     const uint8_t *tid, struct stun_unknown_attr *ua);
+int stun_attr_decode(struct stun_attr *attr, struct mbuf *mb,
+		     const uint8_t *tid, struct stun_unknown_attr *ua,
+		     char **strv, size_t *strsz);
 void stun_attr_dump(const struct stun_attr *a);
 
 int  stun_addr_encode(struct mbuf *mb, const struct sa *addr,
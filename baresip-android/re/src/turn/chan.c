@@ -8,7 +8,7 @@
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_hash.h>
-#include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_md5.h>
 #include <re_udp.h>
@@ -38,7 +38,7 @@ struct chan {
 	struct loop_state ls;
 	uint16_t nr;
 	struct sa peer;
-	struct tmr tmr;
+	struct kalive ka;
 	struct turnc *turnc;
 	struct stun_ctrans *ct;
 	turnc_chan_h *ch;
@@ -65,7 +65,7 @@ static void chan_destructor(void *data)
 {
 	struct chan *chan = data;
 
-	tmr_cancel(&chan->tmr);
+	kalive_cancel(&chan->ka);
 	mem_deref(chan->ct);
 	hash_unlink(&chan->he_numb);
 	hash_unlink(&chan->he_peer);
@@ -112,7 +112,11 @@ static void chanbind_resp_handler(int err, uint16_t scode, const char *reason,
 	switch (scode) {
 
 	case 0:
-		tmr_start(&chan->tmr, CHAN_REFRESH * 1000, timeout, chan);
+		err = kalive_start(&chan->ka, CHAN_REFRESH * 1000,
+				   timeout, chan);
+		if (err)
+			break;
+
 		if (chan->ch) {
 			chan->ch(chan->arg);
 			chan->ch  = NULL;
@@ -197,7 +201,7 @@ int turnc_add_chan(struct turnc *turnc, const struct sa *peer,
 	hash_append(turnc->chans->ht_peer, sa_hash(peer, SA_ALL),
 		    &chan->he_peer, chan);
 
-	tmr_init(&chan->tmr);
+	kalive_init(&chan->ka, 0);
 	chan->turnc = turnc;
 	chan->ch = ch;
 	chan->arg = arg;
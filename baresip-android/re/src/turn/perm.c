@@ -8,7 +8,7 @@
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_hash.h>
-#include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_md5.h>
 #include <re_udp.h>
@@ -27,7 +27,7 @@ struct perm {
 	struct le he;
 	struct loop_state ls;
 	struct sa peer;
-	struct tmr tmr;
+	struct kalive ka;
 	struct turnc *turnc;
 	struct stun_ctrans *ct;
 	turnc_perm_h *ph;
@@ -42,7 +42,7 @@ static void destructor(void *arg)
 {
 	struct perm *perm = arg;
 
-	tmr_cancel(&perm->tmr);
+	kalive_cancel(&perm->ka);
 	mem_deref(perm->ct);
 	hash_unlink(&perm->he);
 }
@@ -87,7 +87,11 @@ static void createperm_resp_handler(int err, uint16_t scode,
 	switch (scode) {
 
 	case 0:
-		tmr_start(&perm->tmr, PERM_REFRESH * 1000, timeout, perm);
+		err = kalive_start(&perm->ka, PERM_REFRESH * 1000,
+				   timeout, perm);
+		if (err)
+			break;
+
 		if (perm->ph) {
 			perm->ph(perm->arg);
 			perm->ph  = NULL;
@@ -162,7 +166,7 @@ int turnc_add_perm(struct turnc *turnc, const struct sa *peer,
 		return ENOMEM;
 
 	hash_append(turnc->perms, sa_hash(peer, SA_ADDR), &perm->he, perm);
-	tmr_init(&perm->tmr);
+	kalive_init(&perm->ka, 0);
 	perm->peer = *peer;
 	perm->turnc = turnc;
 	perm->ph = ph;
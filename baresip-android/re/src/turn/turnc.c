@@ -10,7 +10,7 @@
 #include <re_md5.h>
 #include <re_list.h>
 #include <re_hash.h>
-#include <re_tmr.h>
+#include <re_kalive.h>
 #include <re_sa.h>
 #include <re_udp.h>
 #include <re_tcp.h>
@@ -52,7 +52,7 @@ static void destructor(void *arg)
 	if (turnc->allocated)
 		(void)refresh_request(turnc, 0, true, NULL, NULL);
 
-	tmr_cancel(&turnc->tmr);
+	kalive_cancel(&turnc->ka);
 	mem_deref(turnc->ct);
 
 	hash_flush(turnc->perms);
@@ -80,13 +80,13 @@ static void timeout(void *arg)
 }
 
 
-static void refresh_timer(struct turnc *turnc)
+static int refresh_timer(struct turnc *turnc)
 {
 	const uint32_t t = turnc->lifetime*1000*3/4;
 
 	DEBUG_INFO("Start refresh timer.. %u seconds\n", t/1000);
 
-	tmr_start(&turnc->tmr, t, timeout, turnc);
+	return kalive_start(&turnc->ka, t, timeout, turnc);
 }
 
 
@@ -115,7 +115,7 @@ static void allocate_resp_handler(int err, uint16_t scode, const char *reason,
 			turnc->lifetime = ltm->v.lifetime;
 
 		turnc->allocated = true;
-		refresh_timer(turnc);
+		err = refresh_timer(turnc);
 		break;
 
 	case 300:
@@ -193,7 +193,10 @@ static void refresh_resp_handler(int err, uint16_t scode, const char *reason,
 		ltm = stun_msg_attr(msg, STUN_ATTR_LIFETIME);
 		if (ltm)
 			turnc->lifetime = ltm->v.lifetime;
-		refresh_timer(turnc);
+		err = refresh_timer(turnc);
+		if (err)
+			break;
+
 		return;
 
 	case 401:
@@ -429,7 +432,7 @@ int turnc_alloc(struct turnc **turncp, const struct stun_conf *conf, int proto,
 	if (err)
 		goto out;
 
-	tmr_init(&turnc->tmr);
+	kalive_init(&turnc->ka, 0);
 	turnc->proto = proto;
 	turnc->sock = mem_ref(sock);
 	turnc->psrv = *srv;
@@ -666,16 +669,20 @@ void turnc_loopstate_reset(struct loop_state *ls)
 int turnc_keygen(struct turnc *turnc, const struct stun_msg *msg)
 {
 	struct stun_attr *realm, *nonce;
+	int err;
 
 	realm = stun_msg_attr(msg, STUN_ATTR_REALM);
 	nonce = stun_msg_attr(msg, STUN_ATTR_NONCE);
 	if (!realm || !nonce)
 		return EPROTO;
 
-	mem_deref(turnc->realm);
-	mem_deref(turnc->nonce);
-	turnc->realm = mem_ref(realm->v.realm);
-	turnc->nonce = mem_ref(nonce->v.nonce);
+	turnc->realm = mem_deref(turnc->realm);
+	turnc->nonce = mem_deref(turnc->nonce);
+
+	err  = str_dup(&turnc->realm, realm->v.realm);
+	err |= str_dup(&turnc->nonce, nonce->v.nonce);
+	if (err)
+		return err;
 
 	return md5_printf(turnc->md5_hash, "%s:%s:%s",
 			  turnc->username, turnc->realm, turnc->password);
@@ -26,7 +26,7 @@ struct turnc {
 	int proto;                     /**< Transport protocol              */
 	struct stun *stun;             /**< STUN Instance                   */
 	uint32_t lifetime;             /**< Allocation lifetime in [seconds]*/
-	struct tmr tmr;                /**< Allocation refresh timer        */
+	struct kalive ka;              /**< Allocation refresh timer        */
 	turnc_h *th;                   /**< Turn client handler             */
 	void *arg;                     /**< Handler argument                */
 	uint8_t md5_hash[MD5_SIZE];    /**< Cached MD5-sum of credentials   */
@@ -3,6 +3,9 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#ifdef HAVE_SENDMMSG
+#define _GNU_SOURCE 1
+#endif
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -22,6 +25,9 @@
 #ifdef __APPLE__
 #include "TargetConditionals.h"
 #endif
+#ifdef HAVE_SENDMMSG
+#include <sys/socket.h>
+#endif
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -52,7 +58,28 @@
 
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_BATCH = 64,
+};
+
+
+/** Defines a datagram queued in a batch */
+struct udp_qent {
+	struct udp_sock *us; /**< UDP Socket, referenced          */
+	struct sa dst;       /**< Destination, unset if connected */
+	size_t pos;          /**< Position in queue buffer        */
+	size_t len;          /**< Length of datagram              */
+	int fd;              /**< Socket file descriptor          */
+};
+
+/** Defines a batch of datagrams sent by the polling thread */
+struct udp_batch {
+	struct udp_batch *prev; /**< Enclosing batch of the thread  */
+	struct udp_batch **ubp; /**< Batch of the thread, if begun  */
+	struct mbuf *qb;        /**< Queued datagrams               */
+	struct udp_qent *qv;    /**< Queued datagram entries        */
+	uint32_t qc;            /**< Number of queued datagrams     */
+	uint32_t qsz;           /**< Size of queued entry vector    */
 };
 
 
@@ -127,16 +154,40 @@ static void udp_destructor(void *data)
 }
 
 
+static void udp_deliver(struct udp_sock *us, struct sa *src,
+			struct mbuf *mb)
+{
+	struct le *le;
+
+	/* call helpers */
+	le = us->helpers.head;
+	while (le) {
+		struct udp_helper *uh = le->data;
+		bool hdld;
+
+		le = le->next;
+
+		hdld = uh->recvh(src, mb, uh->arg);
+		if (hdld)
+			return;
+	}
+
+	us->rh(src, mb, us->arg);
+}
+
+
 static void udp_read(struct udp_sock *us, int fd)
 {
 	struct mbuf *mb = mbuf_alloc(us->rxsz);
 	struct sa src;
-	struct le *le;
 	int err = 0;
 	ssize_t n;
 
-	if (!mb)
+	if (!mb) {
+		if (us->eh)
+			us->eh(ENOMEM, us->arg);
 		return;
+	}
 
 	src.len = sizeof(src.u);
 	n = recvfrom(fd, BUF_CAST mb->buf + us->rx_presz,
@@ -203,22 +254,45 @@ static void udp_read(struct udp_sock *us, int fd)
 
 	(void)mbuf_resize(mb, mb->end);
 
-	/* call helpers */
-	le = us->helpers.head;
-	while (le) {
-		struct udp_helper *uh = le->data;
-		bool hdld;
+	udp_deliver(us, &src, mb);
 
-		le = le->next;
+ out:
+	mem_deref(mb);
+}
 
-		hdld = uh->recvh(&src, mb, uh->arg);
-		if (hdld)
-			goto out;
+
+/* Datagram read by the polling loop */
+static void udp_recv_handler(int err, const struct sa *src,
+			     const uint8_t *buf, size_t len, void *arg)
+{
+	struct udp_sock *us = arg;
+	struct mbuf *mb;
+	struct sa sa;
+
+	if (err) {
+		if (us->eh)
+			us->eh(err, us->arg);
+		return;
+	}
+
+	mb = mbuf_alloc(max(us->rxsz, us->rx_presz + len));
+	if (!mb) {
+		if (us->eh)
+			us->eh(ENOMEM, us->arg);
+		return;
 	}
 
-	us->rh(&src, mb, us->arg);
+	memcpy(mb->buf + us->rx_presz, buf, len);
+
+	mb->pos = us->rx_presz;
+	mb->end = us->rx_presz + len;
+
+	(void)mbuf_resize(mb, mb->end);
+
+	sa_cpy(&sa, src);
+
+	udp_deliver(us, &sa, mb);
 
- out:
 	mem_deref(mb);
 }
 
@@ -422,9 +496,193 @@ int udp_connect(struct udp_sock *us, const struct sa *peer)
 }
 
 
+extern struct udp_batch **udpbatchp_get(void);
+
+
+static void batch_clear(struct udp_batch *ub)
+{
+	uint32_t i;
+
+	for (i=0; i<ub->qc; i++)
+		mem_deref(ub->qv[i].us);
+
+	ub->qc = 0;
+
+	if (ub->qb)
+		mbuf_rewind(ub->qb);
+}
+
+
+static void batch_destructor(void *data)
+{
+	struct udp_batch *ub = data;
+
+	if (ub->ubp)
+		*ub->ubp = ub->prev;
+
+	if (ub->qc)
+		DEBUG_WARNING("%u queued datagrams dropped\n", ub->qc);
+
+	batch_clear(ub);
+
+	mem_deref(ub->qb);
+	mem_deref(ub->qv);
+}
+
+
+static int udp_queue(struct udp_batch *ub, struct udp_sock *us, int fd,
+		     const struct sa *dst, const struct mbuf *mb)
+{
+	struct udp_qent *qe;
+	int err;
+
+	if (ub->qc >= ub->qsz) {
+
+		const uint32_t sz = ub->qsz ? ub->qsz * 2 : UDP_BATCH;
+		struct udp_qent *qv;
+
+		qv = mem_reallocarray(ub->qv, sz, sizeof(*qv), NULL);
+		if (!qv)
+			return ENOMEM;
+
+		ub->qv  = qv;
+		ub->qsz = sz;
+	}
+
+	qe = &ub->qv[ub->qc];
+
+	qe->pos = ub->qb->end;
+	qe->len = mbuf_get_left(mb);
+	qe->fd  = fd;
+
+	if (dst)
+		qe->dst = *dst;
+	else
+		sa_init(&qe->dst, AF_UNSPEC);
+
+	ub->qb->pos = ub->qb->end;
+	err = mbuf_write_mem(ub->qb, mbuf_buf(mb), qe->len);
+	if (err)
+		return err;
+
+	qe->us = mem_ref(us);
+	++ub->qc;
+
+	return 0;
+}
+
+
+static void udp_queue_error(struct udp_sock *us, int err)
+{
+	if (us->eh)
+		us->eh(err, us->arg);
+	else
+		DEBUG_WARNING("send of queued datagram failed: %m\n", err);
+}
+
+
+/* Send one queued datagram, returns the error of the send */
+static int qent_send(const struct udp_batch *ub, const struct udp_qent *qe)
+{
+	const uint8_t *buf = ub->qb->buf + qe->pos;
+	const struct sa *dst = &qe->dst;
+
+	if (sa_af(dst) != AF_UNSPEC) {
+		if (sendto(qe->fd, BUF_CAST buf, qe->len, 0,
+			   &dst->u.sa, dst->len) < 0)
+			return errno;
+	}
+	else {
+		if (send(qe->fd, BUF_CAST buf, qe->len, 0) < 0)
+			return errno;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Send the queued datagrams, with one sendmmsg() per run of datagrams
+ * on the same socket where available. The polling loop sends them
+ * instead if it can.
+ */
+static void udp_flush(struct udp_batch *ub)
+{
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgv[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+#endif
+	uint32_t i = 0;
+
+	while (i < ub->qc) {
+
+		const struct udp_qent *qe = &ub->qv[i];
+		const uint8_t *buf = ub->qb->buf + qe->pos;
+		const struct sa *dst = sa_af(&qe->dst) != AF_UNSPEC ?
+			&qe->dst : NULL;
+		int err;
+
+		err = fd_sendto(qe->fd, buf, qe->len, dst);
+		if (ENOTSUP != err) {
+			if (err)
+				udp_queue_error(qe->us, err);
+			++i;
+			continue;
+		}
+
+#ifdef HAVE_SENDMMSG
+		{
+			uint32_t n = 0;
+			int r;
+
+			memset(msgv, 0, sizeof(msgv));
+
+			while (n < UDP_BATCH && i + n < ub->qc &&
+			       ub->qv[i + n].fd == qe->fd) {
+
+				struct udp_qent *q = &ub->qv[i + n];
+
+				iov[n].iov_base = ub->qb->buf + q->pos;
+				iov[n].iov_len  = q->len;
+
+				msgv[n].msg_hdr.msg_iov = &iov[n];
+				msgv[n].msg_hdr.msg_iovlen = 1;
+
+				if (sa_af(&q->dst) != AF_UNSPEC) {
+					msgv[n].msg_hdr.msg_name =
+						&q->dst.u.sa;
+					msgv[n].msg_hdr.msg_namelen =
+						q->dst.len;
+				}
+
+				++n;
+			}
+
+			r = sendmmsg(qe->fd, msgv, n, 0);
+			if (r > 0) {
+				i += r;
+				continue;
+			}
+		}
+#endif
+
+		/* send the first datagram of the run alone, so that an
+		   error is reported for the datagram that failed */
+		err = qent_send(ub, qe);
+		if (err)
+			udp_queue_error(qe->us, err);
+
+		++i;
+	}
+
+	batch_clear(ub);
+}
+
+
 static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 			     struct mbuf *mb, struct le *le)
 {
+	struct udp_batch **ubp;
 	struct sa hdst;
 	int err = 0, fd;
 
@@ -449,6 +707,15 @@ static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 			return err;
 	}
 
+	ubp = udpbatchp_get();
+	if (ubp && *ubp)
+		return udp_queue(*ubp, us, fd, us->conn ? NULL : dst, mb);
+
+	err = fd_sendto(fd, mb->buf + mb->pos, mb->end - mb->pos,
+			us->conn ? NULL : dst);
+	if (ENOTSUP != err)
+		return err;
+
 	/* Connected socket? */
 	if (us->conn) {
 		if (send(fd, BUF_CAST mb->buf + mb->pos, mb->end - mb->pos,
@@ -483,6 +750,82 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 }
 
 
+/**
+ * Allocate a batch of UDP datagrams
+ *
+ * @param ubp Pointer to allocated batch
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_batch_alloc(struct udp_batch **ubp)
+{
+	struct udp_batch *ub;
+
+	if (!ubp)
+		return EINVAL;
+
+	ub = mem_zalloc(sizeof(*ub), batch_destructor);
+	if (!ub)
+		return ENOMEM;
+
+	ub->qb = mbuf_alloc(UDP_BATCH * 128);
+	if (!ub->qb) {
+		mem_deref(ub);
+		return ENOMEM;
+	}
+
+	*ubp = ub;
+
+	return 0;
+}
+
+
+/**
+ * Begin a batch on the calling thread. Until the batch is ended, the
+ * datagrams that this thread sends on any UDP socket are queued after
+ * the UDP helpers. Datagrams sent by other threads, on the same
+ * sockets, are sent at once. Only the thread running the polling loop
+ * can batch, elsewhere the batch is not used.
+ *
+ * @param ub UDP batch
+ */
+void udp_batch_begin(struct udp_batch *ub)
+{
+	struct udp_batch **ubp;
+
+	if (!ub || ub->ubp)
+		return;
+
+	ubp = udpbatchp_get();
+	if (!ubp)
+		return;
+
+	ub->prev = *ubp;
+	ub->ubp  = ubp;
+	*ubp = ub;
+}
+
+
+/**
+ * End a batch, and send the queued datagrams. Errors sending them are
+ * reported to the error handler of their socket.
+ *
+ * @param ub UDP batch
+ */
+void udp_batch_end(struct udp_batch *ub)
+{
+	if (!ub || !ub->ubp)
+		return;
+
+	*ub->ubp = ub->prev;
+	ub->ubp  = NULL;
+	ub->prev = NULL;
+
+	if (ub->qc)
+		udp_flush(ub);
+}
+
+
 /**
  * Send an anonymous UDP Datagram to a peer
  *
@@ -696,12 +1039,16 @@ int udp_thread_attach(struct udp_sock *us)
 		err = fd_listen(us->fd, FD_READ, udp_read_handler, us);
 		if (err)
 			goto out;
+
+		(void)fd_recv_set(us->fd, udp_recv_handler);
 	}
 
 	if (-1 != us->fd6) {
 		err = fd_listen(us->fd6, FD_READ, udp_read_handler6, us);
 		if (err)
 			goto out;
+
+		(void)fd_recv_set(us->fd6, udp_recv_handler);
 	}
 
  out:
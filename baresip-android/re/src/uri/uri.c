@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <ctype.h>
 #include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
@@ -71,20 +72,179 @@ int uri_encode(struct re_printf *pf, const struct uri *uri)
 }
 
 
+/*
+ * Hand-written matchers for the URI grammars. Each one is the re_regex()
+ * expression in its comment, matched at the start of the string with the
+ * same semantics (greedy character classes, no backtracking). Well-formed
+ * input always matches there; anything else falls back to re_regex(),
+ * which also tries later start positions.
+ */
+
+
+/* index of the first character at or after i that is in set */
+static size_t span_until(const struct pl *pl, size_t i, const char *set)
+{
+	for (; i < pl->l; i++) {
+
+		if (strchr(set, pl->p[i]))
+			break;
+	}
+
+	return i;
+}
+
+
+static size_t span_digit(const struct pl *pl, size_t i)
+{
+	while (i < pl->l && '0' <= pl->p[i] && pl->p[i] <= '9')
+		++i;
+
+	return i;
+}
+
+
+static void pl_range(struct pl *pl, const struct pl *src, size_t a, size_t b)
+{
+	pl->p = src->p + a;
+	pl->l = b - a;
+}
+
+
+/* "\\[[0-9a-f:]+\\][:]*[0-9]*" */
+static bool ipv6_match(const struct pl *pl, struct pl *host, struct pl *port)
+{
+	size_t i = 1, j;
+
+	if (!pl->l || pl->p[0] != '[')
+		return false;
+
+	while (i < pl->l && (isxdigit((unsigned char)pl->p[i]) ||
+			     pl->p[i] == ':'))
+		++i;
+
+	if (i == 1 || i == pl->l || pl->p[i] != ']')
+		return false;
+
+	pl_range(host, pl, 1, i);
+
+	for (j = i + 1; j < pl->l && pl->p[j] == ':'; j++)
+		;
+
+	pl_range(port, pl, j, span_digit(pl, j));
+
+	return true;
+}
+
+
+/* "[^:]+[:]*[0-9]*" */
+static bool host_match(const struct pl *pl, struct pl *host, struct pl *port)
+{
+	size_t i = span_until(pl, 0, ":"), j;
+
+	if (!i)
+		return false;
+
+	pl_range(host, pl, 0, i);
+
+	for (j = i; j < pl->l && pl->p[j] == ':'; j++)
+		;
+
+	pl_range(port, pl, j, span_digit(pl, j));
+
+	return true;
+}
+
+
+/* "[^:]+:[^@:]*[:]*[^@]*@[^;? ]+[^?]*[^]*" */
+static bool userinfo_match(const struct pl *pl, struct uri *uri,
+			   struct pl *hostport)
+{
+	size_t i, j, k, h, q;
+
+	i = span_until(pl, 0, ":");
+	if (!i || i == pl->l)
+		return false;
+
+	j = span_until(pl, i + 1, "@:");
+
+	for (k = j; k < pl->l && pl->p[k] == ':'; k++)
+		;
+
+	h = span_until(pl, k, "@");
+	if (h == pl->l)
+		return false;
+
+	q = span_until(pl, h + 1, ";? ");
+	if (q == h + 1)
+		return false;
+
+	pl_range(&uri->scheme, pl, 0, i);
+	pl_range(&uri->user, pl, i + 1, j);
+	pl_range(&uri->password, pl, k, h);
+	pl_range(hostport, pl, h + 1, q);
+
+	h = span_until(pl, q, "?");
+
+	pl_range(&uri->params, pl, q, h);
+	pl_range(&uri->headers, pl, h, pl->l);
+
+	return true;
+}
+
+
+/* "[^:]+:[^;? ]+[^?]*[^]*" */
+static bool scheme_match(const struct pl *pl, struct uri *uri,
+			 struct pl *hostport)
+{
+	size_t i, q, h;
+
+	i = span_until(pl, 0, ":");
+	if (!i || i == pl->l)
+		return false;
+
+	q = span_until(pl, i + 1, ";? ");
+	if (q == i + 1)
+		return false;
+
+	h = span_until(pl, q, "?");
+
+	pl_range(&uri->scheme, pl, 0, i);
+	pl_range(hostport, pl, i + 1, q);
+	pl_range(&uri->params, pl, q, h);
+	pl_range(&uri->headers, pl, h, pl->l);
+
+	return true;
+}
+
+
 /**
  * Decode host-port portion of a URI (if present)
  *
+ * @param hostport Host-port string, e.g. "10.0.0.1:5060" or "[::1]"
+ * @param host     Returned host, without brackets for IPv6 addresses
+ * @param port     Returned port, empty if not present
+ *
  * @return 0 if success, otherwise errorcode
  */
-static int decode_hostport(const struct pl *hostport, struct pl *host,
-			   struct pl *port)
+int uri_decode_hostport(const struct pl *hostport, struct pl *host,
+			struct pl *port)
 {
+	if (!hostport || !host || !port)
+		return EINVAL;
+
 	/* Try IPv6 first */
-	if (!re_regex(hostport->p, hostport->l, "\\[[0-9a-f:]+\\][:]*[0-9]*",
+	if (ipv6_match(hostport, host, port))
+		return 0;
+
+	if (pl_strchr(hostport, '[') &&
+	    !re_regex(hostport->p, hostport->l, "\\[[0-9a-f:]+\\][:]*[0-9]*",
 		      host, NULL, port))
 		return 0;
 
 	/* Then non-IPv6 host */
+	if (host_match(hostport, host, port))
+		return 0;
+
 	return re_regex(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
 			host, NULL, port);
 }
@@ -109,20 +269,26 @@ int uri_decode(struct uri *uri, const struct pl *pl)
 		return EINVAL;
 
 	memset(uri, 0, sizeof(*uri));
-	if (0 == re_regex(pl->p, pl->l,
-			  "[^:]+:[^@:]*[:]*[^@]*@[^;? ]+[^?]*[^]*",
-			  &uri->scheme, &uri->user, NULL, &uri->password,
-			  &hostport, &uri->params, &uri->headers)) {
-
-		if (0 == decode_hostport(&hostport, &uri->host, &port))
+	if (userinfo_match(pl, uri, &hostport) ||
+	    (pl_strchr(pl, '@') &&
+	     0 == re_regex(pl->p, pl->l,
+			   "[^:]+:[^@:]*[:]*[^@]*@[^;? ]+[^?]*[^]*",
+			   &uri->scheme, &uri->user, NULL, &uri->password,
+			   &hostport, &uri->params, &uri->headers))) {
+
+		if (0 == uri_decode_hostport(&hostport, &uri->host, &port))
 			goto out;
 	}
 
 	memset(uri, 0, sizeof(*uri));
-	err = re_regex(pl->p, pl->l, "[^:]+:[^;? ]+[^?]*[^]*",
-		       &uri->scheme, &hostport, &uri->params, &uri->headers);
+	if (scheme_match(pl, uri, &hostport))
+		err = 0;
+	else
+		err = re_regex(pl->p, pl->l, "[^:]+:[^;? ]+[^?]*[^]*",
+			       &uri->scheme, &hostport, &uri->params,
+			       &uri->headers);
 	if (0 == err) {
-		err = decode_hostport(&hostport, &uri->host, &port);
+		err = uri_decode_hostport(&hostport, &uri->host, &port);
 		if (0 == err)
 			goto out;
 	}
@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -53,10 +54,14 @@ struct websock_conn {
 	websock_estab_h *estabh;
 	websock_recv_h *recvh;
 	websock_close_h *closeh;
+	websock_chunk_h *chunkh;
 	void *arg;
+	struct websock_hdr shdr;
+	uint64_t soff;
 	enum websock_state state;
 	unsigned kaint;
 	bool active;
+	bool streaming;
 };
 
 
@@ -108,6 +113,7 @@ static void conn_destructor(void *arg)
 	if (conn->state == CLOSING) {
 
 		conn->recvh  = dummy_recv_handler;
+		conn->chunkh = NULL;
 		conn->closeh = internal_close_handler;
 		conn->arg    = conn;
 
@@ -168,10 +174,82 @@ static enum websock_scode websock_err2scode(int err)
 }
 
 
-static int websock_decode(struct websock_hdr *hdr, struct mbuf *mb)
+/**
+ * Apply (or remove) the WebSocket masking to a block of payload data
+ *
+ * The payload is processed one machine word at a time, with the masking
+ * key rotated to match the word alignment of the buffer.
+ *
+ * @param p      Payload data
+ * @param len    Number of bytes to mask
+ * @param mkey   Masking key
+ * @param offset Offset of the first byte within the frame payload
+ */
+void websock_mask(uint8_t *p, size_t len, const uint8_t mkey[4],
+		  uint64_t offset)
 {
-	uint8_t v, *p;
-	size_t i;
+	uint8_t kbuf[sizeof(uint64_t)];
+	uint64_t key;
+	size_t i, k = (size_t)(offset & 3);
+
+	if (!p || !mkey)
+		return;
+
+	/* bytewise until the buffer is word aligned */
+	while (len && ((uintptr_t)p & (sizeof(uint64_t) - 1))) {
+		*p++ ^= mkey[k];
+		k = (k + 1) & 3;
+		--len;
+	}
+
+	for (i=0; i<sizeof(kbuf); i++)
+		kbuf[i] = mkey[(k + i) & 3];
+
+	memcpy(&key, kbuf, sizeof(key));
+
+	while (len >= 4 * sizeof(uint64_t)) {
+
+		uint64_t *w = (uint64_t *)(void *)p;
+
+		w[0] ^= key;
+		w[1] ^= key;
+		w[2] ^= key;
+		w[3] ^= key;
+
+		p   += 4 * sizeof(uint64_t);
+		len -= 4 * sizeof(uint64_t);
+	}
+
+	while (len >= sizeof(uint64_t)) {
+
+		*(uint64_t *)(void *)p ^= key;
+
+		p   += sizeof(uint64_t);
+		len -= sizeof(uint64_t);
+	}
+
+	for (i=0; i<len; i++)
+		p[i] ^= kbuf[i];
+}
+
+
+/**
+ * Decode a WebSocket frame header
+ *
+ * On return the buffer is positioned at the start of the payload.
+ * The payload itself is not checked for availability or unmasked.
+ *
+ * @param hdr Frame header to decode into
+ * @param mb  Buffer to decode from
+ *
+ * @return 0 if success, ENODATA if header is incomplete
+ */
+int websock_hdr_decode(struct websock_hdr *hdr, struct mbuf *mb)
+{
+	uint8_t v;
+
+	if (!hdr || !mb)
+		return EINVAL;
 
 	if (mbuf_get_left(mb) < 2)
 		return ENODATA;
@@ -204,22 +282,101 @@ static int websock_decode(struct websock_hdr *hdr, struct mbuf *mb)
 
 	if (hdr->mask) {
 
-		if (mbuf_get_left(mb) < (4 + hdr->len))
+		if (mbuf_get_left(mb) < 4)
 			return ENODATA;
 
-		hdr->mkey[0] = mbuf_read_u8(mb);
-		hdr->mkey[1] = mbuf_read_u8(mb);
-		hdr->mkey[2] = mbuf_read_u8(mb);
-		hdr->mkey[3] = mbuf_read_u8(mb);
+		(void)mbuf_read_mem(mb, hdr->mkey, sizeof(hdr->mkey));
+	}
+
+	return 0;
+}
+
+
+/* detach the next len bytes of the receive buffer into mbp */
+static int buf_split(struct websock_conn *conn, struct mbuf **mbp,
+		     size_t len)
+{
+	struct mbuf *mb = conn->mb;
+	size_t end = mb->end;
+
+	mb->end = mb->pos + len;
 
-		for (i=0, p=mbuf_buf(mb); i<hdr->len; i++)
-			p[i] = p[i] ^ hdr->mkey[i%4];
+	if (end > mb->end) {
+		struct mbuf *mbn = mbuf_alloc(end - mb->end);
+		if (!mbn) {
+			mb->end = end;
+			return ENOMEM;
+		}
+
+		(void)mbuf_write_mem(mbn, mb->buf + mb->end, end - mb->end);
+		mbn->pos = 0;
+
+		conn->mb = mbn;
 	}
 	else {
-		if (mbuf_get_left(mb) < hdr->len)
-			return ENODATA;
+		conn->mb = NULL;
+	}
+
+	*mbp = mb;
+
+	return 0;
+}
+
+
+static void conn_handler_done(struct websock_conn *conn)
+{
+	if (mem_nrefs(conn) == 1) {
+
+		if (conn->state == OPEN)
+			(void)websock_close(conn, WEBSOCK_GOING_AWAY,
+					    "Going Away");
+
+		/*
+		 * This is a hack. We enforce CLOSING
+		 * state so we know the connection will
+		 * continue to live.
+		 */
+		conn->state = CLOSING;
+	}
+
+	mem_deref(conn);
+}
+
+
+/* deliver the available part of a streamed data frame */
+static int stream_chunk(struct websock_conn *conn)
+{
+	const uint64_t rem = conn->shdr.len - conn->soff;
+	const uint64_t off = conn->soff;
+	struct mbuf *mb;
+	size_t n;
+	int err;
+
+	n = (size_t)min((uint64_t)mbuf_get_left(conn->mb), rem);
+	if (!n && rem) {
+		conn->mb = mem_deref(conn->mb);
+		return 0;
 	}
 
+	err = buf_split(conn, &mb, n);
+	if (err)
+		return err;
+
+	if (conn->shdr.mask)
+		websock_mask(mbuf_buf(mb), n, conn->shdr.mkey, off);
+
+	conn->soff += n;
+	if (conn->soff == conn->shdr.len)
+		conn->streaming = false;
+
+	if (conn->chunkh) {
+		mem_ref(conn);
+		conn->chunkh(&conn->shdr, off, mb, conn->arg);
+		conn_handler_done(conn);
+	}
+
+	mem_deref(mb);
+
 	return 0;
 }
 
@@ -253,11 +410,19 @@ static void recv_handler(struct mbuf *mb, void *arg)
 	while (conn->mb) {
 
 		struct websock_hdr hdr;
-		size_t pos, end;
+		size_t pos;
+
+		if (conn->streaming) {
+			err = stream_chunk(conn);
+			if (err)
+				goto out;
+
+			continue;
+		}
 
 		pos = conn->mb->pos;
 
-		err = websock_decode(&hdr, conn->mb);
+		err = websock_hdr_decode(&hdr, conn->mb);
 		if (err) {
 			if (err == ENODATA) {
 				conn->mb->pos = pos;
@@ -278,27 +443,26 @@ static void recv_handler(struct mbuf *mb, void *arg)
 			goto out;
 		}
 
-		mb = conn->mb;
-
-		end     = mb->end;
-		mb->end = mb->pos + (size_t)hdr.len;
+		/* data frames are delivered as they arrive */
+		if (conn->chunkh && hdr.opcode < WEBSOCK_CLOSE) {
+			conn->shdr      = hdr;
+			conn->soff      = 0;
+			conn->streaming = true;
+			continue;
+		}
 
-		if (end > mb->end) {
-			struct mbuf *mbn = mbuf_alloc(end - mb->end);
-			if (!mbn) {
-				err = ENOMEM;
-				goto out;
-			}
+		if (mbuf_get_left(conn->mb) < hdr.len) {
+			conn->mb->pos = pos;
+			break;
+		}
 
-			(void)mbuf_write_mem(mbn, mb->buf + mb->end,
-					     end - mb->end);
-			mbn->pos = 0;
+		if (hdr.mask)
+			websock_mask(mbuf_buf(conn->mb), (size_t)hdr.len,
+				     hdr.mkey, 0);
 
-			conn->mb = mbn;
-		}
-		else {
-			conn->mb = NULL;
-		}
+		err = buf_split(conn, &mb, (size_t)hdr.len);
+		if (err)
+			goto out;
 
 		switch (hdr.opcode) {
 
@@ -307,22 +471,7 @@ static void recv_handler(struct mbuf *mb, void *arg)
 		case WEBSOCK_BIN:
 			mem_ref(conn);
 			conn->recvh(&hdr, mb, conn->arg);
-
-			if (mem_nrefs(conn) == 1) {
-
-				if (conn->state == OPEN)
-					(void)websock_close(conn,
-						            WEBSOCK_GOING_AWAY,
-							    "Going Away");
-
-				/*
-				 * This is a hack. We enforce CLOSING
-				 * state so we know the connection will
-				 * continue to live.
-				 */
-				conn->state = CLOSING;
-			}
-			mem_deref(conn);
+			conn_handler_done(conn);
 			break;
 
 		case WEBSOCK_CLOSE:
@@ -589,15 +738,12 @@ static int websock_encode(struct mbuf *mb, bool fin,
 
 	if (mask) {
 		uint8_t mkey[4];
-		uint8_t *p;
-		size_t i;
 
 		rand_bytes(mkey, sizeof(mkey));
 
 		err |= mbuf_write_mem(mb, mkey, sizeof(mkey));
 
-		for (i=0, p=mbuf_buf(mb); i<len; i++)
-			p[i] = p[i] ^ mkey[i%4];
+		websock_mask(mbuf_buf(mb), len, mkey, 0);
 	}
 
 	return err;
@@ -694,6 +840,28 @@ int websock_close(struct websock_conn *conn, enum websock_scode scode,
 }
 
 
+/**
+ * Deliver data frames incrementally as they arrive
+ *
+ * When a chunk handler is set, TEXT, BIN and CONT frames are no longer
+ * buffered until complete. Instead the chunk handler is called with each
+ * part of the payload as it is received, and the frame is complete when
+ * offset plus the chunk length equals the frame length. Control frames
+ * are always delivered whole.
+ *
+ * @param conn   WebSocket connection
+ * @param chunkh Chunk handler, or NULL to buffer complete frames
+ */
+void websock_chunk_handler_set(struct websock_conn *conn,
+			       websock_chunk_h *chunkh)
+{
+	if (!conn)
+		return;
+
+	conn->chunkh = chunkh;
+}
+
+
 const struct sa *websock_peer(const struct websock_conn *conn)
 {
 	return conn ? &conn->peer : NULL;
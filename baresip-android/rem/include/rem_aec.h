@@ -0,0 +1,27 @@
+/**
+ * @file rem_aec.h  Acoustic Echo Canceller
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct aec;
+
+/** Echo canceller statistics */
+struct aec_stat {
+	bool delay_valid;     /**< Echo path delay has been found        */
+	uint32_t delay_ms;    /**< Estimated echo path delay [ms]        */
+	float erle;           /**< Echo return loss enhancement [dB]     */
+	uint64_t blocks;      /**< Processed capture blocks              */
+	uint64_t underruns;   /**< Capture blocks short of far-end audio */
+	uint64_t overruns;    /**< Far-end samples lost on overflow      */
+	int32_t skew;         /**< Playback to capture clock skew [ppm]  */
+	uint64_t resyncs;     /**< Far-end queue resynchronizations      */
+	uint64_t resets;      /**< Filter resets after divergence        */
+};
+
+int  aec_alloc(struct aec **aecp, uint32_t srate, uint32_t tail_ms);
+void aec_playback(struct aec *aec, const int16_t *sampv, size_t sampc);
+void aec_capture(struct aec *aec, int16_t *sampv, size_t sampc);
+void aec_stats(const struct aec *aec, struct aec_stat *stat);
+uint32_t aec_latency(const struct aec *aec);
+int  aec_debug(struct re_printf *pf, const struct aec *aec);
@@ -6,7 +6,9 @@
 
 
 #include "rem_au.h"
+#include "rem_aec.h"
 #include "rem_aubuf.h"
+#include "rem_auplc.h"
 #include "rem_auconv.h"
 #include "rem_aufile.h"
 #include "rem_autone.h"
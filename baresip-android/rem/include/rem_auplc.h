@@ -0,0 +1,20 @@
+/**
+ * @file rem_auplc.h  Audio Packet Loss Concealment
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct auplc;
+
+/** Packet loss concealment statistics */
+struct auplc_stat {
+	uint64_t frames;      /**< Received frames                      */
+	uint64_t concealed;   /**< Concealed frames                     */
+	uint64_t bursts;      /**< Losses of one or more frames         */
+	uint32_t period;      /**< Last pitch period [samples]          */
+};
+
+int  auplc_alloc(struct auplc **plcp, uint32_t srate);
+void auplc_rx(struct auplc *plc, int16_t *sampv, size_t sampc);
+void auplc_conceal(struct auplc *plc, int16_t *sampv, size_t sampc);
+void auplc_stats(const struct auplc *plc, struct auplc_stat *stat);
@@ -36,5 +36,6 @@ void vidmix_source_set_focus(struct vidmix_source *src,
 			     const struct vidmix_source *focus_src,
 			     bool focus_full);
 void vidmix_source_set_focus_idx(struct vidmix_source *src, unsigned pidx);
+int  vidmix_source_mix(struct vidmix_source *src);
 void vidmix_source_put(struct vidmix_source *src,
 		       const struct vidframe *frame);
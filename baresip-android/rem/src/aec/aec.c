@@ -0,0 +1,993 @@
+/**
+ * @file aec/aec.c  Acoustic Echo Canceller
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem_dsp.h>
+#include <rem_aec.h>
+#include "aec.h"
+
+
+#define DEBUG_MODULE "aec"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * Partitioned-block frequency-domain adaptive filter (PBFDAF) with
+ * overlap-save. The echo tail is split in partitions of one block, and
+ * every block costs three real FFTs of twice the block size plus one
+ * more for the gradient constraint, which is applied to one partition
+ * per block in turn.
+ *
+ * The far-end signal is queued by the playback side, and read one block
+ * per capture block. The queue is resampled by the estimated skew of
+ * the playback and capture clocks, so that the echo path does not drift
+ * away from the filter. A delay estimator correlates binary band
+ * spectra of the near-end and far-end signals, and the filter is run on
+ * the far-end signal delayed accordingly, so the taps cover the echo
+ * itself and not the delay in front of it.
+ */
+
+
+enum {
+	NBANDS        = 32,    /* Bands of the binary spectra            */
+	DELAY_MAX_MS  = 500,   /* Longest delay that can be estimated    */
+	DELAY_HOLD    = 24,    /* Blocks a new delay must persist        */
+	WINDOW_MS     = 1000,  /* Window of the far-end queue level      */
+	DIVERGE_MAX   = 8,     /* Diverged blocks before a filter reset  */
+	FRAC_TAPS     = 16,    /* Taps of the fractional delay filters   */
+	FRAC_PHASES   = 256,   /* Resolution of the fractional delays    */
+	ALIGN         = 8,     /* Floats per vector, array alignment     */
+};
+
+#define MU           1.0f     /* Step size                              */
+#define MU_FLOOR     0.1f     /* Smallest step, adapted filter          */
+#define MU_START     1.0f     /* Smallest step, before convergence      */
+#define DELTA        100.0f   /* Regularization, per sample power       */
+#define ACTIVE       1000.0f  /* Active signal, per sample power        */
+#define COST_ALPHA   (1.0f/64)
+#define COST_CONF    0.75f    /* Best cost below this part of mean      */
+#define BAND_ALPHA   (1.0f/32)
+#define ERLE_ALPHA   0.02f
+#define CONVERGED    6.0f     /* ERLE of an adapted filter [dB]         */
+#define SKEW_KF      0.5      /* Skew loop, level slope gain            */
+#define SKEW_KP      0.05     /* Skew loop, level error gain            */
+#define SKEW_MAX     0.01     /* Largest clock skew                     */
+
+
+/** Acoustic Echo Canceller */
+struct aec {
+	struct lock *lock;      /**< Protects the far-end queue            */
+	struct rfft *fft;       /**< Real FFT of two blocks                */
+	uint32_t srate;         /**< Sampling rate                         */
+	size_t b;               /**< Block size in samples                 */
+	size_t nb;              /**< Number of frequency bins, b + 1       */
+	size_t nbs;             /**< Stride of the bin arrays              */
+	unsigned p;             /**< Number of filter partitions           */
+	unsigned h;             /**< Blocks of far-end history             */
+	unsigned dmax;          /**< Number of delay estimator lags        */
+
+	/* far-end queue, written by playback */
+	int16_t *fifo;
+	size_t fifo_sz;
+	size_t fifo_rd;
+	size_t fifo_wr;
+	bool playing;
+	size_t lvl_min;
+	double lvl_sum;
+	double lvl_ref;
+	double lvl_prev;
+	unsigned wblk;
+	unsigned wlen;
+	size_t frame;           /**< Last far-end frame size               */
+	double frac;            /**< Fractional read position              */
+	double ratio;           /**< Far-end samples per capture sample    */
+	double skew_i;
+	float *interp;          /**< Fractional delay filters              */
+
+	/* near-end blocking */
+	int16_t *nin;
+	int16_t *nout;
+	size_t inc;
+
+	/* adaptive filter */
+	float *mem;
+	float *hist;            /**< Far-end blocks, h * b                 */
+	float *hpow;            /**< Power of the far-end blocks, h        */
+	float *xr, *xi;         /**< Far-end spectra ring, p * nbs         */
+	float *wr, *wi;         /**< Filter partitions, p * nbs            */
+	float *sx;              /**< Far-end power over partitions         */
+	float *yr, *yi;         /**< Echo estimate spectrum                */
+	float *er, *ei;         /**< Error spectrum                        */
+	float *tbuf;            /**< Time domain work buffer, 2 * b        */
+	float *nprev;           /**< Previous near-end block               */
+	uint64_t n;             /**< Block counter                         */
+	unsigned xpos;          /**< Newest far-end spectrum               */
+	unsigned cpos;          /**< Next partition to constrain           */
+	unsigned d;             /**< Far-end delay line in blocks          */
+	unsigned diverged;
+	float py, pe;           /**< Smoothed echo and error power         */
+	bool adapted;
+
+	/* delay estimator */
+	uint16_t bandv[NBANDS + 1];
+	float far_mean[NBANDS];
+	float near_mean[NBANDS];
+	uint32_t *farbits;
+	float *cost;
+	uint64_t updates;
+	int est;
+	int cand;
+	unsigned candc;
+
+	/* statistics */
+	struct aec_stat stat;
+	float erle_n, erle_e;
+};
+
+
+static void destructor(void *arg)
+{
+	struct aec *aec = arg;
+
+	mem_deref(aec->lock);
+	mem_deref(aec->fft);
+	mem_deref(aec->fifo);
+	mem_deref(aec->nin);
+	mem_deref(aec->nout);
+	mem_deref(aec->mem);
+	mem_deref(aec->farbits);
+	mem_deref(aec->cost);
+}
+
+
+static inline unsigned popcount32(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	v = (v + (v >> 4)) & 0x0f0f0f0f;
+
+	return (v * 0x01010101) >> 24;
+}
+
+
+static inline size_t align_up(size_t n)
+{
+	return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+
+static inline float *hist_block(const struct aec *aec, uint64_t n)
+{
+	return aec->hist + (n % aec->h) * aec->b;
+}
+
+
+static inline unsigned xslot(const struct aec *aec, unsigned p)
+{
+	return (aec->xpos + p) % aec->p;
+}
+
+
+static bool far_active(const struct aec *aec, uint64_t ago, unsigned c)
+{
+	unsigned i;
+
+	for (i=0; i<c && ago + i < aec->n; i++) {
+		if (aec->hpow[(aec->n - ago - i) % aec->h] > ACTIVE)
+			return true;
+	}
+
+	return false;
+}
+
+
+static float power(const float *v, size_t n)
+{
+	float sum = 0;
+	size_t i;
+
+	for (i=0; i<n; i++)
+		sum += v[i] * v[i];
+
+	return sum / n;
+}
+
+
+/*
+ * Vector kernels. The bin arrays are padded to a multiple of the vector
+ * width and never alias, so these loops vectorize without tails.
+ */
+
+
+/* y += x * w */
+static void cmac(float * restrict yr, float * restrict yi,
+		 const float * restrict xr, const float * restrict xi,
+		 const float * restrict wr, const float * restrict wi,
+		 size_t n)
+{
+	size_t k;
+
+	for (k=0; k<n; k++) {
+		yr[k] += xr[k] * wr[k] - xi[k] * wi[k];
+		yi[k] += xr[k] * wi[k] + xi[k] * wr[k];
+	}
+}
+
+
+/* w += conj(x) * g */
+static void cmacc(float * restrict wr, float * restrict wi,
+		  const float * restrict xr, const float * restrict xi,
+		  const float * restrict gr, const float * restrict gi,
+		  size_t n)
+{
+	size_t k;
+
+	for (k=0; k<n; k++) {
+		wr[k] += xr[k] * gr[k] + xi[k] * gi[k];
+		wi[k] += xr[k] * gi[k] - xi[k] * gr[k];
+	}
+}
+
+
+/* s += |a|^2 - |b|^2 */
+static void pwr_update(float * restrict s,
+		       const float * restrict ar, const float * restrict ai,
+		       const float * restrict br, const float * restrict bi,
+		       size_t n)
+{
+	size_t k;
+
+	for (k=0; k<n; k++) {
+		const float v = s[k] + ar[k] * ar[k] + ai[k] * ai[k]
+			- br[k] * br[k] - bi[k] * bi[k];
+
+		s[k] = v > 0 ? v : 0;
+	}
+}
+
+
+/* Spectrum of the two far-end blocks ending `ago' blocks back */
+static void far_spectrum(struct aec *aec, float *re, float *im,
+			 uint64_t ago)
+{
+	const size_t b = aec->b;
+
+	if (ago + 1 > aec->n) {
+		memset(aec->tbuf, 0, 2 * b * sizeof(float));
+	}
+	else {
+		memcpy(aec->tbuf, hist_block(aec, aec->n - ago - 1),
+		       b * sizeof(float));
+		memcpy(aec->tbuf + b, hist_block(aec, aec->n - ago),
+		       b * sizeof(float));
+	}
+
+	rfft_forward(aec->fft, re, im, aec->tbuf);
+}
+
+
+static void sx_recompute(struct aec *aec)
+{
+	unsigned p;
+	size_t k;
+
+	memset(aec->sx, 0, aec->nbs * sizeof(float));
+
+	for (p=0; p<aec->p; p++) {
+
+		const float *xr = aec->xr + xslot(aec, p) * aec->nbs;
+		const float *xi = aec->xi + xslot(aec, p) * aec->nbs;
+
+		for (k=0; k<aec->nbs; k++)
+			aec->sx[k] += xr[k] * xr[k] + xi[k] * xi[k];
+	}
+}
+
+
+static void filter_reset(struct aec *aec)
+{
+	const size_t sz = aec->p * aec->nbs * sizeof(float);
+
+	memset(aec->wr, 0, sz);
+	memset(aec->wi, 0, sz);
+
+	aec->py = aec->pe = 0;
+	aec->adapted  = false;
+	aec->diverged = 0;
+}
+
+
+/* Move the far-end delay line, and the filter taps with it */
+static void delay_set(struct aec *aec, unsigned d)
+{
+	const size_t sz = aec->nbs * sizeof(float);
+	const int delta = (int)d - (int)aec->d;
+	unsigned p;
+
+	if (!delta)
+		return;
+
+	if (delta > 0) {
+		for (p=0; p<aec->p; p++) {
+			float *wr = aec->wr + p * aec->nbs;
+			float *wi = aec->wi + p * aec->nbs;
+
+			if (p + delta < aec->p) {
+				memcpy(wr, wr + delta * aec->nbs, sz);
+				memcpy(wi, wi + delta * aec->nbs, sz);
+			}
+			else {
+				memset(wr, 0, sz);
+				memset(wi, 0, sz);
+			}
+		}
+	}
+	else {
+		for (p=aec->p; p-- > 0;) {
+			float *wr = aec->wr + p * aec->nbs;
+			float *wi = aec->wi + p * aec->nbs;
+
+			if (p >= (unsigned)-delta) {
+				memcpy(wr, wr + delta * (int)aec->nbs, sz);
+				memcpy(wi, wi + delta * (int)aec->nbs, sz);
+			}
+			else {
+				memset(wr, 0, sz);
+				memset(wi, 0, sz);
+			}
+		}
+	}
+
+	aec->d = d;
+
+	for (p=0; p<aec->p; p++) {
+		far_spectrum(aec, aec->xr + xslot(aec, p) * aec->nbs,
+			     aec->xi + xslot(aec, p) * aec->nbs,
+			     aec->d + p);
+	}
+
+	sx_recompute(aec);
+}
+
+
+static uint32_t band_bits(const struct aec *aec, float *mean,
+			  const float *re, const float *im)
+{
+	uint32_t bits = 0;
+	unsigned i;
+
+	for (i=0; i<NBANDS; i++) {
+
+		float e = 0;
+		size_t k;
+
+		for (k=aec->bandv[i]; k<aec->bandv[i+1]; k++)
+			e += re[k] * re[k] + im[k] * im[k];
+
+		if (e > mean[i])
+			bits |= 1u << i;
+
+		mean[i] += BAND_ALPHA * (e - mean[i]);
+	}
+
+	return bits;
+}
+
+
+static void delay_estimate(struct aec *aec, const float *near)
+{
+	const size_t b = aec->b;
+	const unsigned lags = (unsigned)min((uint64_t)aec->dmax, aec->n);
+	uint32_t nbits;
+	unsigned l, hold, best = 0;
+	float sum = 0;
+
+	/* the echo estimate spectrum is free at this point */
+	far_spectrum(aec, aec->yr, aec->yi, 0);
+	aec->farbits[aec->n % aec->dmax] = band_bits(aec, aec->far_mean,
+						     aec->yr, aec->yi);
+
+	memcpy(aec->tbuf, aec->nprev, b * sizeof(float));
+	memcpy(aec->tbuf + b, near, b * sizeof(float));
+	memcpy(aec->nprev, near, b * sizeof(float));
+
+	if (!far_active(aec, 0, 1) || power(near, b) < ACTIVE)
+		return;
+
+	rfft_forward(aec->fft, aec->yr, aec->yi, aec->tbuf);
+	nbits = band_bits(aec, aec->near_mean, aec->yr, aec->yi);
+
+	for (l=0; l<lags; l++) {
+
+		const uint32_t fbits = aec->farbits[(aec->n - l) % aec->dmax];
+		const unsigned c = popcount32(nbits ^ fbits);
+
+		aec->cost[l] += COST_ALPHA * ((float)c - aec->cost[l]);
+
+		if (aec->cost[l] < aec->cost[best])
+			best = l;
+
+		sum += aec->cost[l];
+	}
+
+	if (++aec->updates < 1 / COST_ALPHA)
+		return;
+
+	if (aec->cost[best] > COST_CONF * sum / lags)
+		return;
+
+	if ((int)best != aec->cand) {
+		aec->cand  = best;
+		aec->candc = 0;
+	}
+
+	if ((int)best == aec->est)
+		return;
+
+	/* a change to a neighbouring lag must persist longer */
+	if (aec->est >= 0 && abs((int)best - aec->est) < 2)
+		hold = 8 * DELAY_HOLD;
+	else
+		hold = DELAY_HOLD;
+
+	if (++aec->candc < hold)
+		return;
+
+	aec->est = best;
+
+	/* keep one block in front of the echo */
+	delay_set(aec, best ? best - 1 : 0);
+}
+
+
+/* Windowed-sinc fractional delays, one filter per phase */
+static void interp_init(float *tab)
+{
+	unsigned ph, j;
+
+	for (ph=0; ph<=FRAC_PHASES; ph++) {
+
+		float *h = tab + ph * FRAC_TAPS;
+		double sum = 0;
+
+		for (j=0; j<FRAC_TAPS; j++) {
+
+			const double x = (double)j - (FRAC_TAPS/2 - 1)
+				- (double)ph / FRAC_PHASES;
+			const double a = 2 * M_PI * x / FRAC_TAPS;
+			const double w = 0.42 + 0.5 * cos(a)
+				+ 0.08 * cos(2 * a);
+
+			h[j] = (float)(x == 0 ? 1 :
+				       w * sin(M_PI * x) / (M_PI * x));
+			sum += h[j];
+		}
+
+		for (j=0; j<FRAC_TAPS; j++)
+			h[j] = (float)(h[j] / sum);
+	}
+}
+
+
+/*
+ * Once a window, lock the resampling ratio to the clock skew. The
+ * lowest queue level is set to 1.5 blocks at once when it is far off,
+ * e.g. at start. Otherwise the skew is tracked from the slope of the
+ * mean level, and the level is slowly pulled back to where it was after
+ * the last resync, since every change moves the echo path that the
+ * filter has learned.
+ */
+static void skew_update(struct aec *aec)
+{
+	const double ws = (double)aec->wlen * aec->b;
+	const double mean = aec->lvl_sum / aec->wlen;
+	const long err = (long)aec->lvl_min - (long)(aec->b + aec->b / 2);
+	double e;
+
+	if (!aec->stat.resyncs || labs(err) > (long)aec->b / 2) {
+
+		aec->fifo_rd += err;
+		aec->frac     = 0;
+		aec->lvl_ref  = -1;
+		++aec->stat.resyncs;
+		return;
+	}
+
+	if (aec->lvl_ref < 0) {
+		aec->lvl_ref  = mean;
+		aec->lvl_prev = mean;
+		return;
+	}
+
+	e = mean - aec->lvl_ref;
+
+	aec->skew_i  += SKEW_KF * (mean - aec->lvl_prev) / ws;
+	aec->lvl_prev = mean;
+
+	aec->ratio = 1 + aec->skew_i + SKEW_KP * e / ws;
+	aec->ratio = max(min(aec->ratio, 1 + SKEW_MAX), 1 - SKEW_MAX);
+
+	aec->stat.skew = (int32_t)lrint((aec->ratio - 1) * 1e6);
+}
+
+
+/*
+ * The queue level is a sawtooth of far-end frames and capture blocks.
+ * The window spans whole periods of it, so that the mean is steady.
+ */
+static unsigned window_len(const struct aec *aec)
+{
+	const unsigned wmax =
+		(unsigned)(WINDOW_MS * aec->srate / 1000 / aec->b);
+	size_t x = aec->frame, y = aec->b, period;
+
+	while (y) {
+		const size_t t = x % y;
+		x = y;
+		y = t;
+	}
+
+	period = x ? aec->frame / x : 1;
+
+	if (period > wmax)
+		return wmax;
+
+	return (unsigned)(wmax / period * period);
+}
+
+
+/*
+ * Read one far-end block. The queue is resampled by the ratio of the
+ * playback and capture clocks, which keeps the echo path in place.
+ */
+static void far_read(struct aec *aec, float *dst)
+{
+	const size_t b = aec->b;
+	const size_t mask = aec->fifo_sz - 1;
+	size_t level, i;
+
+	lock_write_get(aec->lock);
+
+	level = aec->fifo_wr - aec->fifo_rd;
+
+	if (level < aec->lvl_min)
+		aec->lvl_min = level;
+
+	aec->lvl_sum += level - aec->frac;
+
+	for (i=0; i<b; i++) {
+
+		const size_t start = aec->fifo_rd - (FRAC_TAPS/2 - 1);
+		const unsigned ph = (unsigned)(aec->frac * FRAC_PHASES + 0.5);
+		const float *h = aec->interp + ph * FRAC_TAPS;
+		float y = 0;
+		size_t j;
+
+		if (aec->fifo_wr - aec->fifo_rd < FRAC_TAPS/2 + 1)
+			break;
+
+		for (j=0; j<FRAC_TAPS; j++)
+			y += h[j] * aec->fifo[(start + j) & mask];
+
+		dst[i] = y;
+
+		aec->frac += aec->ratio;
+		while (aec->frac >= 1) {
+			aec->frac -= 1;
+			++aec->fifo_rd;
+		}
+	}
+
+	if (i < b) {
+		memset(dst + i, 0, (b - i) * sizeof(float));
+
+		if (aec->playing)
+			++aec->stat.underruns;
+	}
+
+	if (aec->playing && ++aec->wblk >= aec->wlen) {
+
+		skew_update(aec);
+
+		aec->wblk    = 0;
+		aec->wlen    = window_len(aec);
+		aec->lvl_min = (size_t)-1;
+		aec->lvl_sum = 0;
+	}
+
+	lock_rel(aec->lock);
+}
+
+
+static void process_block(struct aec *aec, int16_t *outv,
+			  const int16_t *inv)
+{
+	const size_t b = aec->b, nbs = aec->nbs;
+	float *near = aec->tbuf + 2 * b;
+	float *e = aec->tbuf + b;
+	float *far, *xr, *xi;
+	float pn, py, pe, mu;
+	bool active;
+	unsigned p;
+	size_t i;
+
+	++aec->n;
+	++aec->stat.blocks;
+
+	far = hist_block(aec, aec->n);
+	far_read(aec, far);
+	aec->hpow[aec->n % aec->h] = power(far, b);
+
+	for (i=0; i<b; i++)
+		near[i] = inv[i];
+
+	pn = power(near, b);
+
+	/* newest far-end spectrum replaces the oldest */
+	aec->xpos = (aec->xpos + aec->p - 1) % aec->p;
+	xr = aec->xr + aec->xpos * nbs;
+	xi = aec->xi + aec->xpos * nbs;
+
+	if (aec->xpos == 0) {
+		far_spectrum(aec, xr, xi, aec->d);
+		sx_recompute(aec);
+	}
+	else {
+		memcpy(aec->yr, xr, nbs * sizeof(float));
+		memcpy(aec->yi, xi, nbs * sizeof(float));
+		far_spectrum(aec, xr, xi, aec->d);
+		pwr_update(aec->sx, xr, xi, aec->yr, aec->yi, nbs);
+	}
+
+	/* may move the delay line, and with it all far-end spectra */
+	delay_estimate(aec, near);
+
+	/* far-end audio within the echo tail */
+	active = far_active(aec, aec->d, aec->p);
+
+	/* echo estimate */
+	memset(aec->yr, 0, nbs * sizeof(float));
+	memset(aec->yi, 0, nbs * sizeof(float));
+
+	for (p=0; p<aec->p; p++) {
+		const size_t x = xslot(aec, p) * nbs;
+		const size_t w = p * nbs;
+
+		cmac(aec->yr, aec->yi, aec->xr + x, aec->xi + x,
+		     aec->wr + w, aec->wi + w, nbs);
+	}
+
+	rfft_inverse(aec->fft, aec->tbuf, aec->yr, aec->yi);
+
+	py = power(aec->tbuf + b, b);
+
+	for (i=0; i<b; i++)
+		e[i] = near[i] - aec->tbuf[b + i];
+
+	pe = power(e, b);
+
+	/* the estimate adds echo instead of removing it */
+	if (pe > pn) {
+
+		for (i=0; i<b; i++)
+			outv[i] = inv[i];
+	}
+	else {
+		for (i=0; i<b; i++)
+			outv[i] = saturate_s16((int32_t)lrintf(e[i]));
+	}
+
+	if (pn > ACTIVE && pe > 4 * pn) {
+
+		if (++aec->diverged >= DIVERGE_MAX) {
+			DEBUG_INFO("filter diverged, reset\n");
+			filter_reset(aec);
+			++aec->stat.resets;
+			return;
+		}
+	}
+	else {
+		aec->diverged = 0;
+	}
+
+	if (active) {
+		aec->erle_n += ERLE_ALPHA * (pn - aec->erle_n);
+		aec->erle_e += ERLE_ALPHA * (pe - aec->erle_e);
+
+		if (aec->erle_e > 0) {
+			aec->stat.erle = 10 * log10f(aec->erle_n /
+						     aec->erle_e);
+		}
+
+		aec->adapted = aec->stat.erle > CONVERGED;
+	}
+
+	if (!active)
+		return;
+
+	/* larger steps while the echo estimate dominates the error */
+	aec->py += 0.125f * (py - aec->py);
+	aec->pe += 0.125f * (pe - aec->pe);
+
+	mu = aec->pe > 0 ? aec->py / aec->pe : 1;
+	mu = MU * max(min(mu, 1.0f), aec->adapted ? MU_FLOOR : MU_START);
+
+	/* gradient */
+	memset(aec->tbuf, 0, b * sizeof(float));
+	rfft_forward(aec->fft, aec->er, aec->ei, aec->tbuf);
+
+	for (i=0; i<aec->nb; i++) {
+		const float g = mu / (aec->sx[i] + aec->p * 2 * b * DELTA);
+
+		aec->er[i] *= g;
+		aec->ei[i] *= g;
+	}
+
+	for (p=0; p<aec->p; p++) {
+		const size_t x = xslot(aec, p) * nbs;
+		const size_t w = p * nbs;
+
+		cmacc(aec->wr + w, aec->wi + w, aec->xr + x, aec->xi + x,
+		      aec->er, aec->ei, nbs);
+	}
+
+	/* constrain one partition to a linear convolution */
+	p = aec->cpos;
+	aec->cpos = (aec->cpos + 1) % aec->p;
+
+	rfft_inverse(aec->fft, aec->tbuf, aec->wr + p * nbs,
+		     aec->wi + p * nbs);
+	memset(aec->tbuf + b, 0, b * sizeof(float));
+	rfft_forward(aec->fft, aec->wr + p * nbs, aec->wi + p * nbs,
+		     aec->tbuf);
+}
+
+
+/**
+ * Allocate a new Acoustic Echo Canceller, for one channel
+ *
+ * @param aecp    Pointer to allocated echo canceller
+ * @param srate   Sampling rate in [Hz]
+ * @param tail_ms Length of the echo tail in [ms]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aec_alloc(struct aec **aecp, uint32_t srate, uint32_t tail_ms)
+{
+	struct aec *aec;
+	size_t b = 16, nfloat;
+	float *f;
+	double lo, hi;
+	unsigned i;
+	int err;
+
+	if (!aecp || srate < 8000 || !tail_ms)
+		return EINVAL;
+
+	aec = mem_zalloc(sizeof(*aec), destructor);
+	if (!aec)
+		return ENOMEM;
+
+	/* at least 8 ms per block */
+	while (b * 125 < srate)
+		b *= 2;
+
+	aec->srate = srate;
+	aec->b     = b;
+	aec->nb    = b + 1;
+	aec->nbs   = align_up(b + 1);
+	aec->p     = max((tail_ms * srate / 1000 + b - 1) / b, 1u);
+	aec->dmax  = (DELAY_MAX_MS * srate / 1000 + b - 1) / b;
+	aec->h     = aec->dmax + aec->p + 2;
+	aec->wlen  = (unsigned)(WINDOW_MS * srate / 1000 / b);
+	aec->est   = -1;
+	aec->cand  = -1;
+
+	aec->fifo_sz = 1;
+	while (aec->fifo_sz < srate)
+		aec->fifo_sz *= 2;
+	aec->lvl_min = (size_t)-1;
+	aec->ratio   = 1;
+
+	err = lock_alloc(&aec->lock);
+	if (err)
+		goto out;
+
+	err = rfft_alloc(&aec->fft, 2 * b);
+	if (err)
+		goto out;
+
+	nfloat = aec->h * (b + 1) + 4 * aec->p * aec->nbs + 5 * aec->nbs
+		+ align_up(2 * b) + 2 * b + (FRAC_PHASES + 1) * FRAC_TAPS;
+
+	aec->fifo    = mem_alloc(aec->fifo_sz * sizeof(int16_t), NULL);
+	aec->nin     = mem_zalloc(b * sizeof(int16_t), NULL);
+	aec->nout    = mem_zalloc(b * sizeof(int16_t), NULL);
+	aec->mem     = mem_zalloc(nfloat * sizeof(float), NULL);
+	aec->farbits = mem_zalloc(aec->dmax * sizeof(uint32_t), NULL);
+	aec->cost    = mem_zalloc(aec->dmax * sizeof(float), NULL);
+	if (!aec->fifo || !aec->nin || !aec->nout || !aec->mem ||
+	    !aec->farbits || !aec->cost) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	f = aec->mem;
+	aec->xr    = f; f += aec->p * aec->nbs;
+	aec->xi    = f; f += aec->p * aec->nbs;
+	aec->wr    = f; f += aec->p * aec->nbs;
+	aec->wi    = f; f += aec->p * aec->nbs;
+	aec->sx    = f; f += aec->nbs;
+	aec->yr    = f; f += aec->nbs;
+	aec->yi    = f; f += aec->nbs;
+	aec->er    = f; f += aec->nbs;
+	aec->ei    = f; f += aec->nbs;
+	aec->tbuf  = f; f += align_up(2 * b) + b;
+	aec->nprev = f; f += b;
+	aec->hpow  = f; f += aec->h;
+	aec->interp = f; f += (FRAC_PHASES + 1) * FRAC_TAPS;
+	aec->hist  = f;
+
+	for (i=0; i<aec->dmax; i++)
+		aec->cost[i] = NBANDS / 2;
+
+	interp_init(aec->interp);
+	/* bands of equal width over 300-4000 Hz */
+	lo = 300.0 * 2 * b / srate;
+	hi = min(4000.0, srate / 2.0) * 2 * b / srate;
+	for (i=0; i<=NBANDS; i++)
+		aec->bandv[i] = (uint16_t)(lo + (hi - lo) * i / NBANDS);
+
+ out:
+	if (err)
+		mem_deref(aec);
+	else
+		*aecp = aec;
+
+	return err;
+}
+
+
+/**
+ * Queue far-end samples, as they are sent to the loudspeaker
+ *
+ * @param aec   Acoustic Echo Canceller
+ * @param sampv Far-end samples
+ * @param sampc Number of samples
+ */
+void aec_playback(struct aec *aec, const int16_t *sampv, size_t sampc)
+{
+	size_t i, mask, level;
+
+	if (!aec || !sampv)
+		return;
+
+	mask = aec->fifo_sz - 1;
+
+	lock_write_get(aec->lock);
+
+	level = aec->fifo_wr - aec->fifo_rd;
+
+	if (level + sampc > aec->fifo_sz) {
+		const size_t lost = level + sampc - aec->fifo_sz;
+
+		aec->fifo_rd += lost;
+		aec->stat.overruns += lost;
+	}
+
+	for (i=0; i<sampc; i++)
+		aec->fifo[(aec->fifo_wr + i) & mask] = sampv[i];
+
+	aec->fifo_wr += sampc;
+	aec->frame   = sampc;
+	aec->playing = true;
+
+	lock_rel(aec->lock);
+}
+
+
+/**
+ * Remove the echo from near-end samples. The output lags the input by
+ * one block, see aec_latency().
+ *
+ * @param aec   Acoustic Echo Canceller
+ * @param sampv Near-end samples, replaced by the output samples
+ * @param sampc Number of samples
+ */
+void aec_capture(struct aec *aec, int16_t *sampv, size_t sampc)
+{
+	if (!aec || !sampv)
+		return;
+
+	while (sampc) {
+
+		const size_t n = min(sampc, aec->b - aec->inc);
+		size_t i;
+
+		for (i=0; i<n; i++) {
+			const int16_t s = sampv[i];
+
+			sampv[i] = aec->nout[aec->inc + i];
+			aec->nin[aec->inc + i] = s;
+		}
+
+		aec->inc += n;
+		sampv    += n;
+		sampc    -= n;
+
+		if (aec->inc == aec->b) {
+			process_block(aec, aec->nout, aec->nin);
+			aec->inc = 0;
+		}
+	}
+}
+
+
+/**
+ * Get the statistics of an Acoustic Echo Canceller
+ *
+ * @param aec  Acoustic Echo Canceller
+ * @param stat Returned statistics
+ */
+void aec_stats(const struct aec *aec, struct aec_stat *stat)
+{
+	if (!aec || !stat)
+		return;
+
+	*stat = aec->stat;
+
+	stat->delay_valid = aec->est >= 0;
+	stat->delay_ms = stat->delay_valid ?
+		(uint32_t)(aec->est * aec->b * 1000 / aec->srate) : 0;
+}
+
+
+/**
+ * Get the processing latency of an Acoustic Echo Canceller
+ *
+ * @param aec Acoustic Echo Canceller
+ *
+ * @return Latency in samples
+ */
+uint32_t aec_latency(const struct aec *aec)
+{
+	return aec ? (uint32_t)aec->b : 0;
+}
+
+
+/**
+ * Print the state of an Acoustic Echo Canceller
+ *
+ * @param pf  Print handler
+ * @param aec Acoustic Echo Canceller
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aec_debug(struct re_printf *pf, const struct aec *aec)
+{
+	struct aec_stat st;
+	int err;
+
+	if (!aec)
+		return 0;
+
+	aec_stats(aec, &st);
+
+	err  = re_hprintf(pf, "aec: %uHz block=%zu partitions=%u"
+			  " delay=%ums%s erle=%.1fdB\n",
+			  aec->srate, aec->b, aec->p, st.delay_ms,
+			  st.delay_valid ? "" : "(?)", st.erle);
+	err |= re_hprintf(pf, "     blocks=%llu underruns=%llu"
+			  " overruns=%llu skew=%dppm resyncs=%llu"
+			  " resets=%llu\n",
+			  st.blocks, st.underruns, st.overruns,
+			  st.skew, st.resyncs, st.resets);
+
+	return err;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file aec/aec.h  Acoustic Echo Canceller -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+struct rfft;
+
+int  rfft_alloc(struct rfft **fftp, size_t n);
+void rfft_forward(const struct rfft *fft, float *re, float *im,
+		  const float *x);
+void rfft_inverse(const struct rfft *fft, float *x, const float *re,
+		  const float *im);
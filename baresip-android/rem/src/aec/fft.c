@@ -0,0 +1,257 @@
+/**
+ * @file aec/fft.c  Acoustic Echo Canceller -- real FFT
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <math.h>
+#include <re.h>
+#include "aec.h"
+
+
+/*
+ * A real FFT of size N is computed with a complex FFT of size N/2 over
+ * the even/odd interleaved input. The complex FFT is an iterative
+ * radix-2 transform on split real/imaginary arrays. Every stage has its
+ * own contiguous twiddle table, so the butterfly loops are plain unit
+ * stride loops over restrict pointers which the compiler vectorizes.
+ */
+
+
+/** Real FFT */
+struct rfft {
+	size_t n;       /**< Real transform size               */
+	size_t m;       /**< Complex transform size, n/2       */
+	unsigned *rev;  /**< Bit-reversal permutation of m     */
+	float *twr;     /**< Per-stage twiddles, real part     */
+	float *twi;     /**< Per-stage twiddles, imaginary     */
+	float *cosv;    /**< Split twiddles, cos(2*pi*k/n)     */
+	float *sinv;    /**< Split twiddles, sin(2*pi*k/n)     */
+	float *zr;      /**< Complex work buffer, real part    */
+	float *zi;      /**< Complex work buffer, imaginary    */
+};
+
+
+static void destructor(void *arg)
+{
+	struct rfft *fft = arg;
+
+	mem_deref(fft->rev);
+	mem_deref(fft->twr);
+	mem_deref(fft->twi);
+	mem_deref(fft->cosv);
+	mem_deref(fft->sinv);
+	mem_deref(fft->zr);
+	mem_deref(fft->zi);
+}
+
+
+/**
+ * Allocate a real FFT
+ *
+ * @param fftp Pointer to allocated FFT
+ * @param n    Transform size, a power of two and at least 4
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rfft_alloc(struct rfft **fftp, size_t n)
+{
+	struct rfft *fft;
+	size_t i, j, len, bits = 0;
+	int err = 0;
+
+	if (!fftp || n < 4 || (n & (n - 1)))
+		return EINVAL;
+
+	fft = mem_zalloc(sizeof(*fft), destructor);
+	if (!fft)
+		return ENOMEM;
+
+	fft->n = n;
+	fft->m = n / 2;
+
+	fft->rev  = mem_alloc(fft->m * sizeof(*fft->rev), NULL);
+	fft->twr  = mem_alloc(fft->m * sizeof(float), NULL);
+	fft->twi  = mem_alloc(fft->m * sizeof(float), NULL);
+	fft->cosv = mem_alloc((fft->m + 1) * sizeof(float), NULL);
+	fft->sinv = mem_alloc((fft->m + 1) * sizeof(float), NULL);
+	fft->zr   = mem_alloc(fft->m * sizeof(float), NULL);
+	fft->zi   = mem_alloc(fft->m * sizeof(float), NULL);
+	if (!fft->rev || !fft->twr || !fft->twi || !fft->cosv ||
+	    !fft->sinv || !fft->zr || !fft->zi) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	while ((1u << bits) < fft->m)
+		++bits;
+
+	for (i=0; i<fft->m; i++) {
+
+		unsigned r = 0;
+
+		for (j=0; j<bits; j++)
+			r |= ((i >> j) & 1) << (bits - 1 - j);
+
+		fft->rev[i] = r;
+	}
+
+	/* stage with butterfly span h uses twiddles at [h, 2h) */
+	for (len=2; len<=fft->m; len<<=1) {
+
+		const size_t h = len / 2;
+
+		for (j=0; j<h; j++) {
+			const double a = -2 * M_PI * j / len;
+
+			fft->twr[h + j] = (float)cos(a);
+			fft->twi[h + j] = (float)sin(a);
+		}
+	}
+
+	for (i=0; i<=fft->m; i++) {
+		const double a = 2 * M_PI * i / n;
+
+		fft->cosv[i] = (float)cos(a);
+		fft->sinv[i] = (float)sin(a);
+	}
+
+ out:
+	if (err)
+		mem_deref(fft);
+	else
+		*fftp = fft;
+
+	return err;
+}
+
+
+static void butterflies(float * restrict ar, float * restrict ai,
+			float * restrict br, float * restrict bi,
+			const float * restrict wr, const float * restrict wi,
+			size_t h)
+{
+	size_t j;
+
+	for (j=0; j<h; j++) {
+
+		const float tr = wr[j] * br[j] - wi[j] * bi[j];
+		const float ti = wr[j] * bi[j] + wi[j] * br[j];
+
+		br[j] = ar[j] - tr;
+		bi[j] = ai[j] - ti;
+		ar[j] = ar[j] + tr;
+		ai[j] = ai[j] + ti;
+	}
+}
+
+
+/* In-place forward complex FFT of bit-reversed input */
+static void cfft(const struct rfft *fft, float *re, float *im)
+{
+	const size_t m = fft->m;
+	size_t len, i;
+
+	/* first stage has the trivial twiddle only */
+	for (i=0; i<m; i+=2) {
+
+		const float tr = re[i+1], ti = im[i+1];
+
+		re[i+1] = re[i] - tr;
+		im[i+1] = im[i] - ti;
+		re[i]  += tr;
+		im[i]  += ti;
+	}
+
+	for (len=4; len<=m; len<<=1) {
+
+		const size_t h = len / 2;
+
+		for (i=0; i<m; i+=len) {
+			butterflies(re + i, im + i, re + i + h, im + i + h,
+				    fft->twr + h, fft->twi + h, h);
+		}
+	}
+}
+
+
+/**
+ * Forward real FFT, unnormalized
+ *
+ * @param fft FFT state
+ * @param re  Real part of the n/2+1 output bins
+ * @param im  Imaginary part of the n/2+1 output bins
+ * @param x   n input samples
+ */
+void rfft_forward(const struct rfft *fft, float *re, float *im,
+		  const float *x)
+{
+	const size_t m = fft->m;
+	float *zr = fft->zr, *zi = fft->zi;
+	size_t k;
+
+	for (k=0; k<m; k++) {
+		zr[fft->rev[k]] = x[2*k];
+		zi[fft->rev[k]] = x[2*k+1];
+	}
+
+	cfft(fft, zr, zi);
+
+	re[0] = zr[0] + zi[0];
+	im[0] = 0;
+	re[m] = zr[0] - zi[0];
+	im[m] = 0;
+
+	/* split the even and odd spectra */
+	for (k=1; k<m; k++) {
+
+		const float ar = zr[k],   ai = zi[k];
+		const float br = zr[m-k], bi = -zi[m-k];
+		const float er = (ar + br) * 0.5f, ei = (ai + bi) * 0.5f;
+		const float odr = (ai - bi) * 0.5f, odi = (br - ar) * 0.5f;
+		const float c = fft->cosv[k], s = fft->sinv[k];
+
+		re[k] = er + c * odr + s * odi;
+		im[k] = ei + c * odi - s * odr;
+	}
+}
+
+
+/**
+ * Inverse real FFT, normalized so that it inverts rfft_forward()
+ *
+ * @param fft FFT state
+ * @param x   n output samples
+ * @param re  Real part of the n/2+1 input bins
+ * @param im  Imaginary part of the n/2+1 input bins
+ */
+void rfft_inverse(const struct rfft *fft, float *x, const float *re,
+		  const float *im)
+{
+	const size_t m = fft->m;
+	const float scale = 0.5f / m;
+	float *zr = fft->zr, *zi = fft->zi;
+	size_t k;
+
+	/* join the even and odd spectra */
+	for (k=0; k<m; k++) {
+
+		const float ar = re[k],   ai = im[k];
+		const float br = re[m-k], bi = -im[m-k];
+		const float er = (ar + br), ei = (ai + bi);
+		const float dr = (ar - br), di = (ai - bi);
+		const float c = fft->cosv[k], s = fft->sinv[k];
+		const float odr = dr * c - di * s, odi = dr * s + di * c;
+		const unsigned r = fft->rev[k];
+
+		zr[r] = (er - odi) * scale;
+		zi[r] = (ei + odr) * scale;
+	}
+
+	/* swapped real and imaginary parts give the inverse */
+	cfft(fft, zi, zr);
+
+	for (k=0; k<m; k++) {
+		x[2*k]   = zr[k];
+		x[2*k+1] = zi[k];
+	}
+}
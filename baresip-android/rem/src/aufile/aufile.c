@@ -15,6 +15,7 @@ struct aufile {
 	struct aufile_prm prm;
 	enum aufile_mode mode;
 	size_t datasize;
+	size_t datapos;
 	size_t nread;
 	size_t nwritten;
 	FILE *f;
@@ -112,6 +113,7 @@ int aufile_open(struct aufile **afp, struct aufile_prm *prm,
 {
 	struct wav_fmt fmt;
 	struct aufile *af;
+	long pos;
 	int aufmt;
 	int err;
 
@@ -137,6 +139,14 @@ int aufile_open(struct aufile **afp, struct aufile_prm *prm,
 		if (err)
 			goto out;
 
+		pos = ftell(af->f);
+		if (pos < 0) {
+			err = errno;
+			goto out;
+		}
+
+		af->datapos = pos;
+
 		aufmt = wavfmt_to_aufmt(fmt.format, fmt.bps);
 		if (aufmt < 0) {
 			err = ENOSYS;
@@ -228,3 +238,29 @@ int aufile_write(struct aufile *af, const uint8_t *p, size_t sz)
 
 	return 0;
 }
+
+
+/**
+ * Get the size of the audio data in a WAV file
+ *
+ * @param af  Audio-file
+ *
+ * @return Number of bytes of audio data
+ */
+size_t aufile_get_size(const struct aufile *af)
+{
+	return af ? af->datasize : 0;
+}
+
+
+/**
+ * Get the position of the audio data in a WAV file opened for reading
+ *
+ * @param af  Audio-file
+ *
+ * @return Offset of the first sample from the start of the file
+ */
+size_t aufile_get_offset(const struct aufile *af)
+{
+	return af ? af->datapos : 0;
+}
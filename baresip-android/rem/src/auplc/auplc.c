@@ -0,0 +1,394 @@
+/**
+ * @file auplc/auplc.c  Audio Packet Loss Concealment
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem_dsp.h>
+#include <rem_auplc.h>
+
+
+/*
+ * Lost audio is extrapolated from the history of the output by WSOLA
+ * (waveform similarity overlap-add). At the start of a loss, the pitch
+ * period is found as the lag whose waveform best matches the end of
+ * the history, and the output continues from there. Whenever the read
+ * position reaches the end of the history, it jumps back by one or
+ * more pitch periods, to the position whose waveform best matches the
+ * current one, and the two are cross-faded. Longer losses cycle over
+ * more periods, so the output does not buzz. Short pitch periods are
+ * repeated in groups of at least 10 ms, which keeps the noise in the
+ * sound from turning into a tone at the pitch.
+ *
+ * After a while, the extrapolated signal is faded out and comfort
+ * noise at the level of the background noise is faded in. The first
+ * frame after a loss is passed on as is: the extrapolation is in phase
+ * with it, and a cross-fade would dip the level of the noise in it.
+ */
+
+
+enum {
+	HIST_MS      = 60,    /* Output history                         */
+	PITCH_MIN_US = 2500,  /* Shortest pitch period, 400 Hz          */
+	PITCH_MAX_US = 15000, /* Longest pitch period, 66 Hz            */
+	MATCH_MS     = 10,    /* Window of the pitch search             */
+	SEGMENT_MS   = 10,    /* Shortest segment of whole periods      */
+	PERIOD_MS    = 20,    /* Loss after which one segment is added  */
+	PERIODS_MAX  = 3,     /* Most segments cycled over              */
+	FADE_MS      = 200,   /* Loss before fading out                 */
+	FADE_LEN_MS  = 200,   /* Fade out time                          */
+};
+
+#define VOICED       0.5f     /* Pitch correlation of voiced sound   */
+#define NOISE_MAX    1000.0f  /* Highest comfort noise level, RMS   */
+#define NOISE_RISE   0.01f    /* Noise level rise per frame          */
+#define CN_SCALE     1.5f     /* Comfort noise filter RMS to 1       */
+
+
+/** Packet Loss Concealment */
+struct auplc {
+	uint32_t srate;          /**< Sampling rate                       */
+	size_t hlen;             /**< History length                      */
+	int16_t *histv;          /**< Output history, newest last         */
+	float *srcv;             /**< History at the start of the loss    */
+	size_t pmin, pmax;       /**< Pitch period range                  */
+	size_t match;            /**< Pitch search window                 */
+	size_t segment;          /**< Shortest segment                    */
+	size_t fade;             /**< Concealed samples before fading     */
+	size_t fade_len;         /**< Fade out length                     */
+
+	/* extrapolation */
+	bool lost;               /**< Loss in progress                    */
+	size_t lostc;            /**< Concealed samples of this loss      */
+	size_t period;           /**< Segment of whole pitch periods      */
+	size_t ola;              /**< Overlap-add length                  */
+	size_t rd;               /**< Read position in srcv               */
+	size_t xrd;              /**< Cross-fade read position            */
+	size_t xf;               /**< Cross-fade samples left             */
+
+	/* comfort noise */
+	float noise;             /**< Background noise level, RMS         */
+	float cn;                /**< Comfort noise filter state          */
+	uint32_t seed;
+
+	struct auplc_stat stat;
+};
+
+
+static void destructor(void *arg)
+{
+	struct auplc *plc = arg;
+
+	mem_deref(plc->histv);
+	mem_deref(plc->srcv);
+}
+
+
+static void hist_push(struct auplc *plc, const int16_t *sampv, size_t n)
+{
+	if (n >= plc->hlen) {
+		memcpy(plc->histv, sampv + n - plc->hlen,
+		       plc->hlen * sizeof(*plc->histv));
+		return;
+	}
+
+	memmove(plc->histv, plc->histv + n,
+		(plc->hlen - n) * sizeof(*plc->histv));
+	memcpy(plc->histv + plc->hlen - n, sampv, n * sizeof(*sampv));
+}
+
+
+/* Normalized cross-correlation of a and b */
+static float xcorr(const float *a, const float *b, size_t n)
+{
+	float ab = 0, aa = 0, bb = 0;
+	size_t i;
+
+	for (i=0; i<n; i++) {
+		ab += a[i] * b[i];
+		aa += a[i] * a[i];
+		bb += b[i] * b[i];
+	}
+
+	return ab / sqrtf(aa * bb + 1.0f);
+}
+
+
+/*
+ * Find the pitch period, as the lag at which the waveform before it
+ * best matches the end of the history.
+ */
+static size_t pitch_find(const struct auplc *plc, float *corr)
+{
+	const float *end = plc->srcv + plc->hlen - plc->match;
+	float best = -2.0f;
+	size_t p, period = plc->pmax;
+
+	for (p=plc->pmin; p<=plc->pmax; p++) {
+
+		const float c = xcorr(end, end - p, plc->match);
+
+		if (c > best) {
+			best   = c;
+			period = p;
+		}
+	}
+
+	*corr = best;
+
+	return period;
+}
+
+
+/*
+ * Jump back by one or more pitch periods, to the position around
+ * there whose waveform best matches the one at the read position.
+ */
+static size_t segment_find(const struct auplc *plc)
+{
+	const size_t periods = min(1 + plc->lostc / (plc->srate * PERIOD_MS
+						     / 1000), PERIODS_MAX);
+	const size_t back = min(periods * plc->period,
+				plc->hlen - 2 * plc->ola);
+	const size_t tol = plc->period / 4;
+	const size_t lo = plc->rd > back + tol ? plc->rd - back - tol : 0;
+	const size_t hi = min(plc->rd - back + tol, plc->rd - plc->ola);
+	float best = -2.0f;
+	size_t s, pos = plc->rd - back;
+
+	for (s=lo; s<=hi; s++) {
+
+		const float c = xcorr(plc->srcv + plc->rd, plc->srcv + s,
+				      plc->ola);
+
+		if (c > best) {
+			best = c;
+			pos  = s;
+		}
+	}
+
+	return pos;
+}
+
+
+static float extrapolate(struct auplc *plc)
+{
+	float v;
+
+	if (plc->xf) {
+		const float w = (float)(plc->ola - plc->xf + 1) /
+			(plc->ola + 1);
+
+		v = (1 - w) * plc->srcv[plc->xrd++] + w * plc->srcv[plc->rd++];
+		--plc->xf;
+	}
+	else {
+		v = plc->srcv[plc->rd++];
+	}
+
+	if (!plc->xf && plc->rd + plc->ola >= plc->hlen) {
+
+		plc->xrd = plc->rd;
+		plc->rd  = segment_find(plc);
+		plc->xf  = plc->ola;
+	}
+
+	return v;
+}
+
+
+static float comfort_noise(struct auplc *plc)
+{
+	plc->seed = plc->seed * 1664525 + 1013904223;
+
+	plc->cn = 0.5f * plc->cn + (float)(int32_t)plc->seed / 2147483648.0f;
+
+	return CN_SCALE * plc->noise * plc->cn;
+}
+
+
+/* Next concealed sample, extrapolated and faded into comfort noise */
+static float conceal_sample(struct auplc *plc)
+{
+	float gain = 1.0f, v = 0;
+
+	if (plc->lostc >= plc->fade + plc->fade_len)
+		gain = 0;
+	else if (plc->lostc > plc->fade)
+		gain -= (float)(plc->lostc - plc->fade) / plc->fade_len;
+
+	if (gain > 0)
+		v = gain * extrapolate(plc);
+
+	if (gain < 1)
+		v += (1 - gain) * comfort_noise(plc);
+
+	++plc->lostc;
+
+	return v;
+}
+
+
+static void loss_start(struct auplc *plc)
+{
+	float corr;
+	size_t i;
+
+	for (i=0; i<plc->hlen; i++)
+		plc->srcv[i] = plc->histv[i];
+
+	plc->period = pitch_find(plc, &corr);
+	plc->stat.period = (uint32_t)plc->period;
+
+	/* not voiced, repeat longer segments of the noise */
+	if (corr < VOICED) {
+		plc->period = plc->hlen / 3;
+	}
+	else if (plc->period < plc->segment) {
+		plc->period *= (plc->segment + plc->period - 1) / plc->period;
+	}
+
+	plc->ola    = max(plc->period / 4, (size_t)plc->srate / 1000);
+	plc->rd     = plc->hlen - plc->period;
+	plc->xf     = 0;
+	plc->lostc  = 0;
+	plc->lost   = true;
+
+	++plc->stat.bursts;
+}
+
+
+static void noise_update(struct auplc *plc, const int16_t *sampv,
+			 size_t sampc)
+{
+	float sum = 0, rms;
+	size_t i;
+
+	for (i=0; i<sampc; i++)
+		sum += (float)sampv[i] * sampv[i];
+
+	rms = sqrtf(sum / sampc);
+
+	if (rms < plc->noise)
+		plc->noise = rms;
+	else
+		plc->noise += NOISE_RISE * (rms - plc->noise);
+
+	plc->noise = min(plc->noise, NOISE_MAX);
+}
+
+
+/**
+ * Allocate a new Packet Loss Concealment state, for one channel
+ *
+ * @param plcp  Pointer to allocated Packet Loss Concealment state
+ * @param srate Sampling rate in [Hz]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int auplc_alloc(struct auplc **plcp, uint32_t srate)
+{
+	struct auplc *plc;
+	int err = 0;
+
+	if (!plcp || srate < 4000)
+		return EINVAL;
+
+	plc = mem_zalloc(sizeof(*plc), destructor);
+	if (!plc)
+		return ENOMEM;
+
+	plc->srate    = srate;
+	plc->hlen     = srate * HIST_MS / 1000;
+	plc->pmin     = srate * PITCH_MIN_US / 1000000;
+	plc->pmax     = srate * PITCH_MAX_US / 1000000;
+	plc->match    = srate * MATCH_MS / 1000;
+	plc->segment  = srate * SEGMENT_MS / 1000;
+	plc->fade     = srate * FADE_MS / 1000;
+	plc->fade_len = srate * FADE_LEN_MS / 1000;
+	plc->noise    = NOISE_MAX;
+	plc->seed     = 1;
+
+	plc->histv = mem_zalloc(plc->hlen * sizeof(*plc->histv), NULL);
+	plc->srcv  = mem_zalloc(plc->hlen * sizeof(*plc->srcv), NULL);
+	if (!plc->histv || !plc->srcv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(plc);
+	else
+		*plcp = plc;
+
+	return err;
+}
+
+
+/**
+ * Process a received audio frame, which ends a loss
+ *
+ * @param plc   Packet Loss Concealment state
+ * @param sampv Audio samples
+ * @param sampc Number of samples
+ */
+void auplc_rx(struct auplc *plc, int16_t *sampv, size_t sampc)
+{
+	if (!plc || !sampv || !sampc)
+		return;
+
+	plc->lost = false;
+
+	noise_update(plc, sampv, sampc);
+	hist_push(plc, sampv, sampc);
+
+	++plc->stat.frames;
+}
+
+
+/**
+ * Conceal a lost audio frame
+ *
+ * @param plc   Packet Loss Concealment state
+ * @param sampv Buffer for the concealed audio samples
+ * @param sampc Number of samples
+ */
+void auplc_conceal(struct auplc *plc, int16_t *sampv, size_t sampc)
+{
+	size_t i;
+
+	if (!plc || !sampv)
+		return;
+
+	if (!plc->lost)
+		loss_start(plc);
+
+	for (i=0; i<sampc; i++) {
+
+		const float v = conceal_sample(plc);
+
+		sampv[i] = saturate_s16((int32_t)v);
+	}
+
+	hist_push(plc, sampv, sampc);
+
+	++plc->stat.concealed;
+}
+
+
+/**
+ * Get the statistics of a Packet Loss Concealment state
+ *
+ * @param plc  Packet Loss Concealment state
+ * @param stat Returned statistics
+ */
+void auplc_stats(const struct auplc *plc, struct auplc_stat *stat)
+{
+	if (!plc || !stat)
+		return;
+
+	*stat = plc->stat;
+}
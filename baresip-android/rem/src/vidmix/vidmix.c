@@ -16,10 +16,64 @@
 #include <rem_vidmix.h>
 
 
+/*
+ * Every source thread composes its own output frame from layout cells
+ * (tiles). The received frame of a source is scaled once per cell size
+ * and shared by all outputs showing it in a cell of that size. A tile
+ * is only drawn again when its source has received a new frame, and
+ * the dirty tiles of an output are drawn by a shared worker pool.
+ */
+
+
+enum {
+	MAX_WORKERS  = 4,     /* Compositor worker threads           */
+	SCALE_EXPIRE = 1000,  /* Scaled frames unused for [ms] expire */
+};
+
 struct vidmix {
 	pthread_rwlock_t rwlock;
 	struct list srcl;
 	bool initialized;
+
+	/* compositor worker pool */
+	pthread_mutex_t mutex;     /* Protects the batch list       */
+	pthread_cond_t cond;       /* Signalled on new batches      */
+	pthread_cond_t done;       /* Signalled on finished batches */
+	struct list batchl;
+	pthread_t *workerv;
+	unsigned workerc;
+	bool pool_initialized;
+	bool run;
+};
+
+/* One layout cell of an output frame, and what was drawn there */
+struct tile {
+	const struct vidmix_source *src;
+	struct vidrect rect;
+	uint64_t gen;              /* Generation of the drawn frame */
+	bool valid;                /* Drawn in a previous frame     */
+	bool dirty;                /* To be drawn in this frame     */
+};
+
+/* Dirty tiles of one output frame, drawn by the worker pool */
+struct batch {
+	struct le le;
+	struct vidframe *frame;
+	struct tile *tilev;
+	unsigned tilec;
+	unsigned next;             /* Next tile to be taken         */
+	unsigned busy;             /* Tiles being drawn             */
+	uint64_t now;
+	int err;
+};
+
+/* A received frame scaled to the size of a layout cell */
+struct scaled {
+	struct le le;
+	struct vidframe *frame;
+	struct vidsz srcsz;
+	uint64_t gen;
+	uint64_t used;
 };
 
 struct vidmix_source {
@@ -39,11 +93,16 @@ struct vidmix_source {
 	bool content;
 	bool clear;
 	bool run;
-};
 
-
-static inline void source_mix_full(struct vidframe *mframe,
-				   const struct vidframe *frame_src);
+	/* compositor state */
+	pthread_mutex_t rx_mutex;  /* Protects frame_rx, gen, scalel */
+	bool rx_initialized;
+	uint64_t gen;              /* Generation of frame_rx        */
+	struct list scalel;        /* Scaled copies of frame_rx     */
+	struct tile *tilev;        /* Tiles of frame_tx             */
+	unsigned tilec;
+	unsigned tilesz;
+};
 
 
 static inline void clear_frame(struct vidframe *vf)
@@ -65,15 +124,49 @@ static void clear_all(struct vidmix *mix)
 }
 
 
+static void pool_stop(struct vidmix *mix)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&mix->mutex);
+	mix->run = false;
+	pthread_cond_broadcast(&mix->cond);
+	pthread_mutex_unlock(&mix->mutex);
+
+	for (i=0; i<mix->workerc; i++)
+		pthread_join(mix->workerv[i], NULL);
+
+	mix->workerc = 0;
+}
+
+
 static void destructor(void *arg)
 {
 	struct vidmix *mix = arg;
 
+	if (mix->pool_initialized) {
+		pool_stop(mix);
+		(void)pthread_cond_destroy(&mix->done);
+		(void)pthread_cond_destroy(&mix->cond);
+		(void)pthread_mutex_destroy(&mix->mutex);
+	}
+
+	mem_deref(mix->workerv);
+
 	if (mix->initialized)
 		(void)pthread_rwlock_destroy(&mix->rwlock);
 }
 
 
+static void scaled_destructor(void *arg)
+{
+	struct scaled *sc = arg;
+
+	list_unlink(&sc->le);
+	mem_deref(sc->frame);
+}
+
+
 static void source_destructor(void *arg)
 {
 	struct vidmix_source *src = arg;
@@ -90,22 +183,243 @@ static void source_destructor(void *arg)
 		pthread_rwlock_unlock(&src->mix->rwlock);
 	}
 
+	list_flush(&src->scalel);
+
+	if (src->rx_initialized)
+		(void)pthread_mutex_destroy(&src->rx_mutex);
+
+	mem_deref(src->tilev);
 	mem_deref(src->frame_tx);
 	mem_deref(src->frame_rx);
 	mem_deref(src->mix);
 }
 
 
-static inline void source_mix(struct vidframe *mframe,
-			      const struct vidframe *frame_src,
-			      unsigned n, unsigned rows, unsigned idx,
-			      bool focus, bool focus_this, bool focus_full)
+/* Copy a frame into a rectangle of the same size */
+static void blit(struct vidframe *dst, const struct vidframe *src,
+		 const struct vidrect *r)
 {
+	const unsigned w = min(r->w, src->size.w);
+	const unsigned h = min(r->h, src->size.h);
+	unsigned y, i;
+
+	for (y=0; y<h; y++) {
+		memcpy(dst->data[0] + (r->y + y) * dst->linesize[0] + r->x,
+		       src->data[0] + y * src->linesize[0], w);
+	}
+
+	for (i=1; i<3; i++) {
+
+		for (y=0; y<h/2; y++) {
+			memcpy(dst->data[i] + (r->y/2 + y) * dst->linesize[i]
+			       + r->x/2,
+			       src->data[i] + y * src->linesize[i], w/2);
+		}
+	}
+}
+
+
+/*
+ * Get the received frame of a source scaled to a cell size. Every size
+ * is scaled once per received frame, and shared by all outputs.
+ * Called with the rx_mutex held.
+ */
+static const struct vidframe *scaled_get(struct vidmix_source *src,
+					 unsigned w, unsigned h, uint64_t now)
+{
+	struct scaled *sc = NULL;
 	struct vidrect rect;
+	struct le *le;
 
-	if (!frame_src)
-		return;
+	le = src->scalel.head;
+	while (le) {
+
+		struct scaled *s = le->data;
+
+		le = le->next;
+
+		if (s->frame->size.w == w && s->frame->size.h == h)
+			sc = s;
+		else if (now > s->used + SCALE_EXPIRE)
+			mem_deref(s);
+	}
+
+	if (!sc) {
+		struct vidsz sz;
+
+		sc = mem_zalloc(sizeof(*sc), scaled_destructor);
+		if (!sc)
+			return NULL;
+
+		sz.w = w;
+		sz.h = h;
+
+		if (vidframe_alloc(&sc->frame, VID_FMT_YUV420P, &sz)) {
+			mem_deref(sc);
+			return NULL;
+		}
+
+		clear_frame(sc->frame);
+		list_append(&src->scalel, &sc->le, sc);
+	}
+
+	sc->used = now;
+
+	if (sc->gen == src->gen)
+		return sc->frame;
+
+	/* letterbox borders move when the aspect ratio changes */
+	if (!vidsz_cmp(&sc->srcsz, &src->frame_rx->size)) {
+		clear_frame(sc->frame);
+		sc->srcsz = src->frame_rx->size;
+	}
+
+	rect.x = 0;
+	rect.y = 0;
+	rect.w = w;
+	rect.h = h;
+
+	vidconv_aspect(sc->frame, src->frame_rx, &rect);
+	sc->gen = src->gen;
+
+	return sc->frame;
+}
+
+
+static int tile_draw(struct vidframe *frame, struct tile *tile,
+		     uint64_t now)
+{
+	struct vidmix_source *src = (struct vidmix_source *)tile->src;
+	const struct vidframe *sf;
+	int err = 0;
+
+	pthread_mutex_lock(&src->rx_mutex);
+
+	if (!src->frame_rx)
+		goto out;
+
+	if (src->frame_rx->size.w == tile->rect.w &&
+	    src->frame_rx->size.h == tile->rect.h)
+		sf = src->frame_rx;
+	else
+		sf = scaled_get(src, tile->rect.w, tile->rect.h, now);
 
+	if (!sf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	blit(frame, sf, &tile->rect);
+
+	tile->gen   = src->gen;
+	tile->valid = true;
+
+ out:
+	pthread_mutex_unlock(&src->rx_mutex);
+
+	return err;
+}
+
+
+/* Take and draw tiles of a batch, called with the pool mutex held */
+static void batch_work(struct vidmix *mix, struct batch *b)
+{
+	while (b->next < b->tilec) {
+
+		struct tile *tile = &b->tilev[b->next++];
+		int err;
+
+		if (!tile->dirty)
+			continue;
+
+		++b->busy;
+		pthread_mutex_unlock(&mix->mutex);
+
+		err = tile_draw(b->frame, tile, b->now);
+
+		pthread_mutex_lock(&mix->mutex);
+		--b->busy;
+
+		if (err)
+			b->err = err;
+	}
+
+	if (b->le.list)
+		list_unlink(&b->le);
+
+	if (!b->busy)
+		pthread_cond_broadcast(&mix->done);
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct vidmix *mix = arg;
+
+	pthread_mutex_lock(&mix->mutex);
+
+	while (mix->run) {
+
+		if (mix->batchl.head) {
+			batch_work(mix, mix->batchl.head->data);
+			continue;
+		}
+
+		pthread_cond_wait(&mix->cond, &mix->mutex);
+	}
+
+	pthread_mutex_unlock(&mix->mutex);
+
+	return NULL;
+}
+
+
+/* Draw the dirty tiles, with the help of the worker pool */
+static int tiles_draw(struct vidmix *mix, struct vidframe *frame,
+		      struct tile *tilev, unsigned tilec, unsigned dirty,
+		      uint64_t now)
+{
+	struct batch b;
+	unsigned i;
+	int err = 0;
+
+	if (dirty < 2 || !mix->workerc) {
+
+		for (i=0; i<tilec; i++) {
+			if (tilev[i].dirty)
+				err |= tile_draw(frame, &tilev[i], now);
+		}
+
+		return err;
+	}
+
+	memset(&b, 0, sizeof(b));
+	b.frame = frame;
+	b.tilev = tilev;
+	b.tilec = tilec;
+	b.now   = now;
+
+	pthread_mutex_lock(&mix->mutex);
+
+	list_append(&mix->batchl, &b.le, &b);
+	pthread_cond_broadcast(&mix->cond);
+
+	batch_work(mix, &b);
+
+	while (b.busy)
+		pthread_cond_wait(&mix->done, &mix->mutex);
+
+	pthread_mutex_unlock(&mix->mutex);
+
+	return b.err;
+}
+
+
+/* Layout cell of a source, false if the source is not shown */
+static bool layout_rect(struct vidrect *rect, const struct vidsz *sz,
+			unsigned n, unsigned rows, unsigned idx,
+			bool focus, bool focus_this, bool focus_full)
+{
 	if (focus) {
 
 		const unsigned nmin = focus_full ? 12 : 6;
@@ -113,152 +427,224 @@ static inline void source_mix(struct vidframe *mframe,
 		n = max((n+1), nmin)/2;
 
 		if (focus_this) {
-			rect.w = mframe->size.w * (n-1) / n;
-			rect.h = mframe->size.h * (n-1) / n;
-			rect.x = 0;
-			rect.y = 0;
+			rect->w = sz->w * (n-1) / n;
+			rect->h = sz->h * (n-1) / n;
+			rect->x = 0;
+			rect->y = 0;
 		}
 		else {
-			rect.w = mframe->size.w / n;
-			rect.h = mframe->size.h / n;
+			rect->w = sz->w / n;
+			rect->h = sz->h / n;
 
 			if (idx < n) {
-				rect.x = mframe->size.w - rect.w;
-				rect.y = rect.h * idx;
+				rect->x = sz->w - rect->w;
+				rect->y = rect->h * idx;
 			}
 			else if (idx < (n*2 - 1)) {
-				rect.x = rect.w * (n*2 - 2 - idx);
-				rect.y = mframe->size.h - rect.h;
+				rect->x = rect->w * (n*2 - 2 - idx);
+				rect->y = sz->h - rect->h;
 			}
 			else {
-				return;
+				return false;
 			}
 		}
 	}
 	else if (rows == 1) {
-
-		source_mix_full(mframe, frame_src);
-		return;
+		rect->w = sz->w;
+		rect->h = sz->h;
+		rect->x = 0;
+		rect->y = 0;
 	}
 	else {
-		rect.w = mframe->size.w / rows;
-		rect.h = mframe->size.h / rows;
-		rect.x = rect.w * (idx % rows);
-		rect.y = rect.h * (idx / rows);
+		rect->w = sz->w / rows;
+		rect->h = sz->h / rows;
+		rect->x = rect->w * (idx % rows);
+		rect->y = rect->h * (idx / rows);
 	}
 
-	vidconv_aspect(mframe, frame_src, &rect);
+	return rect->w && rect->h;
 }
 
 
-static inline void source_mix_full(struct vidframe *mframe,
-				   const struct vidframe *frame_src)
+static inline unsigned calc_rows(unsigned n)
 {
-	if (!frame_src)
-		return;
+	unsigned rows;
 
-	if (vidsz_cmp(&mframe->size, &frame_src->size)) {
+	for (rows=1;; rows++)
+		if (n <= (rows * rows))
+			return rows;
+}
 
-		vidframe_copy(mframe, frame_src);
-	}
-	else {
-		struct vidrect rect;
 
-		rect.w = mframe->size.w;
-		rect.h = mframe->size.h;
-		rect.x = 0;
-		rect.y = 0;
+static inline bool source_shown(const struct vidmix_source *src,
+				const struct vidmix_source *lsrc)
+{
+	if (lsrc == src && !src->selfview)
+		return false;
 
-		vidconv_aspect(mframe, frame_src, &rect);
-	}
+	if (lsrc->content && src->content_hide)
+		return false;
+
+	return true;
 }
 
 
-static inline unsigned calc_rows(unsigned n)
+/* Put a source in the next tile, and mark it dirty if it changed */
+static void tile_set(struct vidmix_source *src,
+		     const struct vidmix_source *lsrc,
+		     const struct vidrect *rect, bool force)
 {
-	unsigned rows;
+	struct tile *tile = &src->tilev[src->tilec++];
+	struct vidmix_source *ls = (struct vidmix_source *)lsrc;
+	uint64_t gen;
 
-	for (rows=1;; rows++)
-		if (n <= (rows * rows))
-			return rows;
+	pthread_mutex_lock(&ls->rx_mutex);
+	gen = ls->gen;
+	pthread_mutex_unlock(&ls->rx_mutex);
+
+	if (force || !tile->valid || tile->src != lsrc ||
+	    !vidrect_cmp(&tile->rect, rect) || tile->gen != gen) {
+
+		tile->src   = lsrc;
+		tile->rect  = *rect;
+		tile->valid = false;
+		tile->dirty = true;
+	}
+	else {
+		tile->dirty = false;
+	}
 }
 
 
-static void *vidmix_thread(void *arg)
+/*
+ * Compose the output frame of a source. Only the tiles whose source
+ * has received a new frame since the last composition are drawn.
+ * Called with the source mutex held.
+ */
+static int source_compose(struct vidmix_source *src, uint64_t now)
 {
-	struct vidmix_source *src = arg;
 	struct vidmix *mix = src->mix;
-	uint64_t ts = tmr_jiffies();
+	const struct vidmix_source *full = NULL;
+	unsigned n, rows, idx, dirty = 0, i;
+	struct le *le;
+	int err = 0;
 
-	pthread_mutex_lock(&src->mutex);
+	pthread_rwlock_rdlock(&mix->rwlock);
 
-	while (src->run) {
+	if (src->clear) {
+		clear_frame(src->frame_tx);
+		memset(src->tilev, 0, src->tilesz * sizeof(*src->tilev));
+		src->clear = false;
+	}
 
-		unsigned n, rows, idx;
-		struct le *le;
-		uint64_t now;
+	for (le=mix->srcl.head, n=0; le; le=le->next) {
 
-		pthread_mutex_unlock(&src->mutex);
-		(void)usleep(4000);
-		pthread_mutex_lock(&src->mutex);
-
-		now = tmr_jiffies();
+		const struct vidmix_source *lsrc = le->data;
 
-		if (ts > now)
+		if (!source_shown(src, lsrc))
 			continue;
 
-		if (!src->frame_tx) {
-			ts += src->fint;
-			continue;
-		}
+		if (lsrc == src->focus && src->focus_full)
+			full = lsrc;
 
-		pthread_rwlock_rdlock(&mix->rwlock);
+		++n;
+	}
 
-		if (src->clear) {
-			clear_frame(src->frame_tx);
-			src->clear = false;
+	if (n + 1 > src->tilesz) {
+
+		struct tile *tilev;
+
+		tilev = mem_zalloc((n + 1) * sizeof(*tilev), NULL);
+		if (!tilev) {
+			err = ENOMEM;
+			goto out;
 		}
 
-		for (le=mix->srcl.head, n=0; le; le=le->next) {
+		mem_deref(src->tilev);
+		src->tilev  = tilev;
+		src->tilesz = n + 1;
+	}
 
-			const struct vidmix_source *lsrc = le->data;
+	src->tilec = 0;
+	rows = calc_rows(n);
 
-			if (lsrc == src && !src->selfview)
-				continue;
+	/* the full focus is drawn first, with the others on top of it */
+	if (full) {
 
-			if (lsrc->content && src->content_hide)
-				continue;
+		struct vidrect rect = {0, 0, 0, 0};
 
-			if (lsrc == src->focus && src->focus_full)
-				source_mix_full(src->frame_tx, lsrc->frame_rx);
+		rect.w = src->frame_tx->size.w;
+		rect.h = src->frame_tx->size.h;
 
-			++n;
+		tile_set(src, full, &rect, false);
+
+		if (src->tilev[0].dirty) {
+			err = tile_draw(src->frame_tx, &src->tilev[0], now);
+			src->tilev[0].dirty = false;
+			++dirty;
 		}
+	}
 
-		rows = calc_rows(n);
+	for (le=mix->srcl.head, idx=0; le; le=le->next) {
 
-		for (le=mix->srcl.head, idx=0; le; le=le->next) {
+		const struct vidmix_source *lsrc = le->data;
+		struct vidrect rect;
 
-			const struct vidmix_source *lsrc = le->data;
+		if (!source_shown(src, lsrc) || lsrc == full)
+			continue;
 
-			if (lsrc == src && !src->selfview)
-				continue;
+		if (layout_rect(&rect, &src->frame_tx->size, n, rows, idx,
+				src->focus != NULL, src->focus == lsrc,
+				src->focus_full)) {
 
-			if (lsrc->content && src->content_hide)
-				continue;
+			tile_set(src, lsrc, &rect, dirty > 0 && full);
+		}
 
-			if (lsrc == src->focus && src->focus_full)
-				continue;
+		if (src->focus != lsrc)
+			++idx;
+	}
+
+	for (i=0, dirty=0; i<src->tilec; i++) {
+		if (src->tilev[i].dirty)
+			++dirty;
+	}
+
+	err |= tiles_draw(mix, src->frame_tx, src->tilev, src->tilec, dirty,
+			  now);
+
+ out:
+	pthread_rwlock_unlock(&mix->rwlock);
+
+	return err;
+}
 
-			source_mix(src->frame_tx, lsrc->frame_rx, n, rows, idx,
-				   src->focus != NULL, src->focus == lsrc,
-				   src->focus_full);
 
-			if (src->focus != lsrc)
-				++idx;
+static void *vidmix_thread(void *arg)
+{
+	struct vidmix_source *src = arg;
+	uint64_t ts = tmr_jiffies();
+
+	pthread_mutex_lock(&src->mutex);
+
+	while (src->run) {
+
+		uint64_t now;
+
+		pthread_mutex_unlock(&src->mutex);
+		(void)usleep(4000);
+		pthread_mutex_lock(&src->mutex);
+
+		now = tmr_jiffies();
+
+		if (ts > now)
+			continue;
+
+		if (!src->frame_tx) {
+			ts += src->fint;
+			continue;
 		}
 
-		pthread_rwlock_unlock(&mix->rwlock);
+		(void)source_compose(src, now);
 
 		src->fh((uint32_t)ts * 90, src->frame_tx, src->arg);
 
@@ -317,6 +703,52 @@ static void *content_thread(void *arg)
 }
 
 
+static int pool_start(struct vidmix *mix)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned i, n;
+	int err;
+
+	n = cpus > 0 ? min((unsigned)cpus, MAX_WORKERS) : 1;
+
+	mix->workerv = mem_zalloc(n * sizeof(*mix->workerv), NULL);
+	if (!mix->workerv)
+		return ENOMEM;
+
+	err = pthread_mutex_init(&mix->mutex, NULL);
+	if (err)
+		return err;
+
+	err = pthread_cond_init(&mix->cond, NULL);
+	if (err) {
+		(void)pthread_mutex_destroy(&mix->mutex);
+		return err;
+	}
+
+	err = pthread_cond_init(&mix->done, NULL);
+	if (err) {
+		(void)pthread_cond_destroy(&mix->cond);
+		(void)pthread_mutex_destroy(&mix->mutex);
+		return err;
+	}
+
+	mix->pool_initialized = true;
+	mix->run = true;
+
+	for (i=0; i<n; i++) {
+
+		err = pthread_create(&mix->workerv[i], NULL,
+				     worker_thread, mix);
+		if (err)
+			return err;
+
+		++mix->workerc;
+	}
+
+	return 0;
+}
+
+
 /**
  * Allocate a new Video mixer
  *
@@ -356,6 +788,8 @@ int vidmix_alloc(struct vidmix **mixp)
 
 	mix->initialized = true;
 
+	err = pool_start(mix);
+
  out:
 	(void)pthread_rwlockattr_destroy(&attr);
 
@@ -405,6 +839,12 @@ int vidmix_source_alloc(struct vidmix_source **srcp, struct vidmix *mix,
 	if (err)
 		goto out;
 
+	err = pthread_mutex_init(&src->rx_mutex, NULL);
+	if (err)
+		goto out;
+
+	src->rx_initialized = true;
+
 	if (sz) {
 		err = vidframe_alloc(&src->frame_tx, VID_FMT_YUV420P, sz);
 		if (err)
@@ -482,8 +922,12 @@ void vidmix_source_enable(struct vidmix_source *src, bool enable)
 	pthread_rwlock_wrlock(&src->mix->rwlock);
 
 	if (enable) {
-		if (src->frame_rx)
+		pthread_mutex_lock(&src->rx_mutex);
+		if (src->frame_rx) {
 			clear_frame(src->frame_rx);
+			++src->gen;
+		}
+		pthread_mutex_unlock(&src->rx_mutex);
 
 		list_append(&src->mix->srcl, &src->le, src);
 	}
@@ -572,6 +1016,7 @@ int vidmix_source_set_size(struct vidmix_source *src, const struct vidsz *sz)
 	pthread_mutex_lock(&src->mutex);
 	mem_deref(src->frame_tx);
 	src->frame_tx = frame;
+	src->clear = true;
 	pthread_mutex_unlock(&src->mutex);
 
 	return 0;
@@ -703,6 +1148,45 @@ void vidmix_source_set_focus_idx(struct vidmix_source *src, unsigned pidx)
 }
 
 
+/**
+ * Compose the output frame of a video mixer source now, and pass it to
+ * the frame handler. This is what the source thread does once per frame
+ * interval, for applications that drive the mixer from their own clock.
+ *
+ * @param src Video mixer source
+ *
+ * @return 0 if success, otherwise errorcode. If a tile could not be
+ *         drawn, the frame is not passed on, and the tile is drawn again
+ *         at the next composition.
+ */
+int vidmix_source_mix(struct vidmix_source *src)
+{
+	uint64_t now;
+	int err = 0;
+
+	if (!src)
+		return EINVAL;
+
+	if (src->content)
+		return 0;
+
+	pthread_mutex_lock(&src->mutex);
+
+	if (src->frame_tx) {
+
+		now = tmr_jiffies();
+
+		err = source_compose(src, now);
+		if (!err)
+			src->fh((uint32_t)now * 90, src->frame_tx, src->arg);
+	}
+
+	pthread_mutex_unlock(&src->mutex);
+
+	return err;
+}
+
+
 /**
  * Put a video frame into the video mixer
  *
@@ -711,9 +1195,13 @@ void vidmix_source_set_focus_idx(struct vidmix_source *src, unsigned pidx)
  */
 void vidmix_source_put(struct vidmix_source *src, const struct vidframe *frame)
 {
+	bool resized = false;
+
 	if (!src || !frame || frame->fmt != VID_FMT_YUV420P)
 		return;
 
+	pthread_mutex_lock(&src->rx_mutex);
+
 	if (!src->frame_rx || !vidsz_cmp(&src->frame_rx->size, &frame->size)) {
 
 		struct vidframe *frm;
@@ -721,17 +1209,22 @@ void vidmix_source_put(struct vidmix_source *src, const struct vidframe *frame)
 
 		err = vidframe_alloc(&frm, VID_FMT_YUV420P, &frame->size);
 		if (err)
-			return;
-
-		pthread_rwlock_wrlock(&src->mix->rwlock);
+			goto out;
 
 		mem_deref(src->frame_rx);
 		src->frame_rx = frm;
+		resized = true;
+	}
 
-		clear_all(src->mix);
+	vidframe_copy(src->frame_rx, frame);
+	++src->gen;
+
+ out:
+	pthread_mutex_unlock(&src->rx_mutex);
 
+	if (resized) {
+		pthread_rwlock_wrlock(&src->mix->rwlock);
+		clear_all(src->mix);
 		pthread_rwlock_unlock(&src->mix->rwlock);
 	}
-
-	vidframe_copy(src->frame_rx, frame);
 }
@@ -9,14 +9,18 @@
 /* cmd */
 
 typedef void(restund_cmd_h)(struct mbuf *mb);
+typedef bool(restund_cmd_chunk_h)(struct mbuf *mb, uint32_t *cursor);
 
 struct restund_cmdsub {
 	struct le le;
 	restund_cmd_h *cmdh;
 	const char *cmd;
+	restund_cmd_chunk_h *chunkh;  /**< Optional, prints output in chunks */
 };
 
 void restund_cmd(const struct pl *cmd, struct mbuf *mb);
+bool restund_cmd_chunk(const struct pl *cmd, struct mbuf *mb,
+		       uint32_t *cursor);
 void restund_cmd_subscribe(struct restund_cmdsub *cs);
 void restund_cmd_unsubscribe(struct restund_cmdsub *cs);
 
@@ -95,6 +99,9 @@ typedef int(restund_db_account_h)(const char *username, const char *ha1,
 typedef int(restund_db_account_all_h)(const char *realm,
 				      restund_db_account_h *acch, void *arg);
 typedef int(restund_db_account_cnt_h)(const char *realm, uint32_t *n);
+typedef int(restund_db_account_chg_h)(const char *realm, uint64_t *wm,
+				      bool *full,
+				      restund_db_account_h *acch, void *arg);
 typedef int(restund_db_traffic_log_h)(const char *username,
 				      const struct sa *cli,
 				      const struct sa *relay,
@@ -108,6 +115,7 @@ struct restund_db {
 	restund_db_account_all_h *allh;
 	restund_db_account_cnt_h *cnth;
 	restund_db_traffic_log_h *tlogh;
+	restund_db_account_chg_h *chgh;  /**< Accounts changed, optional */
 };
 
 int  restund_log_traffic(const char *username, const struct sa *cli,
@@ -115,6 +123,8 @@ int  restund_log_traffic(const char *username, const struct sa *cli,
 			 time_t start, time_t end,
 			 const struct restund_trafstat *ts);
 int  restund_get_ha1(const char *username, uint8_t *ha1);
+int  restund_db_gen(uint32_t *genp);
+void restund_db_sync(void);
 const char *restund_realm(void);
 void restund_db_set_handler(struct restund_db *db);
 void restund_db_set_auth_handler(restund_db_auth_h *authh);
@@ -14,12 +14,43 @@ enum {
 	NONCE_EXPIRY   = 3600,
 	NONCE_MAX_SIZE = 48,
 	NONCE_MIN_SIZE = 33,
+	CACHE_BSIZE    = 1024,
+	SWEEP_INTERVAL = 60,
+};
+
+
+/*
+ * Credentials of a 5-tuple that authenticated, so that further requests
+ * on it, e.g. of the same TURN allocation, skip the nonce check and the
+ * database lookup, and verify the MESSAGE-INTEGRITY with the padded key.
+ */
+struct cred {
+	struct le he;
+	struct sa src;
+	struct sa dst;
+	int proto;
+	char *username;
+	char nonce[NONCE_MAX_SIZE + 1];
+	time_t expires;            /**< Nonce expiry                 */
+	uint32_t gen;              /**< Database generation          */
+	uint8_t *key;              /**< HA1, referenced by requests  */
+	struct hmac *hmac;         /**< HMAC-SHA1 of the key         */
 };
 
 
 static struct {
 	uint32_t nonce_expiry;
 	uint64_t secret;
+	struct hash *cache;
+	struct tmr tmr;
+	uint32_t credc;
+	uint64_t hitc;
+	uint64_t missc;
+	uint64_t challc;           /**< Requests without integrity   */
+	uint64_t failc_req;        /**< Bad requests                 */
+	uint64_t failc_nonce;      /**< Stale nonces                 */
+	uint64_t failc_user;       /**< Unknown users                */
+	uint64_t failc_pass;       /**< Bad passwords                */
 } auth;
 
 
@@ -41,7 +72,8 @@ static const char *mknonce(char *nonce, time_t now, const struct sa *src)
 }
 
 
-static bool nonce_validate(char *nonce, time_t now, const struct sa *src)
+static bool nonce_validate(char *nonce, time_t now, const struct sa *src,
+			   time_t *expires)
 {
 	uint8_t nkey[MD5_SIZE], ckey[MD5_SIZE];
 	uint64_t nv[3];
@@ -81,10 +113,148 @@ static bool nonce_validate(char *nonce, time_t now, const struct sa *src)
 		return false;
 	}
 
+	*expires = (time_t)nv[0] + auth.nonce_expiry;
+
 	return true;
 }
 
 
+static void cred_destructor(void *arg)
+{
+	struct cred *cred = arg;
+
+	hash_unlink(&cred->he);
+	--auth.credc;
+	mem_deref(cred->username);
+	mem_deref(cred->key);
+	mem_deref(cred->hmac);
+}
+
+
+static uint32_t tuple_hash(int proto, const struct sa *src,
+			   const struct sa *dst)
+{
+	return sa_hash(src, SA_ALL) ^ sa_hash(dst, SA_ALL) ^ proto;
+}
+
+
+struct tuple {
+	const struct sa *src;
+	const struct sa *dst;
+	int proto;
+};
+
+
+static bool cache_cmp_handler(struct le *le, void *arg)
+{
+	const struct cred *cred = le->data;
+	const struct tuple *tup = arg;
+
+	return cred->proto == tup->proto &&
+		sa_cmp(&cred->src, tup->src, SA_ALL) &&
+		sa_cmp(&cred->dst, tup->dst, SA_ALL);
+}
+
+
+static struct cred *cache_lookup(int proto, const struct sa *src,
+				 const struct sa *dst)
+{
+	struct tuple tup;
+
+	tup.src   = src;
+	tup.dst   = dst;
+	tup.proto = proto;
+
+	return list_ledata(hash_lookup(auth.cache,
+				       tuple_hash(proto, src, dst),
+				       cache_cmp_handler, &tup));
+}
+
+
+/*
+ * The cached credentials are used if the request has the username and
+ * nonce that were validated, the nonce has not expired, and the
+ * database was not synced since.
+ */
+static bool cache_match(const struct cred *cred, const char *username,
+			const char *nonce, time_t now)
+{
+	uint32_t gen;
+
+	if (restund_db_gen(&gen) || gen != cred->gen)
+		return false;
+
+	if (now > cred->expires)
+		return false;
+
+	return !strcmp(cred->nonce, nonce) &&
+		!strcmp(cred->username, username);
+}
+
+
+static void cache_store(int proto, const struct sa *src,
+			const struct sa *dst, const char *username,
+			const char *nonce, time_t expires, uint32_t gen,
+			uint8_t *key)
+{
+	struct cred *cred;
+	int err;
+
+	if (!auth.cache)
+		return;
+
+	cred = cache_lookup(proto, src, dst);
+	if (cred)
+		mem_deref(cred);
+
+	cred = mem_zalloc(sizeof(*cred), cred_destructor);
+	if (!cred)
+		return;
+
+	++auth.credc;
+
+	err  = str_dup(&cred->username, username);
+	err |= hmac_create(&cred->hmac, HMAC_HASH_SHA1, key, MD5_SIZE);
+	if (err) {
+		mem_deref(cred);
+		return;
+	}
+
+	cred->src     = *src;
+	cred->dst     = *dst;
+	cred->proto   = proto;
+	cred->expires = expires;
+	cred->gen     = gen;
+	cred->key     = mem_ref(key);
+	str_ncpy(cred->nonce, nonce, sizeof(cred->nonce));
+
+	hash_append(auth.cache, tuple_hash(proto, src, dst), &cred->he, cred);
+}
+
+
+static bool sweep_handler(struct le *le, void *arg)
+{
+	struct cred *cred = le->data;
+	const time_t *now = arg;
+
+	if (*now > cred->expires)
+		mem_deref(cred);
+
+	return false;
+}
+
+
+static void sweep_timeout(void *arg)
+{
+	const time_t now = time(NULL);
+	(void)arg;
+
+	tmr_start(&auth.tmr, SWEEP_INTERVAL * 1000, sweep_timeout, NULL);
+
+	(void)hash_apply(auth.cache, sweep_handler, (void *)&now);
+}
+
+
 static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 			    const struct sa *src, const struct sa *dst,
 			    const struct stun_msg *msg)
@@ -92,8 +262,11 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 	struct stun_attr *mi, *user, *realm, *nonce;
 	const time_t now = time(NULL);
 	char nstr[NONCE_MAX_SIZE + 1];
+	struct cred *cred;
+	time_t expires;
+	uint32_t gen;
+	bool cache;
 	int err;
-	(void)dst;
 
 	if (ctx->key)
 		return false;
@@ -104,6 +277,7 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 	nonce = stun_msg_attr(msg, STUN_ATTR_NONCE);
 
 	if (!mi) {
+		++auth.challc;
 		err = stun_ereply(proto, sock, src, 0, msg,
 				  401, "Unauthorized",
 				  NULL, 0, ctx->fp, 3,
@@ -114,6 +288,7 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 	}
 
 	if (!user || !realm || !nonce) {
+		++auth.failc_req;
 		err = stun_ereply(proto, sock, src, 0, msg,
 				  400, "Bad Request",
 				  NULL, 0, ctx->fp, 1,
@@ -121,7 +296,23 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 		goto unauth;
 	}
 
-	if (!nonce_validate(nonce->v.nonce, now, src)) {
+	cred = cache_lookup(proto, src, dst);
+	if (cred && cache_match(cred, user->v.username, nonce->v.nonce, now)) {
+
+		if (!stun_msg_chk_mi_hmac(msg, cred->hmac)) {
+			ctx->key    = mem_ref(cred->key);
+			ctx->keylen = MD5_SIZE;
+			++auth.hitc;
+			return false;
+		}
+
+		/* fall through, so that the failure is handled as usual */
+	}
+
+	++auth.missc;
+
+	if (!nonce_validate(nonce->v.nonce, now, src, &expires)) {
+		++auth.failc_nonce;
 		err = stun_ereply(proto, sock, src, 0, msg,
 				  438, "Stale Nonce",
 				  NULL, 0, ctx->fp, 3,
@@ -143,9 +334,13 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 
 	ctx->keylen = MD5_SIZE;
 
+	/* the generation before the lookup, a sync in between is seen */
+	cache = !restund_db_gen(&gen);
+
 	if (restund_get_ha1(user->v.username, ctx->key)) {
 		restund_info("auth: unknown user '%s' (%j)\n",
 			     user->v.username, src);
+		++auth.failc_user;
 		err = stun_ereply(proto, sock, src, 0, msg,
 				  401, "Unauthorized",
 				  NULL, 0, ctx->fp, 3,
@@ -158,6 +353,7 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 	if (stun_msg_chk_mi(msg, ctx->key, ctx->keylen)) {
 		restund_info("auth: bad password for user '%s' (%j)\n",
 			     user->v.username, src);
+		++auth.failc_pass;
 		err = stun_ereply(proto, sock, src, 0, msg,
 				  401, "Unauthorized",
 				  NULL, 0, ctx->fp, 3,
@@ -167,6 +363,10 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 		goto unauth;
 	}
 
+	if (cache)
+		cache_store(proto, src, dst, user->v.username, nonce->v.nonce,
+			    expires, gen, ctx->key);
+
 	return false;
 
  unauth:
@@ -178,22 +378,64 @@ static bool request_handler(struct restund_msgctx *ctx, int proto, void *sock,
 }
 
 
+static void stats_handler(struct mbuf *mb)
+{
+	(void)mbuf_printf(mb, "cache_size %u\n", auth.credc);
+	(void)mbuf_printf(mb, "cache_hits %llu\n", auth.hitc);
+	(void)mbuf_printf(mb, "cache_misses %llu\n", auth.missc);
+	(void)mbuf_printf(mb, "challenges %llu\n", auth.challc);
+	(void)mbuf_printf(mb, "fail_bad_request %llu\n", auth.failc_req);
+	(void)mbuf_printf(mb, "fail_stale_nonce %llu\n", auth.failc_nonce);
+	(void)mbuf_printf(mb, "fail_unknown_user %llu\n", auth.failc_user);
+	(void)mbuf_printf(mb, "fail_bad_password %llu\n", auth.failc_pass);
+	(void)mbuf_printf(mb, "fail_tot %llu\n",
+			  auth.failc_req + auth.failc_nonce +
+			  auth.failc_user + auth.failc_pass);
+}
+
+
 static struct restund_stun stun = {
 	.reqh = request_handler
 };
 
 
+static struct restund_cmdsub cmd_authstats = {
+	.cmdh = stats_handler,
+	.cmd  = "authstats",
+};
+
+
 static int module_init(void)
 {
+	uint32_t x, bsize = CACHE_BSIZE;
+	int err;
+
 	auth.nonce_expiry = NONCE_EXPIRY;
 	auth.secret = rand_u64();
 
 	conf_get_u32(restund_conf(), "auth_nonce_expiry", &auth.nonce_expiry);
+	conf_get_u32(restund_conf(), "auth_cache_size", &bsize);
+
+	/* auth_cache_size 0 disables the credential cache */
+	if (bsize) {
+		for (x=2; (uint32_t)1<<x<bsize; x++);
+		bsize = 1<<x;
+
+		err = hash_alloc(&auth.cache, bsize);
+		if (err) {
+			restund_error("auth: cache alloc error: %m\n", err);
+			return err;
+		}
+
+		tmr_start(&auth.tmr, SWEEP_INTERVAL * 1000, sweep_timeout,
+			  NULL);
+	}
 
 	restund_stun_register_handler(&stun);
+	restund_cmd_subscribe(&cmd_authstats);
 
-	restund_debug("auth: module loaded (nonce_expiry=%us)\n",
-		      auth.nonce_expiry);
+	restund_debug("auth: module loaded (nonce_expiry=%us cache=%u)\n",
+		      auth.nonce_expiry, bsize);
 
 	return 0;
 }
@@ -201,6 +443,11 @@ static int module_init(void)
 
 static int module_close(void)
 {
+	tmr_cancel(&auth.tmr);
+	hash_flush(auth.cache);
+	auth.cache = mem_deref(auth.cache);
+
+	restund_cmd_unsubscribe(&cmd_authstats);
 	restund_stun_unregister_handler(&stun);
 
 	restund_debug("auth: module closed\n");
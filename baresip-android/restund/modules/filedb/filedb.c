@@ -4,16 +4,22 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
+#define _BSD_SOURCE 1
+#define _DEFAULT_SOURCE 1
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <re.h>
 #include <restund.h>
 
 
 static char filepath[512] = "/etc/restund.auth";
+static int inotify_fd = -1;
 
 
 static int user_load(uint32_t *nump, restund_db_account_h *acch, void *arg)
@@ -112,11 +118,140 @@ static int accounts_count(const char *realm, uint32_t *n)
 }
 
 
+/* Time of a file status field in [ns] */
+static uint64_t stat_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+
+/*
+ * The file has no per-row changes, so the watermark is its version.
+ * Unchanged files are not read at all, changed files are listed in full.
+ * The times have nanoseconds, so that a file replaced twice within a
+ * second is read again.
+ */
+static int accounts_changed(const char *realm, uint64_t *wm, bool *full,
+			    restund_db_account_h *acch, void *arg)
+{
+	struct stat st;
+	uint64_t v;
+	int err;
+
+	if (!realm || !wm || !full || !acch)
+		return EINVAL;
+
+	if (stat(filepath, &st) < 0) {
+		err = errno;
+		restund_error("filedb: stat '%s': %m\n", filepath, err);
+		return err;
+	}
+
+#ifdef __APPLE__
+	v  = stat_ns(&st.st_mtimespec) ^ stat_ns(&st.st_ctimespec) << 1;
+#else
+	v  = stat_ns(&st.st_mtim) ^ stat_ns(&st.st_ctim) << 1;
+#endif
+	v ^= (uint64_t)st.st_size << 16 ^ (uint64_t)st.st_ino;
+
+	if (v == *wm)
+		return 0;
+
+	err = user_load(NULL, acch, arg);
+	if (err)
+		return err;
+
+	*wm   = v;
+	*full = true;
+
+	return 0;
+}
+
+
+#ifdef __linux__
+static void inotify_handler(int flags, void *arg)
+{
+	const char *name = strrchr(filepath, '/');
+	uint8_t buf[4096];
+	bool changed = false;
+	ssize_t n;
+	(void)arg;
+
+	if (!(flags & FD_READ))
+		return;
+
+	name = name ? name + 1 : filepath;
+
+	while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+
+		ssize_t i;
+
+		for (i=0; i<n;) {
+			const struct inotify_event *ev = (void *)&buf[i];
+
+			if (ev->len && !strcmp(ev->name, name))
+				changed = true;
+
+			i += sizeof(*ev) + ev->len;
+		}
+	}
+
+	if (changed) {
+		restund_debug("filedb: %s changed\n", filepath);
+		restund_db_sync();
+	}
+}
+
+
+/* Watch the directory, so that the file can be replaced by a rename */
+static void watch_init(void)
+{
+	char dir[sizeof(filepath)];
+	char *p;
+	int err;
+
+	str_ncpy(dir, filepath, sizeof(dir));
+
+	p = strrchr(dir, '/');
+	if (p == dir)
+		p[1] = '\0';
+	else if (p)
+		*p = '\0';
+	else
+		str_ncpy(dir, ".", sizeof(dir));
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0) {
+		err = errno;
+		goto out;
+	}
+
+	if (inotify_add_watch(inotify_fd, dir,
+			      IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		err = errno;
+		goto out;
+	}
+
+	err = fd_listen(inotify_fd, FD_READ, inotify_handler, NULL);
+
+ out:
+	if (err) {
+		restund_warning("filedb: unable to watch '%s': %m\n",
+				filepath, err);
+		if (inotify_fd >= 0)
+			(void)close(inotify_fd);
+		inotify_fd = -1;
+	}
+}
+#endif
+
+
 static int module_init(void)
 {
 	static struct restund_db db = {
 		.allh = accounts_getall,
 		.cnth = accounts_count,
+		.chgh = accounts_changed,
 	};
 
 	restund_db_set_handler(&db);
@@ -124,6 +259,10 @@ static int module_init(void)
 	conf_get_str(restund_conf(), "filedb_path",
 		     filepath, sizeof(filepath));
 
+#ifdef __linux__
+	watch_init();
+#endif
+
 	restund_debug("filedb: module loaded (%s)\n", filepath);
 
 	return 0;
@@ -132,6 +271,14 @@ static int module_init(void)
 
 static int module_close(void)
 {
+#ifdef __linux__
+	if (inotify_fd >= 0) {
+		fd_close(inotify_fd);
+		(void)close(inotify_fd);
+		inotify_fd = -1;
+	}
+#endif
+
 	restund_debug("filedb: module closed\n");
 
 	return 0;
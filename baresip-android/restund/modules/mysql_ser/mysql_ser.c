@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <mysql/mysql.h>
 #include <mysql/errmsg.h>
 #include <re.h>
@@ -22,6 +23,7 @@ static struct {
 	char user[128];
 	char pass[128];
 	char db[128];
+	char sync[64];     /* Column with the version of a row, optional */
 	MYSQL mysql;
 	uint32_t version;  /* SER Version, e.g. 1, 2 or 3 */
 } my;
@@ -143,6 +145,69 @@ static int accounts_getall(const char *realm, restund_db_account_h *acch,
 }
 
 
+/*
+ * Rows are changed when the sync column is at or above the watermark.
+ * Equal values are listed again, so that rows written in the same second
+ * as the last sync are not lost. Removed rows are not seen here, they are
+ * removed by the periodic full sync.
+ */
+static int accounts_changed(const char *realm, uint64_t *wm, bool *full,
+			    restund_db_account_h *acch, void *arg)
+{
+	MYSQL_RES *res;
+	uint64_t v = *wm;
+	int err = 0;
+
+	if (!realm || !wm || !full || !acch)
+		return EINVAL;
+
+	switch (my.version) {
+
+	case 2:
+		err = query(&res,
+			    "SELECT auth_username, ha1, %s "
+			    "FROM credentials WHERE realm = '%s' "
+			    "AND %s >= %llu;",
+			    my.sync, realm, my.sync, *wm);
+		break;
+
+	default:
+		err = query(&res,
+			    "SELECT username, ha1, %s "
+			    "FROM subscriber where domain = '%s' "
+			    "AND %s >= %llu;",
+			    my.sync, realm, my.sync, *wm);
+		break;
+	}
+
+	if (err) {
+		restund_warning("mysql: unable to select changes: %s\n",
+				mysql_error(&my.mysql));
+		return err;
+	}
+
+	for (;!err;) {
+		MYSQL_ROW row;
+
+		row = mysql_fetch_row(res);
+		if (!row)
+			break;
+
+		err = acch(row[0] ? row[0] : "", row[1] ? row[1] : "", arg);
+
+		if (row[2])
+			v = max(v, (uint64_t)strtoull(row[2], NULL, 10));
+	}
+
+	mysql_free_result(res);
+
+	if (!err)
+		*wm = v;
+
+	return err;
+}
+
+
 static int accounts_count(const char *realm, uint32_t *n)
 {
 	MYSQL_RES *res;
@@ -187,6 +252,17 @@ static int accounts_count(const char *realm, uint32_t *n)
 }
 
 
+static bool column_valid(const char *name)
+{
+	for (; *name; name++) {
+		if (!isalnum((unsigned char)*name) && *name != '_')
+			return false;
+	}
+
+	return true;
+}
+
+
 static int module_init(void)
 {
 	static struct restund_db db = {
@@ -200,6 +276,16 @@ static int module_init(void)
 	conf_get_str(restund_conf(), "mysql_pass", my.pass, sizeof(my.pass));
 	conf_get_str(restund_conf(), "mysql_db",   my.db,   sizeof(my.db));
 	conf_get_u32(restund_conf(), "mysql_ser", &my.version);
+	conf_get_str(restund_conf(), "mysql_sync_column",
+		     my.sync, sizeof(my.sync));
+
+	/* the column name goes into the query as it is */
+	if (my.sync[0] && !column_valid(my.sync)) {
+		restund_warning("mysql: bad sync column '%s'\n", my.sync);
+		my.sync[0] = '\0';
+	}
+
+	db.chgh = my.sync[0] ? accounts_changed : NULL;
 
 	if (myconnect()) {
 		restund_error("mysql: %s\n", mysql_error(&my.mysql));
@@ -18,6 +18,9 @@ struct conn {
 	struct tmr tmr;
 	struct httpd *httpd;
 	struct tcp_conn *tc;
+	char *uri;         /**< URI of the response being sent      */
+	uint32_t cursor;   /**< Position in the response            */
+	bool done;         /**< All of the response is queued       */
 };
 
 
@@ -42,40 +45,97 @@ static void estab_handler(void *arg)
 }
 
 
+/*
+ * The response body is produced one chunk at a time, when the connection
+ * is ready to send more, so that a large response does not block the
+ * main loop. The length is not known in advance, the end of the response
+ * is signalled by closing the connection.
+ */
+static void send_handler(void *arg)
+{
+	struct conn *conn = arg;
+	struct mbuf *mb;
+	struct pl uri;
+	bool more;
+	int err = 0;
+
+	if (conn->done) {
+		conn = mem_deref(conn);
+		return;
+	}
+
+	mb = mbuf_alloc(8192);
+	if (!mb) {
+		conn = mem_deref(conn);
+		return;
+	}
+
+	pl_set_str(&uri, conn->uri);
+	more = conn->httpd->h(&uri, mb, &conn->cursor);
+
+	if (mb->end) {
+		mb->pos = 0;
+		err = tcp_send(conn->tc, mb);
+	}
+
+	mem_deref(mb);
+
+	if (err) {
+		conn = mem_deref(conn);
+		return;
+	}
+
+	conn->done = !more;
+
+	tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT, timeout_handler, conn);
+}
+
+
 static void recv_handler(struct mbuf *mbrx, void *arg)
 {
-	struct mbuf *mb = NULL, *body = NULL;
+	struct mbuf *mb = NULL;
 	struct conn *conn = arg;
 	struct pl met, url, ver;
 	int err = 0;
 
+	/* one request per connection */
+	if (conn->uri)
+		return;
+
 	if (re_regex((char *)mbrx->buf, mbrx->end,
 		     "[^ ]+ [^ ]+ HTTP/[^\r\n]+\r\n", &met, &url, &ver)) {
 		re_printf("invalid http request\n");
 		goto out;
 	}
 
-	mb   = mbuf_alloc(512);
-	body = mbuf_alloc(8192);
-	if (!mb || !body)
+	mb = mbuf_alloc(512);
+	if (!mb) {
+		err = ENOMEM;
 		goto out;
-
-	conn->httpd->h(&url, body);
+	}
 
 	err |= mbuf_printf(mb, "HTTP/%r 200 OK\r\n", &ver);
 	err |= mbuf_write_str(mb, "Content-Type: text/html;charset=UTF-8\r\n");
-	err |= mbuf_printf(mb, "Content-Length: %u\r\n\r\n", body->end);
-	err |= mbuf_write_mem(mb, body->buf, body->end);
+	err |= mbuf_write_str(mb, "Connection: close\r\n\r\n");
+	err |= pl_strdup(&conn->uri, &url);
 	if (err)
 		goto out;
 
 	mb->pos = 0;
-	tcp_send(conn->tc, mb);
+	err = tcp_send(conn->tc, mb);
+	if (err)
+		goto out;
+
+	err = tcp_set_send(conn->tc, send_handler);
+	if (err)
+		goto out;
 
 	tmr_start(&conn->tmr, TCP_IDLE_TIMEOUT, timeout_handler, conn);
  out:
 	mem_deref(mb);
-	mem_deref(body);
+
+	if (err)
+		conn = mem_deref(conn);
 }
 
 
@@ -95,6 +155,7 @@ static void conn_destructor(void *arg)
 	tmr_cancel(&conn->tmr);
 	list_unlink(&conn->le);
 	conn->tc = mem_deref(conn->tc);
+	mem_deref(conn->uri);
 }
 
 
@@ -4,7 +4,17 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
-typedef void(httpd_h)(const struct pl *uri, struct mbuf *mb);
+/**
+ * Print a part of the response, called until it returns false
+ *
+ * @param uri    Request URI
+ * @param mb     Buffer for the response body
+ * @param cursor Position in the response, zero at the first call
+ *
+ * @return true if there is more of the response, false if done
+ */
+typedef bool(httpd_h)(const struct pl *uri, struct mbuf *mb,
+		      uint32_t *cursor);
 
 struct httpd;
 
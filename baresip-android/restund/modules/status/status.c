@@ -16,9 +16,21 @@ enum {
 };
 
 
+/** A command from the UDP interface, answered one chunk at a time */
+struct udp_req {
+	struct le le;
+	struct tmr tmr;
+	struct sa src;
+	struct pl cmd;
+	char buf[32];
+	uint32_t cursor;
+};
+
+
 static struct {
 	struct udp_sock *us;
 	struct httpd *httpd;
+	struct list reql;
 	time_t start;
 } stg;
 
@@ -39,76 +51,120 @@ static void server_info(struct mbuf *mb)
 }
 
 
-static void httpd_handler(const struct pl *uri, struct mbuf *mb)
+static bool httpd_handler(const struct pl *uri, struct mbuf *mb,
+			  uint32_t *cursor)
 {
 	struct pl cmd, params, r;
-	uint32_t refresh = 0;
+	uint32_t refresh = 0, pos;
+	bool more;
 
 	if (re_regex(uri->p, uri->l, "/[^?]*[^]*", &cmd, &params))
-		return;
+		return false;
 
 	if (!re_regex(params.p, params.l, "[?&]1r=[0-9]+", NULL, &r))
 		refresh = pl_u32(&r);
 
-	mbuf_write_str(mb, "<html>\n<head>\n");
-	mbuf_write_str(mb, " <title>Restund Server Status</title>\n");
+	/* the command's cursor is one less, zero is the page head */
+	if (*cursor == 0) {
+
+		mbuf_write_str(mb, "<html>\n<head>\n");
+		mbuf_write_str(mb, " <title>Restund Server Status</title>\n");
+
+		if (refresh)
+			mbuf_printf(mb,
+				    " <meta http-equiv=\"refresh\""
+				    " content=\"%u\">\n", refresh);
+
+		mbuf_write_str(mb, "</head>\n<body>\n");
+		mbuf_write_str(mb, "<h2>Restund Server Status</h2>\n");
+		server_info(mb);
+		mbuf_write_str(mb, "<hr size=\"1\"/>\n<pre>\n");
+	}
+
+	pos = *cursor ? *cursor - 1 : 0;
+	more = restund_cmd_chunk(&cmd, mb, &pos);
+	*cursor = pos + 1;
 
-	if (refresh)
-		mbuf_printf(mb,
-			    " <meta http-equiv=\"refresh\" content=\"%u\">\n",
-			    refresh);
+	if (!more)
+		mbuf_write_str(mb, "</pre>\n</body>\n</html>\n");
 
-	mbuf_write_str(mb, "</head>\n<body>\n");
-	mbuf_write_str(mb, "<h2>Restund Server Status</h2>\n");
-	server_info(mb);
-	mbuf_write_str(mb, "<hr size=\"1\"/>\n<pre>\n");
-	restund_cmd(&cmd, mb);
-	mbuf_write_str(mb, "</pre>\n</body>\n</html>\n");
+	return more;
 }
 
 
-static void udp_recv(const struct sa *src, struct mbuf *mbrx, void *arg)
+static void udp_req_destructor(void *arg)
 {
-	static struct pl cmd = PL("");
-	static char buf[32];
-	bool done = false;
-	struct mbuf *mb;
+	struct udp_req *req = arg;
 
-	(void)arg;
+	list_unlink(&req->le);
+	tmr_cancel(&req->tmr);
+}
 
-	if (!re_regex((char *)mbrx->buf, mbrx->end, "[^\n]+", &cmd)) {
-		cmd.l = MIN(cmd.l, sizeof(buf));
-		memcpy(buf, cmd.p, cmd.l);
-		cmd.p = buf;
-	}
+
+/*
+ * Every chunk of the output is sent as datagrams of CHUNK_SIZE at most,
+ * and the next chunk is produced from a timer, after the main loop has
+ * handled the sockets that are ready.
+ */
+static void udp_chunk(void *arg)
+{
+	struct udp_req *req = arg;
+	struct mbuf *mb;
+	bool more;
 
 	mb = mbuf_alloc(8192);
-	if (!mb)
+	if (!mb) {
+		mem_deref(req);
 		return;
+	}
 
-	restund_cmd(&cmd, mb);
+	more = restund_cmd_chunk(&req->cmd, mb, &req->cursor);
 
 	mb->pos = 0;
 
-	while (!done) {
+	while (mbuf_get_left(mb)) {
 
 		struct mbuf mbtx;
 
 		mbtx.buf = mbuf_buf(mb);
 		mbtx.pos = 0;
-		mbtx.end = mb->buf - mbtx.buf + mb->end;
-
-		if (mbtx.end > CHUNK_SIZE)
-			mbtx.end = CHUNK_SIZE;
-		else
-			done = true;
+		mbtx.end = min(mbuf_get_left(mb), CHUNK_SIZE);
 
-		udp_send(stg.us, src, &mbtx);
+		udp_send(stg.us, &req->src, &mbtx);
 
 		mb->pos += mbtx.end;
 	}
 
-	mb = mem_deref(mb);
+	mem_deref(mb);
+
+	if (more)
+		tmr_start(&req->tmr, 0, udp_chunk, req);
+	else
+		mem_deref(req);
+}
+
+
+static void udp_recv(const struct sa *src, struct mbuf *mbrx, void *arg)
+{
+	struct udp_req *req;
+	struct pl cmd;
+
+	(void)arg;
+
+	req = mem_zalloc(sizeof(*req), udp_req_destructor);
+	if (!req)
+		return;
+
+	if (!re_regex((char *)mbrx->buf, mbrx->end, "[^\n]+", &cmd)) {
+		req->cmd.l = min(cmd.l, sizeof(req->buf));
+		memcpy(req->buf, cmd.p, req->cmd.l);
+	}
+
+	req->cmd.p = req->buf;
+	req->src   = *src;
+	list_append(&stg.reql, &req->le, req);
+
+	udp_chunk(req);
 }
 
 
@@ -176,6 +232,7 @@ static int module_init(void)
 
 static int module_close(void)
 {
+	list_flush(&stg.reql);
 	stg.us = mem_deref(stg.us);
 	stg.httpd = mem_deref(stg.httpd);
 
@@ -11,8 +11,6 @@
 
 
 enum {
-	PERM_HASH_SIZE = 16,
-	CHAN_HASH_SIZE = 16,
 	PORT_TRY_MAX = 32,
 	TCP_MAX_TXQSZ  = 8192,
 };
@@ -48,18 +46,48 @@ static const struct sa *relay_addr(const struct turnd *turnd, uint8_t af)
 }
 
 
+static struct relay_pool *relay_pool(const struct turnd *turnd, uint8_t af)
+{
+	switch (af) {
+
+	case STUN_AF_IPv4:
+		return turnd->pool;
+
+	case STUN_AF_IPv6:
+		return turnd->pool6;
+	}
+
+	return NULL;
+}
+
+
+static void alloc_stat(const struct allocation *al)
+{
+	struct turnd *turnd = turndp();
+	const uint64_t ms = tmr_jiffies() - al->start;
+
+	hist_add(&turnd->hist_lifetime, ms / 1000);
+	hist_add(&turnd->hist_bps, ms ? al->bytec * 1000 / ms : 0);
+}
+
+
 static void destructor(void *arg)
 {
 	struct allocation *al = arg;
 
-	hash_flush(al->perms);
-	mem_deref(al->perms);
-	mem_deref(al->chans);
+	alloc_stat(al);
+	permlist_flush(&al->perms);
+	chanlist_flush(&al->chans);
 	restund_debug("turn: allocation %p destroyed\n", al);
 	hash_unlink(&al->he);
 	tmr_cancel(&al->tmr);
 	mem_deref(al->username);
+	mem_deref(al->user);
 	mem_deref(al->cli_sock);
+	relay_pool_put(relay_pool(turndp(), sa_stunaf(&al->rel_addr)),
+		       al->rel_us, &al->rel_addr);
+	relay_pool_put(relay_pool(turndp(), sa_stunaf(&al->rsv_addr)),
+		       al->rsv_us, &al->rsv_addr);
 	mem_deref(al->rel_us);
 	mem_deref(al->rsv_us);
 	turndp()->allocc_cur--;
@@ -90,13 +118,18 @@ static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
 		}
 	}
 
-	perm = perm_find(al->perms, src);
+	perm = perm_find(&al->perms, src);
 	if (!perm) {
 		++al->dropc_rx;
 		return;
 	}
 
-	chan = chan_peer_find(al->chans, src);
+	if (!quota_check(al, mbuf_get_left(mb))) {
+		++turndp()->quota_dropc_rx;
+		return;
+	}
+
+	chan = chan_peer_find(&al->chans, src);
 	if (chan) {
 		uint16_t len = mbuf_get_left(mb);
 		size_t start;
@@ -138,17 +171,35 @@ static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
 		const size_t bytes = mbuf_get_left(mb);
 
 		perm_rx_stat(perm, bytes);
+		al->bytec += bytes;
 		turndp()->bytec_rx += bytes;
 	}
 }
 
 
-static int relay_listen(const struct sa *rel_addr, struct allocation *al,
+static int relay_listen(const struct sa *rel_addr, struct relay_pool *pool,
+			struct allocation *al,
 			const struct stun_even_port *even)
 {
 	uint32_t i;
 	int err = 0;
 
+	if (pool) {
+		if (even && even->r)
+			err = relay_pool_get_pair(pool, &al->rel_us,
+						  &al->rel_addr, &al->rsv_us,
+						  &al->rsv_addr);
+		else
+			err = relay_pool_get(pool, &al->rel_us,
+					     &al->rel_addr, even != NULL);
+		if (err)
+			return err;
+
+		udp_handler_set(al->rel_us, udp_recv, al);
+
+		return 0;
+	}
+
 	for (i=0; i<PORT_TRY_MAX; i++) {
 
 		err = udp_listen(&al->rel_us, rel_addr, udp_recv, al);
@@ -231,6 +282,7 @@ void allocate_request(struct turnd *turnd, struct allocation *alx,
 {
 	struct stun_attr *reqaf, *attr, *even, *rsvt;
 	struct allocation *al = NULL;
+	struct relay_pool *pool;
 	const struct sa *rel_addr;
 	uint32_t lifetime;
 	int err = 0, rerr;
@@ -258,6 +310,7 @@ void allocate_request(struct turnd *turnd, struct allocation *alx,
 	af = reqaf ? reqaf->v.req_addr_family : STUN_AF_IPv4;
 
 	rel_addr = relay_addr(turnd, af);
+	pool = relay_pool(turnd, af);
 	if (!sa_isset(rel_addr, SA_ADDR)) {
 		restund_info("turn: unsupported address family: %u\n", af);
 		rerr = stun_ereply(proto, sock, src, 0, msg,
@@ -336,44 +389,39 @@ void allocate_request(struct turnd *turnd, struct allocation *alx,
 	hash_append(turnd->ht_alloc, sa_hash(src, SA_ALL), &al->he, al);
 	tmr_start(&al->tmr, lifetime * 1000, timeout, al);
 	attr = stun_msg_attr(msg, STUN_ATTR_USERNAME);
-	al->username = mem_ref(attr ? attr->v.username : NULL);
+	if (attr)
+		(void)str_dup(&al->username, attr->v.username);
 	memcpy(al->tid, stun_msg_tid(msg), sizeof(al->tid));
 	al->cli_sock = mem_ref(sock);
 	al->cli_addr = *src;
 	al->srv_addr = *dst;
 	al->proto = proto;
+	al->start = tmr_jiffies();
 	sa_init(&al->rsv_addr, AF_UNSPEC);
+	quota_init(&al->quota, &turnd->quota_alloc);
 	turndp()->allocc_tot++;
 	turndp()->allocc_cur++;
 
-	/* Permissions */
-	err = perm_hash_alloc(&al->perms, PERM_HASH_SIZE);
-	if (err) {
-		restund_warning("turn: perm list alloc: %m\n", err);
-		rerr = stun_ereply(proto, sock, src, 0, msg,
-				   500, "Server Error",
-				   ctx->key, ctx->keylen, ctx->fp, 1,
-				   STUN_ATTR_SOFTWARE, restund_software);
-		goto out;
-	}
-
-	/* Channels */
-	err = chanlist_alloc(&al->chans, CHAN_HASH_SIZE);
-	if (err) {
-		restund_warning("turn: chan list alloc: %m\n", err);
-		rerr = stun_ereply(proto, sock, src, 0, msg,
-				   500, "Server Error",
-				   ctx->key, ctx->keylen, ctx->fp, 1,
-				   STUN_ATTR_SOFTWARE, restund_software);
-		goto out;
+	/* Quota shared by the allocations of a user */
+	if (al->username) {
+		err = quota_user_get(&al->user, al->username);
+		if (err) {
+			restund_warning("turn: user quota: %m\n", err);
+			rerr = stun_ereply(proto, sock, src, 0, msg,
+					   500, "Server Error",
+					   ctx->key, ctx->keylen, ctx->fp, 1,
+					   STUN_ATTR_SOFTWARE,
+					   restund_software);
+			goto out;
+		}
 	}
 
 	/* Relay socket */
 	if (rsvt)
 		err = rsvt_listen(turnd->ht_alloc, al, rsvt->v.rsv_token);
 	else
-		err = relay_listen(rel_addr, al, even ? &even->v.even_port :
-				   NULL);
+		err = relay_listen(rel_addr, pool, al,
+				   even ? &even->v.even_port : NULL);
 
 	if (err) {
 		restund_warning("turn: relay listen: %m\n", err);
@@ -384,8 +432,9 @@ void allocate_request(struct turnd *turnd, struct allocation *alx,
 		goto out;
 	}
 
+	/* the pool sockets are set up once */
 	udp_rxbuf_presz_set(al->rel_us, 4);
-	if (turndp()->udp_sockbuf_size > 0)
+	if (!pool && turndp()->udp_sockbuf_size > 0)
 		(void)udp_sockbuf_set(al->rel_us, turndp()->udp_sockbuf_size);
 
 	restund_debug("turn: allocation %p created %s/%J/%J - %J (%us)\n",
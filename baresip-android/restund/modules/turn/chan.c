@@ -14,18 +14,14 @@ enum {
 	CHAN_NUMB_MIN = 0x4000,
 	CHAN_NUMB_MAX = 0x7fff,
 	CHAN_LIFETIME = 600,
-};
-
-
-struct chanlist {
-	struct hash *ht_numb;
-	struct hash *ht_peer;
+	CHAN_HASH_SIZE = 16,
 };
 
 
 struct chan {
 	struct le he_numb;
 	struct le he_peer;
+	struct chanlist *cl;
 	struct sa peer;
 	const struct allocation *al;
 	time_t expires;
@@ -33,13 +29,19 @@ struct chan {
 };
 
 
-static void chanlist_destructor(void *arg)
+static void chanlist_remove(struct chanlist *cl, struct chan *chan)
 {
-	struct chanlist *cl = arg;
+	uint32_t i;
 
-	hash_flush(cl->ht_numb);
-	mem_deref(cl->ht_numb);
-	mem_deref(cl->ht_peer);
+	for (i=0; i<cl->chanc; i++) {
+
+		if (cl->chanv[i] != chan)
+			continue;
+
+		cl->chanv[i] = cl->chanv[--cl->chanc];
+		cl->chanv[cl->chanc] = NULL;
+		break;
+	}
 }
 
 
@@ -52,6 +54,9 @@ static void destructor(void *arg)
 
 	hash_unlink(&chan->he_numb);
 	hash_unlink(&chan->he_peer);
+
+	if (chan->cl)
+		chanlist_remove(chan->cl, chan);
 }
 
 
@@ -74,13 +79,26 @@ static bool hash_peer_cmp_handler(struct le *le, void *arg)
 
 struct chan *chan_numb_find(const struct chanlist *cl, uint16_t numb)
 {
-	struct chan *chan;
+	struct chan *chan = NULL;
+	uint32_t i;
 
 	if (!cl)
 		return NULL;
 
-	chan = list_ledata(hash_lookup(cl->ht_numb, numb,
-				       hash_numb_cmp_handler, &numb));
+	if (cl->ht_numb) {
+		chan = list_ledata(hash_lookup(cl->ht_numb, numb,
+					       hash_numb_cmp_handler, &numb));
+	}
+	else {
+		for (i=0; i<cl->chanc; i++) {
+
+			if (cl->chanv[i]->numb == numb) {
+				chan = cl->chanv[i];
+				break;
+			}
+		}
+	}
+
 	if (!chan)
 		return NULL;
 
@@ -97,13 +115,28 @@ struct chan *chan_numb_find(const struct chanlist *cl, uint16_t numb)
 
 struct chan *chan_peer_find(const struct chanlist *cl, const struct sa *peer)
 {
-	struct chan *chan;
+	struct chan *chan = NULL;
+	uint32_t i;
 
 	if (!cl || !peer)
 		return NULL;
 
-	chan = list_ledata(hash_lookup(cl->ht_peer, sa_hash(peer, SA_ALL),
-				       hash_peer_cmp_handler, (void *)peer));
+	if (cl->ht_peer) {
+		chan = list_ledata(hash_lookup(cl->ht_peer,
+					       sa_hash(peer, SA_ALL),
+					       hash_peer_cmp_handler,
+					       (void *)peer));
+	}
+	else {
+		for (i=0; i<cl->chanc; i++) {
+
+			if (sa_cmp(&cl->chanv[i]->peer, peer, SA_ALL)) {
+				chan = cl->chanv[i];
+				break;
+			}
+		}
+	}
+
 	if (!chan)
 		return NULL;
 
@@ -130,43 +163,62 @@ const struct sa *chan_peer(const struct chan *chan)
 }
 
 
-int chanlist_alloc(struct chanlist **clp, uint32_t bsize)
+void chanlist_flush(struct chanlist *cl)
 {
-	struct chanlist *cl;
-	int err;
+	if (!cl)
+		return;
 
-	if (!clp)
-		return EINVAL;
+	while (cl->chanc)
+		mem_deref(cl->chanv[cl->chanc - 1]);
 
-	cl = mem_zalloc(sizeof(*cl), chanlist_destructor);
-	if (!cl)
-		return ENOMEM;
+	hash_flush(cl->ht_numb);
+	cl->ht_numb = mem_deref(cl->ht_numb);
+	cl->ht_peer = mem_deref(cl->ht_peer);
+}
 
-	err = hash_alloc(&cl->ht_numb, bsize);
-	if (err)
-		goto out;
 
-	err = hash_alloc(&cl->ht_peer, bsize);
-	if (err)
-		goto out;
+/* Move the inline channels to hash tables */
+static int chanlist_spill(struct chanlist *cl)
+{
+	uint32_t i;
+	int err;
 
- out:
+	err = hash_alloc(&cl->ht_numb, CHAN_HASH_SIZE);
 	if (err)
-		cl = mem_deref(cl);
-	else
-		*clp = cl;
+		return err;
+
+	err = hash_alloc(&cl->ht_peer, CHAN_HASH_SIZE);
+	if (err) {
+		cl->ht_numb = mem_deref(cl->ht_numb);
+		return err;
+	}
+
+	for (i=0; i<cl->chanc; i++) {
+
+		struct chan *chan = cl->chanv[i];
+
+		hash_append(cl->ht_numb, chan->numb, &chan->he_numb, chan);
+		hash_append(cl->ht_peer, sa_hash(&chan->peer, SA_ALL),
+			    &chan->he_peer, chan);
+		cl->chanv[i] = NULL;
+	}
+
+	cl->chanc = 0;
 
-	return err;
+	return 0;
 }
 
 
-static bool status_handler(struct le *le, void *arg)
+static void chan_print(const struct chan *chan, struct mbuf *mb)
 {
-	struct chan *chan = le->data;
-	struct mbuf *mb = arg;
-
 	(void)mbuf_printf(mb, " (0x%x %J %is)", chan->numb, &chan->peer,
 			  chan->expires - time(NULL));
+}
+
+
+static bool status_handler(struct le *le, void *arg)
+{
+	chan_print(le->data, arg);
 
 	return false;
 }
@@ -174,10 +226,16 @@ static bool status_handler(struct le *le, void *arg)
 
 void chan_status(const struct chanlist *cl, struct mbuf *mb)
 {
+	uint32_t i;
+
 	if (!cl || !mb)
 		return;
 
 	(void)mbuf_printf(mb, "    channels:   ");
+
+	for (i=0; i<cl->chanc; i++)
+		chan_print(cl->chanv[i], mb);
+
 	(void)hash_apply(cl->ht_numb, status_handler, mb);
 	(void)mbuf_printf(mb, "\n");
 }
@@ -192,13 +250,23 @@ static struct chan *chan_create(struct chanlist *cl, uint16_t numb,
 	if (!cl || !peer)
 		return NULL;
 
+	if (!cl->ht_numb && cl->chanc == CHAN_INLINE && chanlist_spill(cl))
+		return NULL;
+
 	chan = mem_zalloc(sizeof(*chan), destructor);
 	if (!chan)
 		return NULL;
 
-	hash_append(cl->ht_numb, numb, &chan->he_numb, chan);
-	hash_append(cl->ht_peer, sa_hash(peer, SA_ALL), &chan->he_peer, chan);
+	if (cl->ht_numb) {
+		hash_append(cl->ht_numb, numb, &chan->he_numb, chan);
+		hash_append(cl->ht_peer, sa_hash(peer, SA_ALL),
+			    &chan->he_peer, chan);
+	}
+	else {
+		cl->chanv[cl->chanc++] = chan;
+	}
 
+	chan->cl = cl;
 	chan->peer = *peer;
 	chan->numb = numb;
 	chan->al = al;
@@ -259,8 +327,8 @@ void chanbind_request(struct allocation *al, struct restund_msgctx *ctx,
 		goto out;
 	}
 
-	ch_numb = chan_numb_find(al->chans, chnr->v.channel_number);
-	ch_peer = chan_peer_find(al->chans, &peer->v.xor_peer_addr);
+	ch_numb = chan_numb_find(&al->chans, chnr->v.channel_number);
+	ch_peer = chan_peer_find(&al->chans, &peer->v.xor_peer_addr);
 
 	if (ch_numb != ch_peer) {
 		restund_info("turn: channel %p/peer %p already bound\n",
@@ -273,7 +341,7 @@ void chanbind_request(struct allocation *al, struct restund_msgctx *ctx,
 	}
 
 	if (!ch_numb) {
-		chan = chan_create(al->chans, chnr->v.channel_number,
+		chan = chan_create(&al->chans, chnr->v.channel_number,
 				   &peer->v.xor_peer_addr, al);
 		if (!chan) {
 			restund_info("turn: unable to create channel\n");
@@ -285,9 +353,9 @@ void chanbind_request(struct allocation *al, struct restund_msgctx *ctx,
 		}
 	}
 
-	permx = perm_find(al->perms, &peer->v.xor_peer_addr);
+	permx = perm_find(&al->perms, &peer->v.xor_peer_addr);
 	if (!permx) {
-		perm = perm_create(al->perms, &peer->v.xor_peer_addr, al);
+		perm = perm_create(&al->perms, &peer->v.xor_peer_addr, al);
 		if (!perm) {
 			restund_info("turn: unable to create permission\n");
 			rerr = stun_ereply(proto, sock, src, 0, msg,
@@ -0,0 +1,57 @@
+/**
+ * @file hist.c Turn Server Histograms
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <re.h>
+#include <restund.h>
+#include "turn.h"
+
+
+/**
+ * Count a value in a histogram, the last bucket counts all values that
+ * are too large for the others
+ *
+ * @param h   Histogram
+ * @param val Value
+ */
+void hist_add(struct hist *h, uint64_t val)
+{
+	uint32_t n = 0;
+
+	if (!h)
+		return;
+
+	while (val && n < HIST_SIZE - 1) {
+		val >>= 1;
+		++n;
+	}
+
+	++h->v[n];
+}
+
+
+/**
+ * Print a histogram on one line, as the lower bound of every bucket
+ * and its count
+ *
+ * @param mb   Buffer to print to
+ * @param name Name of the histogram
+ * @param h    Histogram
+ */
+void hist_print(struct mbuf *mb, const char *name, const struct hist *h)
+{
+	uint32_t n;
+
+	if (!mb || !name || !h)
+		return;
+
+	(void)mbuf_printf(mb, "%s", name);
+
+	for (n=0; n<HIST_SIZE; n++)
+		(void)mbuf_printf(mb, " %llu:%llu",
+				  n ? 1ULL << (n - 1) : 0ULL, h->v[n]);
+
+	(void)mbuf_write_str(mb, "\n");
+}
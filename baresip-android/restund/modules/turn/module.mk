@@ -7,7 +7,10 @@
 MOD		:= turn
 $(MOD)_SRCS	+= alloc.c
 $(MOD)_SRCS	+= chan.c
+$(MOD)_SRCS	+= hist.c
 $(MOD)_SRCS	+= perm.c
+$(MOD)_SRCS	+= pool.c
+$(MOD)_SRCS	+= quota.c
 $(MOD)_SRCS	+= turn.c
 $(MOD)_LFLAGS	+=
 
@@ -12,11 +12,14 @@
 
 enum {
 	PERM_LIFETIME = 300,
+	PERM_HASH_SIZE = 16,
 };
 
 
 struct perm {
 	struct le he;
+	struct le le;
+	struct permlist *pl;
 	struct sa peer;
 	struct restund_trafstat ts;
 	const struct allocation *al;
@@ -33,12 +36,35 @@ struct createperm {
 };
 
 
+static void permlist_remove(struct permlist *pl, struct perm *perm)
+{
+	uint32_t i;
+
+	if (perm->he.list) {
+		hash_unlink(&perm->he);
+		return;
+	}
+
+	for (i=0; i<pl->permc; i++) {
+
+		if (pl->permv[i] != perm)
+			continue;
+
+		pl->permv[i] = pl->permv[--pl->permc];
+		pl->permv[pl->permc] = NULL;
+		break;
+	}
+}
+
+
 static void destructor(void *arg)
 {
 	struct perm *perm = arg;
 	int err;
 
-	hash_unlink(&perm->he);
+	if (perm->pl)
+		permlist_remove(perm->pl, perm);
+	list_unlink(&perm->le);
 
 	restund_debug("turn: allocation %p permission %j destroyed "
 		      "(%llu/%llu %llu/%llu)\n",
@@ -66,15 +92,30 @@ static bool hash_cmp_handler(struct le *le, void *arg)
 }
 
 
-struct perm *perm_find(const struct hash *ht, const struct sa *peer)
+struct perm *perm_find(const struct permlist *pl, const struct sa *peer)
 {
-	struct perm *perm;
+	struct perm *perm = NULL;
+	uint32_t i;
 
-	if (!ht || !peer)
+	if (!pl || !peer)
 		return NULL;
 
-	perm = list_ledata(hash_lookup(ht, sa_hash(peer, SA_ADDR),
-				       hash_cmp_handler, (void *)peer));
+	if (pl->ht) {
+		perm = list_ledata(hash_lookup(pl->ht,
+					       sa_hash(peer, SA_ADDR),
+					       hash_cmp_handler,
+					       (void *)peer));
+	}
+	else {
+		for (i=0; i<pl->permc; i++) {
+
+			if (sa_cmp(&pl->permv[i]->peer, peer, SA_ADDR)) {
+				perm = pl->permv[i];
+				break;
+			}
+		}
+	}
+
 	if (!perm)
 		return NULL;
 
@@ -89,21 +130,53 @@ struct perm *perm_find(const struct hash *ht, const struct sa *peer)
 }
 
 
-struct perm *perm_create(struct hash *ht, const struct sa *peer,
+/* Move the inline permissions to a hash table */
+static int permlist_spill(struct permlist *pl)
+{
+	uint32_t i;
+	int err;
+
+	err = hash_alloc(&pl->ht, PERM_HASH_SIZE);
+	if (err)
+		return err;
+
+	for (i=0; i<pl->permc; i++) {
+
+		struct perm *perm = pl->permv[i];
+
+		hash_append(pl->ht, sa_hash(&perm->peer, SA_ADDR),
+			    &perm->he, perm);
+		pl->permv[i] = NULL;
+	}
+
+	pl->permc = 0;
+
+	return 0;
+}
+
+
+struct perm *perm_create(struct permlist *pl, const struct sa *peer,
 			 const struct allocation *al)
 {
 	const time_t now = time(NULL);
 	struct perm *perm;
 
-	if (!ht || !peer || !al)
+	if (!pl || !peer || !al)
+		return NULL;
+
+	if (!pl->ht && pl->permc == PERM_INLINE && permlist_spill(pl))
 		return NULL;
 
 	perm = mem_zalloc(sizeof(*perm), destructor);
 	if (!perm)
 		return NULL;
 
-	hash_append(ht, sa_hash(peer, SA_ADDR), &perm->he, perm);
+	if (pl->ht)
+		hash_append(pl->ht, sa_hash(peer, SA_ADDR), &perm->he, perm);
+	else
+		pl->permv[pl->permc++] = perm;
 
+	perm->pl = pl;
 	perm->peer = *peer;
 	perm->al = al;
 	perm->expires = now + PERM_LIFETIME;
@@ -146,32 +219,48 @@ void perm_rx_stat(struct perm *perm, size_t bytc)
 }
 
 
-int perm_hash_alloc(struct hash **ht, uint32_t bsize)
+void permlist_flush(struct permlist *pl)
 {
-	return hash_alloc(ht, bsize);
+	if (!pl)
+		return;
+
+	while (pl->permc)
+		mem_deref(pl->permv[pl->permc - 1]);
+
+	hash_flush(pl->ht);
+	pl->ht = mem_deref(pl->ht);
 }
 
 
-static bool status_handler(struct le *le, void *arg)
+static void perm_print(const struct perm *perm, struct mbuf *mb)
 {
-	struct perm *perm = le->data;
-	struct mbuf *mb = arg;
-
 	(void)mbuf_printf(mb, " (%j %is relay %llu/%llu)", &perm->peer,
 			  perm->expires - time(NULL),
 			  perm->ts.pktc_tx, perm->ts.pktc_rx);
+}
+
+
+static bool status_handler(struct le *le, void *arg)
+{
+	perm_print(le->data, arg);
 
 	return false;
 }
 
 
-void perm_status(struct hash *ht, struct mbuf *mb)
+void perm_status(const struct permlist *pl, struct mbuf *mb)
 {
-	if (!ht || !mb)
+	uint32_t i;
+
+	if (!pl || !mb)
 		return;
 
 	(void)mbuf_printf(mb, "    permissions:");
-	(void)hash_apply(ht, status_handler, mb);
+
+	for (i=0; i<pl->permc; i++)
+		perm_print(pl->permv[i], mb);
+
+	(void)hash_apply(pl->ht, status_handler, mb);
 	(void)mbuf_printf(mb, "\n");
 }
 
@@ -189,9 +278,9 @@ static bool attrib_handler(const struct stun_attr *attr, void *arg)
 		return true;
 	}
 
-	perm = perm_find(cp->al->perms, &attr->v.xor_peer_addr);
+	perm = perm_find(&cp->al->perms, &attr->v.xor_peer_addr);
 	if (!perm) {
-		perm = perm_create(cp->al->perms, &attr->v.xor_peer_addr,
+		perm = perm_create(&cp->al->perms, &attr->v.xor_peer_addr,
 				   cp->al);
 		if (!perm)
 			return true;
@@ -199,8 +288,9 @@ static bool attrib_handler(const struct stun_attr *attr, void *arg)
 		perm->new = true;
 	}
 
-	hash_unlink(&perm->he);
-	list_append(&cp->perml, &perm->he, perm);
+	/* the same peer may be listed twice */
+	if (!perm->le.list)
+		list_append(&cp->perml, &perm->le, perm);
 
 	return false;
 }
@@ -209,15 +299,12 @@ static bool attrib_handler(const struct stun_attr *attr, void *arg)
 static bool rollback_handler(struct le *le, void *arg)
 {
 	struct perm *perm = le->data;
-	struct allocation *al = arg;
+	(void)arg;
 
-	list_unlink(&perm->he);
+	list_unlink(&perm->le);
 
 	if (perm->new)
 		mem_deref(perm);
-	else
-		hash_append(al->perms, sa_hash(&perm->peer, SA_ADDR),
-			    &perm->he, perm);
 
 	return false;
 }
@@ -226,10 +313,9 @@ static bool rollback_handler(struct le *le, void *arg)
 static bool commit_handler(struct le *le, void *arg)
 {
 	struct perm *perm = le->data;
-	struct allocation *al = arg;
+	(void)arg;
 
-	list_unlink(&perm->he);
-	hash_append(al->perms, sa_hash(&perm->peer, SA_ADDR), &perm->he, perm);
+	list_unlink(&perm->le);
 
 	if (perm->new)
 		perm->new = false;
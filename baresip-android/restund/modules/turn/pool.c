@@ -0,0 +1,268 @@
+/**
+ * @file pool.c Turn Server Relay Port Pool
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <re.h>
+#include <restund.h>
+#include "turn.h"
+
+
+/*
+ * The relay sockets are bound once, over a configured port range, and
+ * handed out to the allocations. Free ports are kept on two lists, by
+ * the parity of the port, so that both any port and an even port are
+ * found in constant time. Released ports go to the end of the lists, so
+ * that a port is not reused sooner than it has to be.
+ */
+
+
+enum {
+	PAIR_TRY_MAX = 32,
+};
+
+
+struct relay_port {
+	struct le le;
+	struct udp_sock *us;
+	bool used;
+};
+
+struct relay_pool {
+	struct relay_port *portv;
+	struct list freel[2];     /**< Free ports, even and odd     */
+	struct sa addr;
+	uint16_t min;
+	uint32_t portc;
+	uint32_t freec;
+};
+
+
+static void destructor(void *arg)
+{
+	struct relay_pool *pool = arg;
+	uint32_t i;
+
+	for (i=0; i<pool->portc; i++)
+		mem_deref(pool->portv[i].us);
+
+	mem_deref(pool->portv);
+}
+
+
+static uint16_t port_numb(const struct relay_pool *pool,
+			  const struct relay_port *port)
+{
+	return pool->min + (uint16_t)(port - pool->portv);
+}
+
+
+static void port_take(struct relay_pool *pool, struct relay_port *port,
+		      struct udp_sock **usp, struct sa *addr)
+{
+	list_unlink(&port->le);
+	port->used = true;
+	--pool->freec;
+
+	*usp  = mem_ref(port->us);
+	*addr = pool->addr;
+	sa_set_port(addr, port_numb(pool, port));
+}
+
+
+/**
+ * Allocate a relay port pool, and bind all ports in the range
+ *
+ * @param poolp       Pointer to allocated relay port pool
+ * @param addr        Relay address
+ * @param min         First port of the range
+ * @param max         Last port of the range
+ * @param sockbuf_size Socket buffer size, 0 for the system default
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int relay_pool_alloc(struct relay_pool **poolp, const struct sa *addr,
+		     uint16_t min, uint16_t max, uint32_t sockbuf_size)
+{
+	struct relay_pool *pool;
+	uint32_t i;
+	int err = 0;
+
+	if (!poolp || !addr || !min || min > max)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), destructor);
+	if (!pool)
+		return ENOMEM;
+
+	pool->addr  = *addr;
+	pool->min   = min;
+	pool->portc = max - min + 1;
+
+	pool->portv = mem_zalloc(pool->portc * sizeof(*pool->portv), NULL);
+	if (!pool->portv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<pool->portc; i++) {
+
+		struct relay_port *port = &pool->portv[i];
+		struct sa laddr = *addr;
+
+		sa_set_port(&laddr, min + i);
+
+		err = udp_listen(&port->us, &laddr, NULL, NULL);
+		if (err == EADDRINUSE) {
+			restund_debug("turn: pool: port %u in use\n", min + i);
+			continue;
+		}
+		else if (err) {
+			restund_warning("turn: pool: port %u: %m\n",
+					min + i, err);
+			break;
+		}
+
+		udp_rxbuf_presz_set(port->us, 4);
+		if (sockbuf_size > 0)
+			(void)udp_sockbuf_set(port->us, sockbuf_size);
+
+		list_append(&pool->freel[(min + i) & 1], &port->le, port);
+		++pool->freec;
+	}
+
+	err = pool->freec ? 0 : EADDRINUSE;
+
+	restund_info("turn: relay pool %j ports %u-%u (%u bound)\n",
+		     addr, min, max, pool->freec);
+
+ out:
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Get a relay socket from the pool
+ *
+ * @param pool Relay port pool
+ * @param usp  Pointer to the relay socket, referenced
+ * @param addr Returned relay address
+ * @param even True for an even port
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int relay_pool_get(struct relay_pool *pool, struct udp_sock **usp,
+		   struct sa *addr, bool even)
+{
+	struct relay_port *port;
+
+	if (!pool || !usp || !addr)
+		return EINVAL;
+
+	/* even ports are kept for the requests that need them */
+	port = list_ledata(list_head(&pool->freel[1]));
+	if (even || !port)
+		port = list_ledata(list_head(&pool->freel[0]));
+
+	if (!port)
+		return EADDRINUSE;
+
+	port_take(pool, port, usp, addr);
+
+	return 0;
+}
+
+
+/**
+ * Get a relay socket on an even port from the pool, and reserve the
+ * next port
+ *
+ * @param pool     Relay port pool
+ * @param usp      Pointer to the relay socket, referenced
+ * @param addr     Returned relay address
+ * @param rsvp     Pointer to the reserved socket, referenced
+ * @param rsv_addr Returned reserved address
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int relay_pool_get_pair(struct relay_pool *pool, struct udp_sock **usp,
+			struct sa *addr, struct udp_sock **rsvp,
+			struct sa *rsv_addr)
+{
+	struct le *le;
+	uint32_t i;
+
+	if (!pool || !usp || !addr || !rsvp || !rsv_addr)
+		return EINVAL;
+
+	le = list_head(&pool->freel[0]);
+
+	for (i=0; le && i<PAIR_TRY_MAX; i++, le=le->next) {
+
+		struct relay_port *port = le->data;
+		struct relay_port *next = port + 1;
+
+		if (next >= pool->portv + pool->portc)
+			continue;
+
+		if (!next->us || next->used)
+			continue;
+
+		port_take(pool, port, usp, addr);
+		port_take(pool, next, rsvp, rsv_addr);
+
+		return 0;
+	}
+
+	return EADDRINUSE;
+}
+
+
+/**
+ * Return a relay socket to the pool. Sockets that are not from the pool
+ * are ignored. The caller still holds its reference to the socket.
+ *
+ * @param pool Relay port pool
+ * @param us   Relay socket
+ * @param addr Relay address
+ */
+void relay_pool_put(struct relay_pool *pool, struct udp_sock *us,
+		    const struct sa *addr)
+{
+	struct relay_port *port;
+	uint16_t numb;
+
+	if (!pool || !us || !addr)
+		return;
+
+	numb = sa_port(addr);
+	if (numb < pool->min || (uint32_t)(numb - pool->min) >= pool->portc)
+		return;
+
+	port = &pool->portv[numb - pool->min];
+	if (port->us != us || !port->used)
+		return;
+
+	udp_handler_set(us, NULL, NULL);
+
+	port->used = false;
+	list_append(&pool->freel[numb & 1], &port->le, port);
+	++pool->freec;
+}
+
+
+void relay_pool_status(const struct relay_pool *pool, struct mbuf *mb)
+{
+	if (!pool || !mb)
+		return;
+
+	(void)mbuf_printf(mb, "pool %j ports %u-%u free %u\n", &pool->addr,
+			  pool->min, pool->min + pool->portc - 1,
+			  pool->freec);
+}
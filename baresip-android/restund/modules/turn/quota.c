@@ -0,0 +1,261 @@
+/**
+ * @file quota.c Turn Server Bandwidth and Packet Rate Quotas
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <string.h>
+#include <re.h>
+#include <restund.h>
+#include "turn.h"
+
+
+/*
+ * Relayed traffic is limited by token buckets, one for bytes and one for
+ * packets, per allocation and per user. The tokens are kept in units of
+ * 1/1000 byte or packet, so that a bucket is refilled with the rate per
+ * second for every millisecond, without a division. A bucket holds the
+ * tokens of QUOTA_BURST_MS at most.
+ */
+
+
+enum {
+	USER_HASH_SIZE = 256,
+	QUOTA_BURST_MS = 500,
+};
+
+
+struct turn_user {
+	struct le he;
+	struct quota quota;
+	uint64_t dropc;
+	char *name;
+};
+
+
+static void user_destructor(void *arg)
+{
+	struct turn_user *user = arg;
+
+	hash_unlink(&user->he);
+	mem_deref(user->name);
+}
+
+
+static bool user_cmp_handler(struct le *le, void *arg)
+{
+	const struct turn_user *user = le->data;
+
+	return !strcmp(user->name, arg);
+}
+
+
+static void bucket_refill(struct tbucket *b, uint32_t rate, uint64_t now)
+{
+	const uint64_t cap = (uint64_t)rate * QUOTA_BURST_MS;
+
+	b->tokens += (now - b->last) * rate;
+	b->last = now;
+
+	if (b->tokens > cap)
+		b->tokens = cap;
+}
+
+
+static bool quota_take(struct quota *q, const struct quota_conf *conf,
+		       uint64_t now, size_t bytes)
+{
+	const uint64_t cost = (uint64_t)bytes * 1000;
+
+	if (conf->bps)
+		bucket_refill(&q->bytes, conf->bps, now);
+
+	if (conf->pps)
+		bucket_refill(&q->pkts, conf->pps, now);
+
+	if (conf->bps && q->bytes.tokens < cost)
+		return false;
+
+	if (conf->pps && q->pkts.tokens < 1000)
+		return false;
+
+	if (conf->bps)
+		q->bytes.tokens -= cost;
+
+	if (conf->pps)
+		q->pkts.tokens -= 1000;
+
+	return true;
+}
+
+
+static void quota_give(struct quota *q, const struct quota_conf *conf,
+		       size_t bytes)
+{
+	if (conf->bps)
+		q->bytes.tokens += (uint64_t)bytes * 1000;
+
+	if (conf->pps)
+		q->pkts.tokens += 1000;
+}
+
+
+/**
+ * Initialize a quota, with full buckets
+ *
+ * @param q    Quota
+ * @param conf Quota configuration
+ */
+void quota_init(struct quota *q, const struct quota_conf *conf)
+{
+	const uint64_t now = tmr_jiffies();
+
+	if (!q || !conf)
+		return;
+
+	q->bytes.tokens = (uint64_t)conf->bps * QUOTA_BURST_MS;
+	q->bytes.last   = now;
+	q->pkts.tokens  = (uint64_t)conf->pps * QUOTA_BURST_MS;
+	q->pkts.last    = now;
+}
+
+
+/**
+ * Check a relayed packet against the quotas of the allocation and its
+ * user, and take its tokens
+ *
+ * @param al    Allocation
+ * @param bytes Size of the packet
+ *
+ * @return true if the packet may be relayed, false to drop it
+ */
+bool quota_check(struct allocation *al, size_t bytes)
+{
+	const struct turnd *turnd = turndp();
+	uint64_t now;
+
+	if (!turnd->quota_alloc.bps && !turnd->quota_alloc.pps &&
+	    !al->user)
+		return true;
+
+	now = tmr_jiffies();
+
+	if (!quota_take(&al->quota, &turnd->quota_alloc, now, bytes))
+		goto drop;
+
+	if (al->user && !quota_take(&al->user->quota, &turnd->quota_user,
+				    now, bytes)) {
+		quota_give(&al->quota, &turnd->quota_alloc, bytes);
+		++al->user->dropc;
+		goto drop;
+	}
+
+	return true;
+
+ drop:
+	++al->quota_dropc;
+
+	return false;
+}
+
+
+/**
+ * Get the quota state of a user, shared by all allocations of the user
+ *
+ * @param userp Pointer to the user, referenced
+ * @param name  Username
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int quota_user_get(struct turn_user **userp, const char *name)
+{
+	struct turnd *turnd = turndp();
+	struct turn_user *user;
+	int err;
+
+	if (!userp || !name)
+		return EINVAL;
+
+	if (!turnd->ht_user)
+		return 0;
+
+	user = list_ledata(hash_lookup(turnd->ht_user, hash_joaat_str(name),
+				       user_cmp_handler, (void *)name));
+	if (user) {
+		*userp = mem_ref(user);
+		return 0;
+	}
+
+	user = mem_zalloc(sizeof(*user), user_destructor);
+	if (!user)
+		return ENOMEM;
+
+	err = str_dup(&user->name, name);
+	if (err) {
+		mem_deref(user);
+		return err;
+	}
+
+	quota_init(&user->quota, &turnd->quota_user);
+	hash_append(turnd->ht_user, hash_joaat_str(name), &user->he, user);
+
+	*userp = user;
+
+	return 0;
+}
+
+
+/**
+ * Initialize the quotas from the configuration
+ *
+ * @param turnd TURN server
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int quota_init_conf(struct turnd *turnd)
+{
+	struct conf *conf = restund_conf();
+
+	(void)conf_get_u32(conf, "turn_max_alloc_bps",
+			   &turnd->quota_alloc.bps);
+	(void)conf_get_u32(conf, "turn_max_alloc_pps",
+			   &turnd->quota_alloc.pps);
+	(void)conf_get_u32(conf, "turn_max_user_bps",
+			   &turnd->quota_user.bps);
+	(void)conf_get_u32(conf, "turn_max_user_pps",
+			   &turnd->quota_user.pps);
+
+	restund_debug("turn: quota alloc=%u/%u user=%u/%u (bytes/pkts)\n",
+		      turnd->quota_alloc.bps, turnd->quota_alloc.pps,
+		      turnd->quota_user.bps, turnd->quota_user.pps);
+
+	if (!turnd->quota_user.bps && !turnd->quota_user.pps)
+		return 0;
+
+	return hash_alloc(&turnd->ht_user, USER_HASH_SIZE);
+}
+
+
+static bool user_status(struct le *le, void *arg)
+{
+	const struct turn_user *user = le->data;
+	struct mbuf *mb = arg;
+
+	(void)mbuf_printf(mb, "- \"%s\" %u allocations (quota drop %llu)\n",
+			  user->name, mem_nrefs(user), user->dropc);
+
+	return false;
+}
+
+
+void quota_status(const struct turnd *turnd, struct mbuf *mb)
+{
+	if (!turnd || !mb)
+		return;
+
+	(void)mbuf_printf(mb, "quota alloc %u bytes/s %u pkts/s,"
+			  " user %u bytes/s %u pkts/s\n",
+			  turnd->quota_alloc.bps, turnd->quota_alloc.pps,
+			  turnd->quota_user.bps, turnd->quota_user.pps);
+	(void)hash_apply(turnd->ht_user, user_status, mb);
+}
@@ -12,6 +12,7 @@
 
 enum {
 	ALLOC_DEFAULT_BSIZE = 512,
+	STATUS_CHUNK_ALLOCS = 32,
 };
 
 
@@ -173,12 +174,17 @@ static bool indication_handler(struct restund_msgctx *ctx, int proto,
 	if (!peer || !data)
 		return true;
 
-	perm = perm_find(al->perms, &peer->v.xor_peer_addr);
+	perm = perm_find(&al->perms, &peer->v.xor_peer_addr);
 	if (!perm) {
 		++al->dropc_tx;
 		return true;
 	}
 
+	if (!quota_check(al, mbuf_get_left(&data->v.data))) {
+		++turnd.quota_dropc_tx;
+		return true;
+	}
+
 	err = udp_send(al->rel_us, &peer->v.xor_peer_addr, &data->v.data);
 	if (err)
 		turnd.errc_tx++;
@@ -186,6 +192,7 @@ static bool indication_handler(struct restund_msgctx *ctx, int proto,
 		const size_t bytes = mbuf_get_left(&data->v.data);
 
 		perm_tx_stat(perm, bytes);
+		al->bytec += bytes;
 		turnd.bytec_tx += bytes;
 	}
 
@@ -215,16 +222,21 @@ static bool raw_handler(int proto, const struct sa *src,
 	if (mbuf_get_left(mb) < len)
 		return false;
 
-	chan = chan_numb_find(al->chans, numb);
+	chan = chan_numb_find(&al->chans, numb);
 	if (!chan)
 		return false;
 
-	perm = perm_find(al->perms, chan_peer(chan));
+	perm = perm_find(&al->perms, chan_peer(chan));
 	if (!perm) {
 		++al->dropc_tx;
 		return false;
 	}
 
+	if (!quota_check(al, len)) {
+		++turnd.quota_dropc_tx;
+		return true;
+	}
+
 	mb->end = mb->pos + len;
 
 	err = udp_send(al->rel_us, chan_peer(chan), mb);
@@ -234,6 +246,7 @@ static bool raw_handler(int proto, const struct sa *src,
 		const size_t bytes = mbuf_get_left(mb);
 
 		perm_tx_stat(perm, bytes);
+		al->bytec += bytes;
 		turnd.bytec_tx += bytes;
 	}
 
@@ -248,26 +261,52 @@ static bool allocation_status(struct le *le, void *arg)
 	struct mbuf *mb = arg;
 
 	(void)mbuf_printf(mb,
-			  "- %04u %s/%J/%J - %J \"%s\" %us (drop %llu/%llu)\n",
+			  "- %04u %s/%J/%J - %J \"%s\" %us (drop %llu/%llu"
+			  " quota %llu)\n",
 			  sa_hash(&al->cli_addr, SA_ALL) & (bsize - 1),
 			  stun_transp_name(al->proto), &al->cli_addr,
 			  &al->srv_addr, &al->rel_addr, al->username,
 			  (uint32_t)tmr_get_expire(&al->tmr) / 1000,
-			  al->dropc_tx, al->dropc_rx);
+			  al->dropc_tx, al->dropc_rx, al->quota_dropc);
 
-	perm_status(al->perms, mb);
-	chan_status(al->chans, mb);
+	perm_status(&al->perms, mb);
+	chan_status(&al->chans, mb);
 
 	return false;
 }
 
 
-static void status_handler(struct mbuf *mb)
+/*
+ * The allocations are printed a number of hash buckets at a time, and
+ * the cursor is the index of the next bucket. Allocations that are
+ * created or deleted in between chunks do not invalidate it.
+ */
+static bool status_chunk(struct mbuf *mb, uint32_t *cursor)
 {
-	(void)mbuf_printf(mb, "TURN relay=%j relay6=%j (err %llu/%llu)\n",
-			  &turnd.rel_addr, &turnd.rel_addr6,
-			  turnd.errc_tx, turnd.errc_rx);
-	(void)hash_apply(turnd.ht_alloc, allocation_status, mb);
+	const uint32_t bsize = hash_bsize(turnd.ht_alloc);
+	uint32_t n = 0;
+
+	if (*cursor == 0) {
+		(void)mbuf_printf(mb, "TURN relay=%j relay6=%j"
+				  " (err %llu/%llu)\n",
+				  &turnd.rel_addr, &turnd.rel_addr6,
+				  turnd.errc_tx, turnd.errc_rx);
+		relay_pool_status(turnd.pool, mb);
+		relay_pool_status(turnd.pool6, mb);
+		quota_status(&turnd, mb);
+	}
+
+	while (*cursor < bsize && n < STATUS_CHUNK_ALLOCS) {
+
+		struct le *le = list_head(hash_list(turnd.ht_alloc, *cursor));
+
+		for (; le; le = le->next, ++n)
+			(void)allocation_status(le, mb);
+
+		++*cursor;
+	}
+
+	return *cursor < bsize;
 }
 
 
@@ -279,6 +318,10 @@ static void stats_handler(struct mbuf *mb)
 	(void)mbuf_printf(mb, "bytes_rx %llu\n", turnd.bytec_rx);
 	(void)mbuf_printf(mb, "bytes_tot %llu\n",
 			  turnd.bytec_tx + turnd.bytec_rx);
+	(void)mbuf_printf(mb, "quota_drops_tx %llu\n", turnd.quota_dropc_tx);
+	(void)mbuf_printf(mb, "quota_drops_rx %llu\n", turnd.quota_dropc_rx);
+	hist_print(mb, "alloc_lifetime_s", &turnd.hist_lifetime);
+	hist_print(mb, "alloc_bytes_per_s", &turnd.hist_bps);
 }
 
 
@@ -290,8 +333,8 @@ static struct restund_stun stun = {
 
 
 static struct restund_cmdsub cmd_turn = {
-	.cmdh = status_handler,
-	.cmd  = "turn",
+	.cmd    = "turn",
+	.chunkh = status_chunk,
 };
 
 
@@ -304,6 +347,7 @@ static struct restund_cmdsub cmd_turnstats = {
 static int module_init(void)
 {
 	uint32_t x, bsize = ALLOC_DEFAULT_BSIZE;
+	uint32_t port_min = 0, port_max = 0;
 	struct pl opt;
 	int err = 0;
 
@@ -356,6 +400,43 @@ static int module_init(void)
 		goto out;
 	}
 
+	err = quota_init_conf(&turnd);
+	if (err) {
+		restund_error("turn: quota: %m\n", err);
+		goto out;
+	}
+
+	/* turn_relay_port_min, turn_relay_port_max */
+	conf_get_u32(restund_conf(), "turn_relay_port_min", &port_min);
+	conf_get_u32(restund_conf(), "turn_relay_port_max", &port_max);
+
+	if (port_min && (port_min > port_max || port_max > 65535)) {
+		restund_error("turn: bad relay port range %u-%u\n",
+			      port_min, port_max);
+		err = EINVAL;
+		goto out;
+	}
+
+	if (port_min && sa_isset(&turnd.rel_addr, SA_ADDR)) {
+		err = relay_pool_alloc(&turnd.pool, &turnd.rel_addr,
+				       port_min, port_max,
+				       turnd.udp_sockbuf_size);
+		if (err) {
+			restund_error("turn: relay pool: %m\n", err);
+			goto out;
+		}
+	}
+
+	if (port_min && sa_isset(&turnd.rel_addr6, SA_ADDR)) {
+		err = relay_pool_alloc(&turnd.pool6, &turnd.rel_addr6,
+				       port_min, port_max,
+				       turnd.udp_sockbuf_size);
+		if (err) {
+			restund_error("turn: relay pool6: %m\n", err);
+			goto out;
+		}
+	}
+
 	restund_debug("turn: lifetime=%u ext=%j ext6=%j bsz=%u\n",
 		      turnd.lifetime_max, &turnd.rel_addr, &turnd.rel_addr6,
 		      bsize);
@@ -369,6 +450,9 @@ static int module_close(void)
 {
 	hash_flush(turnd.ht_alloc);
 	turnd.ht_alloc = mem_deref(turnd.ht_alloc);
+	turnd.ht_user = mem_deref(turnd.ht_user);
+	turnd.pool = mem_deref(turnd.pool);
+	turnd.pool6 = mem_deref(turnd.pool6);
 	restund_cmd_unsubscribe(&cmd_turnstats);
 	restund_cmd_unsubscribe(&cmd_turn);
 	restund_stun_unregister_handler(&stun);
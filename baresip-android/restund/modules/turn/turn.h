@@ -4,21 +4,78 @@
  * Copyright (C) 2010 Creytiv.com
  */
 
+enum {
+	PERM_INLINE = 4,
+	CHAN_INLINE = 4,
+	HIST_SIZE   = 24,
+};
+
+struct relay_pool;
+
+/** Token bucket, in 1/1000 units */
+struct tbucket {
+	uint64_t tokens;
+	uint64_t last;
+};
+
+/** Bandwidth and packet rate quota */
+struct quota {
+	struct tbucket bytes;
+	struct tbucket pkts;
+};
+
+/** Histogram, bucket n > 0 counts the values from 2^(n-1) to 2^n - 1 */
+struct hist {
+	uint64_t v[HIST_SIZE];
+};
+
+/** Quota configuration, 0 is unlimited */
+struct quota_conf {
+	uint32_t bps;   /**< Bytes per second   */
+	uint32_t pps;   /**< Packets per second */
+};
+
 struct turnd {
 	struct sa rel_addr;
 	struct sa rel_addr6;
+	struct relay_pool *pool;
+	struct relay_pool *pool6;
 	struct hash *ht_alloc;
+	struct hash *ht_user;
+	struct quota_conf quota_alloc;
+	struct quota_conf quota_user;
+	struct hist hist_lifetime;  /**< Allocation lifetime [s]       */
+	struct hist hist_bps;       /**< Allocation throughput [B/s]   */
 	uint64_t bytec_tx;
 	uint64_t bytec_rx;
 	uint64_t errc_tx;
 	uint64_t errc_rx;
+	uint64_t quota_dropc_tx;
+	uint64_t quota_dropc_rx;
 	uint64_t allocc_tot;
 	uint32_t allocc_cur;
 	uint32_t lifetime_max;
 	uint32_t udp_sockbuf_size;
 };
 
-struct chanlist;
+struct perm;
+struct chan;
+struct turn_user;
+
+/** Permissions, inline until there are more than PERM_INLINE */
+struct permlist {
+	struct perm *permv[PERM_INLINE];
+	uint32_t permc;
+	struct hash *ht;
+};
+
+/** Channels, inline until there are more than CHAN_INLINE */
+struct chanlist {
+	struct chan *chanv[CHAN_INLINE];
+	uint32_t chanc;
+	struct hash *ht_numb;
+	struct hash *ht_peer;
+};
 
 struct allocation {
 	struct le he;
@@ -32,10 +89,15 @@ struct allocation {
 	struct udp_sock *rel_us;
 	struct udp_sock *rsv_us;
 	char *username;
-	struct hash *perms;
-	struct chanlist *chans;
+	struct turn_user *user;
+	struct permlist perms;
+	struct chanlist chans;
+	struct quota quota;
+	uint64_t start;
+	uint64_t bytec;
 	uint64_t dropc_tx;
 	uint64_t dropc_rx;
+	uint64_t quota_dropc;
 	int proto;
 };
 
@@ -56,23 +118,42 @@ void chanbind_request(struct allocation *al, struct restund_msgctx *ctx,
 struct turnd *turndp(void);
 
 
-struct perm;
-
-struct perm *perm_find(const struct hash *ht, const struct sa *addr);
-struct perm *perm_create(struct hash *ht, const struct sa *peer,
+struct perm *perm_find(const struct permlist *pl, const struct sa *addr);
+struct perm *perm_create(struct permlist *pl, const struct sa *peer,
 			 const struct allocation *al);
 void perm_refresh(struct perm *perm);
 void perm_tx_stat(struct perm *perm, size_t bytc);
 void perm_rx_stat(struct perm *perm, size_t bytc);
-int  perm_hash_alloc(struct hash **ht, uint32_t bsize);
-void perm_status(struct hash *ht, struct mbuf *mb);
-
+void permlist_flush(struct permlist *pl);
+void perm_status(const struct permlist *pl, struct mbuf *mb);
 
-struct chan;
 
 struct chan *chan_numb_find(const struct chanlist *cl, uint16_t numb);
 struct chan *chan_peer_find(const struct chanlist *cl, const struct sa *peer);
 uint16_t chan_numb(const struct chan *chan);
 const struct sa *chan_peer(const struct chan *chan);
-int  chanlist_alloc(struct chanlist **clp, uint32_t bsize);
+void chanlist_flush(struct chanlist *cl);
 void chan_status(const struct chanlist *cl, struct mbuf *mb);
+
+
+int  relay_pool_alloc(struct relay_pool **poolp, const struct sa *addr,
+		      uint16_t min, uint16_t max, uint32_t sockbuf_size);
+int  relay_pool_get(struct relay_pool *pool, struct udp_sock **usp,
+		    struct sa *addr, bool even);
+int  relay_pool_get_pair(struct relay_pool *pool, struct udp_sock **usp,
+			 struct sa *addr, struct udp_sock **rsvp,
+			 struct sa *rsv_addr);
+void relay_pool_put(struct relay_pool *pool, struct udp_sock *us,
+		    const struct sa *addr);
+void relay_pool_status(const struct relay_pool *pool, struct mbuf *mb);
+
+
+void hist_add(struct hist *h, uint64_t val);
+void hist_print(struct mbuf *mb, const char *name, const struct hist *h);
+
+
+void quota_init(struct quota *q, const struct quota_conf *conf);
+bool quota_check(struct allocation *al, size_t bytes);
+int  quota_user_get(struct turn_user **userp, const char *name);
+int  quota_init_conf(struct turnd *turnd);
+void quota_status(const struct turnd *turnd, struct mbuf *mb);
@@ -28,13 +28,22 @@ void restund_cmd(const struct pl *cmd, struct mbuf *mb)
 		struct restund_cmdsub *cs = le->data;
 		le = le->next;
 
-		if (!cs->cmdh)
+		if (!cs->cmdh && !cs->chunkh)
 			continue;
 
 		if (pl_strcmp(cmd, cs->cmd))
 			continue;
 
-		cs->cmdh(mb);
+		if (cs->cmdh) {
+			cs->cmdh(mb);
+		}
+		else {
+			uint32_t cursor = 0;
+
+			while (cs->chunkh(mb, &cursor))
+				;
+		}
+
 		found = true;
 	}
 
@@ -43,6 +52,46 @@ void restund_cmd(const struct pl *cmd, struct mbuf *mb)
 }
 
 
+/**
+ * Run a server command, one chunk of its output at a time. A command
+ * with a chunk handler prints a part of its output for every call, and
+ * continues where it stopped at the next call, so that the caller can
+ * return to the main loop in between. Other commands print all of their
+ * output at the first call.
+ *
+ * @param cmd    Command
+ * @param mb     Buffer for the output
+ * @param cursor Position in the output, set to zero for the first call
+ *
+ * @return true if there is more output, false if done
+ */
+bool restund_cmd_chunk(const struct pl *cmd, struct mbuf *mb,
+		       uint32_t *cursor)
+{
+	struct le *le;
+
+	if (!cmd || !mb || !cursor)
+		return false;
+
+	for (le = csl.head; le; le = le->next) {
+
+		struct restund_cmdsub *cs = le->data;
+
+		if (!cs->chunkh || cs->cmdh)
+			continue;
+
+		if (pl_strcmp(cmd, cs->cmd))
+			continue;
+
+		return cs->chunkh(mb, cursor);
+	}
+
+	restund_cmd(cmd, mb);
+
+	return false;
+}
+
+
 void restund_cmd_subscribe(struct restund_cmdsub *cs)
 {
 	if (!cs)
@@ -13,10 +13,23 @@
 #include "stund.h"
 
 
+enum {
+	SYNC_FULL_INTERVAL = 86400,
+};
+
+
 struct account {
 	struct le he;
 	char *username;
 	uint8_t ha1[MD5_SIZE];
+	uint32_t epoch;        /**< Full sync that last listed the account */
+};
+
+
+/* An in-place sync */
+struct sync {
+	uint32_t epoch;
+	uint32_t changec;
 };
 
 
@@ -37,11 +50,21 @@ static struct {
 		pthread_mutex_t mutex;
 		struct hash *ht;
 		uint32_t syncint;
+		uint32_t syncint_full;
+		uint32_t gen;
+		uint32_t count;        /**< Number of accounts          */
+		uint32_t epoch;        /**< Current full sync           */
+		uint64_t wm;           /**< Watermark of changes        */
+		time_t full_last;      /**< Time of the last full sync  */
+		uint64_t syncc;        /**< Number of syncs             */
+		uint64_t changec;      /**< Number of changed accounts  */
+		uint32_t sync_ms;      /**< Duration of the last sync   */
 	} cred;
 	struct {
 		struct list fifo;
 		pthread_mutex_t mutex;
 		pthread_cond_t cond;
+		bool sync;             /**< Sync requested              */
 	} traffic;
 	pthread_t thread;
 	char realm[256];
@@ -54,6 +77,7 @@ static struct {
 		  .mutex   = PTHREAD_MUTEX_INITIALIZER,
 		  .ht      = NULL,
 		  .syncint = 3600,
+		  .syncint_full = SYNC_FULL_INTERVAL,
 	},
 	.traffic = {
 		  .mutex = PTHREAD_MUTEX_INITIALIZER,
@@ -85,9 +109,9 @@ static void account_destructor(void *arg)
 }
 
 
-static int account_handler(const char *username, const char *ha1, void *arg)
+static int account_alloc(struct account **accp, const char *username,
+			 const char *ha1, uint32_t epoch)
 {
-	struct hash *ht = arg;
 	struct account *acc;
 	int err = ENOMEM;
 	size_t len;
@@ -108,28 +132,171 @@ static int account_handler(const char *username, const char *ha1, void *arg)
 	if (err)
 		goto out;
 
-	hash_append(ht, hash_joaat_str(acc->username), &acc->he, acc);
+	acc->epoch = epoch;
 
 	err = 0;
 
  out:
 	if (err)
 		mem_deref(acc);
+	else
+		*accp = acc;
 
 	return err;
 }
 
 
-static int sync_credentials(void)
+static int account_handler(const char *username, const char *ha1, void *arg)
+{
+	struct hash *ht = arg;
+	struct account *acc;
+	int err;
+
+	/* removed account */
+	if (!ha1)
+		return 0;
+
+	err = account_alloc(&acc, username, ha1, database.cred.epoch);
+	if (err)
+		return err;
+
+	hash_append(ht, hash_joaat_str(acc->username), &acc->he, acc);
+
+	return 0;
+}
+
+
+static bool count_handler(struct le *le, void *arg)
+{
+	uint32_t *n = arg;
+	(void)le;
+
+	++*n;
+
+	return false;
+}
+
+
+static struct account *account_find(const char *username)
+{
+	return list_ledata(hash_lookup(database.cred.ht,
+				       hash_joaat_str(username),
+				       hash_cmp_handler, (void *)username));
+}
+
+
+/*
+ * Apply a changed account in place. The lock is only held for the
+ * lookup and the update of one account, so that requests are not held
+ * up by a sync.
+ */
+static int change_handler(const char *username, const char *ha1, void *arg)
+{
+	struct sync *sync = arg;
+	uint8_t key[MD5_SIZE];
+	struct account *acc;
+	int err;
+
+	if (ha1) {
+		err = str_hex(key, sizeof(key), ha1);
+		if (err)
+			return err;
+	}
+
+	pthread_mutex_lock(&database.cred.mutex);
+
+	acc = account_find(username);
+	if (acc && !ha1) {
+		hash_unlink(&acc->he);
+		--database.cred.count;
+		++sync->changec;
+	}
+	else if (acc) {
+		if (memcmp(acc->ha1, key, sizeof(key))) {
+			memcpy(acc->ha1, key, sizeof(key));
+			++sync->changec;
+		}
+
+		acc->epoch = sync->epoch;
+	}
+
+	pthread_mutex_unlock(&database.cred.mutex);
+
+	/* removed account */
+	if (!ha1) {
+		mem_deref(acc);
+		return 0;
+	}
+
+	/* updated account */
+	if (acc)
+		return 0;
+
+	/* new account, only this thread adds accounts */
+	err = account_alloc(&acc, username, ha1, sync->epoch);
+	if (err)
+		return err;
+
+	pthread_mutex_lock(&database.cred.mutex);
+	hash_append(database.cred.ht, hash_joaat_str(acc->username),
+		    &acc->he, acc);
+	++database.cred.count;
+	pthread_mutex_unlock(&database.cred.mutex);
+
+	++sync->changec;
+
+	return 0;
+}
+
+
+/* Remove the accounts that the last full sync did not list */
+static void sweep(struct sync *sync)
 {
+	uint32_t i, bsize = hash_bsize(database.cred.ht);
+
+	for (i=0; i<bsize; i++) {
+
+		struct list stale = LIST_INIT;
+		struct le *le;
+
+		pthread_mutex_lock(&database.cred.mutex);
+
+		le = list_head(hash_list(database.cred.ht, i));
+		while (le) {
+			struct account *acc = le->data;
+
+			le = le->next;
+
+			if (acc->epoch == sync->epoch)
+				continue;
+
+			hash_unlink(&acc->he);
+			list_append(&stale, &acc->he, acc);
+			--database.cred.count;
+			++sync->changec;
+		}
+
+		pthread_mutex_unlock(&database.cred.mutex);
+
+		list_flush(&stale);
+	}
+}
+
+
+/* Load all accounts into a new hash table, sized for them */
+static int sync_rebuild(void)
+{
+	const struct restund_db *db = database.db;
 	struct hash *ht = NULL, *ht_old;
 	uint32_t n, x, sz;
+	uint64_t wm = 0;
+	bool full;
 	int err = 0;
 
-	if (!database.db || !database.db->allh || !database.db->cnth)
+	if (!db->cnth || (!db->allh && !db->chgh))
 		goto out;
 
-	err = database.db->cnth(database.realm, &n);
+	err = db->cnth(database.realm, &n);
 	if (err) {
 		restund_warning("database sync error (cnt): %m\n", err);
 		goto out;
@@ -145,19 +312,32 @@ static int sync_credentials(void)
 		goto out;
 	}
 
-	err = database.db->allh(database.realm, account_handler, ht);
+	/* all changes since the start give the watermark as well */
+	if (db->chgh)
+		err = db->chgh(database.realm, &wm, &full, account_handler,
+			       ht);
+	else
+		err = db->allh(database.realm, account_handler, ht);
 	if (err) {
 		restund_warning("database sync error (all): %m\n", err);
 		goto out;
 	}
 
+	n = 0;
+	(void)hash_apply(ht, count_handler, &n);
+
 	pthread_mutex_lock(&database.cred.mutex);
 	ht_old = database.cred.ht;
 	database.cred.ht = ht;
+	database.cred.count = n;
+	database.cred.wm = wm;
+	__atomic_add_fetch(&database.cred.gen, 1, __ATOMIC_RELEASE);
 	pthread_mutex_unlock(&database.cred.mutex);
 
 	ht = ht_old;
 
+	database.cred.full_last = time(NULL);
+
 	restund_debug("database successfully synced (n=%u hashsize=%u)\n",
 		      n, sz);
 
@@ -169,6 +349,86 @@ static int sync_credentials(void)
 }
 
 
+/*
+ * Apply the changes since the last sync in place. Without changes from
+ * the backend, or when a full sync is due, all accounts are listed, and
+ * the ones that were not listed are removed.
+ */
+static int sync_update(void)
+{
+	const struct restund_db *db = database.db;
+	const time_t now = time(NULL);
+	struct sync sync;
+	bool full = true;
+	int err;
+
+	sync.epoch   = ++database.cred.epoch;
+	sync.changec = 0;
+
+	if (db->chgh &&
+	    now < database.cred.full_last + database.cred.syncint_full) {
+		uint64_t wm = database.cred.wm;
+
+		full = false;
+
+		err = db->chgh(database.realm, &wm, &full, change_handler,
+			       &sync);
+		if (!err)
+			database.cred.wm = wm;
+	}
+	else if (db->allh) {
+		err = db->allh(database.realm, change_handler, &sync);
+	}
+	else {
+		return 0;
+	}
+
+	if (err) {
+		restund_warning("database sync error (changes): %m\n", err);
+	}
+	else if (full) {
+		sweep(&sync);
+		database.cred.full_last = now;
+	}
+
+	if (sync.changec) {
+		pthread_mutex_lock(&database.cred.mutex);
+		database.cred.changec += sync.changec;
+		__atomic_add_fetch(&database.cred.gen, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&database.cred.mutex);
+	}
+
+	restund_debug("database: %u changes (%s sync, n=%u)\n", sync.changec,
+		      full ? "full" : "incremental", database.cred.count);
+
+	return err;
+}
+
+
+static int sync_credentials(void)
+{
+	const uint64_t start = tmr_jiffies();
+	int err;
+
+	if (!database.db)
+		return 0;
+
+	/* the table is rebuilt when it gets too crowded */
+	if (!database.cred.ht ||
+	    database.cred.count > 2 * hash_bsize(database.cred.ht))
+		err = sync_rebuild();
+	else
+		err = sync_update();
+
+	pthread_mutex_lock(&database.cred.mutex);
+	++database.cred.syncc;
+	database.cred.sync_ms = (uint32_t)(tmr_jiffies() - start);
+	pthread_mutex_unlock(&database.cred.mutex);
+
+	return err;
+}
+
+
 static int save_traffic_records(void)
 {
 	int err = 0;
@@ -231,16 +491,18 @@ static void *database_thread(void *arg)
 	gettimespec(&ts, 0);
 
 	for (;;) {
-		bool quit;
+		bool quit, sync;
 
 		pthread_mutex_lock(&database.traffic.mutex);
 		quit = database.quit;
-		if (!quit) {
+		if (!quit && !database.traffic.sync) {
 			err = pthread_cond_timedwait(&database.traffic.cond,
 						     &database.traffic.mutex,
 						     &ts);
 			quit = database.quit;
 		}
+		sync = database.traffic.sync;
+		database.traffic.sync = false;
 		pthread_mutex_unlock(&database.traffic.mutex);
 
 		(void)save_traffic_records();
@@ -248,7 +510,7 @@ static void *database_thread(void *arg)
 		if (quit)
 			break;
 
-		if (err != ETIMEDOUT)
+		if (err != ETIMEDOUT && !sync)
 			continue;
 
 		(void)sync_credentials();
@@ -344,6 +606,46 @@ int restund_get_ha1(const char *username, uint8_t *ha1)
 }
 
 
+/**
+ * Request a sync of the credentials, e.g. when a backend sees that they
+ * changed. The sync is done by the database thread.
+ */
+void restund_db_sync(void)
+{
+	if (!database.run)
+		return;
+
+	pthread_mutex_lock(&database.traffic.mutex);
+	database.traffic.sync = true;
+	pthread_cond_signal(&database.traffic.cond);
+	pthread_mutex_unlock(&database.traffic.mutex);
+}
+
+
+/**
+ * Get the generation of the credentials, which changes whenever they
+ * are synced from the database. A HA1 from restund_get_ha1() can be
+ * cached for as long as the generation stays the same.
+ *
+ * @param genp Returned generation
+ *
+ * @return 0 if success, ENOTSUP if credentials can not be cached
+ */
+int restund_db_gen(uint32_t *genp)
+{
+	if (!genp)
+		return EINVAL;
+
+	/* an auth handler may reject a username at any time */
+	if (database.authh)
+		return ENOTSUP;
+
+	*genp = __atomic_load_n(&database.cred.gen, __ATOMIC_ACQUIRE);
+
+	return 0;
+}
+
+
 const char *restund_realm(void)
 {
 	return database.realm;
@@ -359,9 +661,32 @@ void restund_db_set_handler(struct restund_db *db)
 void restund_db_set_auth_handler(restund_db_auth_h *authh)
 {
 	database.authh = authh;
+	__atomic_add_fetch(&database.cred.gen, 1, __ATOMIC_RELEASE);
+}
+
+
+static void status_handler(struct mbuf *mb)
+{
+	pthread_mutex_lock(&database.cred.mutex);
+
+	(void)mbuf_printf(mb, "accounts %u\n", database.cred.count);
+	(void)mbuf_printf(mb, "hashsize %u\n",
+			  hash_bsize(database.cred.ht));
+	(void)mbuf_printf(mb, "generation %u\n", database.cred.gen);
+	(void)mbuf_printf(mb, "syncs %llu\n", database.cred.syncc);
+	(void)mbuf_printf(mb, "changes %llu\n", database.cred.changec);
+	(void)mbuf_printf(mb, "sync_ms %u\n", database.cred.sync_ms);
+
+	pthread_mutex_unlock(&database.cred.mutex);
 }
 
 
+static struct restund_cmdsub cmd_db = {
+	.cmdh = status_handler,
+	.cmd  = "db",
+};
+
+
 int restund_db_init(void)
 {
 	int err;
@@ -373,6 +698,8 @@ int restund_db_init(void)
 	/* syncinterval config */
 	(void)conf_get_u32(restund_conf(), "syncinterval",
 			   &database.cred.syncint);
+	(void)conf_get_u32(restund_conf(), "syncinterval_full",
+			   &database.cred.syncint_full);
 
 	if (!database.db)
 		return 0;
@@ -385,6 +712,8 @@ int restund_db_init(void)
 
 	database.run = true;
 
+	restund_cmd_subscribe(&cmd_db);
+
 	restund_debug("database: realm is '%s', sync interval is %u secs\n",
 		      database.realm, database.cred.syncint);
 
@@ -396,6 +725,8 @@ void restund_db_close(void)
 {
 	struct hash *ht;
 
+	restund_cmd_unsubscribe(&cmd_db);
+
 	if (database.run) {
 		pthread_mutex_lock(&database.traffic.mutex);
 		database.quit = true;
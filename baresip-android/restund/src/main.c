@@ -160,6 +160,7 @@ static void usage(void)
 int main(int argc, char *argv[])
 {
 	bool daemon = true;
+	uint32_t maxfds = 1024;
 	int err = 0;
 	struct pl opt;
 
@@ -202,12 +203,6 @@ int main(int argc, char *argv[])
 
 	restund_cmd_subscribe(&cmd_reload);
 
-	err = fd_setsize(1024);
-	if (err) {
-		restund_warning("fd_setsize error: %m\n", err);
-		goto out;
-	}
-
 	err = libre_init();
 	if (err) {
 		restund_error("re init failed: %m\n", err);
@@ -226,6 +221,15 @@ int main(int argc, char *argv[])
 	if (!conf_get(conf, "debug", &opt) && !pl_strcasecmp(&opt, "yes"))
 		restund_log_enable_debug(true);
 
+	/* every relay socket takes a file descriptor */
+	(void)conf_get_u32(conf, "max_fds", &maxfds);
+
+	err = fd_setsize(maxfds);
+	if (err) {
+		restund_warning("fd_setsize error: %m\n", err);
+		goto out;
+	}
+
 	/* udp */
 	err = restund_udp_init();
 	if (err)
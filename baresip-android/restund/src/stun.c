@@ -23,13 +23,16 @@ void restund_process_msg(int proto, void *sock,
 {
 	struct le *le = stn.stunl.head;
 	struct restund_msgctx ctx;
-	struct stun_msg *msg;
+	struct stun_msg *msg, *hmsg = NULL;
+	struct stun_msg_fixed fm;
 	int err;
 
 	if (!sock || !src || !dst || !mb)
 		return;
 
-	err = stun_msg_decode(&msg, mb, &ctx.ua);
+	err = stun_msg_decode_fixed(&fm, mb, &ctx.ua);
+	if (err == EOVERFLOW)
+		err = stun_msg_decode(&hmsg, mb, &ctx.ua);
 	if (err) {
 		while (le) {
 			struct restund_stun *st = le->data;
@@ -43,6 +46,8 @@ void restund_process_msg(int proto, void *sock,
 		return;
 	}
 
+	msg = hmsg ? hmsg : &fm.msg;
+
 	ctx.key = NULL;
 	ctx.keylen = 0;
 	ctx.fp = false;
@@ -84,7 +89,7 @@ void restund_process_msg(int proto, void *sock,
 	}
 
 	mem_deref(ctx.key);
-	mem_deref(msg);
+	mem_deref(hmsg);
 }
 
 
@@ -0,0 +1,70 @@
+#!/bin/bash
+#
+# Test the fairness of the TURN quotas, with one flooding allocation
+# and a number of voice allocations
+#
+# Copyright (C) 2010 Creytiv.com
+#
+#
+# usage:
+#
+#    quotatest.sh <restund> <module path> <turnfair> [clients] [seconds]
+#
+# turnfair is built from turnfair.c.
+#
+
+
+if [ $# -lt 3 ]
+then
+    echo "usage: quotatest.sh <restund> <module path> <turnfair>" \
+	"[clients] [seconds]"
+    exit 2
+fi
+
+restund=$1
+modpath=$2
+turnfair=$3
+clients=${4:-10}
+seconds=${5:-3}
+quota=100000
+port=38080
+
+dir=$(mktemp -d)
+trap 'kill $pid 2>/dev/null; rm -rf $dir' EXIT
+
+cat > $dir/restund.conf <<EOF
+daemon			no
+realm			myrealm
+udp_listen		127.0.0.1:38478
+udp_sockbuf_size	4194304
+module_path		$modpath
+module			stat.so
+module			binding.so
+module			turn.so
+module			status.so
+turn_relay_addr		127.0.0.1
+turn_max_alloc_bps	$quota
+turn_max_alloc_pps	1000
+status_udp_addr		127.0.0.1
+status_udp_port		38001
+status_http_addr	127.0.0.1
+status_http_port	$port
+EOF
+
+$restund -n -f $dir/restund.conf > $dir/restund.log 2>&1 &
+pid=$!
+sleep 1
+
+$turnfair 127.0.0.1:38478 $quota $clients $seconds
+err=$?
+
+curl -s http://127.0.0.1:$port/turnstats | grep quota_drops
+
+if [ $err -eq 0 ]
+then
+    echo "OK"
+else
+    echo "FAIL"
+fi
+
+exit $err
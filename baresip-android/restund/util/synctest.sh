@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Test the incremental credential sync with a large filedb user file
+#
+# Copyright (C) 2010 Creytiv.com
+#
+#
+# usage:
+#
+#    synctest.sh <restund> <module path> [number of users]
+#
+
+
+if [ $# -lt 2 ]
+then
+    echo "usage: synctest.sh <restund> <module path> [number of users]"
+    exit 2
+fi
+
+restund=$1
+modpath=$2
+users=${3:-1000000}
+port=38080
+
+dir=$(mktemp -d)
+trap 'kill $pid 2>/dev/null; rm -rf $dir' EXIT
+
+genusers() {
+    awk -v a=$1 -v b=$2 -v s=$3 \
+	'BEGIN { for (i = a; i < b; i++) printf "user%u:%08x%024x\n", i, s, i }'
+}
+
+# print a value of the "db" status command
+status() {
+    curl -s http://127.0.0.1:$port/db | sed -n "s/^$1 //p"
+}
+
+# wait until a value of the "db" status command is as expected
+expect() {
+    for i in $(seq 1 300); do
+	[ "$(status $1)" = "$2" ] && return 0
+	sleep 0.1
+    done
+
+    echo "FAIL: $1 is $(status $1), expected $2"
+    exit 1
+}
+
+# replace the user file, like an editor or a provisioning script would
+replace() {
+    cat > $dir/auth.tmp
+    mv $dir/auth.tmp $dir/auth.txt
+}
+
+cat > $dir/restund.conf <<EOF
+daemon			no
+realm			myrealm
+syncinterval		600
+syncinterval_full	86400
+udp_listen		127.0.0.1:38478
+module_path		$modpath
+module			stat.so
+module			filedb.so
+module			status.so
+filedb_path		$dir/auth.txt
+status_udp_addr		127.0.0.1
+status_udp_port		38001
+status_http_addr	127.0.0.1
+status_http_port	$port
+EOF
+
+echo "generating $users users"
+genusers 0 $users 0 > $dir/auth.txt
+
+$restund -n -f $dir/restund.conf > $dir/restund.log 2>&1 &
+pid=$!
+
+expect accounts $users
+gen=$(status generation)
+echo "initial sync: $(status sync_ms) ms"
+
+# same users, the file is read again but nothing is changed
+syncs=$(status syncs)
+cat $dir/auth.txt | replace
+expect syncs $((syncs + 1))
+expect changes 0
+expect generation $gen
+
+# add 1000 users
+(genusers 0 $users 0; genusers $users $((users + 1000)) 0) | replace
+expect accounts $((users + 1000))
+expect changes 1000
+echo "add 1000 users: $(status sync_ms) ms"
+
+# change the password of 10 users, remove 10 users
+(genusers 0 10 1; genusers 20 $((users + 1000)) 0) | replace
+expect accounts $((users + 990))
+expect changes 1020
+echo "change 10 and remove 10 users: $(status sync_ms) ms"
+
+echo "OK"
@@ -0,0 +1,240 @@
+/**
+ * @file turnbench.c  TURN allocation benchmark client
+ *
+ * Creates, refreshes and deletes TURN allocations against a server,
+ * from a number of concurrent client sockets, and prints the rate.
+ *
+ * build:
+ *
+ *    cc -DHAVE_INTTYPES_H -o turnbench turnbench.c -I../re/include \
+ *        -L../re -lre
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+
+
+enum {
+	LIFETIME = 600,
+};
+
+
+struct client {
+	struct udp_sock *us;
+	struct stun_ctrans *ct;
+	uint16_t method;
+	uint32_t lifetime;
+};
+
+
+static struct {
+	struct stun *stun;
+	struct sa srv;
+	struct client *clientv;
+	uint32_t clientc;
+	uint32_t allocs;     /**< Allocations to create                 */
+	uint32_t started;
+	uint32_t done;
+	uint32_t active;
+	uint32_t retries;
+	uint32_t errors;
+} bench;
+
+
+static void client_next(struct client *cli);
+
+
+static void resp_handler(int err, uint16_t scode, const char *reason,
+			 const struct stun_msg *msg, void *arg)
+{
+	struct client *cli = arg;
+	(void)msg;
+
+	/* the last deletion from this 5-tuple was not done yet */
+	if (!err && scode == 437 && cli->method == STUN_METHOD_ALLOCATE) {
+		++bench.retries;
+		client_next(cli);
+		return;
+	}
+
+	if (err || scode) {
+		re_fprintf(stderr, "%s: %m %u %s\n",
+			   stun_method_name(cli->method), err, scode, reason);
+		++bench.errors;
+		--bench.active;
+		if (!bench.active)
+			re_cancel();
+		return;
+	}
+
+	switch (cli->method) {
+
+	case STUN_METHOD_ALLOCATE:
+		cli->method   = STUN_METHOD_REFRESH;
+		cli->lifetime = LIFETIME;
+		break;
+
+	case STUN_METHOD_REFRESH:
+		if (cli->lifetime) {
+			cli->lifetime = 0;
+			break;
+		}
+
+		++bench.done;
+
+		if (bench.started == bench.allocs) {
+			if (!--bench.active)
+				re_cancel();
+			return;
+		}
+
+		cli->method = STUN_METHOD_ALLOCATE;
+		++bench.started;
+		break;
+	}
+
+	client_next(cli);
+}
+
+
+static void client_next(struct client *cli)
+{
+	const uint8_t proto = IPPROTO_UDP;
+	int err;
+
+	if (cli->method == STUN_METHOD_ALLOCATE)
+		err = stun_request(&cli->ct, bench.stun, IPPROTO_UDP, cli->us,
+				   &bench.srv, 0, STUN_METHOD_ALLOCATE,
+				   NULL, 0, false, resp_handler, cli, 2,
+				   STUN_ATTR_REQ_TRANSPORT, &proto,
+				   STUN_ATTR_LIFETIME, &cli->lifetime);
+	else
+		err = stun_request(&cli->ct, bench.stun, IPPROTO_UDP, cli->us,
+				   &bench.srv, 0, STUN_METHOD_REFRESH,
+				   NULL, 0, false, resp_handler, cli, 1,
+				   STUN_ATTR_LIFETIME, &cli->lifetime);
+	if (err) {
+		re_fprintf(stderr, "request: %m\n", err);
+		++bench.errors;
+		if (!--bench.active)
+			re_cancel();
+	}
+}
+
+
+static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	(void)src;
+	(void)arg;
+
+	(void)stun_recv(bench.stun, mb);
+}
+
+
+static void signal_handler(int sig)
+{
+	(void)sig;
+
+	re_cancel();
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct sa laddr;
+	uint64_t start, ms;
+	uint32_t i;
+	int err;
+
+	if (argc < 2) {
+		re_fprintf(stderr, "usage: turnbench <server addr:port> "
+			   "[allocations] [clients]\n");
+		return 2;
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	bench.allocs  = argc > 2 ? atoi(argv[2]) : 100000;
+	bench.clientc = argc > 3 ? atoi(argv[3]) : 1000;
+	bench.clientc = min(bench.clientc, bench.allocs);
+
+	err = fd_setsize(bench.clientc + 64);
+	if (err)
+		goto out;
+
+	err = sa_decode(&bench.srv, argv[1], strlen(argv[1]));
+	if (err) {
+		re_fprintf(stderr, "bad server address: %s\n", argv[1]);
+		goto out;
+	}
+
+	err = stun_alloc(&bench.stun, NULL, NULL, NULL);
+	if (err)
+		goto out;
+
+	bench.clientv = mem_zalloc(bench.clientc * sizeof(*bench.clientv),
+				   NULL);
+	if (!bench.clientv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	sa_init(&laddr, sa_af(&bench.srv));
+
+	for (i=0; i<bench.clientc; i++) {
+
+		err = udp_listen(&bench.clientv[i].us, &laddr, udp_recv,
+				 NULL);
+		if (err) {
+			re_fprintf(stderr, "client socket: %m\n", err);
+			goto out;
+		}
+	}
+
+	start = tmr_jiffies();
+
+	for (i=0; i<bench.clientc; i++) {
+
+		struct client *cli = &bench.clientv[i];
+
+		cli->method   = STUN_METHOD_ALLOCATE;
+		cli->lifetime = LIFETIME;
+		++bench.started;
+		++bench.active;
+
+		client_next(cli);
+	}
+
+	(void)re_main(signal_handler);
+
+	ms = max(tmr_jiffies() - start, 1);
+
+	re_printf("%u allocations created, refreshed and deleted"
+		  " by %u clients in %llu ms: %llu allocations/s"
+		  " (%u retries, %u errors)\n",
+		  bench.done, bench.clientc, ms, bench.done * 1000ULL / ms,
+		  bench.retries, bench.errors);
+
+	if (bench.errors || bench.done != bench.allocs)
+		err = EPROTO;
+
+ out:
+	if (bench.clientv) {
+		for (i=0; i<bench.clientc; i++) {
+			mem_deref(bench.clientv[i].ct);
+			mem_deref(bench.clientv[i].us);
+		}
+	}
+
+	mem_deref(bench.clientv);
+	mem_deref(bench.stun);
+
+	libre_close();
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+#!/bin/bash
+#
+# Benchmark TURN allocations, with and without the relay port pool
+#
+# Copyright (C) 2010 Creytiv.com
+#
+#
+# usage:
+#
+#    turnbench.sh <restund> <module path> <turnbench> [allocations] [clients]
+#
+# turnbench is built from turnbench.c. Every client and every relay
+# socket takes a file descriptor, check "ulimit -n".
+#
+
+
+if [ $# -lt 3 ]
+then
+    echo "usage: turnbench.sh <restund> <module path> <turnbench>" \
+	"[allocations] [clients]"
+    exit 2
+fi
+
+restund=$1
+modpath=$2
+turnbench=$3
+allocs=${4:-100000}
+clients=${5:-1000}
+
+dir=$(mktemp -d)
+trap 'kill $pid 2>/dev/null; rm -rf $dir' EXIT
+
+run() {
+    cat > $dir/restund.conf <<EOF
+daemon			no
+realm			myrealm
+max_fds			$((clients * 2 + 1024))
+udp_listen		127.0.0.1:38478
+udp_sockbuf_size	524288
+module_path		$modpath
+module			stat.so
+module			binding.so
+module			turn.so
+turn_max_allocations	$clients
+turn_relay_addr		127.0.0.1
+EOF
+    [ -n "$1" ] && echo "$1" | tr ',' '\n' >> $dir/restund.conf
+
+    $restund -n -f $dir/restund.conf > $dir/restund.log 2>&1 &
+    pid=$!
+    sleep 1
+
+    $turnbench 127.0.0.1:38478 $allocs $clients
+    err=$?
+
+    kill $pid
+    wait $pid 2>/dev/null
+
+    return $err
+}
+
+echo -n "relay sockets per allocation: "
+run || exit 1
+
+echo -n "relay port pool:              "
+run "turn_relay_port_min	40000,turn_relay_port_max	$((40000 + clients))" \
+    || exit 1
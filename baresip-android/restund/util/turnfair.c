@@ -0,0 +1,342 @@
+/**
+ * @file turnfair.c  TURN quota fairness test client
+ *
+ * One client floods its allocation with Send indications, the others
+ * send at the rate of a voice call. A peer socket counts what is relayed
+ * for each allocation. The test passes if the well-behaved clients get
+ * all their packets through, and the flooding client gets no more than
+ * the quota of its allocation.
+ *
+ * build:
+ *
+ *    cc -DHAVE_INTTYPES_H -o turnfair turnfair.c -I../re/include \
+ *        -L../re -lre
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+
+
+enum {
+	LIFETIME    = 600,
+	VOICE_PTIME = 20,     /* Packet interval of a voice call [ms]    */
+	VOICE_SIZE  = 160,
+	FLOOD_BURST = 50,     /* Packets of the flooder per millisecond  */
+	FLOOD_SIZE  = 1000,
+	DRAIN_MS    = 500,
+};
+
+
+struct client {
+	struct udp_sock *us;
+	struct stun_ctrans *ct;
+	struct tmr tmr;
+	struct sa relay;
+	uint64_t bytec_tx;
+	uint64_t bytec_rx;
+	bool flood;
+};
+
+
+static struct {
+	struct stun *stun;
+	struct udp_sock *peer_us;
+	struct sa srv;
+	struct sa peer;
+	struct mbuf *mb;
+	struct client *clientv;
+	uint32_t clientc;
+	uint32_t ready;
+	uint32_t quota;      /**< Quota of an allocation [bytes/s]      */
+	uint32_t duration;   /**< Test duration [s]                     */
+	struct tmr tmr;
+	bool running;
+	int err;
+} fair;
+
+
+static void send_handler(void *arg)
+{
+	struct client *cli = arg;
+	const uint32_t n = cli->flood ? FLOOD_BURST : 1;
+	const size_t size = cli->flood ? FLOOD_SIZE : VOICE_SIZE;
+	uint32_t i;
+
+	if (!fair.running)
+		return;
+
+	tmr_start(&cli->tmr, cli->flood ? 1 : VOICE_PTIME, send_handler, cli);
+
+	for (i=0; i<n; i++) {
+
+		int err;
+
+		fair.mb->pos = 0;
+		fair.mb->end = size;
+
+		err = stun_indication(IPPROTO_UDP, cli->us, &fair.srv, 0,
+				      STUN_METHOD_SEND, NULL, 0, false, 2,
+				      STUN_ATTR_XOR_PEER_ADDR, &fair.peer,
+				      STUN_ATTR_DATA, fair.mb);
+		if (err)
+			break;
+
+		cli->bytec_tx += size;
+	}
+}
+
+
+static void stop_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static void start(void)
+{
+	uint32_t i;
+
+	fair.running = true;
+
+	for (i=0; i<fair.clientc; i++)
+		send_handler(&fair.clientv[i]);
+
+	tmr_start(&fair.tmr, fair.duration * 1000, stop_handler, NULL);
+}
+
+
+static void abort_test(int err)
+{
+	fair.err = err;
+	re_cancel();
+}
+
+
+static void perm_handler(int err, uint16_t scode, const char *reason,
+			 const struct stun_msg *msg, void *arg)
+{
+	(void)msg;
+	(void)arg;
+
+	if (err || scode) {
+		re_fprintf(stderr, "createperm: %m %u %s\n",
+			   err, scode, reason);
+		abort_test(err ? err : EPROTO);
+		return;
+	}
+
+	if (++fair.ready == fair.clientc)
+		start();
+}
+
+
+static void alloc_handler(int err, uint16_t scode, const char *reason,
+			  const struct stun_msg *msg, void *arg)
+{
+	struct client *cli = arg;
+	struct stun_attr *attr;
+
+	if (err || scode) {
+		re_fprintf(stderr, "allocate: %m %u %s\n", err, scode, reason);
+		abort_test(err ? err : EPROTO);
+		return;
+	}
+
+	attr = stun_msg_attr(msg, STUN_ATTR_XOR_RELAY_ADDR);
+	if (!attr) {
+		abort_test(EPROTO);
+		return;
+	}
+
+	cli->relay = attr->v.xor_relay_addr;
+
+	err = stun_request(&cli->ct, fair.stun, IPPROTO_UDP, cli->us,
+			   &fair.srv, 0, STUN_METHOD_CREATEPERM,
+			   NULL, 0, false, perm_handler, cli, 1,
+			   STUN_ATTR_XOR_PEER_ADDR, &fair.peer);
+	if (err)
+		abort_test(err);
+}
+
+
+static void client_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	(void)src;
+	(void)arg;
+
+	(void)stun_recv(fair.stun, mb);
+}
+
+
+static void peer_recv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	uint32_t i;
+	(void)arg;
+
+	for (i=0; i<fair.clientc; i++) {
+
+		struct client *cli = &fair.clientv[i];
+
+		if (sa_cmp(&cli->relay, src, SA_ALL)) {
+			cli->bytec_rx += mbuf_get_left(mb);
+			break;
+		}
+	}
+}
+
+
+static void drain_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static void signal_handler(int sig)
+{
+	(void)sig;
+
+	abort_test(EINTR);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const uint8_t proto = IPPROTO_UDP;
+	const uint32_t lifetime = LIFETIME;
+	uint64_t flood_max;
+	struct sa laddr;
+	uint32_t i;
+	int err;
+
+	if (argc < 3) {
+		re_fprintf(stderr, "usage: turnfair <server addr:port> "
+			   "<quota bytes/s> [clients] [seconds]\n");
+		return 2;
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	fair.quota    = atoi(argv[2]);
+	fair.clientc  = argc > 3 ? atoi(argv[3]) : 10;
+	fair.duration = argc > 4 ? atoi(argv[4]) : 3;
+
+	if (fair.clientc < 2) {
+		err = EINVAL;
+		goto out;
+	}
+
+	err = sa_decode(&fair.srv, argv[1], strlen(argv[1]));
+	if (err) {
+		re_fprintf(stderr, "bad server address: %s\n", argv[1]);
+		goto out;
+	}
+
+	err = stun_alloc(&fair.stun, NULL, NULL, NULL);
+	if (err)
+		goto out;
+
+	fair.mb = mbuf_alloc(FLOOD_SIZE);
+	fair.clientv = mem_zalloc(fair.clientc * sizeof(*fair.clientv),
+				  NULL);
+	if (!fair.mb || !fair.clientv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	(void)mbuf_fill(fair.mb, 0xa5, FLOOD_SIZE);
+
+	laddr = fair.srv;
+	sa_set_port(&laddr, 0);
+
+	err = udp_listen(&fair.peer_us, &laddr, peer_recv, NULL);
+	if (err)
+		goto out;
+
+	err = udp_local_get(fair.peer_us, &fair.peer);
+	if (err)
+		goto out;
+
+	(void)udp_sockbuf_set(fair.peer_us, 4 * 1024 * 1024);
+
+	for (i=0; i<fair.clientc; i++) {
+
+		struct client *cli = &fair.clientv[i];
+
+		cli->flood = (i == 0);
+
+		err = udp_listen(&cli->us, &laddr, client_recv, NULL);
+		if (err)
+			goto out;
+
+		err = stun_request(&cli->ct, fair.stun, IPPROTO_UDP, cli->us,
+				   &fair.srv, 0, STUN_METHOD_ALLOCATE,
+				   NULL, 0, false, alloc_handler, cli, 2,
+				   STUN_ATTR_REQ_TRANSPORT, &proto,
+				   STUN_ATTR_LIFETIME, &lifetime);
+		if (err)
+			goto out;
+	}
+
+	(void)re_main(signal_handler);
+
+	err = fair.err;
+	if (err)
+		goto out;
+
+	/* stop sending, and relay what is still on its way */
+	fair.running = false;
+	tmr_start(&fair.tmr, DRAIN_MS, drain_handler, NULL);
+	(void)re_main(signal_handler);
+
+	/* the quota, and a full bucket at the start */
+	flood_max = (uint64_t)fair.quota * fair.duration * 11 / 10
+		+ fair.quota / 2;
+
+	for (i=0; i<fair.clientc; i++) {
+
+		const struct client *cli = &fair.clientv[i];
+		bool ok;
+
+		if (cli->flood)
+			ok = cli->bytec_rx <= flood_max;
+		else
+			ok = cli->bytec_rx * 100 >= cli->bytec_tx * 95;
+
+		re_printf("%s %2u: sent %8llu bytes, relayed %8llu bytes"
+			  " (%llu bytes/s) %s\n",
+			  cli->flood ? "flood" : "voice", i,
+			  cli->bytec_tx, cli->bytec_rx,
+			  cli->bytec_rx / fair.duration, ok ? "ok" : "FAIL");
+
+		if (!ok)
+			err = EPROTO;
+	}
+
+ out:
+	if (fair.clientv) {
+		for (i=0; i<fair.clientc; i++) {
+			tmr_cancel(&fair.clientv[i].tmr);
+			mem_deref(fair.clientv[i].ct);
+			mem_deref(fair.clientv[i].us);
+		}
+	}
+
+	tmr_cancel(&fair.tmr);
+	mem_deref(fair.clientv);
+	mem_deref(fair.peer_us);
+	mem_deref(fair.mb);
+	mem_deref(fair.stun);
+
+	libre_close();
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/**
+ * @file aec.c  Acoustic Echo Canceller Testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <re.h>
+#include <rem.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test/aec"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+enum {
+	SRATE     = 16000,
+	PTIME     = 20,
+	ECHO_MS   = 20,     /* Length of the simulated echo path   */
+	SINC_TAPS = 32,     /* Taps of the drift resampling filter */
+};
+
+
+/* Echo path of a simulated room */
+struct room {
+	uint32_t srate;
+	double ratio;       /* Playback to capture clock ratio */
+	size_t delay;       /* Echo path delay in samples      */
+	float *h;           /* Echo impulse response           */
+	size_t hlen;
+	uint32_t seed;
+};
+
+
+static double rnd(struct room *room)
+{
+	room->seed = room->seed * 1664525 + 1013904223;
+
+	return (double)(room->seed >> 8) / (1 << 23) - 1.0;
+}
+
+
+/*
+ * Generate far-end speech-like noise bursts, and the near-end echo of
+ * them as heard through the room, sampled by the capture clock.
+ */
+static int room_simulate(struct room *room, int16_t **farp,
+			 size_t *farnp, int16_t **nearp, size_t n)
+{
+	const size_t farn = (size_t)(n * room->ratio) + SINC_TAPS + 1;
+	int16_t *far, *near = NULL;
+	float *fd = NULL;
+	double lp = 0, env = 0, e2 = 0;
+	size_t i, j;
+	int err = 0;
+
+	room->hlen = room->srate * ECHO_MS / 1000;
+
+	far  = mem_alloc(farn * sizeof(*far), NULL);
+	near = mem_alloc(n * sizeof(*near), NULL);
+	fd   = mem_alloc(n * sizeof(*fd), NULL);
+	room->h = mem_alloc(room->hlen * sizeof(*room->h), NULL);
+	if (!far || !near || !fd || !room->h) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* lowpass noise, switched on and off every half second */
+	for (i=0; i<farn; i++) {
+
+		if (i % (room->srate / 2) == 0)
+			env = (rnd(room) > -0.4) ? 3000 : 0;
+
+		lp = 0.8 * lp + rnd(room);
+		far[i] = (int16_t)(env * lp);
+	}
+
+	/* exponentially decaying echo with 6 dB of loss */
+	for (j=0; j<room->hlen; j++) {
+		room->h[j] = (float)(rnd(room) * exp(-5.0 * j / room->hlen));
+		e2 += room->h[j] * room->h[j];
+	}
+	for (j=0; j<room->hlen; j++)
+		room->h[j] *= (float)(0.5 / sqrt(e2));
+
+	/* far-end signal at the capture clock */
+	for (i=0; i<n; i++) {
+
+		const double x = i * room->ratio;
+		const long c = (long)x;
+		double s = 0;
+		long k;
+
+		for (k=1-SINC_TAPS/2; k<=SINC_TAPS/2; k++) {
+
+			const double d = x - (double)(c + k);
+			const double a = M_PI * d / (SINC_TAPS/2);
+			double w;
+
+			if (c + k < 0)
+				continue;
+
+			w = 0.42 + 0.5 * cos(a) + 0.08 * cos(2 * a);
+			s += far[c + k] * (d == 0 ? 1 : w * sin(M_PI * d) /
+					   (M_PI * d));
+		}
+
+		fd[i] = (float)s;
+	}
+
+	for (i=0; i<n; i++) {
+
+		double e = rnd(room) * 3;
+
+		for (j=0; j<room->hlen && j + room->delay <= i; j++)
+			e += room->h[j] * fd[i - room->delay - j];
+
+		near[i] = saturate_s16((int32_t)e);
+	}
+
+	*farp  = far;
+	*farnp = farn;
+	*nearp = near;
+
+ out:
+	mem_deref(fd);
+	if (err) {
+		mem_deref(far);
+		mem_deref(near);
+	}
+
+	return err;
+}
+
+
+/*
+ * Run the echo canceller over one channel, with the far-end audio
+ * played out at `ratio' samples per captured sample. The ERLE is
+ * measured from sample `skip' onwards.
+ */
+static double aec_run(struct aec *aec, uint32_t srate, double ratio,
+		      const int16_t *far, size_t farn,
+		      int16_t *near, size_t n, size_t skip)
+{
+	const size_t frame = srate * PTIME / 1000;
+	double pin = 0, pout = 0;
+	size_t t, played = 0, i;
+
+	for (t=0; t + frame <= n; t += frame) {
+
+		size_t end = (size_t)((t + frame) * ratio);
+
+		if (end > farn)
+			end = farn;
+
+		if (end > played) {
+			aec_playback(aec, far + played, end - played);
+			played = end;
+		}
+
+		for (i=0; t >= skip && i<frame; i++)
+			pin += (double)near[t + i] * near[t + i];
+
+		aec_capture(aec, near + t, frame);
+
+		for (i=0; t >= skip && i<frame; i++)
+			pout += (double)near[t + i] * near[t + i];
+	}
+
+	return 10 * log10((pin + 1) / (pout + 1));
+}
+
+
+int test_aec(void)
+{
+	struct room room;
+	struct aec *aec = NULL;
+	struct aec_stat st;
+	int16_t *far = NULL, *near = NULL;
+	const size_t n = 10 * SRATE;
+	size_t farn;
+	double erle;
+	int err;
+
+	memset(&room, 0, sizeof(room));
+	room.srate = SRATE;
+	room.ratio = 1 + 100e-6;
+	room.delay = SRATE * 60 / 1000;
+	room.seed  = 42;
+
+	err = room_simulate(&room, &far, &farn, &near, n);
+	if (err)
+		goto out;
+
+	err = aec_alloc(&aec, SRATE, 64);
+	if (err)
+		goto out;
+
+	erle = aec_run(aec, SRATE, room.ratio, far, farn, near, n,
+		       n - 2 * SRATE);
+
+	aec_stats(aec, &st);
+
+	TEST_ASSERT(erle > 15.0);
+	TEST_ASSERT(st.delay_valid);
+	TEST_ASSERT(st.delay_ms >= 40 && st.delay_ms <= 80);
+	TEST_ASSERT(st.skew > 50 && st.skew < 150);
+	TEST_EQUALS(0, st.resets);
+
+ out:
+	mem_deref(aec);
+	mem_deref(room.h);
+	mem_deref(far);
+	mem_deref(near);
+
+	return err;
+}
+
+
+static int wav_load(int16_t **sampvp, size_t *sampcp,
+		    struct aufile_prm *prm, const char *filename)
+{
+	struct aufile *af;
+	struct mbuf *mb;
+	int err;
+
+	err = aufile_open(&af, prm, filename, AUFILE_READ);
+	if (err) {
+		DEBUG_WARNING("%s: could not open (%m)\n", filename, err);
+		return err;
+	}
+
+	mb = mbuf_alloc(aufile_get_size(af));
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		uint8_t buf[4096];
+		size_t sz = sizeof(buf);
+
+		err = aufile_read(af, buf, &sz);
+		if (err || !sz)
+			break;
+
+		err = mbuf_write_mem(mb, buf, sz);
+		if (err)
+			goto out;
+	}
+	if (err)
+		goto out;
+
+	if (prm->fmt != AUFMT_S16LE || !prm->channels) {
+		err = ENOTSUP;
+		goto out;
+	}
+
+	*sampcp = mb->end / 2;
+	*sampvp = mem_alloc(mb->end, NULL);
+	if (!*sampvp) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	memcpy(*sampvp, mb->buf, mb->end);
+
+ out:
+	mem_deref(mb);
+	mem_deref(af);
+
+	return err;
+}
+
+
+static void deinterleave(int16_t *dst, const int16_t *src, size_t n,
+			 uint8_t ch, uint8_t c)
+{
+	size_t i;
+
+	for (i=0; i<n; i++)
+		dst[i] = src[i * ch + c];
+}
+
+
+/*
+ * Echo canceller benchmark. Set AEC_NEAR and AEC_FAR to a pair of
+ * recorded near-end (microphone) and far-end (loudspeaker) WAV files,
+ * with the same format, to measure the CPU load per channel and the
+ * ERLE on real recordings. Otherwise a simulated room is used.
+ */
+int test_aec_perf(void)
+{
+	const char *near_file = getenv("AEC_NEAR");
+	const char *far_file  = getenv("AEC_FAR");
+	struct aufile_prm prm, fprm;
+	struct aec *aec = NULL;
+	struct room room;
+	int16_t *far = NULL, *near = NULL, *fch = NULL, *nch = NULL;
+	size_t farn, nearn, n, fn;
+	double cpu = 0, erle = 0;
+	uint8_t c;
+	int err = 0;
+
+	memset(&room, 0, sizeof(room));
+
+	if (near_file && far_file) {
+
+		err  = wav_load(&near, &nearn, &prm, near_file);
+		err |= wav_load(&far, &farn, &fprm, far_file);
+		if (err)
+			goto out;
+
+		if (prm.srate != fprm.srate ||
+		    prm.channels != fprm.channels) {
+			DEBUG_WARNING("near-end and far-end formats differ\n");
+			err = EINVAL;
+			goto out;
+		}
+	}
+	else {
+		room.srate = SRATE;
+		room.ratio = 1;
+		room.delay = SRATE * 40 / 1000;
+		room.seed  = 7;
+
+		prm.srate    = SRATE;
+		prm.channels = 1;
+
+		err = room_simulate(&room, &far, &farn, &near, 4 * SRATE);
+		if (err)
+			goto out;
+
+		nearn = 4 * SRATE;
+	}
+
+	n  = nearn / prm.channels;
+	fn = farn / prm.channels;
+
+	fch = mem_alloc(fn * sizeof(*fch), NULL);
+	nch = mem_alloc(n * sizeof(*nch), NULL);
+	if (!fch || !nch) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (c=0; c<prm.channels; c++) {
+
+		clock_t t0;
+
+		deinterleave(fch, far, fn, prm.channels, c);
+		deinterleave(nch, near, n, prm.channels, c);
+
+		err = aec_alloc(&aec, prm.srate, 128);
+		if (err)
+			goto out;
+
+		t0 = clock();
+
+		erle += aec_run(aec, prm.srate, 1.0, fch, fn, nch, n,
+				min(n / 4, (size_t)prm.srate));
+
+		cpu += (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+		if (near_file && far_file) {
+			(void)re_fprintf(stderr, "%H", aec_debug, aec);
+		}
+
+		aec = mem_deref(aec);
+	}
+
+	if (near_file && far_file) {
+		(void)re_fprintf(stderr, "aec: %u channels of %.1f seconds:"
+				 " cpu=%.2f%% per channel erle=%.1fdB\n",
+				 prm.channels, (double)n / prm.srate,
+				 100.0 * cpu / prm.channels * prm.srate / n,
+				 erle / prm.channels);
+	}
+
+ out:
+	mem_deref(aec);
+	mem_deref(room.h);
+	mem_deref(far);
+	mem_deref(near);
+	mem_deref(fch);
+	mem_deref(nch);
+
+	return err;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file auplc.c  Audio Packet Loss Concealment Testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <math.h>
+#include <re.h>
+#include <rem.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test/auplc"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+enum {
+	SRATE  = 8000,
+	FRAME  = 160,
+	PERIOD = 40,      /* Pitch period of the test signal, 200 Hz */
+};
+
+
+/* Voiced sound with three harmonics */
+static void voiced(int16_t *sampv, size_t n, size_t t0)
+{
+	size_t i;
+
+	for (i=0; i<n; i++) {
+
+		const double ph = 2 * M_PI * ((t0 + i) % PERIOD) / PERIOD;
+
+		sampv[i] = (int16_t)(6000 * sin(ph) + 3000 * sin(2 * ph + 1)
+				     + 1500 * sin(3 * ph + 2));
+	}
+}
+
+
+static double snr(const int16_t *ref, const int16_t *x, size_t n)
+{
+	double s = 0, e = 0;
+	size_t i;
+
+	for (i=0; i<n; i++) {
+		s += (double)ref[i] * ref[i];
+		e += (double)(ref[i] - x[i]) * (ref[i] - x[i]);
+	}
+
+	return 10 * log10((s + 1) / (e + 1));
+}
+
+
+static double rms(const int16_t *x, size_t n)
+{
+	double s = 0;
+	size_t i;
+
+	for (i=0; i<n; i++)
+		s += (double)x[i] * x[i];
+
+	return sqrt(s / n);
+}
+
+
+static int maxstep(const int16_t *x, size_t n)
+{
+	int m = 0;
+	size_t i;
+
+	for (i=1; i<n; i++)
+		m = max(m, abs(x[i] - x[i-1]));
+
+	return m;
+}
+
+
+int test_auplc(void)
+{
+	struct auplc *plc = NULL;
+	struct auplc_stat st;
+	int16_t ref[FRAME], out[3 * FRAME];
+	size_t t = 0, i;
+	int step, err;
+
+	err = auplc_alloc(&plc, SRATE);
+	if (err)
+		goto out;
+
+	for (i=0; i<50; i++, t += FRAME) {
+		voiced(out, FRAME, t);
+		auplc_rx(plc, out, FRAME);
+	}
+
+	/* a single lost frame is extrapolated from the pitch period */
+	voiced(ref, FRAME, t);
+	auplc_conceal(plc, out + FRAME, FRAME);
+	t += FRAME;
+
+	auplc_stats(plc, &st);
+	TEST_EQUALS(0, st.period % PERIOD);
+	TEST_ASSERT(snr(ref, out + FRAME, FRAME) > 20.0);
+
+	/* the next good frame follows without a click */
+	voiced(out + 2 * FRAME, FRAME, t);
+	auplc_rx(plc, out + 2 * FRAME, FRAME);
+	t += FRAME;
+
+	step = maxstep(out, FRAME);
+	TEST_ASSERT(maxstep(out, 3 * FRAME) < step * 3 / 2);
+
+	/* a long loss fades out to comfort noise */
+	for (i=0; i<25; i++) {
+		auplc_conceal(plc, out, FRAME);
+
+		if (i == 0) {
+			voiced(ref, FRAME, t);
+			TEST_ASSERT(snr(ref, out, FRAME) > 20.0);
+		}
+
+		t += FRAME;
+	}
+
+	TEST_ASSERT(rms(out, FRAME) > 10.0);
+	TEST_ASSERT(rms(out, FRAME) < 1500.0);
+
+	voiced(out, FRAME, t);
+	auplc_rx(plc, out, FRAME);
+
+	auplc_stats(plc, &st);
+	TEST_EQUALS(52, st.frames);
+	TEST_EQUALS(26, st.concealed);
+	TEST_EQUALS(2, st.bursts);
+
+ out:
+	mem_deref(plc);
+
+	return err;
+}
@@ -13,7 +13,7 @@
 #include <re_dbg.h>
 
 
-int test_crc32(void)
+static int crc32_known(void)
 {
 	const struct {
 		const char *str;
@@ -41,3 +41,177 @@ int test_crc32(void)
 
 	return 0;
 }
+
+
+enum {
+	CRC_BUFSZ  = 2048,
+	CRC_ROUNDS = 256,
+	CRC_MSEC   = 50,
+};
+
+
+static uint32_t crc_tab[256];
+
+
+static void crc_tab_init(void)
+{
+	uint32_t i, j;
+
+	for (i=0; i<256; i++) {
+
+		uint32_t c = i;
+
+		for (j=0; j<8; j++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+		crc_tab[i] = c;
+	}
+}
+
+
+/* reference: one table lookup per byte */
+static uint32_t crc_bytewise(uint32_t crc, const uint8_t *p, size_t size)
+{
+	crc = ~crc;
+
+	while (size--)
+		crc = crc_tab[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+
+enum crc_impl {
+	CRC_RE,
+	CRC_LIB,
+	CRC_REF,
+};
+
+
+/* run for a while and return the speed in [MB/s] */
+static unsigned crc_speed(const uint8_t *buf, size_t size,
+			  enum crc_impl impl)
+{
+	uint64_t t0, t1, n = 0;
+	uint32_t crc = 0;
+	unsigned i;
+
+	t0 = t1 = tmr_jiffies();
+
+	while (t1 - t0 < CRC_MSEC) {
+
+		for (i=0; i<CRC_ROUNDS; i++) {
+
+			switch (impl) {
+
+			case CRC_RE:
+				crc = re_crc32(crc, buf, (uint32_t)size);
+				break;
+
+			case CRC_LIB:
+				crc = (uint32_t)crc32(crc, buf,
+						      (unsigned)size);
+				break;
+
+			default:
+				crc = crc_bytewise(crc, buf, size);
+				break;
+			}
+		}
+
+		n += CRC_ROUNDS;
+		t1 = tmr_jiffies();
+	}
+
+	(void)crc;
+
+	return (unsigned)(n * size / (1000 * (t1 - t0)));
+}
+
+
+/*
+ * Compare crc32() and re_crc32() with a bytewise CRC-32 over unaligned
+ * buffers of all sizes
+ */
+static int crc32_bytewise(void)
+{
+	uint8_t *buf;
+	size_t i;
+	int err = 0;
+
+	buf = mem_alloc(CRC_BUFSZ, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	rand_bytes(buf, CRC_BUFSZ);
+	crc_tab_init();
+
+	for (i=0; i<CRC_BUFSZ - 16; i += 1 + (i >> 4)) {
+
+		const size_t off = rand_u16() % 16;
+		const uint32_t ref = crc_bytewise(0, buf + off, i);
+		uint32_t crc;
+
+		crc = (uint32_t)crc32(0, buf + off, (unsigned)i);
+		TEST_EQUALS(ref, crc);
+
+		crc = re_crc32(0, buf + off, (uint32_t)i);
+		TEST_EQUALS(ref, crc);
+
+		/* split in two, continued with the previous value */
+		crc = re_crc32(0, buf + off, (uint32_t)(i / 3));
+		crc = re_crc32(crc, buf + off + i / 3, (uint32_t)(i - i / 3));
+		TEST_EQUALS(ref, crc);
+	}
+
+ out:
+	mem_deref(buf);
+
+	return err;
+}
+
+
+int test_crc32(void)
+{
+	int err;
+
+	err = crc32_known();
+	if (err)
+		return err;
+
+	err = crc32_bytewise();
+	if (err)
+		return err;
+
+	return 0;
+}
+
+
+/* Print the speed of re_crc32(), crc32() and a bytewise CRC-32 */
+int test_crc32_perf(void)
+{
+	static const size_t sizev[] = {100, 1500};
+	uint8_t *buf;
+	size_t i;
+
+	buf = mem_alloc(CRC_BUFSZ, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	rand_bytes(buf, CRC_BUFSZ);
+	crc_tab_init();
+
+	for (i=0; i<ARRAY_SIZE(sizev); i++) {
+
+		(void)re_fprintf(stderr, "crc32: %4zu bytes:  %6u MB/s"
+				 "  (crc32 %6u MB/s, bytewise %6u MB/s)\n",
+				 sizev[i],
+				 crc_speed(buf + 1, sizev[i], CRC_RE),
+				 crc_speed(buf + 1, sizev[i], CRC_LIB),
+				 crc_speed(buf + 1, sizev[i], CRC_REF));
+	}
+
+	mem_deref(buf);
+
+	return 0;
+}
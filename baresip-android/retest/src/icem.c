@@ -0,0 +1,144 @@
+/**
+ * @file icem.c  ICE Media checklist testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "icemtest"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	LCAND_COUNT = 20,
+	RCAND_COUNT = 50,
+	ROUNDS      = 20,
+};
+
+
+/*
+ * Form the checklist of a media stream with LCAND_COUNT local host
+ * candidates, one per interface, and RCAND_COUNT remote candidates.
+ */
+static int checklist_form(struct udp_sock *us)
+{
+	struct icem *icem = NULL;
+	char buf[128];
+	unsigned i;
+	int err;
+
+	err = icem_alloc(&icem, ICE_MODE_FULL, ICE_ROLE_CONTROLLING,
+			 IPPROTO_UDP, 0, 0x0123456789abcdefULL,
+			 "lufr", "lpwd-0123456789abcdefghij",
+			 NULL, NULL, NULL);
+	TEST_ERR(err);
+
+	err = icem_comp_add(icem, ICE_COMPID_RTP, us);
+	TEST_ERR(err);
+
+	for (i=0; i<LCAND_COUNT; i++) {
+
+		struct sa addr;
+		char ifname[16];
+
+		(void)re_snprintf(buf, sizeof(buf), "10.%u.0.1", i);
+		(void)re_snprintf(ifname, sizeof(ifname), "eth%u", i);
+
+		err = sa_set_str(&addr, buf, 0);
+		TEST_ERR(err);
+
+		err = icem_cand_add(icem, ICE_COMPID_RTP, 65535 - i, ifname,
+				    &addr);
+		TEST_ERR(err);
+	}
+
+	err  = icem_sdp_decode(icem, ice_attr_ufrag, "rufr");
+	err |= icem_sdp_decode(icem, ice_attr_pwd,
+			       "rpwd-0123456789abcdefghij");
+	TEST_ERR(err);
+
+	for (i=0; i<RCAND_COUNT; i++) {
+
+		(void)re_snprintf(buf, sizeof(buf),
+				  "%u 1 UDP %u 192.168.%u.%u %u typ host",
+				  i + 1, 2130706431 - i, i / 200, i % 200 + 1,
+				  10000 + 2 * i);
+
+		err = icem_sdp_decode(icem, ice_attr_cand, buf);
+		TEST_ERR(err);
+	}
+
+	err = icem_conncheck_start(icem);
+	TEST_ERR(err);
+
+	ice_candpair_set_states(icem);
+
+	TEST_EQUALS(LCAND_COUNT * RCAND_COUNT,
+		    list_count(icem_checkl(icem)));
+
+ out:
+	mem_deref(icem);
+
+	return err;
+}
+
+
+int test_icem_checklist(void)
+{
+	struct udp_sock *us = NULL;
+	struct sa laddr;
+	int err;
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&us, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	err = checklist_form(us);
+
+ out:
+	mem_deref(us);
+
+	return err;
+}
+
+
+int test_icem_perf(void)
+{
+	struct udp_sock *us = NULL;
+	struct sa laddr;
+	uint64_t t0, t1;
+	unsigned i;
+	int err;
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&us, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<ROUNDS; i++) {
+
+		err = checklist_form(us);
+		if (err)
+			goto out;
+	}
+
+	t1 = tmr_jiffies();
+
+	(void)re_fprintf(stderr, "ice: checklist %ux%u:  %8u checklists/sec\n",
+			 LCAND_COUNT, RCAND_COUNT,
+			 (unsigned)(1000ULL * ROUNDS / (t1 - t0 + 1)));
+
+ out:
+	mem_deref(us);
+
+	return err;
+}
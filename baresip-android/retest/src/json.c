@@ -756,3 +756,314 @@ int test_json_array(void)
 	mem_deref(dict);
 	return err;
 }
+
+
+static int doc_verify(const char *str, size_t len)
+{
+	static const size_t chunkv[] = {1, 7, 1460};
+	struct odict *dict = NULL, *dict2 = NULL;
+	struct json_doc *doc = NULL;
+	unsigned i;
+	int err;
+
+	err = json_decode_odict(&dict, DICT_BSIZE, str, len, MAX_LEVELS);
+	TEST_ERR(err);
+
+	/* zero-copy */
+	err = json_doc_decode(&doc, str, len, MAX_LEVELS);
+	TEST_ERR(err);
+
+	err = json_doc_odict(&dict2, DICT_BSIZE, doc);
+	TEST_ERR(err);
+
+	TEST_ASSERT(odict_compare(dict, dict2));
+
+	doc = mem_deref(doc);
+	dict2 = mem_deref(dict2);
+
+	/* incremental */
+	for (i=0; i<ARRAY_SIZE(chunkv); i++) {
+
+		size_t pos;
+
+		err = json_doc_alloc(&doc, MAX_LEVELS);
+		TEST_ERR(err);
+
+		for (pos=0; pos<len; pos+=chunkv[i]) {
+
+			if (json_doc_complete(doc))
+				break;
+
+			err = json_doc_feed(doc, str + pos,
+					    min(chunkv[i], len - pos));
+			TEST_ERR(err);
+		}
+
+		TEST_ASSERT(json_doc_complete(doc));
+
+		err = json_doc_odict(&dict2, DICT_BSIZE, doc);
+		TEST_ERR(err);
+
+		TEST_ASSERT(odict_compare(dict, dict2));
+
+		doc = mem_deref(doc);
+		dict2 = mem_deref(dict2);
+	}
+
+ out:
+	mem_deref(doc);
+	mem_deref(dict2);
+	mem_deref(dict);
+
+	return err;
+}
+
+
+int test_json_doc(void)
+{
+	static const char *testv[] = {
+		"{}",
+		"[]",
+		"{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}",
+		"[ {\"foo\" : 111, \"bar\" : -42}, [], {}, [[1], [2.5]] ]",
+		"{ \"\\\"\\b\\f\\n\\r\\t\" : \"\\u0001\\\"val\\\\\" }",
+		"{ \"num\" : [0, -0.0042, 2.0E3, 2.0E-3, 1372701600000,"
+		"  1.30142114406914976E17, -1.3014211440691497E-17] }",
+	};
+	static const char *badv[] = {
+		"", "}", "{]", "{[}", "]", "\"hei\"", "123",
+		"{ \"a\" : t }", "{ \"a\" : frue }", "{ \"a\" : 1.e3 }",
+		"{ \"a\" 1 }", "{ \"a\" : 1 \"b\" : 2 }", "[1, 2",
+		"{ \"broken_key }", "{ \"key\" : \"broken_value }",
+		"[[[[[[[[[[[]]]]]]]]]]]",
+	};
+	const char *files[] = {
+		"data/rfc7159.json",
+		"data/fstab.json",
+		"data/widget.json",
+		"data/webapp.json",
+		"data/menu.json",
+	};
+	const struct json_node *root, *n;
+	struct json_doc *doc = NULL;
+	struct mbuf *mb;
+	struct pl pl;
+	unsigned i;
+	int err = 0;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	for (i=0; i<ARRAY_SIZE(testv); i++) {
+		err = doc_verify(testv[i], strlen(testv[i]));
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<ARRAY_SIZE(files); i++) {
+
+		mbuf_rewind(mb);
+
+		err = test_load_file(mb, files[i]);
+		if (err)
+			goto out;
+
+		err = doc_verify((char *)mb->buf, mb->end);
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<ARRAY_SIZE(badv); i++) {
+
+		int e = json_doc_decode(&doc, badv[i], strlen(badv[i]),
+					MAX_LEVELS);
+
+		TEST_ASSERT(e == EBADMSG || e == EOVERFLOW);
+	}
+
+	/* strings are views into the source buffer */
+	err = json_doc_decode(&doc, testv[2], strlen(testv[2]), MAX_LEVELS);
+	TEST_ERR(err);
+
+	root = json_doc_root(doc);
+	TEST_ASSERT(root != NULL);
+	TEST_EQUALS(ODICT_OBJECT, root->type);
+	TEST_EQUALS(3U, root->count);
+
+	n = json_node_lookup(doc, json_node_lookup(doc, root, "c"), "d");
+	TEST_ASSERT(n != NULL);
+	TEST_EQUALS(ODICT_STRING, n->type);
+	json_node_str(&pl, doc, n);
+	TEST_ASSERT(pl.p == testv[2] + 39);
+	TEST_STRCMP("e", (size_t)1, pl.p, pl.l);
+
+	n = json_node_child(doc, json_node_lookup(doc, root, "b"));
+	TEST_ASSERT(n != NULL);
+	TEST_EQUALS(ODICT_BOOL, n->type);
+	TEST_ASSERT(n->u.boolean);
+	n = json_node_next(doc, json_node_next(doc, n));
+	TEST_ASSERT(n != NULL);
+	TEST_EQUALS(ODICT_NULL, n->type);
+	TEST_ASSERT(json_node_next(doc, n) == NULL);
+
+ out:
+	mem_deref(doc);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int doc_count(const struct json_doc *doc, const struct json_node *n)
+{
+	const struct json_node *c;
+	int count = 1;
+
+	for (c = json_node_child(doc, n); c; c = json_node_next(doc, c))
+		count += doc_count(doc, c);
+
+	return count;
+}
+
+
+/* A document of 1 MB, an array of events and their count */
+static int json_1mb(struct mbuf **mbp, unsigned *countp)
+{
+	struct mbuf *mb;
+	unsigned i;
+	int err;
+
+	mb = mbuf_alloc(1024 * 1024 + 1024);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_str(mb, "{\"events\":[");
+
+	for (i=0; !err && mb->end < 1024 * 1024; i++) {
+		err = mbuf_printf(mb,
+				  "%s{\"id\":%u,\"type\":\"call\\/state\","
+				  "\"peer\":\"sip:user%u@example.com\","
+				  "\"active\":%s,\"level\":%u.%02u,"
+				  "\"media\":[\"audio\",\"video\"],"
+				  "\"stats\":{\"rtt\":%u,\"lost\":null}}",
+				  i ? "," : "", i, i, (i & 1) ? "true" : "false",
+				  i % 100, i % 97, i % 300);
+	}
+
+	err |= mbuf_printf(mb, "],\"count\":%u}", i);
+	if (err) {
+		mem_deref(mb);
+		return err;
+	}
+
+	*mbp    = mb;
+	*countp = i;
+
+	return 0;
+}
+
+
+/* decode a 1 MB document in one piece and in TCP-sized chunks */
+int test_json_doc_1mb(void)
+{
+	struct json_doc *doc = NULL, *doc2 = NULL;
+	const struct json_node *root, *n;
+	struct mbuf *mb = NULL;
+	unsigned i;
+	int err = 0;
+
+	err = json_1mb(&mb, &i);
+	TEST_ERR(err);
+
+	err = json_doc_decode(&doc, (char *)mb->buf, mb->end, MAX_LEVELS);
+	TEST_ERR(err);
+
+	root = json_doc_root(doc);
+	n = json_node_lookup(doc, root, "count");
+	TEST_ASSERT(n != NULL);
+	TEST_EQUALS(ODICT_INT, n->type);
+	TEST_EQUALS(i, n->u.integer);
+
+	n = json_node_lookup(doc, root, "events");
+	TEST_ASSERT(n != NULL);
+	TEST_EQUALS(i, n->count);
+
+	err = json_doc_alloc(&doc2, MAX_LEVELS);
+	TEST_ERR(err);
+
+	for (mb->pos = 0; mb->pos < mb->end; mb->pos += 1460) {
+
+		err = json_doc_feed(doc2, (char *)mbuf_buf(mb),
+				    min(1460, mbuf_get_left(mb)));
+		TEST_ERR(err);
+	}
+
+	TEST_ASSERT(json_doc_complete(doc2));
+	TEST_EQUALS(doc_count(doc, root),
+		    doc_count(doc2, json_doc_root(doc2)));
+
+ out:
+	mem_deref(doc2);
+	mem_deref(doc);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * Decode the same 1 MB document with json_doc and with
+ * json_decode_odict, and print the time of each
+ */
+int test_json_doc_perf(void)
+{
+	enum { ROUNDS = 10 };
+	struct json_doc *doc;
+	struct odict *od;
+	struct mbuf *mb = NULL;
+	uint64_t t0, t1, t2;
+	unsigned count, i;
+	int err;
+
+	err = json_1mb(&mb, &count);
+	TEST_ERR(err);
+
+	t0 = tmr_jiffies();
+
+	for (i=0; i<ROUNDS; i++) {
+
+		err = json_doc_decode(&doc, (char *)mb->buf, mb->end,
+				      MAX_LEVELS);
+		mem_deref(doc);
+		TEST_ERR(err);
+	}
+
+	t1 = tmr_jiffies();
+
+	for (i=0; i<ROUNDS; i++) {
+
+		err = json_decode_odict(&od, DICT_BSIZE, (char *)mb->buf,
+					mb->end, MAX_LEVELS);
+		mem_deref(od);
+		TEST_ERR(err);
+	}
+
+	t2 = tmr_jiffies();
+
+	(void)re_fprintf(stderr, "json: %zu bytes, %u objects\n",
+			 mb->end, count);
+	(void)re_fprintf(stderr, "json: json_doc:          %6.2f ms"
+			 "  (%4u MB/s)\n",
+			 (double)(t1 - t0) / ROUNDS,
+			 (unsigned)(ROUNDS * mb->end / (1000 * (t1 - t0 + 1))));
+	(void)re_fprintf(stderr, "json: json_decode_odict: %6.2f ms"
+			 "  (%4u MB/s)\n",
+			 (double)(t2 - t1) / ROUNDS,
+			 (unsigned)(ROUNDS * mb->end / (1000 * (t2 - t1 + 1))));
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
@@ -0,0 +1,240 @@
+/**
+ * @file kalive.c  Keepalive scheduler testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "test.h"
+
+
+#define DEBUG_MODULE "testkalive"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	N_FLOWS = 256,
+	DELAY   = 300,
+	IVAL    = 5000,
+};
+
+struct kalive_test {
+	struct flow {
+		struct kalive_test *kt;
+		struct kalive ka;
+		uint64_t jfs;
+		unsigned n_fire;
+		unsigned idx;
+	} flowv[N_FLOWS];
+
+	struct udp_sock *usc;
+	struct udp_sock *uss;
+	struct sa srv;
+	uint64_t start;
+	unsigned n_recv;
+	unsigned n_expect;
+	unsigned n_thread;
+	bool thread_sent;
+	int thread_err;
+	int err;
+};
+
+
+static int send_idx(struct kalive_test *kt, uint32_t idx)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(8);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_u32(mb, htonl(idx));
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	err = udp_send(kt->usc, &kt->srv, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *send_thread(void *arg)
+{
+	struct kalive_test *kt = arg;
+
+	kt->thread_err = send_idx(kt, N_FLOWS);
+
+	return NULL;
+}
+
+
+static int thread_send(struct kalive_test *kt)
+{
+	pthread_t tid;
+	int err;
+
+	kt->thread_sent = true;
+
+	err = pthread_create(&tid, NULL, send_thread, kt);
+	if (err)
+		return err;
+
+	pthread_join(tid, NULL);
+
+	return kt->thread_err;
+}
+#endif
+
+
+static void kalive_handler(void *arg)
+{
+	struct flow *flow = arg;
+	struct kalive_test *kt = flow->kt;
+	int err = 0;
+
+	++flow->n_fire;
+	flow->jfs = tmr_jiffies();
+
+#ifdef HAVE_PTHREAD
+	/* a send from another thread is not part of the batch */
+	if (!kt->thread_sent)
+		err = thread_send(kt);
+#endif
+
+	if (!err)
+		err = send_idx(kt, flow->idx);
+
+	if (err) {
+		kt->err = err;
+		re_cancel();
+	}
+}
+
+
+static void udp_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct kalive_test *kt = arg;
+	uint32_t idx;
+	(void)src;
+
+	if (mbuf_get_left(mb) != 4) {
+		kt->err = EBADMSG;
+		re_cancel();
+		return;
+	}
+
+	idx = ntohl(mbuf_read_u32(mb));
+
+	/* sent by the thread before the batch */
+	if (idx == N_FLOWS && !kt->n_recv) {
+		++kt->n_thread;
+		return;
+	}
+
+	if (idx >= N_FLOWS || idx % 4 == 0) {
+		kt->err = EPROTO;
+		re_cancel();
+		return;
+	}
+
+	if (++kt->n_recv >= kt->n_expect)
+		re_cancel();
+}
+
+
+/*
+ * Start keepalives on one socket, where every fourth flow carried media
+ * and must be suppressed. The others are sent in one batch. A datagram
+ * sent by another thread on the socket during the batch is sent first.
+ */
+int test_kalive(void)
+{
+	struct kalive_test kt;
+	struct sa laddr;
+	size_t i;
+	int err;
+
+	memset(&kt, 0, sizeof(kt));
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = udp_listen(&kt.uss, &laddr, udp_recv_handler, &kt);
+	TEST_ERR(err);
+
+	err = udp_listen(&kt.usc, &laddr, NULL, NULL);
+	TEST_ERR(err);
+
+	err = udp_sockbuf_set(kt.uss, 1 << 20);
+	TEST_ERR(err);
+
+	err = udp_local_get(kt.uss, &kt.srv);
+	TEST_ERR(err);
+
+	kt.start = tmr_jiffies();
+
+	for (i=0; i<N_FLOWS; i++) {
+
+		struct flow *flow = &kt.flowv[i];
+
+		flow->kt  = &kt;
+		flow->idx = (unsigned)i;
+
+		kalive_init(&flow->ka, IVAL);
+
+		if (i % 4 == 0)
+			kalive_activity(&flow->ka);
+		else
+			++kt.n_expect;
+
+		err = kalive_start(&flow->ka, DELAY, kalive_handler, flow);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(2000);
+	TEST_ERR(err);
+	TEST_ERR(kt.err);
+	TEST_EQUALS(kt.n_expect, kt.n_recv);
+#ifdef HAVE_PTHREAD
+	TEST_EQUALS(1, kt.n_thread);
+#endif
+
+	for (i=0; i<N_FLOWS; i++) {
+
+		const struct flow *flow = &kt.flowv[i];
+
+		if (i % 4 == 0) {
+			TEST_EQUALS(0, flow->n_fire);
+			TEST_ASSERT(kalive_isrunning(&flow->ka));
+			continue;
+		}
+
+		TEST_EQUALS(1, flow->n_fire);
+		TEST_ASSERT(!kalive_isrunning(&flow->ka));
+
+		/* jitter and bucket make keepalives early, never late */
+		TEST_ASSERT(flow->jfs + DELAY/10 + 250 >= kt.start + DELAY);
+		TEST_ASSERT(flow->jfs <= kt.start + DELAY + 200);
+	}
+
+ out:
+	for (i=0; i<N_FLOWS; i++)
+		kalive_cancel(&kt.flowv[i].ka);
+
+	mem_deref(kt.usc);
+	mem_deref(kt.uss);
+
+	return err;
+}
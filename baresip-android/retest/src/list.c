@@ -151,11 +151,16 @@ int test_list_sort(void)
 	/* sort the list in ascending order */
 	list_sort(&lst, sort_handler, NULL);
 
+	TEST_EQUALS(NUM_ELEMENTS, list_count(&lst));
+
 	/* verify that the list is sorted */
 	for (le = lst.head; le; le = le->next) {
 
 		struct node *node = le->data;
 
+		TEST_ASSERT(le->prev ? le->prev->next == le : lst.head == le);
+		TEST_ASSERT(le->next || lst.tail == le);
+
 		if (prev_value_set) {
 			TEST_ASSERT(node->value >= prev_value);
 		}
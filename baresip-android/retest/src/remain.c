@@ -5,6 +5,7 @@
  */
 
 #include <string.h>
+#include <time.h>
 #include <re.h>
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
@@ -122,6 +123,388 @@ static int test_remain_thread(void)
 #endif
 
 
+enum {
+	ECHO_WINDOW  = 8,
+	ECHO_TIMEOUT = 5000,
+	ECHO_MAXSZ   = 4000,   /* Larger than the io_uring send slots */
+	PERF_PAIRS   = 16,
+	PERF_COUNT   = 4000,
+	PERF_SIZE    = 172,    /* RTP with 20 ms of G.711 */
+};
+
+struct echo {
+	struct udp_sock *cli;
+	struct udp_sock *srv;
+	struct sa srv_addr;
+	struct mbuf *mb;
+	unsigned sent;
+	unsigned recv;
+	unsigned total;
+	unsigned *pending;
+	bool check;
+	bool done;
+	int err;
+};
+
+
+static size_t echo_size(const struct echo *e, unsigned seq)
+{
+	return e->check ? 1 + (seq * 331) % ECHO_MAXSZ : PERF_SIZE;
+}
+
+
+static int echo_send(struct echo *e)
+{
+	const size_t n = echo_size(e, e->sent);
+	size_t i;
+
+	e->mb->pos = 0;
+	e->mb->end = 0;
+
+	for (i=0; i<n; i++)
+		(void)mbuf_write_u8(e->mb, (uint8_t)(e->sent * 7 + i));
+
+	e->mb->pos = 0;
+	++e->sent;
+
+	return udp_send(e->cli, &e->srv_addr, e->mb);
+}
+
+
+static void echo_done(struct echo *e, int err)
+{
+	if (e->done)
+		return;
+
+	e->done = true;
+	e->err  = err;
+
+	if (--*e->pending == 0)
+		re_cancel();
+}
+
+
+static void srv_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct echo *e = arg;
+	int err;
+
+	err = udp_send(e->srv, src, mb);
+	if (err)
+		echo_done(e, err);
+}
+
+
+static void cli_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct echo *e = arg;
+	int err = 0;
+	size_t i;
+	(void)src;
+
+	if (e->done)
+		return;
+
+	/* in order and intact */
+	if (e->check) {
+		TEST_EQUALS(echo_size(e, e->recv), mbuf_get_left(mb));
+
+		for (i=0; i<mbuf_get_left(mb); i++) {
+			TEST_EQUALS((uint8_t)(e->recv * 7 + i),
+				    mbuf_buf(mb)[i]);
+		}
+	}
+
+	if (++e->recv == e->total) {
+		echo_done(e, 0);
+		return;
+	}
+
+	if (e->sent < e->total)
+		err = echo_send(e);
+
+ out:
+	if (err)
+		echo_done(e, err);
+}
+
+
+static void echo_error_handler(int err, void *arg)
+{
+	echo_done(arg, err);
+}
+
+
+static void echo_timeout(void *arg)
+{
+	unsigned *pending = arg;
+
+	DEBUG_WARNING("echo: timeout, %u pending\n", *pending);
+	re_cancel();
+}
+
+
+static void echo_reset(struct echo *e)
+{
+	mem_deref(e->cli);
+	mem_deref(e->srv);
+	mem_deref(e->mb);
+}
+
+
+static int echo_init(struct echo *e, unsigned *pending, unsigned total,
+		     bool check, bool conn)
+{
+	struct sa laddr;
+	int err;
+
+	e->total   = total;
+	e->pending = pending;
+	e->check   = check;
+
+	(void)sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err = udp_listen(&e->srv, &laddr, srv_recv_handler, e);
+	if (err)
+		return err;
+
+	err = udp_listen(&e->cli, &laddr, cli_recv_handler, e);
+	if (err)
+		return err;
+
+	udp_error_handler_set(e->srv, echo_error_handler);
+	udp_error_handler_set(e->cli, echo_error_handler);
+
+	err = udp_local_get(e->srv, &e->srv_addr);
+	if (err)
+		return err;
+
+	if (conn) {
+		err = udp_connect(e->cli, &e->srv_addr);
+		if (err)
+			return err;
+	}
+
+	e->mb = mbuf_alloc(ECHO_MAXSZ);
+	if (!e->mb)
+		return ENOMEM;
+
+	++*pending;
+
+	return 0;
+}
+
+
+/*
+ * Datagrams go back and forth between pairs of sockets, with a window
+ * of datagrams in flight per pair
+ */
+static int echo_run(struct echo *ev, unsigned pairs, unsigned total,
+		    bool check, bool conn)
+{
+	unsigned pending = 0, i, w;
+	struct tmr tmr;
+	int err = 0;
+
+	tmr_init(&tmr);
+	memset(ev, 0, pairs * sizeof(*ev));
+
+	for (i=0; i<pairs; i++) {
+		err = echo_init(&ev[i], &pending, total, check, conn);
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<pairs; i++) {
+		for (w=0; w<ECHO_WINDOW; w++) {
+			err = echo_send(&ev[i]);
+			if (err)
+				goto out;
+		}
+	}
+
+	tmr_start(&tmr, ECHO_TIMEOUT, echo_timeout, &pending);
+
+	err = re_main(NULL);
+	if (err)
+		goto out;
+
+	for (i=0; i<pairs; i++) {
+
+		err = ev[i].err;
+		if (err)
+			goto out;
+
+		TEST_EQUALS(total, ev[i].recv);
+	}
+
+ out:
+	tmr_cancel(&tmr);
+
+	for (i=0; i<pairs; i++)
+		echo_reset(&ev[i]);
+
+	return err;
+}
+
+
+struct senderr {
+	struct udp_sock *us;
+	struct mbuf *mb;
+	struct sa dst;
+	int err;
+};
+
+
+static void senderr_recv_handler(const struct sa *src, struct mbuf *mb,
+				 void *arg)
+{
+	(void)src;
+	(void)mb;
+	(void)arg;
+}
+
+
+static void senderr_handler(int err, void *arg)
+{
+	struct senderr *se = arg;
+
+	se->err = err;
+	re_cancel();
+}
+
+
+/* Sent from the loop, where the polling method may send it */
+static void senderr_send(void *arg)
+{
+	struct senderr *se = arg;
+
+	se->mb->pos = 0;
+
+	se->err = udp_send(se->us, &se->dst, se->mb);
+	if (se->err)
+		re_cancel();
+}
+
+
+/*
+ * A failed send is reported by udp_send(), or to the error handler if
+ * the polling loop sends the datagram
+ */
+static int send_error_run(void)
+{
+	struct senderr se;
+	struct tmr tmr, tmo;
+	unsigned pending = 1;
+	struct sa laddr;
+	int err;
+
+	memset(&se, 0, sizeof(se));
+	tmr_init(&tmr);
+	tmr_init(&tmo);
+
+	/* an IPv6 destination on an IPv4 socket */
+	(void)sa_set_str(&laddr, "127.0.0.1", 0);
+	(void)sa_set_str(&se.dst, "::1", 9);
+
+	err = udp_listen(&se.us, &laddr, senderr_recv_handler, &se);
+	if (err)
+		goto out;
+
+	udp_error_handler_set(se.us, senderr_handler);
+
+	se.mb = mbuf_alloc(4);
+	if (!se.mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mbuf_write_u32(se.mb, 0);
+	if (err)
+		goto out;
+
+	tmr_start(&tmr, 0, senderr_send, &se);
+	tmr_start(&tmo, ECHO_TIMEOUT, echo_timeout, &pending);
+
+	err = re_main(NULL);
+	if (err)
+		goto out;
+
+	if (se.err == ENOMEM) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	TEST_ASSERT(se.err != 0);
+
+ out:
+	tmr_cancel(&tmo);
+	tmr_cancel(&tmr);
+	mem_deref(se.mb);
+	mem_deref(se.us);
+
+	return err;
+}
+
+
+static const enum poll_method methodv[] = {
+#ifdef HAVE_POLL
+	METHOD_POLL,
+#endif
+#ifdef HAVE_SELECT
+	METHOD_SELECT,
+#endif
+#ifdef HAVE_EPOLL
+	METHOD_EPOLL,
+#endif
+#ifdef HAVE_KQUEUE
+	METHOD_KQUEUE,
+#endif
+#ifdef HAVE_IO_URING
+	METHOD_IO_URING,
+#endif
+};
+
+
+/* The main loop with all polling methods, on this platform */
+static int test_remain_methods(void)
+{
+	const enum poll_method method = poll_method_get();
+	struct echo e;
+	unsigned i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(methodv); i++) {
+
+		if (poll_method_set(methodv[i]))
+			continue;
+
+		err = echo_run(&e, 1, 64, true, false);
+		if (err)
+			break;
+
+		err = echo_run(&e, 1, 64, true, true);
+		if (err)
+			break;
+
+		err = send_error_run();
+		if (err)
+			break;
+	}
+
+	if (err) {
+		DEBUG_WARNING("method %s: %m\n",
+			      poll_method_name(methodv[i]), err);
+	}
+
+	(void)poll_method_set(method);
+
+	return err;
+}
+
+
 int test_remain(void)
 {
 	int err = 0;
@@ -132,5 +515,65 @@ int test_remain(void)
 		return err;
 #endif
 
+	err = test_remain_methods();
+	if (err)
+		return err;
+
+	return err;
+}
+
+
+/*
+ * Main loop benchmark, datagrams per second and CPU time per datagram
+ * over loopback, with epoll and with io_uring
+ */
+int test_remain_perf(void)
+{
+	static const enum poll_method perfv[] = {
+		METHOD_EPOLL, METHOD_IO_URING
+	};
+	const enum poll_method method = poll_method_get();
+	struct echo *ev;
+	unsigned i;
+	int err = 0;
+
+	ev = mem_alloc(PERF_PAIRS * sizeof(*ev), NULL);
+	if (!ev)
+		return ENOMEM;
+
+	for (i=0; i<ARRAY_SIZE(perfv); i++) {
+
+		const unsigned pkts = 2 * PERF_PAIRS * PERF_COUNT;
+		uint64_t t0, t1;
+		clock_t c0, c1;
+
+		if (poll_method_set(perfv[i])) {
+			(void)re_fprintf(stderr, "remain: %s not supported\n",
+					 poll_method_name(perfv[i]));
+			continue;
+		}
+
+		t0 = tmr_jiffies();
+		c0 = clock();
+
+		err = echo_run(ev, PERF_PAIRS, PERF_COUNT, false, false);
+		if (err)
+			break;
+
+		t1 = tmr_jiffies();
+		c1 = clock();
+
+		(void)re_fprintf(stderr, "remain: %-8s %8u packets/sec,"
+				 " %6.2f usec cpu/packet\n",
+				 poll_method_name(perfv[i]),
+				 (unsigned)(1000ULL * pkts / (t1 - t0 + 1)),
+				 1e6 * (double)(c1 - c0) / CLOCKS_PER_SEC
+				 / pkts);
+	}
+
+	(void)poll_method_set(method);
+
+	mem_deref(ev);
+
 	return err;
 }
@@ -371,6 +371,147 @@ int test_sdp_parse(void)
 }
 
 
+/* a typical WebRTC-style offer with many codecs and ICE candidates */
+static const char large_offer[] =
+	"v=0\r\n"
+	"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"c=IN IP4 192.0.2.10\r\n"
+	"t=0 0\r\n"
+	"b=AS:2048\r\n"
+	"a=ice-options:trickle\r\n"
+	"m=audio 49170 RTP/AVP 111 103 104 9 0 8 106 105 13 110 112 126\r\n"
+	"c=IN IP4 192.0.2.10\r\n"
+	"b=TIAS:64000\r\n"
+	"a=rtcp:49171 IN IP4 192.0.2.10\r\n"
+	"a=candidate:1 1 udp 2122260223 192.0.2.10 49170 typ host\r\n"
+	"a=candidate:1 2 udp 2122260222 192.0.2.10 49171 typ host\r\n"
+	"a=candidate:2 1 udp 2122194687 10.0.0.5 49170 typ host\r\n"
+	"a=candidate:2 2 udp 2122194686 10.0.0.5 49171 typ host\r\n"
+	"a=candidate:3 1 udp 1686052607 198.51.100.7 61665 typ srflx"
+	" raddr 192.0.2.10 rport 49170\r\n"
+	"a=candidate:3 2 udp 1686052606 198.51.100.7 61666 typ srflx"
+	" raddr 192.0.2.10 rport 49171\r\n"
+	"a=candidate:4 1 udp 41885439 203.0.113.1 50002 typ relay"
+	" raddr 198.51.100.7 rport 61665\r\n"
+	"a=candidate:4 2 udp 41885438 203.0.113.1 50003 typ relay"
+	" raddr 198.51.100.7 rport 61666\r\n"
+	"a=ice-ufrag:F7gI\r\n"
+	"a=ice-pwd:x9cml/YzichV2+XlhiMu8g\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtpmap:103 ISAC/16000\r\n"
+	"a=rtpmap:104 ISAC/32000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:106 CN/32000\r\n"
+	"a=rtpmap:105 CN/16000\r\n"
+	"a=rtpmap:13 CN/8000\r\n"
+	"a=rtpmap:110 telephone-event/48000\r\n"
+	"a=rtpmap:112 telephone-event/32000\r\n"
+	"a=rtpmap:126 telephone-event/8000\r\n"
+	"a=fmtp:126 0-15\r\n"
+	"a=ptime:20\r\n"
+	"a=sendrecv\r\n"
+	"m=video 49172 RTP/AVP 96 97 98 99 100 101 102\r\n"
+	"c=IN IP4 192.0.2.10\r\n"
+	"b=AS:1800\r\n"
+	"a=rtcp:49173 IN IP4 192.0.2.10\r\n"
+	"a=candidate:1 1 udp 2122260223 192.0.2.10 49172 typ host\r\n"
+	"a=candidate:1 2 udp 2122260222 192.0.2.10 49173 typ host\r\n"
+	"a=candidate:3 1 udp 1686052607 198.51.100.7 61667 typ srflx"
+	" raddr 192.0.2.10 rport 49172\r\n"
+	"a=candidate:3 2 udp 1686052606 198.51.100.7 61668 typ srflx"
+	" raddr 192.0.2.10 rport 49173\r\n"
+	"a=rtpmap:96 VP8/90000\r\n"
+	"a=rtcp-fb:96 nack\r\n"
+	"a=rtcp-fb:96 nack pli\r\n"
+	"a=rtcp-fb:96 ccm fir\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=rtpmap:98 VP9/90000\r\n"
+	"a=rtpmap:99 rtx/90000\r\n"
+	"a=fmtp:99 apt=98\r\n"
+	"a=rtpmap:100 H264/90000\r\n"
+	"a=fmtp:100 level-asymmetry-allowed=1;packetization-mode=1;"
+	"profile-level-id=42e01f\r\n"
+	"a=rtpmap:101 rtx/90000\r\n"
+	"a=fmtp:101 apt=100\r\n"
+	"a=rtpmap:102 red/90000\r\n"
+	"a=sendrecv\r\n";
+
+
+/**
+ * Decode a large SDP offer; run with -p to get offers decoded per second
+ */
+int test_sdp_decode_offer(void)
+{
+	struct sdp_session *sess = NULL;
+	struct sdp_media *audio, *video;
+	const struct sdp_format *fmt;
+	struct mbuf *mb;
+	struct sa laddr, rtcp;
+	int err;
+
+	mb = mbuf_alloc(sizeof(large_offer));
+	if (!mb)
+		return ENOMEM;
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err = sdp_session_alloc(&sess, &laddr);
+	if (err)
+		goto out;
+
+	err  = sdp_media_add(&audio, sess, sdp_media_audio, 5004,
+			     sdp_proto_rtpavp);
+	err |= sdp_media_add(&video, sess, sdp_media_video, 5006,
+			     sdp_proto_rtpavp);
+	if (err)
+		goto out;
+
+	err  = sdp_format_add(NULL, audio, false, "0", "PCMU", 8000, 1,
+			      NULL, NULL, NULL, false, NULL);
+	err |= sdp_format_add(NULL, audio, false, "111", "opus", 48000, 2,
+			      NULL, NULL, NULL, false, NULL);
+	err |= sdp_format_add(NULL, video, false, "100", "H264", 90000, 1,
+			      NULL, NULL, NULL, false, NULL);
+	if (err)
+		goto out;
+
+	err = mbuf_write_str(mb, large_offer);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	err = sdp_decode(sess, mb, true);
+	TEST_ERR(err);
+
+	TEST_EQUALS(49170, sa_port(sdp_media_raddr(audio)));
+	sdp_media_raddr_rtcp(video, &rtcp);
+	TEST_EQUALS(49173, sa_port(&rtcp));
+	TEST_EQUALS(1800, sdp_media_rbandwidth(video, SDP_BANDWIDTH_AS));
+
+	fmt = sdp_media_rformat(audio, "opus");
+	TEST_ASSERT(fmt != NULL);
+	TEST_EQUALS(48000, fmt->srate);
+	TEST_EQUALS(2, fmt->ch);
+	TEST_STRCMP("minptime=10;useinbandfec=1", (size_t)26,
+		    fmt->params, str_len(fmt->params));
+
+	TEST_ASSERT(NULL != sdp_media_rformat(video, "H264"));
+	TEST_ASSERT(NULL != sdp_media_rattr(audio, "ice-pwd"));
+
+ out:
+	mem_deref(sess);
+	mem_deref(mb);
+
+	return err;
+}
+
+
 struct oa {
 	struct sdp_session *alice, *bob;
 };
@@ -818,3 +959,221 @@ int test_sdp_extmap(void)
  out:
 	return err;
 }
+
+
+struct enc_side {
+	struct sdp_session *sess;
+	struct sdp_media *audio;
+	struct sdp_media *video;
+	struct sdp_format *opus;
+	unsigned count;
+};
+
+
+static int enc_fmtp_handler(struct mbuf *mb, const struct sdp_format *fmt,
+			    bool offer, void *data)
+{
+	struct enc_side *side = data;
+
+	return mbuf_printf(mb, "a=x-fmt:%s %u %d\r\n",
+			   fmt->id, ++side->count, offer);
+}
+
+
+static int enc_media_handler(struct mbuf *mb, bool offer, void *arg)
+{
+	struct enc_side *side = arg;
+
+	return mbuf_printf(mb, "a=x-media:%u %d\r\n", ++side->count, offer);
+}
+
+
+static int enc_side_alloc(struct enc_side *side, bool cache)
+{
+	struct sa laddr;
+	int err;
+
+	(void)sa_set_str(&laddr, "10.0.0.1", 0);
+
+	err = sdp_session_alloc(&side->sess, &laddr);
+	if (err)
+		return err;
+
+	sdp_session_set_encode_cache(side->sess, cache);
+
+	err  = sdp_media_add(&side->audio, side->sess, sdp_media_audio, 5004,
+			     sdp_proto_rtpavp);
+	err |= sdp_media_add(&side->video, side->sess, sdp_media_video, 6004,
+			     sdp_proto_rtpavp);
+	if (err)
+		return err;
+
+	err  = sdp_format_add(&side->opus, side->audio, false, "96", "opus",
+			      48000, 2, enc_fmtp_handler, NULL, side, false,
+			      "useinbandfec=1");
+	err |= sdp_format_add(NULL, side->audio, false, "0", "PCMU",
+			      8000, 1, NULL, NULL, NULL, false, NULL);
+	err |= sdp_format_add(NULL, side->video, false, "97", "H264",
+			      90000, 1, enc_fmtp_handler, NULL, side, false,
+			      "packetization-mode=1");
+	err |= sdp_media_set_lattr(side->audio, false, "ssrc", "1234 cname:x");
+	err |= sdp_media_set_lattr(side->video, false, "ssrc", "5678 cname:x");
+	if (err)
+		return err;
+
+	sdp_media_set_encode_handler(side->video, enc_media_handler, side);
+
+	return 0;
+}
+
+
+/* skip the version and owner lines, the owner differs per session */
+static void enc_body(struct pl *pl, const struct mbuf *mb)
+{
+	const char *p;
+
+	pl->p = (const char *)mb->buf;
+	pl->l = mb->end;
+
+	p = pl_strchr(pl, '\n');
+	if (p)
+		p = memchr(p + 1, '\n', pl->l - (p + 1 - pl->p));
+
+	if (p)
+		pl_advance(pl, p + 1 - pl->p);
+}
+
+
+static int enc_step(struct enc_side *side, unsigned step)
+{
+	struct sa laddr;
+	struct mbuf *mb;
+	int err = 0;
+
+	switch (step) {
+
+	case 2:
+		sdp_media_set_ldir(side->audio, SDP_SENDONLY);
+		break;
+
+	case 3:
+		err = sdp_media_set_lattr(side->audio, false, "candidate",
+					  "1 1 UDP 2130706431 10.0.0.1 %u "
+					  "typ host", 5004);
+		break;
+
+	case 4:
+		sdp_media_set_lport(side->video, 6006);
+		break;
+
+	case 5:
+		err = sdp_format_set_params(side->opus, "stereo=1");
+		break;
+
+	case 6:
+		err = sdp_format_add(NULL, side->audio, true, "8", "PCMA",
+				     8000, 1, NULL, NULL, NULL, false, NULL);
+		break;
+
+	case 7:
+		(void)sa_set_str(&laddr, "10.0.0.2", 7000);
+		sdp_media_set_laddr(side->audio, &laddr);
+		sdp_media_set_lport_rtcp(side->audio, 7001);
+		break;
+
+	case 8:
+		sdp_media_del_lattr(side->audio, "candidate");
+		sdp_media_set_lbandwidth(side->video, SDP_BANDWIDTH_AS, 512);
+		break;
+
+	case 9:
+		/* remote offer with inactive audio */
+		mb = mbuf_alloc(256);
+		if (!mb)
+			return ENOMEM;
+
+		err = mbuf_write_str(mb,
+				     "v=0\r\n"
+				     "o=- 1 2 IN IP4 10.0.0.9\r\n"
+				     "s=-\r\n"
+				     "c=IN IP4 10.0.0.9\r\n"
+				     "t=0 0\r\n"
+				     "m=audio 9000 RTP/AVP 96 0\r\n"
+				     "a=rtpmap:96 opus/48000/2\r\n"
+				     "a=inactive\r\n"
+				     "m=video 9002 RTP/AVP 97\r\n"
+				     "a=rtpmap:97 H264/90000\r\n");
+		mb->pos = 0;
+		if (!err)
+			err = sdp_decode(side->sess, mb, true);
+		mem_deref(mb);
+		break;
+
+	case 11:
+		sdp_media_set_disabled(side->video, true);
+		break;
+
+	case 12:
+		sdp_media_set_disabled(side->video, false);
+		sdp_media_set_encode_handler(side->video, NULL, NULL);
+		break;
+
+	default:
+		break;
+	}
+
+	return err;
+}
+
+
+int test_sdp_encode_cache(void)
+{
+	struct enc_side plain, cached;
+	struct mbuf *mbp = NULL, *mbc = NULL;
+	unsigned step;
+	int err;
+
+	memset(&plain, 0, sizeof(plain));
+	memset(&cached, 0, sizeof(cached));
+
+	err  = enc_side_alloc(&plain, false);
+	err |= enc_side_alloc(&cached, true);
+	TEST_ERR(err);
+
+	for (step=0; step<14; step++) {
+
+		const bool offer = step < 9 || step > 10;
+		struct pl bp, bc;
+
+		err  = enc_step(&plain, step);
+		err |= enc_step(&cached, step);
+		TEST_ERR(err);
+
+		err  = sdp_encode(&mbp, plain.sess, offer);
+		err |= sdp_encode(&mbc, cached.sess, offer);
+		TEST_ERR(err);
+
+		enc_body(&bp, mbp);
+		enc_body(&bc, mbc);
+
+		if (pl_cmp(&bp, &bc)) {
+			DEBUG_WARNING("step %u:\n%r\n--\n%r\n",
+				      step, &bp, &bc);
+			err = EBADMSG;
+			goto out;
+		}
+
+		mbp = mem_deref(mbp);
+		mbc = mem_deref(mbc);
+	}
+
+	TEST_EQUALS(plain.count, cached.count);
+
+ out:
+	mem_deref(mbp);
+	mem_deref(mbc);
+	mem_deref(plain.sess);
+	mem_deref(cached.sess);
+
+	return err;
+}
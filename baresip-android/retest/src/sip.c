@@ -157,6 +157,91 @@ int test_sip_addr(void)
 }
 
 
+/* reference decoder, with the original re_regex() expressions */
+static int addr_decode_regex(struct sip_addr *addr, const struct pl *pl)
+{
+	memset(addr, 0, sizeof(*addr));
+
+	if (0 == re_regex(pl->p, pl->l, "[~ \t\r\n<]*[ \t\r\n]*<[^>]+>[^]*",
+			  &addr->dname, NULL, &addr->auri, &addr->params)) {
+
+		if (!addr->dname.l)
+			addr->dname.p = NULL;
+
+		if (!addr->params.l)
+			addr->params.p = NULL;
+	}
+	else {
+		memset(addr, 0, sizeof(*addr));
+
+		if (re_regex(pl->p, pl->l, "[^;]+[^]*",
+			     &addr->auri, &addr->params))
+			return EBADMSG;
+	}
+
+	return 0;
+}
+
+
+static bool pl_same(const struct pl *a, const struct pl *b)
+{
+	return a->l == b->l && (a->p == b->p || !a->l);
+}
+
+
+int test_sip_addr_regex(void)
+{
+	const char *addrv[] = {
+		"\"Agmund Bolt\" <sip:agmund@bolt.com:5060>;tag=1",
+		"Agmund Bolt <sip:agmund@bolt.com>",
+		"Agmund  \t Bolt\t<sip:agmund@bolt.com>;lr",
+		"\"Agmund \\\"AB\\\" Bolt\" <sip:ab@bolt.com>",
+		"\"<sip:quoted@bolt.com>\" <sip:ab@bolt.com>",
+		"Bolt<sip:ab@bolt.com>",
+		"<sip:ab@bolt.com>",
+		"   <sip:ab@bolt.com>",
+		"sip:ab@bolt.com;tag=2",
+		";;sip:ab@bolt.com;tag=2",
+		"<sip:ab@bolt.com",
+		"<> sip:ab@bolt.com",
+		"\"x\" <>;y",
+		"\"",
+	};
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(addrv); i++) {
+		struct sip_addr addr, ref;
+		struct pl pl;
+		int e1, e2;
+
+		pl_set_str(&pl, addrv[i]);
+
+		e1 = addr_decode_regex(&ref, &pl);
+		e2 = sip_addr_decode(&addr, &pl);
+
+		/* uri_decode() may still reject what the regex accepted */
+		if (e1 || e2) {
+			TEST_ASSERT(e2 != 0);
+			continue;
+		}
+
+		if (!pl_same(&ref.dname, &addr.dname) ||
+		    !pl_same(&ref.auri, &addr.auri) ||
+		    !pl_same(&ref.params, &addr.params)) {
+			DEBUG_WARNING("sip_addr: %u: '%s': dname='%r' auri='%r'"
+				      " params='%r'\n", i, addrv[i],
+				      &addr.dname, &addr.auri, &addr.params);
+			err = EINVAL;
+			goto out;
+		}
+	}
+
+ out:
+	return err;
+}
+
+
 int test_sip_via(void)
 {
 	struct {
@@ -692,3 +777,157 @@ int test_sip_hdr(void)
 
 	return err;
 }
+
+
+static int framer_expect(struct sip_framer *fr, enum sip_frame *expv,
+			 unsigned *expi, unsigned expc, size_t blen)
+{
+	struct sip_msg *msg = NULL;
+	int err;
+
+	for (;;) {
+		enum sip_frame type;
+		struct mbuf *mb;
+
+		err = sip_framer_next(fr, &type, &mb);
+		if (err == ENODATA)
+			return 0;
+		TEST_ERR(err);
+
+		TEST_ASSERT(*expi < expc);
+		TEST_EQUALS(expv[*expi], type);
+		++*expi;
+
+		if (type != SIP_FRAME_MSG)
+			continue;
+
+		err = sip_msg_decode(&msg, mb);
+		mem_deref(mb);
+		TEST_ERR(err);
+
+		TEST_EQUALS(pl_u32(&msg->clen), mbuf_get_left(msg->mb));
+		if (!pl_strcmp(&msg->met, "NOTIFY")) {
+			TEST_EQUALS(blen, mbuf_get_left(msg->mb));
+			TEST_EQUALS('x', mbuf_buf(msg->mb)[blen - 1]);
+		}
+
+		msg = mem_deref(msg);
+	}
+
+ out:
+	mem_deref(msg);
+
+	/* the frames or their content did not match */
+	return err == EINVAL ? EBADMSG : err;
+}
+
+
+/* one large message and keep-alives in random segment sizes */
+int test_sip_framer(void)
+{
+	static const char hdr[] =
+		"NOTIFY sip:alice@10.0.0.1:5060;transport=tcp SIP/2.0\r\n"
+		"Via: SIP/2.0/TCP 10.0.0.2:5060;branch=z9hG4bK776asdhds\r\n"
+		"From: <sip:presence@example.com>;tag=a6c85cf\r\n"
+		"To: <sip:alice@example.com>;tag=1928301774\r\n"
+		"Call-ID: a84b4c76e66710\r\n"
+		"CSeq: 314159 NOTIFY\r\n"
+		"Event: presence\r\n"
+		"Subscription-State: active;expires=3600\r\n"
+		"Content-Type: application/pidf+xml\r\n"
+		"Content-Length: %zu\r\n"
+		"\r\n";
+	static const char small[] =
+		"OPTIONS sip:alice@10.0.0.1 SIP/2.0\r\n"
+		"Via: SIP/2.0/TCP 10.0.0.2:5060;branch=z9hG4bK776asdhdt\r\n"
+		"Call-ID: b84b4c76e66710\r\n"
+		"CSeq: 1 OPTIONS\r\n"
+		"l: 0\r\n"
+		"\r\n";
+	enum sip_frame expv[] = {
+		SIP_FRAME_PING, SIP_FRAME_MSG, SIP_FRAME_CRLF,
+		SIP_FRAME_MSG, SIP_FRAME_MSG
+	};
+	const size_t blen = 48000;
+	struct sip_framer *fr = NULL;
+	struct mbuf *stream, *mb = NULL;
+	unsigned round;
+	int err;
+
+	stream = mbuf_alloc(blen + 1024);
+	if (!stream)
+		return ENOMEM;
+
+	err  = mbuf_write_str(stream, "\r\n\r\n");
+	err |= mbuf_printf(stream, hdr, blen);
+	err |= mbuf_fill(stream, 'x', blen);
+	err |= mbuf_write_str(stream, "\r\n");
+	err |= mbuf_write_str(stream, small);
+	err |= mbuf_write_str(stream, small);
+	TEST_ERR(err);
+
+	for (round=0; round<64; round++) {
+
+		unsigned expi = 0;
+
+		err = sip_framer_alloc(&fr, 65536);
+		TEST_ERR(err);
+
+		stream->pos = 0;
+
+		while (mbuf_get_left(stream)) {
+
+			size_t n = 1 + rand_u16() % (round < 32 ? 64 : 2920);
+
+			/* a ping is only detected when it arrives whole */
+			if (!stream->pos)
+				n = max(n, 4);
+
+			n = min(n, mbuf_get_left(stream));
+
+			mb = mbuf_alloc(n);
+			if (!mb) {
+				err = ENOMEM;
+				goto out;
+			}
+
+			(void)mbuf_write_mem(mb, mbuf_buf(stream), n);
+			mb->pos = 0;
+			stream->pos += n;
+
+			err = sip_framer_input(fr, mb);
+			mb = mem_deref(mb);
+			TEST_ERR(err);
+
+			err = framer_expect(fr, expv, &expi, ARRAY_SIZE(expv),
+					    blen);
+			TEST_ERR(err);
+		}
+
+		TEST_EQUALS(ARRAY_SIZE(expv), expi);
+
+		fr = mem_deref(fr);
+	}
+
+	/* oversized message */
+	err = sip_framer_alloc(&fr, 1024);
+	TEST_ERR(err);
+
+	stream->pos = 4;
+	stream->end = 4 + 2048;
+
+	err = sip_framer_input(fr, stream);
+	TEST_ERR(err);
+
+	err = sip_framer_next(fr, &expv[0], &mb);
+	TEST_EQUALS(EOVERFLOW, err);
+
+	err = 0;
+
+ out:
+	mem_deref(mb);
+	mem_deref(fr);
+	mem_deref(stream);
+
+	return err;
+}
@@ -4,8 +4,10 @@
 # Copyright (C) 2010 Creytiv.com
 #
 
+SRCS	+= aec.c
 SRCS	+= aes.c
 SRCS	+= aubuf.c
+SRCS	+= auplc.c
 SRCS	+= base64.c
 SRCS	+= bfcp.c
 SRCS	+= conf.c
@@ -20,8 +22,10 @@ SRCS	+= hmac.c
 SRCS	+= http.c
 SRCS	+= httpauth.c
 SRCS	+= ice.c
+SRCS	+= icem.c
 SRCS	+= jbuf.c
 SRCS	+= json.c
+SRCS	+= kalive.c
 SRCS	+= list.c
 SRCS	+= main.c
 SRCS	+= mbuf.c
@@ -52,6 +56,7 @@ SRCS	+= udp.c
 SRCS	+= uri.c
 SRCS	+= vid.c
 SRCS	+= vidconv.c
+SRCS	+= vidmix.c
 SRCS	+= websock.c
 
 ifneq ($(USE_TLS),)
@@ -37,8 +37,10 @@ struct test {
 #define TEST(a) {a, #a}
 
 static const struct test tests[] = {
+	TEST(test_aec),
 	TEST(test_aes),
 	TEST(test_aubuf),
+	TEST(test_auplc),
 	TEST(test_base64),
 	TEST(test_bfcp),
 	TEST(test_bfcp_bin),
@@ -78,12 +80,16 @@ static const struct test tests[] = {
 	TEST(test_httpauth_resp),
 	TEST(test_ice),
 	TEST(test_ice_lite),
+	TEST(test_icem_checklist),
 	TEST(test_jbuf),
 	TEST(test_json),
 	TEST(test_json_file),
 	TEST(test_json_unicode),
 	TEST(test_json_bad),
 	TEST(test_json_array),
+	TEST(test_json_doc),
+	TEST(test_json_doc_1mb),
+	TEST(test_kalive),
 	TEST(test_list),
 	TEST(test_list_ref),
 	TEST(test_list_sort),
@@ -108,11 +114,15 @@ static const struct test tests[] = {
 	TEST(test_sdp_all),
 	TEST(test_sdp_bfcp),
 	TEST(test_sdp_parse),
+	TEST(test_sdp_decode_offer),
 	TEST(test_sdp_oa),
 	TEST(test_sdp_extmap),
+	TEST(test_sdp_encode_cache),
 	TEST(test_sha1),
 	TEST(test_sip_addr),
+	TEST(test_sip_addr_regex),
 	TEST(test_sip_apply),
+	TEST(test_sip_framer),
 	TEST(test_sip_hdr),
 	TEST(test_sip_param),
 	TEST(test_sip_parse),
@@ -140,6 +150,7 @@ static const struct test tests[] = {
 	TEST(test_turn_tcp),
 	TEST(test_udp),
 	TEST(test_uri),
+	TEST(test_uri_regex),
 	TEST(test_uri_cmp),
 	TEST(test_uri_encode),
 	TEST(test_uri_headers),
@@ -148,7 +159,11 @@ static const struct test tests[] = {
 	TEST(test_uri_escape),
 	TEST(test_vid),
 	TEST(test_vidconv),
+	TEST(test_vidmix),
 	TEST(test_websock),
+	TEST(test_websock_mask),
+	TEST(test_websock_frame_1k),
+	TEST(test_websock_frame_64k),
 
 #ifdef USE_TLS
 	/* combination tests: */
@@ -156,6 +171,19 @@ static const struct test tests[] = {
 #endif
 };
 
+/* Benchmarks, only run as performance tests (-p) */
+static const struct test perf_tests[] = {
+	TEST(test_aec_perf),
+	TEST(test_crc32_perf),
+	TEST(test_hash_perf),
+	TEST(test_icem_perf),
+	TEST(test_json_doc_perf),
+	TEST(test_remain_perf),
+	TEST(test_stun_perf),
+	TEST(test_vidmix_perf),
+	TEST(test_websock_perf),
+};
+
 
 static const struct test *find_test(const char *name)
 {
@@ -171,6 +199,20 @@ static const struct test *find_test(const char *name)
 }
 
 
+static const struct test *find_perf_test(const char *name)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(perf_tests); i++) {
+
+		if (0 == str_casecmp(name, perf_tests[i].name))
+			return &perf_tests[i];
+	}
+
+	return NULL;
+}
+
+
 /**
  * Run a single testcase in OOM (Out-of-memory) mode.
  *
@@ -441,6 +483,8 @@ int test_perf(const char *name, bool verbose)
 		const struct test *test;
 
 		test = find_test(name);
+		if (!test)
+			test = find_perf_test(name);
 		if (!test) {
 			(void)re_fprintf(stderr, "no such test: %s\n", name);
 			return ENOENT;
@@ -451,23 +495,27 @@ int test_perf(const char *name, bool verbose)
 			return err;
 	}
 	else {
-		struct timing timingv[ARRAY_SIZE(tests)];
+		struct timing timingv[ARRAY_SIZE(tests) +
+				      ARRAY_SIZE(perf_tests)];
 
 		memset(&timingv, 0, sizeof(timingv));
 
-		/* All test cases */
-		for (i=0; i<ARRAY_SIZE(tests); i++) {
+		/* All test cases, and the performance test cases */
+		for (i=0; i<ARRAY_SIZE(timingv); i++) {
 
 			struct timing *tim = &timingv[i];
 			double usec_avg;
 
-			tim->test = &tests[i];
+			if (i < ARRAY_SIZE(tests))
+				tim->test = &tests[i];
+			else
+				tim->test = &perf_tests[i - ARRAY_SIZE(tests)];
 
-			err = testcase_perf(&tests[i],
+			err = testcase_perf(tim->test,
 					    &usec_avg);
 			if (err) {
 				DEBUG_WARNING("perf: %s failed (%m)\n",
-					      tests[i].name, err);
+					      tim->test->name, err);
 				return err;
 			}
 
@@ -624,6 +672,13 @@ void test_listcases(void)
 				(i+(n+1)/2) < n ? tests[i+(n+1)/2].name : "");
 	}
 
+	n = ARRAY_SIZE(perf_tests);
+
+	(void)re_printf("\n%u performance test cases:\n", n);
+
+	for (i=0; i<n; i++)
+		(void)re_printf("    %s\n", perf_tests[i].name);
+
 	(void)re_printf("\n");
 }
 
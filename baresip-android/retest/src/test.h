@@ -105,13 +105,17 @@
 
 
 /* Module API */
+int test_aec(void);
+int test_aec_perf(void);
 int test_aes(void);
 int test_aubuf(void);
+int test_auplc(void);
 int test_base64(void);
 int test_bfcp(void);
 int test_bfcp_bin(void);
 int test_conf(void);
 int test_crc32(void);
+int test_crc32_perf(void);
 int test_dns_hdr(void);
 int test_dns_rr(void);
 int test_dns_dname(void);
@@ -133,6 +137,7 @@ int test_fmt_unicode(void);
 int test_g711_alaw(void);
 int test_g711_ulaw(void);
 int test_hash(void);
+int test_hash_perf(void);
 int test_hmac_sha1(void);
 int test_hmac_sha256(void);
 int test_http(void);
@@ -141,12 +146,18 @@ int test_httpauth_chall(void);
 int test_httpauth_resp(void);
 int test_ice(void);
 int test_ice_lite(void);
+int test_icem_checklist(void);
+int test_icem_perf(void);
 int test_jbuf(void);
 int test_json(void);
 int test_json_bad(void);
 int test_json_file(void);
 int test_json_unicode(void);
 int test_json_array(void);
+int test_json_doc(void);
+int test_json_doc_1mb(void);
+int test_json_doc_perf(void);
+int test_kalive(void);
 int test_list(void);
 int test_list_ref(void);
 int test_list_sort(void);
@@ -159,6 +170,7 @@ int test_natbd(void);
 int test_odict(void);
 int test_odict_array(void);
 int test_remain(void);
+int test_remain_perf(void);
 int test_rtp(void);
 int test_rtcp_encode(void);
 int test_rtcp_encode_afb(void);
@@ -171,11 +183,15 @@ int test_sa_ntop(void);
 int test_sdp_all(void);
 int test_sdp_bfcp(void);
 int test_sdp_parse(void);
+int test_sdp_decode_offer(void);
 int test_sdp_oa(void);
 int test_sdp_extmap(void);
+int test_sdp_encode_cache(void);
 int test_sha1(void);
 int test_sip_addr(void);
+int test_sip_addr_regex(void);
 int test_sip_apply(void);
+int test_sip_framer(void);
 int test_sip_hdr(void);
 int test_sip_msg(void);
 int test_sip_param(void);
@@ -189,6 +205,7 @@ int test_stun_req(void);
 int test_stun_resp(void);
 int test_stun_reqltc(void);
 int test_stun(void);
+int test_stun_perf(void);
 int test_sys_div(void);
 int test_sys_endian(void);
 int test_sys_rand(void);
@@ -199,6 +216,7 @@ int test_turn(void);
 int test_turn_tcp(void);
 int test_udp(void);
 int test_uri(void);
+int test_uri_regex(void);
 int test_uri_cmp(void);
 int test_uri_encode(void);
 int test_uri_headers(void);
@@ -207,7 +225,13 @@ int test_uri_params_headers(void);
 int test_uri_escape(void);
 int test_vid(void);
 int test_vidconv(void);
+int test_vidmix(void);
+int test_vidmix_perf(void);
 int test_websock(void);
+int test_websock_mask(void);
+int test_websock_frame_1k(void);
+int test_websock_frame_64k(void);
+int test_websock_perf(void);
 #ifdef USE_TLS
 int test_dtls(void);
 int test_dtls_1_2(void);
@@ -98,6 +98,120 @@ int test_uri(void)
 }
 
 
+/* reference decoder, with the original re_regex() expressions */
+static int uri_decode_regex(struct uri *uri, const struct pl *pl)
+{
+	struct pl port = PL_INIT;
+	struct pl hostport;
+	int err;
+
+	memset(uri, 0, sizeof(*uri));
+	if (0 == re_regex(pl->p, pl->l,
+			  "[^:]+:[^@:]*[:]*[^@]*@[^;? ]+[^?]*[^]*",
+			  &uri->scheme, &uri->user, NULL, &uri->password,
+			  &hostport, &uri->params, &uri->headers)) {
+
+		if (0 == re_regex(hostport.p, hostport.l,
+				  "\\[[0-9a-f:]+\\][:]*[0-9]*",
+				  &uri->host, NULL, &port) ||
+		    0 == re_regex(hostport.p, hostport.l, "[^:]+[:]*[0-9]*",
+				  &uri->host, NULL, &port))
+			goto out;
+	}
+
+	memset(uri, 0, sizeof(*uri));
+	err = re_regex(pl->p, pl->l, "[^:]+:[^;? ]+[^?]*[^]*",
+		       &uri->scheme, &hostport, &uri->params, &uri->headers);
+	if (err)
+		return err;
+
+	if (0 == re_regex(hostport.p, hostport.l,
+			  "\\[[0-9a-f:]+\\][:]*[0-9]*",
+			  &uri->host, NULL, &port))
+		goto out;
+
+	err = re_regex(hostport.p, hostport.l, "[^:]+[:]*[0-9]*",
+		       &uri->host, NULL, &port);
+	if (err)
+		return err;
+
+ out:
+	if (pl_isset(&port))
+		uri->port = (uint16_t)pl_u32(&port);
+
+	return 0;
+}
+
+
+static bool pl_same(const struct pl *a, const struct pl *b)
+{
+	return a->l == b->l && (a->p == b->p || !a->l);
+}
+
+
+/*
+ * Verify that uri_decode() splits corner cases exactly
+ * like the original regular expressions
+ */
+int test_uri_regex(void)
+{
+	const char *uriv[] = {
+		"sip:user:pass@host:5060;transport=udp?a=b",
+		"SIP:USER@HOST",
+		"sip:host::5060",
+		"sip:user::pw:x@host",
+		"sip:@host",
+		"sip:a@b@c",
+		"sip:user@;x",
+		"sip:host;a=1?b=2?c",
+		"sip:[::1]",
+		"sip:[::1]:5060",
+		"sip:[ABCD::1]::77;x",
+		"sip:u@[::1",
+		"sip:u@x[::1]:5",
+		"sip:[]:5",
+		":sip:host",
+		"::host",
+		"sip:",
+		"tel:+4712345678",
+		"noscheme",
+	};
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(uriv); i++) {
+		struct uri uri, ref;
+		struct pl pl;
+		int e1, e2;
+
+		pl_set_str(&pl, uriv[i]);
+
+		e1 = uri_decode_regex(&ref, &pl);
+		e2 = uri_decode(&uri, &pl);
+
+		TEST_EQUALS(e1 != 0, e2 != 0);
+		if (e1)
+			continue;
+
+		if (!pl_same(&ref.scheme, &uri.scheme) ||
+		    !pl_same(&ref.user, &uri.user) ||
+		    !pl_same(&ref.password, &uri.password) ||
+		    !pl_same(&ref.host, &uri.host) ||
+		    !pl_same(&ref.params, &uri.params) ||
+		    !pl_same(&ref.headers, &uri.headers) ||
+		    ref.port != uri.port) {
+			DEBUG_WARNING("uri: %u: '%s': %H\n", i, uriv[i],
+				      uri_encode, &uri);
+			err = EINVAL;
+			goto out;
+		}
+	}
+
+ out:
+	return err;
+}
+
+
 int test_uri_encode(void)
 {
 	const struct {
@@ -0,0 +1,283 @@
+/**
+ * @file vidmix.c Video Mixer Testcode
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "test/vidmix"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+enum {
+	MAX_SOURCES = 16,
+	FPS         = 25,
+	ROUNDS      = 20,
+};
+
+struct mixer {
+	struct vidmix *mix;
+	struct vidmix_source *srcv[MAX_SOURCES];
+	struct vidframe *frame;  /* Input frame   */
+	struct vidframe *out;    /* Output frame  */
+	unsigned n;
+	unsigned frames;
+};
+
+
+static void frame_handler(uint32_t ts, const struct vidframe *frame,
+			  void *arg)
+{
+	struct mixer *mx = arg;
+	(void)ts;
+
+	if (mx->out)
+		vidframe_copy(mx->out, frame);
+
+	++mx->frames;
+}
+
+
+static void mixer_reset(struct mixer *mx)
+{
+	unsigned i;
+
+	for (i=0; i<mx->n; i++)
+		mem_deref(mx->srcv[i]);
+
+	mem_deref(mx->frame);
+	mem_deref(mx->out);
+	mem_deref(mx->mix);
+}
+
+
+static int mixer_init(struct mixer *mx, unsigned n,
+		      const struct vidsz *insz, const struct vidsz *outsz)
+{
+	unsigned i;
+	int err;
+
+	memset(mx, 0, sizeof(*mx));
+
+	err = vidmix_alloc(&mx->mix);
+	if (err)
+		return err;
+
+	err = vidframe_alloc(&mx->frame, VID_FMT_YUV420P, insz);
+	if (err)
+		return err;
+
+	for (i=0; i<n; i++) {
+
+		err = vidmix_source_alloc(&mx->srcv[i], mx->mix, outsz, FPS,
+					  false, frame_handler, mx);
+		if (err)
+			return err;
+
+		++mx->n;
+
+		vidmix_source_enable(mx->srcv[i], true);
+	}
+
+	return 0;
+}
+
+
+static uint8_t source_fill(struct mixer *mx, unsigned i, uint32_t v)
+{
+	vidframe_fill(mx->frame, v, v, v);
+	vidmix_source_put(mx->srcv[i], mx->frame);
+
+	return mx->frame->data[0][0];
+}
+
+
+/* Luma at the center of a cell in the 2x2 grid */
+static uint8_t cell_luma(const struct vidframe *frame, unsigned idx)
+{
+	const unsigned w = frame->size.w / 2, h = frame->size.h / 2;
+	const unsigned x = w * (idx % 2) + w / 2;
+	const unsigned y = h * (idx / 2) + h / 2;
+
+	return frame->data[0][y * frame->linesize[0] + x];
+}
+
+
+static int vidmix_layout(const struct vidsz *outsz)
+{
+	const struct vidsz insz = {160, 120};
+	struct mixer mx;
+	uint8_t lumav[4];
+	unsigned i;
+	int err;
+
+	err = mixer_init(&mx, 4, &insz, outsz);
+	if (err)
+		goto out;
+
+	err = vidframe_alloc(&mx.out, VID_FMT_YUV420P, outsz);
+	if (err)
+		goto out;
+
+	for (i=0; i<4; i++)
+		lumav[i] = source_fill(&mx, i, 40 + 50 * i);
+
+	/* the first output shows the other three sources */
+	err = vidmix_source_mix(mx.srcv[0]);
+	TEST_ERR(err);
+	TEST_EQUALS(1, mx.frames);
+
+	for (i=0; i<3; i++)
+		TEST_EQUALS(lumav[i+1], cell_luma(mx.out, i));
+
+	/* the second output shares the scaled frames */
+	err = vidmix_source_mix(mx.srcv[1]);
+	TEST_ERR(err);
+	TEST_EQUALS(2, mx.frames);
+
+	TEST_EQUALS(lumav[0], cell_luma(mx.out, 0));
+	TEST_EQUALS(lumav[2], cell_luma(mx.out, 1));
+	TEST_EQUALS(lumav[3], cell_luma(mx.out, 2));
+
+	/* only the cell of the changed source is drawn again */
+	lumav[2] = source_fill(&mx, 2, 250);
+
+	err = vidmix_source_mix(mx.srcv[0]);
+	TEST_ERR(err);
+	TEST_EQUALS(3, mx.frames);
+
+	TEST_EQUALS(lumav[1], cell_luma(mx.out, 0));
+	TEST_EQUALS(lumav[2], cell_luma(mx.out, 1));
+	TEST_EQUALS(lumav[3], cell_luma(mx.out, 2));
+
+	/* a removed source leaves an empty cell */
+	vidmix_source_enable(mx.srcv[3], false);
+	vidframe_fill(mx.frame, 0, 0, 0);
+
+	err = vidmix_source_mix(mx.srcv[0]);
+	TEST_ERR(err);
+	TEST_EQUALS(lumav[1], cell_luma(mx.out, 0));
+	TEST_EQUALS(lumav[2], cell_luma(mx.out, 1));
+	TEST_EQUALS(mx.frame->data[0][0], cell_luma(mx.out, 2));
+
+ out:
+	mixer_reset(&mx);
+
+	return err;
+}
+
+
+int test_vidmix(void)
+{
+	const struct vidsz direct = {320, 240};
+	const struct vidsz scaled = {640, 480};
+	int err;
+
+	err = vidmix_layout(&direct);
+	if (err)
+		return err;
+
+	err = vidmix_layout(&scaled);
+	if (err)
+		return err;
+
+	return 0;
+}
+
+
+static int vidmix_perf(unsigned n, double *changed, double *still)
+{
+	const struct vidsz insz  = {640, 360};
+	const struct vidsz outsz = {1280, 720};
+	struct vidframe *framev[2] = {NULL, NULL};
+	struct mixer mx;
+	uint64_t t0, t1, t2;
+	unsigned r, i;
+	int err;
+
+	err = mixer_init(&mx, n, &insz, &outsz);
+	if (err)
+		goto out;
+
+	for (i=0; i<2; i++) {
+		err = vidframe_alloc(&framev[i], VID_FMT_YUV420P, &insz);
+		if (err)
+			goto out;
+
+		vidframe_fill(framev[i], 100 * i, 50, 200 - 100 * i);
+	}
+
+	for (i=0; i<n; i++)
+		vidmix_source_put(mx.srcv[i], framev[0]);
+
+	/* every source sends a new frame for every output frame */
+	t0 = tmr_jiffies();
+
+	for (r=0; r<ROUNDS; r++) {
+
+		for (i=0; i<n; i++)
+			vidmix_source_put(mx.srcv[i], framev[r % 2]);
+
+		for (i=0; i<n; i++) {
+			err = vidmix_source_mix(mx.srcv[i]);
+			TEST_ERR(err);
+		}
+	}
+
+	t1 = tmr_jiffies();
+
+	/* no new frames, nothing to draw */
+	for (r=0; r<ROUNDS; r++) {
+
+		for (i=0; i<n; i++) {
+			err = vidmix_source_mix(mx.srcv[i]);
+			TEST_ERR(err);
+		}
+	}
+
+	t2 = tmr_jiffies();
+
+	TEST_EQUALS(2 * ROUNDS * n, mx.frames);
+
+	*changed = 1000.0 * (double)(t1 - t0) / (ROUNDS * n);
+	*still   = 1000.0 * (double)(t2 - t1) / (ROUNDS * n);
+
+ out:
+	mem_deref(framev[0]);
+	mem_deref(framev[1]);
+	mixer_reset(&mx);
+
+	return err;
+}
+
+
+/*
+ * Video mixer benchmark, composition time per output frame of 720p,
+ * with all sources changing, and with no source changing.
+ */
+int test_vidmix_perf(void)
+{
+	static const unsigned countv[] = {2, 4, 9, 16};
+	double changed, still;
+	unsigned i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(countv); i++) {
+
+		err = vidmix_perf(countv[i], &changed, &still);
+		if (err)
+			break;
+
+		(void)re_fprintf(stderr, "vidmix: %2u participants:"
+				 " %8.1f usec/frame changed,"
+				 " %8.1f usec/frame still\n",
+				 countv[i], changed, still);
+	}
+
+	return err;
+}